@@ -0,0 +1,568 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/backup.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include "leveldb/checkpoint.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+// A backup directory holds:
+//    shared/...            tables, named as in the database directory but
+//                          with "_<crc>_<size>" added to the file number
+//    private/<id>/...      the descriptors and CURRENT files of backup <id>
+//    meta/<id>             the time of backup <id> and a line for each of
+//                          its files: "shared|private <name> <size> <crc>"
+
+BackupOptions::BackupOptions()
+    : env(Env::Default()),
+      max_background_operations(4) {
+}
+
+BackupEngine::~BackupEngine() { }
+
+namespace {
+
+struct BackupFile {
+  bool shared;          // In shared/ rather than in private/<id>/
+  std::string fname;    // Relative to the database directory
+  uint64_t size;
+  uint32_t crc;
+};
+
+struct Backup {
+  uint64_t timestamp;
+  std::vector<BackupFile> files;
+};
+
+// A file to copy to "target", or only to read if "target" is empty,
+// while its size and checksum are computed.
+struct FileJob {
+  std::string src;
+  std::string target;
+  uint64_t size;
+  uint32_t crc;
+  Status status;
+
+  FileJob(const std::string& s, const std::string& t)
+      : src(s), target(t), size(0), crc(0) { }
+};
+
+static void RunFileJob(Env* env, FileJob* job) {
+  SequentialFile* in;
+  job->status = env->NewSequentialFile(job->src, &in);
+  if (!job->status.ok()) {
+    return;
+  }
+  WritableFile* out = NULL;
+  if (!job->target.empty()) {
+    job->status = env->NewWritableFile(job->target, &out);
+  }
+  static const size_t kBufferSize = 1 << 20;
+  char* buffer = new char[kBufferSize];
+  while (job->status.ok()) {
+    Slice fragment;
+    job->status = in->Read(kBufferSize, &fragment, buffer);
+    if (!job->status.ok() || fragment.empty()) {
+      break;
+    }
+    job->size += fragment.size();
+    job->crc = crc32c::Extend(job->crc, fragment.data(), fragment.size());
+    if (out != NULL) {
+      job->status = out->Append(fragment);
+    }
+  }
+  delete[] buffer;
+  delete in;
+  if (out != NULL) {
+    if (job->status.ok()) {
+      job->status = out->Sync();
+    }
+    if (job->status.ok()) {
+      job->status = out->Close();
+    }
+    delete out;
+  }
+}
+
+// Work shared by the threads started by RunFileJobs().
+struct FileJobState {
+  Env* env;
+  std::vector<FileJob>* jobs;
+  port::Mutex mu;
+  port::CondVar cv;
+  size_t next;      // Protected by mu
+  int running;      // Protected by mu
+
+  FileJobState() : cv(&mu), next(0), running(0) { }
+};
+
+static void FileJobWork(void* arg) {
+  FileJobState* state = reinterpret_cast<FileJobState*>(arg);
+  MutexLock l(&state->mu);
+  while (state->next < state->jobs->size()) {
+    FileJob* job = &(*state->jobs)[state->next++];
+    state->mu.Unlock();
+    RunFileJob(state->env, job);
+    state->mu.Lock();
+  }
+  state->running--;
+  state->cv.SignalAll();
+}
+
+// Run "jobs" on up to "threads" threads and return the first error.
+static Status RunFileJobs(Env* env, int threads, std::vector<FileJob>* jobs) {
+  FileJobState state;
+  state.env = env;
+  state.jobs = jobs;
+  threads = std::min(threads, static_cast<int>(jobs->size()));
+  if (threads <= 1) {
+    FileJobWork(&state);
+  } else {
+    MutexLock l(&state.mu);
+    state.running = threads;
+    for (int i = 0; i < threads; i++) {
+      env->StartThread(&FileJobWork, &state);
+    }
+    while (state.running > 0) {
+      state.cv.Wait();
+    }
+  }
+  for (size_t i = 0; i < jobs->size(); i++) {
+    if (!(*jobs)[i].status.ok()) {
+      return (*jobs)[i].status;
+    }
+  }
+  return Status::OK();
+}
+
+// Create the directories on the way to "dir" + "/" + "fname".
+static void CreateParentDirs(Env* env, const std::string& dir,
+                             const std::string& fname) {
+  for (size_t slash = fname.find('/'); slash != std::string::npos;
+       slash = fname.find('/', slash + 1)) {
+    env->CreateDir(dir + "/" + fname.substr(0, slash));  // Ignore error
+  }
+}
+
+class BackupEngineImpl : public BackupEngine {
+ public:
+  BackupEngineImpl(const BackupOptions& options, const std::string& dir)
+      : options_(options), dir_(dir) { }
+
+  Status Load();
+
+  virtual Status CreateNewBackup(DB* db);
+  virtual void GetBackupInfo(std::vector<BackupInfo>* info);
+  virtual Status VerifyBackup(uint32_t backup_id);
+  virtual Status PurgeOldBackups(int num_backups_to_keep);
+  virtual Status RestoreDBFromBackup(uint32_t backup_id,
+                                     const std::string& db_dir);
+
+  // Where "file" of backup "id" is kept
+  std::string FilePath(uint32_t id, const BackupFile& file) const {
+    if (file.shared) {
+      return dir_ + "/shared/" + SharedName(file);
+    }
+    return PrivateDir(id) + "/" + file.fname;
+  }
+  std::string PrivateDir(uint32_t id) const {
+    return dir_ + "/private/" + NumberToString(id);
+  }
+  std::string MetaFileName(uint32_t id) const {
+    return dir_ + "/meta/" + NumberToString(id);
+  }
+
+  // Name of the shared table "file" under shared/.  File numbers are
+  // reused after a restore, so different tables of the same name and
+  // size are told apart by their checksum.
+  static std::string SharedName(const BackupFile& file) {
+    std::string suffix = "_" + NumberToString(file.crc) + "_" +
+                         NumberToString(file.size);
+    std::string name = file.fname;
+    const size_t dot = name.rfind('.');
+    if (dot == std::string::npos || name.find('/', dot) != std::string::npos) {
+      return name + suffix;
+    }
+    return name.insert(dot, suffix);
+  }
+
+  // Returns true if a backup has a shared table with the name and size
+  // of "file", and also its checksum if "match_crc".
+  bool HasShared(const BackupFile& file, bool match_crc) const;
+
+  const BackupOptions options_;
+  const std::string dir_;
+  std::map<uint32_t, Backup> backups_;
+};
+
+// Backs up the files of a checkpoint as backup "id".
+class BackupHandler : public CheckpointHandler {
+ public:
+  BackupHandler(BackupEngineImpl* engine, uint32_t id)
+      : engine_(engine), env_(engine->options_.env), id_(id),
+        tables_done_(false) { }
+
+  virtual Status AddTable(const std::string& path, const std::string& fname,
+                          uint64_t size) {
+    BackupFile file;
+    file.shared = true;
+    file.fname = fname;
+    file.size = size;
+    file.crc = 0;  // Set by CopyTables()
+    files_.push_back(file);
+    if (engine_->HasShared(file, false)) {
+      // Possibly backed up already: checksum it before deciding
+      checks_.push_back(FileJob(path, ""));
+      checked_.push_back(files_.size() - 1);
+    } else {
+      AddCopy(path, files_.size() - 1);
+    }
+    return Status::OK();
+  }
+
+  virtual Status AddFile(const std::string& fname, const Slice& contents) {
+    // The tables, which stay in place only until this handler returns,
+    // are all known by now.
+    Status s = CopyTables();
+    BackupFile file;
+    file.shared = false;
+    file.fname = fname;
+    file.size = contents.size();
+    file.crc = crc32c::Value(contents.data(), contents.size());
+    if (s.ok()) {
+      CreateParentDirs(env_, engine_->PrivateDir(id_), fname);
+      s = WriteStringToFile(env_, contents, engine_->FilePath(id_, file));
+    }
+    if (s.ok()) {
+      files_.push_back(file);
+    }
+    return s;
+  }
+
+  Status CopyTables() {
+    if (tables_done_) {
+      return status_;
+    }
+    tables_done_ = true;
+    const int threads = engine_->options_.max_background_operations;
+    status_ = RunFileJobs(env_, threads, &checks_);
+    for (size_t i = 0; status_.ok() && i < checks_.size(); i++) {
+      BackupFile* file = &files_[checked_[i]];
+      if (checks_[i].size != file->size) {
+        status_ = Status::Corruption("table changed size while read",
+                                     checks_[i].src);
+      } else {
+        file->crc = checks_[i].crc;
+        if (!engine_->HasShared(*file, true)) {
+          AddCopy(checks_[i].src, checked_[i]);
+        }
+      }
+    }
+    if (status_.ok()) {
+      status_ = RunFileJobs(env_, threads, &jobs_);
+    }
+    for (size_t i = 0; status_.ok() && i < jobs_.size(); i++) {
+      BackupFile* file = &files_[copied_[i]];
+      if (jobs_[i].size != file->size) {
+        status_ = Status::Corruption("table changed size while copied",
+                                     jobs_[i].src);
+      } else {
+        file->crc = jobs_[i].crc;
+        status_ = env_->RenameFile(jobs_[i].target,
+                                   engine_->FilePath(id_, *file));
+      }
+    }
+    return status_;
+  }
+
+  // Remove what this backup has written so far
+  void Abandon() {
+    for (size_t i = 0; i < jobs_.size(); i++) {
+      env_->DeleteFile(jobs_[i].target);
+    }
+    for (size_t i = 0; i < copied_.size(); i++) {
+      env_->DeleteFile(engine_->FilePath(id_, files_[copied_[i]]));
+    }
+    for (size_t i = 0; i < files_.size(); i++) {
+      if (!files_[i].shared) {
+        env_->DeleteFile(engine_->FilePath(id_, files_[i]));
+      }
+    }
+  }
+
+  std::vector<BackupFile> files_;
+
+ private:
+  // Copy the table at "path", which is files_[index], into shared/
+  void AddCopy(const std::string& path, size_t index) {
+    const std::string& fname = files_[index].fname;
+    CreateParentDirs(env_, engine_->dir_, "shared/" + fname);
+    jobs_.push_back(FileJob(path, engine_->dir_ + "/shared/" + fname + ".tmp"));
+    copied_.push_back(index);
+  }
+
+  BackupEngineImpl* const engine_;
+  Env* const env_;
+  const uint32_t id_;
+  std::vector<FileJob> checks_;   // Reads of possibly backed up tables
+  std::vector<size_t> checked_;   // Index in files_ of each check's table
+  std::vector<FileJob> jobs_;     // Copies of new tables
+  std::vector<size_t> copied_;    // Index in files_ of each job's table
+  bool tables_done_;
+  Status status_;
+};
+
+bool BackupEngineImpl::HasShared(const BackupFile& file,
+                                 bool match_crc) const {
+  for (std::map<uint32_t, Backup>::const_iterator it = backups_.begin();
+       it != backups_.end(); ++it) {
+    const std::vector<BackupFile>& files = it->second.files;
+    for (size_t i = 0; i < files.size(); i++) {
+      const BackupFile& f = files[i];
+      if (f.shared && f.fname == file.fname && f.size == file.size &&
+          (!match_crc || f.crc == file.crc)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static bool ParseMetaFile(const std::string& contents, Backup* backup) {
+  Slice input(contents);
+  if (!ConsumeDecimalNumber(&input, &backup->timestamp) ||
+      !input.starts_with("\n")) {
+    return false;
+  }
+  input.remove_prefix(1);
+  while (!input.empty()) {
+    BackupFile file;
+    if (input.starts_with("shared ")) {
+      file.shared = true;
+      input.remove_prefix(strlen("shared "));
+    } else if (input.starts_with("private ")) {
+      file.shared = false;
+      input.remove_prefix(strlen("private "));
+    } else {
+      return false;
+    }
+    const char* space = reinterpret_cast<const char*>(
+        memchr(input.data(), ' ', input.size()));
+    if (space == NULL) {
+      return false;
+    }
+    file.fname.assign(input.data(), space - input.data());
+    input.remove_prefix(file.fname.size() + 1);
+    uint64_t crc;
+    if (!ConsumeDecimalNumber(&input, &file.size) ||
+        !input.starts_with(" ")) {
+      return false;
+    }
+    input.remove_prefix(1);
+    if (!ConsumeDecimalNumber(&input, &crc) || !input.starts_with("\n")) {
+      return false;
+    }
+    input.remove_prefix(1);
+    file.crc = static_cast<uint32_t>(crc);
+    backup->files.push_back(file);
+  }
+  return true;
+}
+
+Status BackupEngineImpl::Load() {
+  Env* env = options_.env;
+  env->CreateDir(dir_);  // Ignore error
+  env->CreateDir(dir_ + "/shared");
+  env->CreateDir(dir_ + "/private");
+  env->CreateDir(dir_ + "/meta");
+  std::vector<std::string> children;
+  Status s = env->GetChildren(dir_ + "/meta", &children);
+  for (size_t i = 0; s.ok() && i < children.size(); i++) {
+    Slice name(children[i]);
+    uint64_t id;
+    if (!ConsumeDecimalNumber(&name, &id) || !name.empty()) {
+      continue;  // Such as a meta file that was never completed
+    }
+    std::string contents;
+    s = ReadFileToString(env, dir_ + "/meta/" + children[i], &contents);
+    if (s.ok() && !ParseMetaFile(contents, &backups_[id])) {
+      s = Status::Corruption("bad backup meta file", children[i]);
+    }
+  }
+  return s;
+}
+
+Status BackupEngineImpl::CreateNewBackup(DB* db) {
+  Env* env = options_.env;
+  const uint32_t id = backups_.empty() ? 1 : backups_.rbegin()->first + 1;
+  env->CreateDir(PrivateDir(id));  // Ignore error
+  BackupHandler handler(this, id);
+  Status s = db->GetCheckpointFiles(&handler);
+
+  Backup backup;
+  backup.timestamp = env->NowMicros() / 1000000;
+  backup.files = handler.files_;
+  std::string meta = NumberToString(backup.timestamp) + "\n";
+  for (size_t i = 0; i < backup.files.size(); i++) {
+    const BackupFile& f = backup.files[i];
+    meta += (f.shared ? "shared " : "private ") + f.fname + " " +
+            NumberToString(f.size) + " " + NumberToString(f.crc) + "\n";
+  }
+  const std::string tmp = MetaFileName(id) + ".tmp";
+  if (s.ok()) {
+    s = WriteStringToFile(env, meta, tmp);
+  }
+  if (s.ok()) {
+    s = env->RenameFile(tmp, MetaFileName(id));
+  }
+  if (s.ok()) {
+    backups_[id] = backup;
+  } else {
+    env->DeleteFile(tmp);
+    handler.Abandon();
+  }
+  return s;
+}
+
+void BackupEngineImpl::GetBackupInfo(std::vector<BackupInfo>* info) {
+  info->clear();
+  for (std::map<uint32_t, Backup>::const_iterator it = backups_.begin();
+       it != backups_.end(); ++it) {
+    BackupInfo b;
+    b.backup_id = it->first;
+    b.timestamp = it->second.timestamp;
+    b.number_files = it->second.files.size();
+    for (size_t i = 0; i < it->second.files.size(); i++) {
+      b.size += it->second.files[i].size;
+    }
+    info->push_back(b);
+  }
+}
+
+// Check that "jobs" read the files of "backup" as they were written
+static Status CheckJobs(const Backup& backup,
+                        const std::vector<FileJob>& jobs) {
+  for (size_t i = 0; i < jobs.size(); i++) {
+    const BackupFile& f = backup.files[i];
+    if (jobs[i].size != f.size || jobs[i].crc != f.crc) {
+      return Status::Corruption("backup file does not match its checksum",
+                                jobs[i].src);
+    }
+  }
+  return Status::OK();
+}
+
+Status BackupEngineImpl::VerifyBackup(uint32_t backup_id) {
+  std::map<uint32_t, Backup>::const_iterator it = backups_.find(backup_id);
+  if (it == backups_.end()) {
+    return Status::NotFound("no such backup", NumberToString(backup_id));
+  }
+  std::vector<FileJob> jobs;
+  for (size_t i = 0; i < it->second.files.size(); i++) {
+    jobs.push_back(FileJob(FilePath(backup_id, it->second.files[i]), ""));
+  }
+  Status s = RunFileJobs(options_.env, options_.max_background_operations,
+                         &jobs);
+  if (s.ok()) {
+    s = CheckJobs(it->second, jobs);
+  }
+  return s;
+}
+
+Status BackupEngineImpl::PurgeOldBackups(int num_backups_to_keep) {
+  Env* env = options_.env;
+  std::vector<BackupFile> dropped;  // Shared tables of the purged backups
+  while (static_cast<int>(backups_.size()) >
+         std::max(num_backups_to_keep, 0)) {
+    const uint32_t id = backups_.begin()->first;
+    const Backup& backup = backups_.begin()->second;
+    Status s = env->DeleteFile(MetaFileName(id));
+    if (!s.ok()) {
+      return s;
+    }
+    std::set<std::string> dirs;
+    for (size_t i = 0; i < backup.files.size(); i++) {
+      const BackupFile& f = backup.files[i];
+      if (f.shared) {
+        dropped.push_back(f);
+      } else {
+        env->DeleteFile(FilePath(id, f));
+        const size_t slash = f.fname.rfind('/');
+        if (slash != std::string::npos) {
+          dirs.insert(f.fname.substr(0, slash));
+        }
+      }
+    }
+    for (std::set<std::string>::iterator d = dirs.begin(); d != dirs.end();
+         ++d) {
+      env->DeleteDir(PrivateDir(id) + "/" + *d);
+    }
+    env->DeleteDir(PrivateDir(id));
+    backups_.erase(backups_.begin());
+  }
+
+  for (size_t i = 0; i < dropped.size(); i++) {
+    if (!HasShared(dropped[i], true)) {
+      env->DeleteFile(dir_ + "/shared/" + SharedName(dropped[i]));
+    }
+  }
+  return Status::OK();
+}
+
+Status BackupEngineImpl::RestoreDBFromBackup(uint32_t backup_id,
+                                             const std::string& db_dir) {
+  std::map<uint32_t, Backup>::const_iterator it = backups_.find(backup_id);
+  if (it == backups_.end()) {
+    return Status::NotFound("no such backup", NumberToString(backup_id));
+  }
+  Env* env = options_.env;
+  Options options;
+  options.env = env;
+  Status s = DestroyDB(db_dir, options);
+  if (!s.ok()) {
+    return s;
+  }
+  env->CreateDir(db_dir);  // Ignore error
+  std::vector<FileJob> jobs;
+  for (size_t i = 0; i < it->second.files.size(); i++) {
+    const BackupFile& f = it->second.files[i];
+    CreateParentDirs(env, db_dir, f.fname);
+    jobs.push_back(FileJob(FilePath(backup_id, f), db_dir + "/" + f.fname));
+  }
+  s = RunFileJobs(env, options_.max_background_operations, &jobs);
+  if (s.ok()) {
+    s = CheckJobs(it->second, jobs);
+  }
+  return s;
+}
+
+}  // namespace
+
+Status BackupEngine::Open(const BackupOptions& options,
+                          const std::string& backup_dir,
+                          BackupEngine** result) {
+  *result = NULL;
+  BackupEngineImpl* engine = new BackupEngineImpl(options, backup_dir);
+  Status s = engine->Load();
+  if (s.ok()) {
+    *result = engine;
+  } else {
+    delete engine;
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,253 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/backup.h"
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+// Env that counts the files written to the shared table directory
+class CountingEnv : public EnvWrapper {
+ public:
+  port::Mutex mu_;
+  int shared_writes_;
+
+  CountingEnv() : EnvWrapper(Env::Default()), shared_writes_(0) { }
+
+  virtual Status NewWritableFile(const std::string& fname,
+                                 WritableFile** result) {
+    if (fname.find("/shared/") != std::string::npos) {
+      MutexLock l(&mu_);
+      shared_writes_++;
+    }
+    return target()->NewWritableFile(fname, result);
+  }
+};
+}  // namespace
+
+class BackupTest {
+ public:
+  std::string dbname_;
+  std::string backup_dir_;
+  std::string restore_dir_;
+  CountingEnv env_;
+  Options options_;
+  BackupOptions backup_options_;
+  DB* db_;
+  BackupEngine* engine_;
+
+  BackupTest() : db_(NULL), engine_(NULL) {
+    dbname_ = test::TmpDir() + "/backup_test";
+    backup_dir_ = test::TmpDir() + "/backup_test_backups";
+    restore_dir_ = test::TmpDir() + "/backup_test_restore";
+    options_.env = &env_;
+    options_.create_if_missing = true;
+    backup_options_.env = &env_;
+    DestroyDB(dbname_, options_);
+    DestroyDB(restore_dir_, options_);
+    DeleteTree(backup_dir_);
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+    OpenEngine();
+  }
+
+  ~BackupTest() {
+    delete engine_;
+    delete db_;
+    DestroyDB(dbname_, options_);
+    DestroyDB(restore_dir_, options_);
+    DeleteTree(backup_dir_);
+  }
+
+  void DeleteTree(const std::string& dir) {
+    std::vector<std::string> children;
+    if (env_.GetChildren(dir, &children).ok()) {
+      for (size_t i = 0; i < children.size(); i++) {
+        if (children[i] != "." && children[i] != "..") {
+          const std::string child = dir + "/" + children[i];
+          if (!env_.DeleteFile(child).ok()) {
+            DeleteTree(child);
+          }
+        }
+      }
+    }
+    env_.DeleteDir(dir);
+  }
+
+  void OpenEngine() {
+    delete engine_;
+    engine_ = NULL;
+    ASSERT_OK(BackupEngine::Open(backup_options_, backup_dir_, &engine_));
+  }
+
+  static std::string Contents(DB* db) {
+    std::string result;
+    Iterator* iter = db->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+    }
+    delete iter;
+    return result;
+  }
+
+  // Writes keys "prefix0" .. "prefix<n-1>" into a table of their own
+  void Fill(const std::string& prefix, int n) {
+    for (int i = 0; i < n; i++) {
+      ASSERT_OK(db_->Put(WriteOptions(), prefix + NumberToString(i),
+                         std::string(100, 'v')));
+    }
+    db_->CompactRange(NULL, NULL);
+  }
+
+  std::string Restored(uint32_t id) {
+    Status s = engine_->RestoreDBFromBackup(id, restore_dir_);
+    if (!s.ok()) {
+      return s.ToString();
+    }
+    DB* db;
+    s = DB::Open(options_, restore_dir_, &db);
+    if (!s.ok()) {
+      return s.ToString();
+    }
+    std::string result = Contents(db);
+    delete db;
+    return result;
+  }
+};
+
+TEST(BackupTest, Incremental) {
+  Fill("a", 100);
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+  const std::string first = Contents(db_);
+  const int first_copies = env_.shared_writes_;
+  ASSERT_GT(first_copies, 0);
+
+  // Only the new table is copied the second time
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "1"));
+  env_.shared_writes_ = 0;
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+  ASSERT_EQ(1, env_.shared_writes_);
+  const std::string second = Contents(db_);
+
+  std::vector<BackupInfo> info;
+  engine_->GetBackupInfo(&info);
+  ASSERT_EQ(2, info.size());
+  ASSERT_EQ(1, info[0].backup_id);
+  ASSERT_EQ(2, info[1].backup_id);
+  ASSERT_GT(info[1].size, info[0].size);
+  ASSERT_OK(engine_->VerifyBackup(1));
+  ASSERT_OK(engine_->VerifyBackup(2));
+
+  ASSERT_EQ(first, Restored(1));
+  ASSERT_EQ(second, Restored(2));
+
+  // Backups survive reopening the engine
+  OpenEngine();
+  engine_->GetBackupInfo(&info);
+  ASSERT_EQ(2, info.size());
+  ASSERT_EQ(first, Restored(1));
+}
+
+TEST(BackupTest, TableNumberReusedAfterRestore) {
+  Fill("a", 100);
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+
+  // Restoring backup 1 resets the file numbers, so each of these writes
+  // ends up in a table of the same name and size.
+  const char* kValues[] = { "1", "2" };
+  std::string contents[2];
+  for (int i = 0; i < 2; i++) {
+    delete db_;
+    db_ = NULL;
+    ASSERT_OK(engine_->RestoreDBFromBackup(1, dbname_));
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+    ASSERT_OK(db_->Put(WriteOptions(), "b", kValues[i]));
+    db_->CompactRange(NULL, NULL);
+    env_.shared_writes_ = 0;
+    ASSERT_OK(engine_->CreateNewBackup(db_));
+    ASSERT_EQ(1, env_.shared_writes_);
+    contents[i] = Contents(db_);
+  }
+  ASSERT_OK(engine_->VerifyBackup(3));
+  ASSERT_EQ(contents[0], Restored(2));
+  ASSERT_EQ(contents[1], Restored(3));
+}
+
+TEST(BackupTest, Purge) {
+  Fill("a", 100);
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+  Fill("b", 100);  // Compacts "a" and "b" into a new table
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+  const std::string second = Contents(db_);
+
+  ASSERT_OK(engine_->PurgeOldBackups(1));
+  std::vector<BackupInfo> info;
+  engine_->GetBackupInfo(&info);
+  ASSERT_EQ(1, info.size());
+  ASSERT_EQ(2, info[0].backup_id);
+  ASSERT_TRUE(engine_->VerifyBackup(1).IsNotFound());
+  ASSERT_OK(engine_->VerifyBackup(2));
+
+  // Only the tables of the remaining backup are left
+  std::vector<std::string> children;
+  ASSERT_OK(env_.GetChildren(backup_dir_ + "/shared", &children));
+  int tables = 0;
+  for (size_t i = 0; i < children.size(); i++) {
+    if (children[i] != "." && children[i] != "..") tables++;
+  }
+  ASSERT_EQ(tables, info[0].number_files - 2);  // Less MANIFEST and CURRENT
+
+  OpenEngine();
+  ASSERT_EQ(second, Restored(2));
+}
+
+TEST(BackupTest, DetectsCorruption) {
+  Fill("a", 100);
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+  std::vector<std::string> children;
+  ASSERT_OK(env_.GetChildren(backup_dir_ + "/shared", &children));
+  for (size_t i = 0; i < children.size(); i++) {
+    if (children[i] == "." || children[i] == "..") continue;
+    const std::string fname = backup_dir_ + "/shared/" + children[i];
+    std::string contents;
+    ASSERT_OK(ReadFileToString(&env_, fname, &contents));
+    contents[contents.size() / 2] ^= 0x80;
+    ASSERT_OK(WriteStringToFile(&env_, contents, fname));
+  }
+  ASSERT_TRUE(engine_->VerifyBackup(1).IsCorruption());
+  ASSERT_TRUE(engine_->RestoreDBFromBackup(1, restore_dir_).IsCorruption());
+}
+
+TEST(BackupTest, ColumnFamilies) {
+  ColumnFamilyHandle* one;
+  ASSERT_OK(db_->CreateColumnFamily(options_, "one", &one));
+  ASSERT_OK(db_->Put(WriteOptions(), one, "x", "1"));
+  ASSERT_OK(db_->Put(WriteOptions(), "y", "2"));
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+  ASSERT_OK(engine_->RestoreDBFromBackup(1, restore_dir_));
+
+  std::vector<ColumnFamilyDescriptor> families;
+  families.push_back(ColumnFamilyDescriptor("one", options_));
+  std::vector<ColumnFamilyHandle*> handles;
+  DB* db;
+  ASSERT_OK(DB::Open(options_, restore_dir_, families, &handles, &db));
+  std::string value;
+  ASSERT_OK(db->Get(ReadOptions(), handles[0], "x", &value));
+  ASSERT_EQ("1", value);
+  ASSERT_OK(db->Get(ReadOptions(), "y", &value));
+  ASSERT_EQ("2", value);
+  delete db;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -11,34 +11,109 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/table_factory.h"
+#include "table/format.h"
 
 namespace leveldb {
 
+namespace {
+
+// Charges every append against a RateLimiter before passing it on.
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  RateLimitedWritableFile(WritableFile* base, RateLimiter* limiter)
+      : base_(base), limiter_(limiter) { }
+  virtual ~RateLimitedWritableFile() { delete base_; }
+
+  virtual Status Append(const Slice& data) {
+    limiter_->Request(data.size());
+    return base_->Append(data);
+  }
+  virtual Status Close() { return base_->Close(); }
+  virtual Status Flush() { return base_->Flush(); }
+  virtual Status Sync() { return base_->Sync(); }
+  virtual std::string GetName() const { return base_->GetName(); }
+
+ private:
+  WritableFile* base_;
+  RateLimiter* limiter_;
+};
+
+}  // namespace
+
+Status NewTableOutputFile(Env* env,
+                          const Options& options,
+                          const std::string& fname,
+                          WritableFile** result) {
+  Status s;
+  if (options.use_direct_io_for_flush_and_compaction) {
+    s = env->NewDirectWritableFile(fname, result);
+  } else {
+    s = env->NewWritableFile(fname, result);
+  }
+  if (s.ok() && options.rate_limiter != NULL) {
+    *result = new RateLimitedWritableFile(*result, options.rate_limiter);
+  }
+  return s;
+}
+
 Status BuildTable(const std::string& dbname,
                   Env* env,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
+                  Iterator* range_del_iter,
                   FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
   iter->SeekToFirst();
+  if (range_del_iter != NULL) {
+    range_del_iter->SeekToFirst();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || (range_del_iter != NULL && range_del_iter->Valid())) {
     WritableFile* file;
-    s = env->NewWritableFile(fname, &file);
+    s = NewTableOutputFile(env, options, fname, &file);
     if (!s.ok()) {
       return s;
     }
 
-    TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    TableWriter* builder =
+        GetTableFactory(options)->NewTableWriter(options, file);
+    bool has_bounds = iter->Valid();
+    if (has_bounds) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
       builder->Add(key, iter->value());
     }
+    for (; range_del_iter != NULL && range_del_iter->Valid();
+         range_del_iter->Next()) {
+      // The table's key range extends over every deleted range, so that
+      // reads of the covered keys consult it.
+      Slice key = range_del_iter->key();
+      InternalKey begin, end;
+      begin.DecodeFrom(key);
+      end.SetFrom(ParsedInternalKey(range_del_iter->value(),
+                                    kMaxSequenceNumber, kValueTypeForSeek));
+      const Comparator* icmp = options.comparator;
+      if (!has_bounds || icmp->Compare(begin.Encode(),
+                                       meta->smallest.Encode()) < 0) {
+        meta->smallest = begin;
+      }
+      if (!has_bounds || icmp->Compare(end.Encode(),
+                                       meta->largest.Encode()) > 0) {
+        meta->largest = end;
+      }
+      has_bounds = true;
+      builder->AddRangeTombstone(key, range_del_iter->value());
+      meta->has_range_deletions = true;
+    }
 
     // Finish and check for builder errors
     if (s.ok()) {
@@ -46,6 +121,7 @@ Status BuildTable(const std::string& dbname,
       if (s.ok()) {
         meta->file_size = builder->FileSize();
         assert(meta->file_size > 0);
+        meta->SetStats(builder->GetProperties());
       }
     } else {
       builder->Abandon();
@@ -76,6 +152,9 @@ Status BuildTable(const std::string& dbname,
   if (!iter->status().ok()) {
     s = iter->status();
   }
+  if (range_del_iter != NULL && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
+  }
 
   if (s.ok() && meta->file_size > 0) {
     // Keep it
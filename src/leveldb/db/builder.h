@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include <string>
 #include "leveldb/status.h"
 
 namespace leveldb {
@@ -16,19 +17,31 @@ class Env;
 class Iterator;
 class TableCache;
 class VersionEdit;
+class WritableFile;
 
-// Build a Table file from the contents of *iter.  The generated file
+// Build a Table file from the contents of *iter, and the range
+// tombstones of *range_del_iter if that is non-NULL.  The generated file
 // will be named according to meta->number.  On success, the rest of
 // *meta will be filled with metadata about the generated table.
-// If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
+// If no data is present in either iterator, meta->file_size will be set
+// to zero, and no Table file will be produced.
 extern Status BuildTable(const std::string& dbname,
                          Env* env,
                          const Options& options,
                          TableCache* table_cache,
                          Iterator* iter,
+                         Iterator* range_del_iter,
                          FileMetaData* meta);
 
+// Create the table file "fname" for the output of a memtable flush or a
+// compaction.  The file bypasses the page cache if
+// options.use_direct_io_for_flush_and_compaction is set, and its writes
+// are throttled by options.rate_limiter if that is non-NULL.
+extern Status NewTableOutputFile(Env* env,
+                                 const Options& options,
+                                 const std::string& fname,
+                                 WritableFile** result);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_BUILDER_H_
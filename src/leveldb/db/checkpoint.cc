@@ -0,0 +1,121 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/checkpoint.h"
+
+#include <set>
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+extern Status WriteStringToFileSync(Env* env, const Slice& data,
+                                    const std::string& fname);
+
+CheckpointHandler::~CheckpointHandler() { }
+
+namespace {
+
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& target) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(target, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  static const size_t kBufferSize = 1 << 20;
+  char* buffer = new char[kBufferSize];
+  while (s.ok()) {
+    Slice fragment;
+    s = in->Read(kBufferSize, &fragment, buffer);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = out->Append(fragment);
+  }
+  delete[] buffer;
+  delete in;
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  return s;
+}
+
+// Writes the files of a checkpoint into a directory.
+class CheckpointWriter : public CheckpointHandler {
+ public:
+  CheckpointWriter(Env* env, const std::string& dir)
+      : env_(env), dir_(dir), link_(true) { }
+
+  virtual Status AddTable(const std::string& path, const std::string& fname,
+                          uint64_t size) {
+    Status s = CreateParentDir(fname);
+    const std::string target = dir_ + "/" + fname;
+    if (s.ok() && link_) {
+      if (env_->LinkFile(path, target).ok()) {
+        return s;
+      }
+      // Not supported, or another file system: copy from now on
+      link_ = false;
+    }
+    if (s.ok()) {
+      s = CopyFile(env_, path, target);
+    }
+    return s;
+  }
+
+  virtual Status AddFile(const std::string& fname, const Slice& contents) {
+    Status s = CreateParentDir(fname);
+    if (s.ok()) {
+      s = WriteStringToFileSync(env_, contents, dir_ + "/" + fname);
+    }
+    return s;
+  }
+
+ private:
+  Status CreateParentDir(const std::string& fname) {
+    const size_t slash = fname.rfind('/');
+    if (slash == std::string::npos ||
+        !dirs_.insert(fname.substr(0, slash)).second) {
+      return Status::OK();
+    }
+    return env_->CreateDir(dir_ + "/" + fname.substr(0, slash));
+  }
+
+  Env* const env_;
+  const std::string dir_;
+  bool link_;
+  std::set<std::string> dirs_;  // Subdirectories created so far
+};
+
+}  // namespace
+
+Status CreateCheckpoint(Env* env, DB* db, const std::string& checkpoint_dir) {
+  if (env->FileExists(checkpoint_dir)) {
+    return Status::InvalidArgument(checkpoint_dir, "exists already");
+  }
+  Status s = env->CreateDir(checkpoint_dir);
+  if (s.ok()) {
+    CheckpointWriter writer(env, checkpoint_dir);
+    s = db->GetCheckpointFiles(&writer);
+    if (!s.ok()) {
+      Options options;
+      options.env = env;
+      DestroyDB(checkpoint_dir, options);
+    }
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,138 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/checkpoint.h"
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "util/logging.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+// Env that cannot link files, so that checkpoints copy them
+class NoLinkEnv : public EnvWrapper {
+ public:
+  NoLinkEnv() : EnvWrapper(Env::Default()) { }
+  virtual Status LinkFile(const std::string& src, const std::string& target) {
+    return Status::NotSupported("LinkFile", src);
+  }
+};
+}  // namespace
+
+class CheckpointTest {
+ public:
+  std::string dbname_;
+  std::string checkpoint_;
+  Options options_;
+  DB* db_;
+
+  CheckpointTest() : db_(NULL) {
+    dbname_ = test::TmpDir() + "/checkpoint_test";
+    checkpoint_ = test::TmpDir() + "/checkpoint_test_copy";
+    options_.create_if_missing = true;
+    DestroyDB(dbname_, options_);
+    DestroyDB(checkpoint_, options_);
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  ~CheckpointTest() {
+    delete db_;
+    DestroyDB(dbname_, options_);
+    DestroyDB(checkpoint_, options_);
+  }
+
+  static std::string Contents(DB* db, ColumnFamilyHandle* cf) {
+    std::string result;
+    Iterator* iter = db->NewIterator(ReadOptions(), cf);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+    }
+    delete iter;
+    return result;
+  }
+
+  // Writes keys "prefix0" .. "prefix<n-1>", flushing some of them
+  void Fill(const std::string& prefix, int n) {
+    for (int i = 0; i < n; i++) {
+      ASSERT_OK(db_->Put(WriteOptions(), prefix + NumberToString(i), "v"));
+      if (i == n / 2) {
+        db_->CompactRange(NULL, NULL);
+      }
+    }
+  }
+};
+
+TEST(CheckpointTest, Basic) {
+  Fill("a", 10);
+  const std::string expected = Contents(db_, db_->DefaultColumnFamily());
+  ASSERT_OK(CreateCheckpoint(options_.env, db_, checkpoint_));
+
+  // Later writes and compactions do not show in the checkpoint
+  Fill("b", 10);
+  ASSERT_OK(db_->Delete(WriteOptions(), "a3"));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_TRUE(CreateCheckpoint(options_.env, db_, checkpoint_)
+              .IsInvalidArgument());
+
+  DB* copy;
+  ASSERT_OK(DB::Open(options_, checkpoint_, &copy));
+  ASSERT_EQ(expected, Contents(copy, copy->DefaultColumnFamily()));
+
+  // The checkpoint is a database of its own
+  ASSERT_OK(copy->Put(WriteOptions(), "c", "v"));
+  delete copy;
+  ASSERT_OK(DB::Open(options_, checkpoint_, &copy));
+  ASSERT_EQ(expected + "c=v ", Contents(copy, copy->DefaultColumnFamily()));
+  delete copy;
+}
+
+TEST(CheckpointTest, EmptyDatabase) {
+  ASSERT_OK(CreateCheckpoint(options_.env, db_, checkpoint_));
+  DB* copy;
+  ASSERT_OK(DB::Open(options_, checkpoint_, &copy));
+  ASSERT_EQ("", Contents(copy, copy->DefaultColumnFamily()));
+  delete copy;
+}
+
+TEST(CheckpointTest, ColumnFamilies) {
+  ColumnFamilyHandle* one;
+  ASSERT_OK(db_->CreateColumnFamily(options_, "one", &one));
+  Fill("a", 10);
+  ASSERT_OK(db_->Put(WriteOptions(), one, "x", "1"));
+  ASSERT_OK(CreateCheckpoint(options_.env, db_, checkpoint_));
+  ASSERT_OK(db_->Put(WriteOptions(), one, "y", "2"));
+
+  std::vector<ColumnFamilyDescriptor> families;
+  families.push_back(ColumnFamilyDescriptor("one", options_));
+  std::vector<ColumnFamilyHandle*> handles;
+  DB* copy;
+  ASSERT_OK(DB::Open(options_, checkpoint_, families, &handles, &copy));
+  ASSERT_EQ(Contents(db_, db_->DefaultColumnFamily()),
+            Contents(copy, copy->DefaultColumnFamily()));
+  ASSERT_EQ("x=1 ", Contents(copy, handles[0]));
+  delete copy;
+}
+
+TEST(CheckpointTest, CopiesWithoutLinks) {
+  NoLinkEnv env;
+  Fill("a", 10);
+  const std::string expected = Contents(db_, db_->DefaultColumnFamily());
+  ASSERT_OK(CreateCheckpoint(&env, db_, checkpoint_));
+  delete db_;
+  db_ = NULL;
+  ASSERT_OK(DestroyDB(dbname_, options_));
+
+  DB* copy;
+  ASSERT_OK(DB::Open(options_, checkpoint_, &copy));
+  ASSERT_EQ(expected, Contents(copy, copy->DefaultColumnFamily()));
+  delete copy;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/column_family.h"
+
+#include "db/db_impl.h"
+#include "db/memtable.h"
+#include "db/table_cache.h"
+#include "db/version_set.h"
+
+namespace leveldb {
+
+const std::string kDefaultColumnFamilyName("default");
+
+ColumnFamilyHandle::~ColumnFamilyHandle() { }
+
+ColumnFamilyData::ColumnFamilyData(const std::string& dbname,
+                                   const InternalKeyComparator* icmp,
+                                   const Options* options,
+                                   TableCache* table_cache,
+                                   VersionSet* versions)
+    : id(0),
+      name(kDefaultColumnFamilyName),
+      dbname(dbname),
+      icmp(icmp),
+      options(options),
+      table_cache(table_cache),
+      versions(versions),
+      mem(NULL),
+      imm(NULL),
+      mem_log_number(0),
+      owned_icmp_(NULL),
+      owned_filter_policy_(NULL),
+      owned_options_(NULL) {
+}
+
+ColumnFamilyData::ColumnFamilyData(uint32_t id, const std::string& name,
+                                   const std::string& dbname,
+                                   const Options& db_options,
+                                   const Options& family_options,
+                                   int table_cache_size)
+    : id(id),
+      name(name),
+      dbname(dbname),
+      mem(NULL),
+      imm(NULL),
+      mem_log_number(0) {
+  Options opts = db_options;
+  opts.comparator = family_options.comparator;
+  opts.write_buffer_size = family_options.write_buffer_size;
+  opts.arena_block_size = family_options.arena_block_size;
+  opts.memtable_huge_page_size = family_options.memtable_huge_page_size;
+  opts.block_size = family_options.block_size;
+  opts.block_restart_interval = family_options.block_restart_interval;
+  opts.max_file_size = family_options.max_file_size;
+  opts.compression = family_options.compression;
+  opts.filter_policy = family_options.filter_policy;
+  opts.prefix_extractor = family_options.prefix_extractor;
+  opts.merge_operator = family_options.merge_operator;
+  opts.compaction_filter = family_options.compaction_filter;
+
+  owned_icmp_ = new InternalKeyComparator(opts.comparator);
+  owned_filter_policy_ = new InternalFilterPolicy(opts.filter_policy,
+                                                  opts.prefix_extractor);
+  // db_options already has an info_log and block_cache to share
+  owned_options_ = new Options(SanitizeOptions(dbname, owned_icmp_,
+                                               owned_filter_policy_, opts));
+  icmp = owned_icmp_;
+  options = owned_options_;
+  table_cache = new TableCache(dbname, options, table_cache_size);
+  versions = new VersionSet(dbname, options, table_cache, icmp);
+}
+
+ColumnFamilyData::~ColumnFamilyData() {
+  if (mem != NULL) mem->Unref();
+  if (imm != NULL) imm->Unref();
+  if (owned_options_ != NULL) {
+    delete versions;
+    delete table_cache;
+    delete owned_options_;
+    delete owned_filter_policy_;
+    delete owned_icmp_;
+  }
+}
+
+}  // namespace leveldb
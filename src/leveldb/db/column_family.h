@@ -0,0 +1,100 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
+#define STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
+
+#include <set>
+#include <string>
+#include <stdint.h>
+#include "db/dbformat.h"
+#include "leveldb/db.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class MemTable;
+class TableCache;
+class VersionSet;
+
+// Per level compaction stats.  stats[level] stores the stats for
+// compactions that produced data for the specified "level".
+struct CompactionStats {
+  int64_t micros;
+  int64_t bytes_read;
+  int64_t bytes_written;
+
+  CompactionStats() : micros(0), bytes_read(0), bytes_written(0) { }
+
+  void Add(const CompactionStats& c) {
+    this->micros += c.micros;
+    this->bytes_read += c.bytes_read;
+    this->bytes_written += c.bytes_written;
+  }
+};
+
+// The state of one column family of a DB.  Each family has its own
+// memtables, tables and descriptor, kept in directory "dbname"; the
+// log, writer queue, mutex and sequence numbers belong to the DB.
+// Fields other than the constant ones are protected by the DB mutex.
+struct ColumnFamilyData : public ColumnFamilyHandle {
+  // The default family, which uses the options, table cache and version
+  // set of the DB itself.  Does not take ownership of them.
+  ColumnFamilyData(const std::string& dbname,
+                   const InternalKeyComparator* icmp,
+                   const Options* options,
+                   TableCache* table_cache,
+                   VersionSet* versions);
+
+  // Family "id" named "name", kept in "dbname", which takes the per
+  // family settings (see ColumnFamilyDescriptor) from "family_options"
+  // and the rest from the sanitized options of the DB.
+  ColumnFamilyData(uint32_t id, const std::string& name,
+                   const std::string& dbname,
+                   const Options& db_options,
+                   const Options& family_options,
+                   int table_cache_size);
+
+  virtual ~ColumnFamilyData();
+
+  virtual const std::string& GetName() const { return name; }
+  virtual uint32_t GetID() const { return id; }
+
+  const Comparator* user_comparator() const {
+    return icmp->user_comparator();
+  }
+
+  // Constant after construction
+  const uint32_t id;
+  const std::string name;
+  const std::string dbname;
+  const InternalKeyComparator* icmp;
+  const Options* options;        // options->comparator == icmp
+  TableCache* table_cache;
+  VersionSet* versions;
+
+  MemTable* mem;
+  MemTable* imm;                 // Memtable being compacted
+  uint64_t mem_log_number;       // First log that may hold entries of mem
+
+  // Set of table files to protect from deletion because they are
+  // part of ongoing compactions.
+  std::set<uint64_t> pending_outputs;
+
+  CompactionStats stats[config::kNumLevels];
+
+ private:
+  // Set only for families other than the default one
+  InternalKeyComparator* owned_icmp_;
+  InternalFilterPolicy* owned_filter_policy_;
+  Options* owned_options_;
+
+  // No copying allowed
+  ColumnFamilyData(const ColumnFamilyData&);
+  void operator=(const ColumnFamilyData&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
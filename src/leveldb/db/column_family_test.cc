@@ -0,0 +1,248 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/db.h"
+
+#include "db/db_impl.h"
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/write_batch.h"
+#include "util/logging.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+// Orders keys backwards
+class ReverseComparator : public Comparator {
+ public:
+  virtual const char* Name() const { return "test.ReverseComparator"; }
+  virtual int Compare(const Slice& a, const Slice& b) const {
+    return -BytewiseComparator()->Compare(a, b);
+  }
+  virtual void FindShortestSeparator(std::string* start,
+                                     const Slice& limit) const { }
+  virtual void FindShortSuccessor(std::string* key) const { }
+};
+}  // namespace
+
+class ColumnFamilyTest {
+ public:
+  std::string dbname_;
+  Options options_;
+  DB* db_;
+  std::vector<ColumnFamilyHandle*> handles_;
+
+  ColumnFamilyTest() : db_(NULL) {
+    dbname_ = test::TmpDir() + "/column_family_test";
+    options_.create_if_missing = true;
+    DestroyDB(dbname_, options_);
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+  }
+
+  ~ColumnFamilyTest() {
+    delete db_;
+    DestroyDB(dbname_, options_);
+  }
+
+  DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+  void Create(const std::string& name) {
+    ColumnFamilyHandle* handle;
+    ASSERT_OK(db_->CreateColumnFamily(options_, name, &handle));
+    ASSERT_EQ(name, handle->GetName());
+    handles_.push_back(handle);
+  }
+
+  Status TryReopen(const std::vector<std::string>& names) {
+    delete db_;
+    db_ = NULL;
+    std::vector<ColumnFamilyDescriptor> families;
+    for (size_t i = 0; i < names.size(); i++) {
+      families.push_back(ColumnFamilyDescriptor(names[i], options_));
+    }
+    return DB::Open(options_, dbname_, families, &handles_, &db_);
+  }
+
+  void Reopen(const std::vector<std::string>& names) {
+    ASSERT_OK(TryReopen(names));
+    ASSERT_EQ(names.size(), handles_.size());
+  }
+
+  std::string Get(ColumnFamilyHandle* cf, const std::string& key) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), cf, key, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  std::string Contents(ColumnFamilyHandle* cf) {
+    std::string result;
+    Iterator* iter = db_->NewIterator(ReadOptions(), cf);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+    }
+    delete iter;
+    return result;
+  }
+
+  int NumTableFilesAtLevel(ColumnFamilyHandle* cf, int level) {
+    std::string property;
+    ASSERT_TRUE(db_->GetProperty(
+        cf, "leveldb.num-files-at-level" + NumberToString(level),
+        &property));
+    return atoi(property.c_str());
+  }
+};
+
+TEST(ColumnFamilyTest, Basic) {
+  ASSERT_EQ(kDefaultColumnFamilyName, db_->DefaultColumnFamily()->GetName());
+  Create("one");
+  Create("two");
+  ColumnFamilyHandle* one = handles_[0];
+  ColumnFamilyHandle* two = handles_[1];
+  ASSERT_TRUE(one->GetID() != two->GetID());
+
+  ASSERT_OK(db_->Put(WriteOptions(), "k", "default"));
+  ASSERT_OK(db_->Put(WriteOptions(), one, "k", "one"));
+  ASSERT_OK(db_->Put(WriteOptions(), two, "j", "two"));
+  ASSERT_EQ("default", Get(db_->DefaultColumnFamily(), "k"));
+  ASSERT_EQ("one", Get(one, "k"));
+  ASSERT_EQ("NOT_FOUND", Get(two, "k"));
+  ASSERT_EQ("k=one ", Contents(one));
+  ASSERT_EQ("j=two ", Contents(two));
+
+  ASSERT_OK(db_->Delete(WriteOptions(), one, "k"));
+  ASSERT_EQ("NOT_FOUND", Get(one, "k"));
+  ASSERT_EQ("default", Get(db_->DefaultColumnFamily(), "k"));
+}
+
+TEST(ColumnFamilyTest, DuplicateName) {
+  Create("one");
+  ColumnFamilyHandle* handle;
+  ASSERT_TRUE(db_->CreateColumnFamily(options_, "one", &handle)
+              .IsInvalidArgument());
+  ASSERT_TRUE(db_->CreateColumnFamily(options_, kDefaultColumnFamilyName,
+                                      &handle).IsInvalidArgument());
+}
+
+TEST(ColumnFamilyTest, AtomicBatch) {
+  Create("one");
+  WriteBatch batch;
+  batch.Put("a", "1");
+  batch.Put(handles_[0], "b", "2");
+  batch.Delete(handles_[0], "c");
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("a=1 ", Contents(db_->DefaultColumnFamily()));
+  ASSERT_EQ("b=2 ", Contents(handles_[0]));
+}
+
+TEST(ColumnFamilyTest, RecoverFromLog) {
+  Create("one");
+  Create("two");
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "0"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "b", "1"));
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[1], "c", "2"));
+
+  std::vector<std::string> names;
+  names.push_back("two");
+  names.push_back("one");
+  Reopen(names);
+  ASSERT_EQ("two", handles_[0]->GetName());
+  ASSERT_EQ("a=0 ", Contents(db_->DefaultColumnFamily()));
+  ASSERT_EQ("c=2 ", Contents(handles_[0]));
+  ASSERT_EQ("b=1 ", Contents(handles_[1]));
+
+  // Sequence numbers keep growing across all families
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[1], "b", "3"));
+  Reopen(names);
+  ASSERT_EQ("b=3 ", Contents(handles_[1]));
+}
+
+TEST(ColumnFamilyTest, FamiliesMustBeListed) {
+  Create("one");
+  std::vector<std::string> names;
+  ASSERT_TRUE(TryReopen(names).IsInvalidArgument());
+  names.push_back("one");
+  names.push_back("missing");
+  ASSERT_TRUE(TryReopen(names).IsInvalidArgument());
+  names.pop_back();
+  Reopen(names);
+}
+
+TEST(ColumnFamilyTest, FlushAndCompact) {
+  Create("one");
+  ColumnFamilyHandle* one = handles_[0];
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(db_->Put(WriteOptions(), one, "key" + NumberToString(i),
+                       std::string(1000, 'x')));
+  }
+  ASSERT_OK(db_->Put(WriteOptions(), "default", "value"));
+
+  // Flushing one family leaves the memtables of the others alone
+  ASSERT_OK(dbfull()->TEST_CompactMemTable(one));
+  ASSERT_EQ(0, NumTableFilesAtLevel(db_->DefaultColumnFamily(), 0));
+  ASSERT_GT(NumTableFilesAtLevel(one, 0) + NumTableFilesAtLevel(one, 1) +
+            NumTableFilesAtLevel(one, 2), 0);
+
+  db_->CompactRange(one, NULL, NULL);
+  ASSERT_EQ(0, NumTableFilesAtLevel(one, 0));
+  ASSERT_EQ(std::string(1000, 'x'), Get(one, "key42"));
+
+  // The log still holds the default family's update, which is replayed
+  // without duplicating the flushed ones.
+  std::vector<std::string> names(1, "one");
+  Reopen(names);
+  ASSERT_EQ("value", Get(db_->DefaultColumnFamily(), "default"));
+  ASSERT_EQ(std::string(1000, 'x'), Get(handles_[0], "key42"));
+  ASSERT_EQ(0, NumTableFilesAtLevel(handles_[0], 0));
+}
+
+TEST(ColumnFamilyTest, OwnComparator) {
+  ReverseComparator reverse;
+  Options cf_options = options_;
+  cf_options.comparator = &reverse;
+  cf_options.block_size = 256;
+  ColumnFamilyHandle* handle;
+  ASSERT_OK(db_->CreateColumnFamily(cf_options, "reverse", &handle));
+  ASSERT_OK(db_->Put(WriteOptions(), handle, "a", "1"));
+  ASSERT_OK(db_->Put(WriteOptions(), handle, "b", "2"));
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "2"));
+  ASSERT_EQ("b=2 a=1 ", Contents(handle));
+  ASSERT_EQ("a=1 b=2 ", Contents(db_->DefaultColumnFamily()));
+
+  ASSERT_OK(dbfull()->TEST_CompactMemTable(handle));
+  ASSERT_EQ("b=2 a=1 ", Contents(handle));
+
+  // Reopening with another comparator is refused
+  delete db_;
+  db_ = NULL;
+  std::vector<ColumnFamilyDescriptor> families;
+  families.push_back(ColumnFamilyDescriptor("reverse", options_));
+  ASSERT_TRUE(!DB::Open(options_, dbname_, families, &handles_, &db_).ok());
+  families[0].options = cf_options;
+  ASSERT_OK(DB::Open(options_, dbname_, families, &handles_, &db_));
+  ASSERT_EQ("b=2 a=1 ", Contents(handles_[0]));
+}
+
+TEST(ColumnFamilyTest, Destroy) {
+  Create("one");
+  ASSERT_OK(db_->Put(WriteOptions(), handles_[0], "a", "1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable(handles_[0]));
+  delete db_;
+  db_ = NULL;
+  ASSERT_OK(DestroyDB(dbname_, options_));
+  ASSERT_TRUE(!Env::Default()->FileExists(dbname_));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
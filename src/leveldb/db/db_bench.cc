@@ -3,16 +3,29 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <sys/types.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <algorithm>
 #include "db/db_impl.h"
 #include "db/version_set.h"
+#include "helpers/memenv/memenv.h"
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "table/merger.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
 #include "util/random.h"
@@ -27,15 +40,47 @@
 //      fill100K      -- write N/1000 100K values in random order in async mode
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
+//      mergerandom   -- add one to N random 8-byte counters with DB::Merge
+//      updaterandom  -- add one to N random 8-byte counters with a Get
+//                       and a Put each, for comparison with mergerandom
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
+//      parallelscan  -- checksum the whole DB with DB::ParallelScan over
+//                       --scan_shards shards
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
+//      multireadrandom -- read N keys in random order, --multiget_size
+//                         sorted keys at a time from one snapshot
+//      prefixscan    -- N scans of up to --scan_length keys that share the
+//                       --prefix_size byte prefix of a random key
+//      mixedreadwrite -- N random reads and writes (--read_percent reads),
+//                        at most --ops_per_sec of them, or as many as fit
+//                        in --duration seconds; prints latency percentiles
+//                        for every second
+//      ycsba .. ycsbf -- N operations of YCSB core workload A to F on the
+//                        keys written by fillseq or fillrandom:
+//                          a: 50% reads, 50% updates
+//                          b: 95% reads, 5% updates
+//                          c: reads only
+//                          d: 95% reads favoring new keys, 5% inserts
+//                          e: 95% scans of 1 to --scan_length keys,
+//                             5% inserts
+//                          f: 50% reads, 50% read-modify-writes
+//                        Keys are picked from a Zipfian distribution
+//                        (see --zipf_theta), and for d the most recently
+//                        inserted keys are the most popular ones
+//      readwhilewriting   -- 1 writer, N threads doing random reads
+//      readwhilecompacting -- 1 thread overwriting and compacting the whole
+//                             DB, N threads doing random reads; use with
+//                             --histogram=1 to see the read tail latency
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
 //      acquireload   -- load N*1000 times
+//      mergeiter4, mergeiter16, mergeiter64 -- N steps of an iterator
+//                       merging 4, 16 or 64 in-memory blocks that hold
+//                       N keys between them (forward, then in reverse)
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -70,9 +115,55 @@ static int FLAGS_reads = -1;
 // Number of concurrent threads to run.
 static int FLAGS_threads = 1;
 
+// Size of each key.  Keys are the record number zero-padded to 16 digits
+// (or to --key_size digits if that is smaller), padded with 'x' to this
+// size.
+static int FLAGS_key_size = 16;
+
+// If larger than --key_size, key sizes are spread uniformly over
+// [--key_size, --key_size_max].  A record's key always has the same size.
+static int FLAGS_key_size_max = 0;
+
 // Size of each value
 static int FLAGS_value_size = 100;
 
+// Distribution of value sizes: "fixed" (--value_size), or "uniform" or
+// "normal" over [--value_size_min, --value_size_max].  The normal
+// distribution is centered on the middle of the range, with one sixth of
+// the range as its standard deviation.
+static const char* FLAGS_value_size_distribution = "fixed";
+static int FLAGS_value_size_min = 10;
+static int FLAGS_value_size_max = 1000;
+
+// Number of keys read together by multireadrandom
+static int FLAGS_multiget_size = 16;
+
+// If positive, tables hold prefix filters on the first --prefix_size
+// bytes of each key, which prefixscan uses.
+static int FLAGS_prefix_size = 0;
+
+// Maximum number of keys read by each scan of prefixscan and ycsbe
+static int FLAGS_scan_length = 100;
+
+// Number of shards, each on its own thread, used by parallelscan
+static int FLAGS_scan_shards = 4;
+
+// Skew of the Zipfian key distribution of the YCSB workloads, in (0,1)
+static double FLAGS_zipf_theta = 0.99;
+
+// Percentage of mixedreadwrite operations that are reads
+static int FLAGS_read_percent = 90;
+
+// If positive, limit mixedreadwrite to this many operations per second,
+// across all threads.
+static int FLAGS_ops_per_sec = 0;
+
+// If positive, mixedreadwrite runs for this many seconds, ignoring --reads
+static int FLAGS_duration = 0;
+
+// If non-NULL, also write the results to this file as JSON
+static const char* FLAGS_json = NULL;
+
 // Arrange to generate values that shrink to this fraction of
 // their original size after compression
 static double FLAGS_compression_ratio = 0.5;
@@ -84,6 +175,13 @@ static bool FLAGS_histogram = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Size of the blocks memtables allocate memory in
+// (initialized to default value by "main")
+static int FLAGS_arena_block_size = 0;
+
+// If non-zero, back memtables with huge pages of this size
+static int FLAGS_memtable_huge_page_size = 0;
+
 // Number of bytes written to each file.
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
@@ -111,14 +209,31 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, flushes and compactions use direct I/O for table files.
+static bool FLAGS_direct_io = false;
+
+// If positive, cap flush and compaction writes at this many bytes/second.
+static int FLAGS_rate_limit = 0;
+
 // Use the db with the following name.
 static const char* FLAGS_db = NULL;
 
+// Environment to run in: "posix" for files on disk, or "mem" to keep the
+// database in memory, which leaves out the cost of file I/O.
+static const char* FLAGS_env = "posix";
+
 namespace leveldb {
 
 namespace {
 leveldb::Env* g_env = NULL;
 
+// Destroy the database named by --db in g_env.
+void DestroyBenchmarkDB() {
+  Options options;
+  options.env = g_env;
+  DestroyDB(FLAGS_db, options);
+}
+
 // Helper for quickly generating random data.
 class RandomGenerator {
  private:
@@ -151,6 +266,97 @@ class RandomGenerator {
   }
 };
 
+// Store in "*key" the key of record "k" (see --key_size).
+static void MakeKey(int64_t k, std::string* key) {
+  const int digits = (FLAGS_key_size < 16) ? FLAGS_key_size : 16;
+  char buf[100];
+  const int n = snprintf(buf, sizeof(buf), "%0*lld", digits,
+                         static_cast<long long>(k));
+  key->assign(buf, n);
+  size_t size = FLAGS_key_size;
+  if (FLAGS_key_size_max > FLAGS_key_size) {
+    // Derive the size from "k" so every access to the record agrees on it
+    const uint64_t h = static_cast<uint64_t>(k) * 2654435761u;
+    size += (h >> 8) % (FLAGS_key_size_max - FLAGS_key_size + 1);
+  }
+  if (key->size() < size) {
+    key->append(size - key->size(), 'x');
+  }
+}
+
+// Returns a uniformly distributed value in [0,1).
+static double RandomDouble(Random* rnd) {
+  return (rnd->Next() - 1) / 2147483646.0;
+}
+
+// Generates ranks in [0,n-1] following a Zipfian distribution with
+// parameter "theta", rank 0 being the most popular, as described in
+// "Quickly Generating Billion-Record Synthetic Databases" (Gray et al.,
+// SIGMOD 1994) and used by YCSB.  Construction takes O(n) time; Next()
+// takes constant time and may be called concurrently.
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(int64_t n, double theta)
+      : n_(n),
+        theta_(theta),
+        alpha_(1.0 / (1.0 - theta)),
+        zetan_(Zeta(n, theta)) {
+    const double zeta2 = Zeta(2, theta);
+    eta_ = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+  }
+
+  int64_t Next(Random* rnd) const {
+    const double u = RandomDouble(rnd);
+    const double uz = u * zetan_;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + pow(0.5, theta_)) return 1;
+    const int64_t r =
+        static_cast<int64_t>(n_ * pow(eta_ * u - eta_ + 1.0, alpha_));
+    return (r < n_) ? r : n_ - 1;
+  }
+
+  // Like Next(), but the popular ranks are scattered over [0,n-1]
+  // instead of being next to each other.
+  int64_t NextScrambled(Random* rnd) const {
+    const uint64_t r = Next(rnd);
+    return Hash(reinterpret_cast<const char*>(&r), sizeof(r), 0xbc9f1d34) %
+           n_;
+  }
+
+ private:
+  static double Zeta(int64_t n, double theta) {
+    double sum = 0;
+    for (int64_t i = 1; i <= n; i++) {
+      sum += 1.0 / pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  const int64_t n_;
+  const double theta_;
+  const double alpha_;
+  const double zetan_;
+  double eta_;
+};
+
+static void AppendJsonString(std::string* out, const Slice& s) {
+  out->push_back('"');
+  for (size_t i = 0; i < s.size(); i++) {
+    const unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      char buf[10];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out->append(buf);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
 #if defined(__linux)
 static Slice TrimSpace(Slice s) {
   size_t start = 0;
@@ -185,8 +391,13 @@ class Stats {
   Histogram hist_;
   std::string message_;
 
+  // If series_interval_ is non-zero, series_[i] holds the latencies of
+  // the ops that finished in the i-th interval of that many micros.
+  double series_interval_;
+  std::vector<Histogram> series_;
+
  public:
-  Stats() { Start(); }
+  Stats() : series_interval_(0) { Start(); }
 
   void Start() {
     next_report_ = 100;
@@ -198,6 +409,12 @@ class Stats {
     start_ = g_env->NowMicros();
     finish_ = start_;
     message_.clear();
+    series_.clear();
+  }
+
+  // Record a latency histogram for every "interval_micros" of the run.
+  void EnableSeries(double interval_micros) {
+    series_interval_ = interval_micros;
   }
 
   void Merge(const Stats& other) {
@@ -207,6 +424,10 @@ class Stats {
     seconds_ += other.seconds_;
     if (other.start_ < start_) start_ = other.start_;
     if (other.finish_ > finish_) finish_ = other.finish_;
+    for (size_t i = 0; i < other.series_.size(); i++) {
+      SeriesAt(i)->Merge(other.series_[i]);
+    }
+    if (series_interval_ == 0) series_interval_ = other.series_interval_;
 
     // Just keep the messages from one thread
     if (message_.empty()) message_ = other.message_;
@@ -221,11 +442,21 @@ class Stats {
     AppendWithSpace(&message_, msg);
   }
 
+  // Do not count the time since the last op (e.g. spent waiting for a
+  // rate limiter) as part of the next op's latency.
+  void SkipIdleTime() {
+    last_op_finish_ = g_env->NowMicros();
+  }
+
   void FinishedSingleOp() {
-    if (FLAGS_histogram) {
+    if (FLAGS_histogram || series_interval_ > 0) {
       double now = g_env->NowMicros();
       double micros = now - last_op_finish_;
       hist_.Add(micros);
+      if (series_interval_ > 0) {
+        SeriesAt(static_cast<size_t>((now - start_) / series_interval_))
+            ->Add(micros);
+      }
       if (micros > 20000) {
         fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
         fflush(stderr);
@@ -247,10 +478,23 @@ class Stats {
     }
   }
 
+  Histogram* SeriesAt(size_t i) {
+    while (series_.size() <= i) {
+      series_.push_back(Histogram());
+      series_.back().Clear();
+    }
+    return &series_[i];
+  }
+
   void AddBytes(int64_t n) {
     bytes_ += n;
   }
 
+  // Count "n" ops that were not timed one by one
+  void AddOps(int n) {
+    done_ += n;
+  }
+
   void Report(const Slice& name) {
     // Pretend at least one op was done in case we are running a benchmark
     // that does not call FinishedSingleOp().
@@ -274,10 +518,75 @@ class Stats {
             (extra.empty() ? "" : " "),
             extra.c_str());
     if (FLAGS_histogram) {
-      fprintf(stdout, "Microseconds per op:\n%s\n", hist_.ToString().c_str());
+      fprintf(stdout, "Microseconds per op:\n"
+              "Percentiles: P50: %.2f P99: %.2f P99.9: %.2f\n%s\n",
+              hist_.Median(), hist_.Percentile(99.0), hist_.Percentile(99.9),
+              hist_.ToString().c_str());
+    }
+    if (!series_.empty()) {
+      fprintf(stdout, "Microseconds per op, every %.0f seconds:\n"
+              "%8s %10s %10s %10s %10s\n", series_interval_ * 1e-6,
+              "Time", "Ops/sec", "P50", "P99", "P99.9");
+      for (size_t i = 0; i < series_.size(); i++) {
+        const Histogram& h = series_[i];
+        const bool empty = (h.Count() == 0);
+        fprintf(stdout, "%8.0f %10.0f %10.2f %10.2f %10.2f\n",
+                (i + 1) * series_interval_ * 1e-6,
+                h.Count() / (series_interval_ * 1e-6),
+                empty ? 0.0 : h.Median(),
+                empty ? 0.0 : h.Percentile(99.0),
+                empty ? 0.0 : h.Percentile(99.9));
+      }
     }
     fflush(stdout);
   }
+
+  // Append the results to "*out" as a JSON object.
+  void AppendJson(const Slice& name, std::string* out) {
+    const double elapsed = (finish_ - start_) * 1e-6;
+    char buf[200];
+    out->append("{\"name\": ");
+    AppendJsonString(out, name);
+    snprintf(buf, sizeof(buf),
+             ", \"ops\": %d, \"micros_per_op\": %.3f, \"ops_per_sec\": %.1f",
+             done_, seconds_ * 1e6 / done_,
+             (elapsed > 0) ? done_ / elapsed : 0.0);
+    out->append(buf);
+    if (bytes_ > 0 && elapsed > 0) {
+      snprintf(buf, sizeof(buf), ", \"mb_per_sec\": %.1f",
+               (bytes_ / 1048576.0) / elapsed);
+      out->append(buf);
+    }
+    if (!message_.empty()) {
+      out->append(", \"message\": ");
+      AppendJsonString(out, message_);
+    }
+    if (hist_.Count() > 0) {
+      snprintf(buf, sizeof(buf),
+               ", \"latency_micros\": {\"p50\": %.2f, \"p99\": %.2f, "
+               "\"p999\": %.2f, \"max\": %.2f}",
+               hist_.Median(), hist_.Percentile(99.0),
+               hist_.Percentile(99.9), hist_.Max());
+      out->append(buf);
+    }
+    if (!series_.empty()) {
+      out->append(", \"series\": [");
+      for (size_t i = 0; i < series_.size(); i++) {
+        const Histogram& h = series_[i];
+        const bool empty = (h.Count() == 0);
+        snprintf(buf, sizeof(buf),
+                 "%s{\"seconds\": %.0f, \"ops\": %.0f, \"p50\": %.2f, "
+                 "\"p99\": %.2f, \"p999\": %.2f}",
+                 (i == 0) ? "" : ", ", (i + 1) * series_interval_ * 1e-6,
+                 h.Count(), empty ? 0.0 : h.Median(),
+                 empty ? 0.0 : h.Percentile(99.0),
+                 empty ? 0.0 : h.Percentile(99.9));
+        out->append(buf);
+      }
+      out->append("]");
+    }
+    out->append("}");
+  }
 };
 
 // State shared by all concurrent executions of the same benchmark.
@@ -312,33 +621,112 @@ struct ThreadState {
   }
 };
 
+// Operation mix of a YCSB core workload, in percent
+struct YCSBWorkload {
+  int read;
+  int update;
+  int insert;
+  int scan;
+  int read_modify_write;
+  bool latest;         // Reads favor the most recently inserted keys
+};
+
+static const YCSBWorkload kYCSBWorkloads[] = {
+  { 50, 50, 0,  0,  0, false },    // A: update heavy
+  { 95,  5, 0,  0,  0, false },    // B: read mostly
+  { 100, 0, 0,  0,  0, false },    // C: read only
+  { 95,  0, 5,  0,  0, true  },    // D: read latest
+  { 0,   0, 5, 95,  0, false },    // E: short ranges
+  { 50,  0, 0,  0, 50, false },    // F: read-modify-write
+};
+
 }  // namespace
 
 class Benchmark {
  private:
+  enum ValueSizeDistribution { kFixed, kUniform, kNormal };
+
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
+  const MergeOperator* merge_operator_;
+  RateLimiter* rate_limiter_;
+  RateLimiter* ops_limiter_;
   DB* db_;
   int num_;
   int value_size_;
+  ValueSizeDistribution value_size_distribution_;
   int entries_per_batch_;
   WriteOptions write_options_;
   int reads_;
   int heap_counter_;
+  YCSBWorkload ycsb_;
+  ZipfianGenerator* zipf_;
+  int merge_children_;
+  port::AtomicUint64 key_count_;  // Records written by fills and inserts
+  std::string json_results_;        // Comma-separated JSON objects
+
+  double AverageKeySize() const {
+    return (FLAGS_key_size_max > FLAGS_key_size)
+        ? (FLAGS_key_size + FLAGS_key_size_max) / 2.0 : FLAGS_key_size;
+  }
+
+  double AverageValueSize() const {
+    if (value_size_distribution_ == kFixed) {
+      return FLAGS_value_size;
+    }
+    return (FLAGS_value_size_min + FLAGS_value_size_max) / 2.0;
+  }
+
+  // Return the size of the next value to write, following
+  // --value_size_distribution.
+  int ValueSize(Random* rnd) const {
+    const int lo = FLAGS_value_size_min;
+    const int hi = FLAGS_value_size_max;
+    switch (value_size_distribution_) {
+      case kUniform:
+        return lo + rnd->Uniform(hi - lo + 1);
+      case kNormal: {
+        // Box-Muller transform
+        const double u1 = 1.0 - RandomDouble(rnd);
+        const double u2 = RandomDouble(rnd);
+        const double z = ::sqrt(-2.0 * ::log(u1)) * ::cos(2.0 * M_PI * u2);
+        const int size =
+            static_cast<int>((lo + hi) / 2.0 + z * (hi - lo) / 6.0);
+        return std::max(lo, std::min(hi, size));
+      }
+      case kFixed:
+        break;
+    }
+    return value_size_;
+  }
 
   void PrintHeader() {
-    const int kKeySize = 16;
     PrintEnvironment();
-    fprintf(stdout, "Keys:       %d bytes each\n", kKeySize);
-    fprintf(stdout, "Values:     %d bytes each (%d bytes after compression)\n",
-            FLAGS_value_size,
-            static_cast<int>(FLAGS_value_size * FLAGS_compression_ratio + 0.5));
+    if (FLAGS_key_size_max > FLAGS_key_size) {
+      fprintf(stdout, "Keys:       %d to %d bytes each\n",
+              FLAGS_key_size, FLAGS_key_size_max);
+    } else {
+      fprintf(stdout, "Keys:       %d bytes each\n", FLAGS_key_size);
+    }
+    if (value_size_distribution_ == kFixed) {
+      fprintf(stdout,
+              "Values:     %d bytes each (%d bytes after compression)\n",
+              FLAGS_value_size,
+              static_cast<int>(FLAGS_value_size * FLAGS_compression_ratio +
+                               0.5));
+    } else {
+      fprintf(stdout, "Values:     %d to %d bytes each (%s)\n",
+              FLAGS_value_size_min, FLAGS_value_size_max,
+              FLAGS_value_size_distribution);
+    }
     fprintf(stdout, "Entries:    %d\n", num_);
     fprintf(stdout, "RawSize:    %.1f MB (estimated)\n",
-            ((static_cast<int64_t>(kKeySize + FLAGS_value_size) * num_)
+            (((AverageKeySize() + AverageValueSize()) * num_)
              / 1048576.0));
     fprintf(stdout, "FileSize:   %.1f MB (estimated)\n",
-            (((kKeySize + FLAGS_value_size * FLAGS_compression_ratio) * num_)
+            (((AverageKeySize() +
+               AverageValueSize() * FLAGS_compression_ratio) * num_)
              / 1048576.0));
     PrintWarnings();
     fprintf(stdout, "------------------------------------------------\n");
@@ -406,12 +794,32 @@ class Benchmark {
     filter_policy_(FLAGS_bloom_bits >= 0
                    ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                    : NULL),
+    prefix_extractor_(FLAGS_prefix_size > 0
+                      ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                      : NULL),
+    merge_operator_(NewUInt64AddOperator()),
+    rate_limiter_(FLAGS_rate_limit > 0
+                  ? NewRateLimiter(g_env, FLAGS_rate_limit)
+                  : NULL),
+    ops_limiter_(FLAGS_ops_per_sec > 0
+                 ? NewRateLimiter(g_env, FLAGS_ops_per_sec)
+                 : NULL),
     db_(NULL),
     num_(FLAGS_num),
     value_size_(FLAGS_value_size),
+    value_size_distribution_(kFixed),
     entries_per_batch_(1),
     reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-    heap_counter_(0) {
+    heap_counter_(0),
+    ycsb_(kYCSBWorkloads[0]),
+    zipf_(NULL),
+    merge_children_(0),
+    key_count_(FLAGS_num) {
+    if (strcmp(FLAGS_value_size_distribution, "uniform") == 0) {
+      value_size_distribution_ = kUniform;
+    } else if (strcmp(FLAGS_value_size_distribution, "normal") == 0) {
+      value_size_distribution_ = kNormal;
+    }
     std::vector<std::string> files;
     g_env->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -420,7 +828,7 @@ class Benchmark {
       }
     }
     if (!FLAGS_use_existing_db) {
-      DestroyDB(FLAGS_db, Options());
+      DestroyBenchmarkDB();
     }
   }
 
@@ -428,6 +836,11 @@ class Benchmark {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    delete prefix_extractor_;
+    delete merge_operator_;
+    delete rate_limiter_;
+    delete ops_limiter_;
+    delete zipf_;
   }
 
   void Run() {
@@ -488,12 +901,27 @@ class Benchmark {
         method = &Benchmark::ReadSequential;
       } else if (name == Slice("readreverse")) {
         method = &Benchmark::ReadReverse;
+      } else if (name == Slice("parallelscan")) {
+        method = &Benchmark::ParallelScan;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
         method = &Benchmark::SeekRandom;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
+      } else if (name == Slice("prefixscan")) {
+        method = &Benchmark::PrefixScan;
+      } else if (name == Slice("mixedreadwrite")) {
+        method = &Benchmark::MixedReadWrite;
+      } else if (name.size() == 5 && name.starts_with("ycsb") &&
+                 name[4] >= 'a' && name[4] <= 'f') {
+        ycsb_ = kYCSBWorkloads[name[4] - 'a'];
+        if (zipf_ == NULL) {
+          zipf_ = new ZipfianGenerator(FLAGS_num, FLAGS_zipf_theta);
+        }
+        method = &Benchmark::YCSB;
       } else if (name == Slice("readhot")) {
         method = &Benchmark::ReadHot;
       } else if (name == Slice("readrandomsmall")) {
@@ -503,15 +931,27 @@ class Benchmark {
         method = &Benchmark::DeleteSeq;
       } else if (name == Slice("deleterandom")) {
         method = &Benchmark::DeleteRandom;
+      } else if (name == Slice("mergerandom")) {
+        method = &Benchmark::MergeRandom;
+      } else if (name == Slice("updaterandom")) {
+        method = &Benchmark::UpdateRandom;
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
+      } else if (name == Slice("readwhilecompacting")) {
+        num_threads++;  // Add extra thread for compacting
+        method = &Benchmark::ReadWhileCompacting;
       } else if (name == Slice("compact")) {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
       } else if (name == Slice("acquireload")) {
         method = &Benchmark::AcquireLoad;
+      } else if (name == Slice("mergeiter4") ||
+                 name == Slice("mergeiter16") ||
+                 name == Slice("mergeiter64")) {
+        merge_children_ = atoi(name.data() + strlen("mergeiter"));
+        method = &Benchmark::MergeIter;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -536,8 +976,9 @@ class Benchmark {
         } else {
           delete db_;
           db_ = NULL;
-          DestroyDB(FLAGS_db, Options());
+          DestroyBenchmarkDB();
           Open();
+          key_count_.NoBarrier_Store(FLAGS_num);
         }
       }
 
@@ -545,6 +986,10 @@ class Benchmark {
         RunBenchmark(num_threads, name, method);
       }
     }
+
+    if (FLAGS_json != NULL) {
+      WriteJson();
+    }
   }
 
  private:
@@ -617,6 +1062,10 @@ class Benchmark {
       arg[0].thread->stats.Merge(arg[i].thread->stats);
     }
     arg[0].thread->stats.Report(name);
+    if (!json_results_.empty()) {
+      json_results_.append(",\n    ");
+    }
+    arg[0].thread->stats.AppendJson(name, &json_results_);
 
     for (int i = 0; i < n; i++) {
       delete arg[i].thread;
@@ -684,6 +1133,55 @@ class Benchmark {
     }
   }
 
+  void MergeIter(ThreadState* thread) {
+    // Each key goes to a random child, so runs from one child are short
+    const int n = merge_children_;
+    Options options;
+    std::vector<BlockBuilder*> builders;
+    for (int i = 0; i < n; i++) {
+      builders.push_back(new BlockBuilder(&options));
+    }
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%016d", i);
+      builders[thread->rand.Uniform(n)]->Add(key, "value");
+    }
+    std::vector<Block*> blocks;
+    std::vector<Iterator*> children;
+    for (int i = 0; i < n; i++) {
+      BlockContents contents;
+      contents.data = builders[i]->Finish();
+      contents.cachable = false;
+      contents.heap_allocated = false;
+      blocks.push_back(new Block(contents));
+      children.push_back(blocks[i]->NewIterator(BytewiseComparator()));
+    }
+    Iterator* iter = NewMergingIterator(BytewiseComparator(), &children[0],
+                                        n);
+
+    int64_t bytes = 0;
+    int64_t i = 0;
+    for (iter->SeekToFirst(); i < reads_ / 2 && iter->Valid(); iter->Next()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+      ++i;
+    }
+    for (iter->SeekToLast(); i < reads_ && iter->Valid(); iter->Prev()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+      ++i;
+    }
+    delete iter;
+    for (int i = 0; i < n; i++) {
+      delete blocks[i];
+      delete builders[i];
+    }
+    thread->stats.AddBytes(bytes);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d children)", n);
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyUncompress(ThreadState* thread) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
@@ -713,11 +1211,17 @@ class Benchmark {
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.arena_block_size = FLAGS_arena_block_size;
+    options.memtable_huge_page_size = FLAGS_memtable_huge_page_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.prefix_extractor = prefix_extractor_;
+    options.merge_operator = merge_operator_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.use_direct_io_for_flush_and_compaction = FLAGS_direct_io;
+    options.rate_limiter = rate_limiter_;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -751,15 +1255,16 @@ class Benchmark {
     RandomGenerator gen;
     WriteBatch batch;
     Status s;
+    std::string key;
     int64_t bytes = 0;
     for (int i = 0; i < num_; i += entries_per_batch_) {
       batch.Clear();
       for (int j = 0; j < entries_per_batch_; j++) {
         const int k = seq ? i+j : (thread->rand.Next() % FLAGS_num);
-        char key[100];
-        snprintf(key, sizeof(key), "%016d", k);
-        batch.Put(key, gen.Generate(value_size_));
-        bytes += value_size_ + strlen(key);
+        MakeKey(k, &key);
+        const int value_size = ValueSize(&thread->rand);
+        batch.Put(key, gen.Generate(value_size));
+        bytes += value_size + key.size();
         thread->stats.FinishedSingleOp();
       }
       s = db_->Write(write_options_, &batch);
@@ -784,6 +1289,53 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  // Sums the checksums of the entries, so that the result does not
+  // depend on the order the shards run in.
+  class ChecksumHandler : public ScanHandler {
+   public:
+    struct Shard {
+      uint32_t checksum;
+      int entries;
+      int64_t bytes;
+      Shard() : checksum(0), entries(0), bytes(0) { }
+    };
+    std::vector<Shard> shards_;
+
+    explicit ChecksumHandler(int n) : shards_(n) { }
+
+    virtual bool Process(int shard, const Slice& key, const Slice& value) {
+      Shard* s = &shards_[shard];
+      s->checksum += crc32c::Extend(crc32c::Value(key.data(), key.size()),
+                                    value.data(), value.size());
+      s->entries++;
+      s->bytes += key.size() + value.size();
+      return true;
+    }
+  };
+
+  void ParallelScan(ThreadState* thread) {
+    ChecksumHandler handler(FLAGS_scan_shards);
+    Status s = db_->ParallelScan(ReadOptions(), Range(Slice(), Slice()),
+                                 FLAGS_scan_shards, &handler);
+    if (!s.ok()) {
+      fprintf(stderr, "parallel scan error: %s\n", s.ToString().c_str());
+      exit(1);
+    }
+    uint32_t checksum = 0;
+    int shards = 0;
+    for (size_t i = 0; i < handler.shards_.size(); i++) {
+      const ChecksumHandler::Shard& shard = handler.shards_[i];
+      checksum += shard.checksum;
+      thread->stats.AddOps(shard.entries);
+      thread->stats.AddBytes(shard.bytes);
+      if (shard.entries > 0) shards++;
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d shards, checksum %08x)", shards,
+             checksum);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadReverse(ThreadState* thread) {
     Iterator* iter = db_->NewIterator(ReadOptions());
     int i = 0;
@@ -799,12 +1351,12 @@ class Benchmark {
 
   void ReadRandom(ThreadState* thread) {
     ReadOptions options;
+    std::string key;
     std::string value;
     int found = 0;
     for (int i = 0; i < reads_; i++) {
-      char key[100];
       const int k = thread->rand.Next() % FLAGS_num;
-      snprintf(key, sizeof(key), "%016d", k);
+      MakeKey(k, &key);
       if (db_->Get(options, key, &value).ok()) {
         found++;
       }
@@ -817,11 +1369,12 @@ class Benchmark {
 
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
+    std::string key;
     std::string value;
     for (int i = 0; i < reads_; i++) {
-      char key[100];
       const int k = thread->rand.Next() % FLAGS_num;
-      snprintf(key, sizeof(key), "%016d.", k);
+      MakeKey(k, &key);
+      key.push_back('.');
       db_->Get(options, key, &value);
       thread->stats.FinishedSingleOp();
     }
@@ -830,11 +1383,11 @@ class Benchmark {
   void ReadHot(ThreadState* thread) {
     ReadOptions options;
     std::string value;
+    std::string key;
     const int range = (FLAGS_num + 99) / 100;
     for (int i = 0; i < reads_; i++) {
-      char key[100];
       const int k = thread->rand.Next() % range;
-      snprintf(key, sizeof(key), "%016d", k);
+      MakeKey(k, &key);
       db_->Get(options, key, &value);
       thread->stats.FinishedSingleOp();
     }
@@ -842,14 +1395,14 @@ class Benchmark {
 
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
+    std::string key;
     int found = 0;
     for (int i = 0; i < reads_; i++) {
       Iterator* iter = db_->NewIterator(options);
-      char key[100];
       const int k = thread->rand.Next() % FLAGS_num;
-      snprintf(key, sizeof(key), "%016d", k);
+      MakeKey(k, &key);
       iter->Seek(key);
-      if (iter->Valid() && iter->key() == key) found++;
+      if (iter->Valid() && iter->key() == Slice(key)) found++;
       delete iter;
       thread->stats.FinishedSingleOp();
     }
@@ -858,16 +1411,183 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<std::string> keys(FLAGS_multiget_size);
+    std::string value;
+    int found = 0;
+    for (int read = 0; read < reads_; ) {
+      const int n = std::min(FLAGS_multiget_size, reads_ - read);
+      for (int j = 0; j < n; j++) {
+        MakeKey(thread->rand.Next() % FLAGS_num, &keys[j]);
+      }
+      std::sort(keys.begin(), keys.begin() + n);
+      options.snapshot = db_->GetSnapshot();
+      for (int j = 0; j < n; j++) {
+        if (db_->Get(options, keys[j], &value).ok()) {
+          found++;
+        }
+      }
+      db_->ReleaseSnapshot(options.snapshot);
+      read += n;
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d keys per op, %d of %d found)",
+             FLAGS_multiget_size, found, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void PrefixScan(ThreadState* thread) {
+    if (prefix_extractor_ == NULL) {
+      thread->stats.AddMessage("(skipped: --prefix_size is not set)");
+      return;
+    }
+    ReadOptions options;
+    options.prefix_same_as_start = true;
+    std::string key;
+    int64_t bytes = 0;
+    int64_t entries = 0;
+    for (int i = 0; i < reads_; i++) {
+      MakeKey(thread->rand.Next() % FLAGS_num, &key);
+      if (prefix_extractor_->InDomain(key)) {
+        key = prefix_extractor_->Transform(key).ToString();
+      }
+      Iterator* iter = db_->NewIterator(options);
+      int n = 0;
+      for (iter->Seek(key); n < FLAGS_scan_length && iter->Valid();
+           iter->Next()) {
+        bytes += iter->key().size() + iter->value().size();
+        n++;
+      }
+      delete iter;
+      entries += n;
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%.1f keys per scan)",
+             reads_ > 0 ? static_cast<double>(entries) / reads_ : 0.0);
+    thread->stats.AddMessage(msg);
+    thread->stats.AddBytes(bytes);
+  }
+
+  void MixedReadWrite(ThreadState* thread) {
+    thread->stats.EnableSeries(1e6);
+    RandomGenerator gen;
+    ReadOptions options;
+    std::string key;
+    std::string value;
+    int reads = 0;
+    int found = 0;
+    int writes = 0;
+    const uint64_t deadline = (FLAGS_duration > 0)
+        ? g_env->NowMicros() + static_cast<uint64_t>(FLAGS_duration) * 1000000
+        : 0;
+    for (int i = 0;
+         deadline > 0 ? g_env->NowMicros() < deadline : i < reads_;
+         i++) {
+      if (ops_limiter_ != NULL) {
+        ops_limiter_->Request(1);
+        thread->stats.SkipIdleTime();
+      }
+      MakeKey(thread->rand.Next() % FLAGS_num, &key);
+      if (static_cast<int>(thread->rand.Uniform(100)) < FLAGS_read_percent) {
+        if (db_->Get(options, key, &value).ok()) {
+          found++;
+        }
+        reads++;
+      } else {
+        PutOrDie(key, gen.Generate(ValueSize(&thread->rand)));
+        writes++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d reads, %d found, %d writes)",
+             reads, found, writes);
+    thread->stats.AddMessage(msg);
+  }
+
+  // Return the key of an existing record for a YCSB read or update.
+  int64_t YCSBKey(Random* rnd) {
+    if (ycsb_.latest) {
+      const int64_t count = key_count_.NoBarrier_Load();
+      const int64_t r = zipf_->Next(rnd);
+      return (r < count) ? count - 1 - r : 0;
+    }
+    return zipf_->NextScrambled(rnd);
+  }
+
+  void YCSB(ThreadState* thread) {
+    RandomGenerator gen;
+    ReadOptions options;
+    std::string key;
+    std::string value;
+    int reads = 0;
+    int found = 0;
+    int writes = 0;
+    int scanned = 0;
+    for (int i = 0; i < reads_; i++) {
+      int op = thread->rand.Uniform(100);
+      if (op < ycsb_.read) {
+        MakeKey(YCSBKey(&thread->rand), &key);
+        if (db_->Get(options, key, &value).ok()) {
+          found++;
+        }
+        reads++;
+      } else if ((op -= ycsb_.read) < ycsb_.update) {
+        MakeKey(YCSBKey(&thread->rand), &key);
+        PutOrDie(key, gen.Generate(ValueSize(&thread->rand)));
+        writes++;
+      } else if ((op -= ycsb_.update) < ycsb_.insert) {
+        MakeKey(key_count_.NoBarrier_FetchAdd(1), &key);
+        PutOrDie(key, gen.Generate(ValueSize(&thread->rand)));
+        writes++;
+      } else if ((op -= ycsb_.insert) < ycsb_.scan) {
+        MakeKey(YCSBKey(&thread->rand), &key);
+        const int length = 1 + thread->rand.Uniform(FLAGS_scan_length);
+        Iterator* iter = db_->NewIterator(options);
+        int n = 0;
+        for (iter->Seek(key); n < length && iter->Valid(); iter->Next()) {
+          n++;
+        }
+        delete iter;
+        scanned += n;
+      } else {
+        MakeKey(YCSBKey(&thread->rand), &key);
+        if (db_->Get(options, key, &value).ok()) {
+          found++;
+        }
+        reads++;
+        PutOrDie(key, gen.Generate(ValueSize(&thread->rand)));
+        writes++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d reads, %d found, %d writes, %d scanned)",
+             reads, found, writes, scanned);
+    thread->stats.AddMessage(msg);
+  }
+
+  void PutOrDie(const Slice& key, const Slice& value) {
+    Status s = db_->Put(write_options_, key, value);
+    if (!s.ok()) {
+      fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+      exit(1);
+    }
+  }
+
   void DoDelete(ThreadState* thread, bool seq) {
     RandomGenerator gen;
     WriteBatch batch;
     Status s;
+    std::string key;
     for (int i = 0; i < num_; i += entries_per_batch_) {
       batch.Clear();
       for (int j = 0; j < entries_per_batch_; j++) {
         const int k = seq ? i+j : (thread->rand.Next() % FLAGS_num);
-        char key[100];
-        snprintf(key, sizeof(key), "%016d", k);
+        MakeKey(k, &key);
         batch.Delete(key);
         thread->stats.FinishedSingleOp();
       }
@@ -887,12 +1607,53 @@ class Benchmark {
     DoDelete(thread, false);
   }
 
+  void MergeRandom(ThreadState* thread) {
+    std::string key;
+    std::string one;
+    PutFixed64(&one, 1);
+    for (int i = 0; i < num_; i++) {
+      const int k = thread->rand.Next() % FLAGS_num;
+      MakeKey(k, &key);
+      Status s = db_->Merge(write_options_, key, one);
+      if (!s.ok()) {
+        fprintf(stderr, "merge error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.AddBytes(key.size() + one.size());
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
+  void UpdateRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::string key;
+    std::string value;
+    for (int i = 0; i < num_; i++) {
+      const int k = thread->rand.Next() % FLAGS_num;
+      MakeKey(k, &key);
+      uint64_t count = 0;
+      if (db_->Get(options, key, &value).ok() && value.size() == 8) {
+        count = DecodeFixed64(value.data());
+      }
+      value.clear();
+      PutFixed64(&value, count + 1);
+      Status s = db_->Put(write_options_, key, value);
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.AddBytes(key.size() + value.size());
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
   void ReadWhileWriting(ThreadState* thread) {
     if (thread->tid > 0) {
       ReadRandom(thread);
     } else {
       // Special thread that keeps writing until other threads are done.
       RandomGenerator gen;
+      std::string key;
       while (true) {
         {
           MutexLock l(&thread->shared->mu);
@@ -903,9 +1664,9 @@ class Benchmark {
         }
 
         const int k = thread->rand.Next() % FLAGS_num;
-        char key[100];
-        snprintf(key, sizeof(key), "%016d", k);
-        Status s = db_->Put(write_options_, key, gen.Generate(value_size_));
+        MakeKey(k, &key);
+        Status s = db_->Put(write_options_, key,
+                            gen.Generate(ValueSize(&thread->rand)));
         if (!s.ok()) {
           fprintf(stderr, "put error: %s\n", s.ToString().c_str());
           exit(1);
@@ -917,6 +1678,43 @@ class Benchmark {
     }
   }
 
+  void ReadWhileCompacting(ThreadState* thread) {
+    if (thread->tid > 0) {
+      ReadRandom(thread);
+    } else {
+      // Special thread that keeps rewriting part of the key space and
+      // then compacting the whole DB until other threads are done, so
+      // that there is always a large compaction running.
+      RandomGenerator gen;
+      std::string key;
+      const int batch = (num_ >= 10) ? num_ / 10 : 1;
+      while (true) {
+        {
+          MutexLock l(&thread->shared->mu);
+          if (thread->shared->num_done + 1 >= thread->shared->num_initialized) {
+            // Other threads have finished
+            break;
+          }
+        }
+
+        for (int i = 0; i < batch; i++) {
+          const int k = thread->rand.Next() % FLAGS_num;
+          MakeKey(k, &key);
+          Status s = db_->Put(write_options_, key,
+                              gen.Generate(ValueSize(&thread->rand)));
+          if (!s.ok()) {
+            fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+            exit(1);
+          }
+        }
+        db_->CompactRange(NULL, NULL);
+      }
+
+      // Do not count any of the preceding work/delay in stats.
+      thread->stats.Start();
+    }
+  }
+
   void Compact(ThreadState* thread) {
     db_->CompactRange(NULL, NULL);
   }
@@ -929,6 +1727,32 @@ class Benchmark {
     fprintf(stdout, "\n%s\n", stats.c_str());
   }
 
+  void WriteJson() {
+    FILE* f = fopen(FLAGS_json, "w");
+    if (f == NULL) {
+      fprintf(stderr, "cannot write %s\n", FLAGS_json);
+      return;
+    }
+    fprintf(f, "{\n  \"version\": \"%d.%d\",\n  \"timestamp\": %lld,\n",
+            kMajorVersion, kMinorVersion,
+            static_cast<long long>(time(NULL)));
+    std::string dist;
+    AppendJsonString(&dist, FLAGS_value_size_distribution);
+    fprintf(f, "  \"config\": {\"num\": %d, \"reads\": %d, "
+            "\"threads\": %d, \"key_size\": %d, \"key_size_max\": %d, "
+            "\"value_size\": %d, \"value_size_distribution\": %s, "
+            "\"value_size_min\": %d, \"value_size_max\": %d, "
+            "\"compression_ratio\": %.2f, \"write_buffer_size\": %d, "
+            "\"block_size\": %d, \"cache_size\": %d, \"bloom_bits\": %d},\n",
+            FLAGS_num, FLAGS_reads, FLAGS_threads, FLAGS_key_size,
+            FLAGS_key_size_max, FLAGS_value_size, dist.c_str(),
+            FLAGS_value_size_min, FLAGS_value_size_max,
+            FLAGS_compression_ratio, FLAGS_write_buffer_size,
+            FLAGS_block_size, FLAGS_cache_size, FLAGS_bloom_bits);
+    fprintf(f, "  \"results\": [\n    %s\n  ]\n}\n", json_results_.c_str());
+    fclose(f);
+  }
+
   static void WriteToFile(void* arg, const char* buf, int n) {
     reinterpret_cast<WritableFile*>(arg)->Append(Slice(buf, n));
   }
@@ -955,6 +1779,7 @@ class Benchmark {
 
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
+  FLAGS_arena_block_size = leveldb::Options().arena_block_size;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
@@ -985,8 +1810,51 @@ int main(int argc, char** argv) {
       FLAGS_threads = n;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
       FLAGS_value_size = n;
+    } else if (sscanf(argv[i], "--key_size=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_key_size = n;
+    } else if (sscanf(argv[i], "--key_size_max=%d%c", &n, &junk) == 1) {
+      FLAGS_key_size_max = n;
+    } else if (strcmp(argv[i], "--value_size_distribution=fixed") == 0 ||
+               strcmp(argv[i], "--value_size_distribution=uniform") == 0 ||
+               strcmp(argv[i], "--value_size_distribution=normal") == 0) {
+      FLAGS_value_size_distribution =
+          argv[i] + strlen("--value_size_distribution=");
+    } else if (sscanf(argv[i], "--value_size_min=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_value_size_min = n;
+    } else if (sscanf(argv[i], "--value_size_max=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_value_size_max = n;
+    } else if (sscanf(argv[i], "--multiget_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_multiget_size = n;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
+    } else if (sscanf(argv[i], "--scan_length=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_scan_length = n;
+    } else if (sscanf(argv[i], "--scan_shards=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_scan_shards = n;
+    } else if (sscanf(argv[i], "--zipf_theta=%lf%c", &d, &junk) == 1 &&
+               d > 0 && d < 1) {
+      FLAGS_zipf_theta = d;
+    } else if (sscanf(argv[i], "--read_percent=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 100) {
+      FLAGS_read_percent = n;
+    } else if (sscanf(argv[i], "--ops_per_sec=%d%c", &n, &junk) == 1) {
+      FLAGS_ops_per_sec = n;
+    } else if (sscanf(argv[i], "--duration=%d%c", &n, &junk) == 1) {
+      FLAGS_duration = n;
+    } else if (strncmp(argv[i], "--json=", 7) == 0) {
+      FLAGS_json = argv[i] + 7;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--arena_block_size=%d%c", &n, &junk) == 1) {
+      FLAGS_arena_block_size = n;
+    } else if (sscanf(argv[i], "--memtable_huge_page_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_memtable_huge_page_size = n;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
@@ -997,15 +1865,35 @@ int main(int argc, char** argv) {
       FLAGS_bloom_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--direct_io=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_direct_io = n;
+    } else if (sscanf(argv[i], "--rate_limit=%d%c", &n, &junk) == 1) {
+      FLAGS_rate_limit = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
+    } else if (strncmp(argv[i], "--env=", 6) == 0) {
+      FLAGS_env = argv[i] + 6;
     } else {
       fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       exit(1);
     }
   }
 
-  leveldb::g_env = leveldb::Env::Default();
+  if (FLAGS_value_size_min > FLAGS_value_size_max) {
+    fprintf(stderr, "--value_size_min is larger than --value_size_max\n");
+    exit(1);
+  }
+
+  if (strcmp(FLAGS_env, "mem") == 0) {
+    // One background thread, like Env::Default(), so that the two compare
+    leveldb::g_env = leveldb::NewMemEnv(leveldb::Env::Default(), 1);
+  } else if (strcmp(FLAGS_env, "posix") == 0) {
+    leveldb::g_env = leveldb::Env::Default();
+  } else {
+    fprintf(stderr, "Unknown --env=%s\n", FLAGS_env);
+    exit(1);
+  }
 
   // Choose a location for the test database if none given with --db=<path>
   if (FLAGS_db == NULL) {
@@ -5,6 +5,7 @@
 #include "db/db_impl.h"
 
 #include <algorithm>
+#include <map>
 #include <set>
 #include <string>
 #include <stdint.h>
@@ -14,42 +15,159 @@
 #include "db/db_iter.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/log_background_reader.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
+#include "db/transaction_log_impl.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/checkpoint.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/listener.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
 #include "port/port.h"
 #include "table/block.h"
+#include "table/format.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// During recovery, the logs after the one being replayed are read and
+// checksummed in the background, up to this many at a time, each
+// buffering up to kLogReadBufferBytes of decoded records.
+static const int kMaxLogsReadAhead = 4;
+static const size_t kLogReadBufferBytes = 4 << 20;
+
+// A secondary instance reads the descriptor of the primary again after
+// reading its logs, and starts over if the primary has moved on to newer
+// logs meanwhile, up to this many times per catch-up.
+static const int kMaxCatchUpAttempts = 4;
+
+namespace {
+
+struct LogReporter : public log::Reader::Reporter {
+  Env* env;
+  Logger* info_log;
+  const char* fname;
+  Status* status;  // NULL if options_.paranoid_checks==false
+  virtual void Corruption(size_t bytes, const Status& s) {
+    Log(info_log, "%s%s: dropping %d bytes; %s",
+        (this->status == NULL ? "(ignoring error) " : ""),
+        fname, static_cast<int>(bytes), s.ToString().c_str());
+    if (this->status != NULL && this->status->ok()) *this->status = s;
+  }
+};
+
+}  // namespace
+
+// A log file being read in the background ahead of RecoverLogFile().
+struct DBImpl::LogToRecover {
+  uint64_t number;
+  std::string fname;
+  Status status;                   // Result of opening the file
+  SequentialFile* file;
+  LogReporter reporter;            // Used from the background thread
+  log::BackgroundReader* reader;   // NULL if the file could not be opened
+
+  LogToRecover() : file(NULL), reader(NULL) { }
+  ~LogToRecover() {
+    delete reader;  // Waits for the background thread
+    delete file;
+  }
+};
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  bool exclusive;  // Never joins a batch group (FlushWAL() and the like)
+  const std::vector<Slice>* check_keys;  // For WriteIfUnchanged()
+  SequenceNumber check_seq;
   port::CondVar cv;
 
-  explicit Writer(port::Mutex* mu) : cv(mu) { }
+  explicit Writer(port::Mutex* mu)
+      : exclusive(false), check_keys(NULL), check_seq(0), cv(mu) { }
+};
+
+// Inserts the records of each column family into its current memtable.
+// Used only at the front of the writer queue, which keeps the memtables
+// and families from changing.
+class DBImpl::WriteMemTables : public ColumnFamilyMemTables {
+ public:
+  explicit WriteMemTables(DBImpl* db) : db_(db) { }
+  virtual MemTable* GetMemTable(uint32_t column_family) {
+    std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+        db_->column_families_.find(column_family);
+    return (it == db_->column_families_.end()) ? NULL : it->second->mem;
+  }
+
+ private:
+  DBImpl* const db_;
+};
+
+// Collects the records replayed from a log into a memtable per column
+// family, skipping the families that had already written them to tables.
+class DBImpl::RecoveryMemTables : public ColumnFamilyMemTables {
+ public:
+  RecoveryMemTables(DBImpl* db, uint64_t log_number)
+      : db_(db), log_number_(log_number) { }
+  ~RecoveryMemTables() {
+    for (std::map<uint32_t, MemTable*>::iterator it = mems_.begin();
+         it != mems_.end(); ++it) {
+      if (it->second != NULL) it->second->Unref();
+    }
+  }
+
+  virtual MemTable* GetMemTable(uint32_t column_family) {
+    std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+        db_->column_families_.find(column_family);
+    if (it == db_->column_families_.end()) {
+      return NULL;
+    }
+    ColumnFamilyData* cfd = it->second;
+    if (log_number_ < cfd->versions->LogNumber() &&
+        log_number_ != cfd->versions->PrevLogNumber()) {
+      return NULL;  // Already in the family's tables
+    }
+    MemTable*& mem = mems_[column_family];
+    if (mem == NULL) {
+      mem = db_->NewMemTable(cfd);
+      mem->Ref();
+    }
+    return mem;
+  }
+
+  // The memtables filled so far, by column family.  The caller may
+  // take them over, replacing them with NULL.
+  std::map<uint32_t, MemTable*>* mems() { return &mems_; }
+
+ private:
+  DBImpl* const db_;
+  const uint64_t log_number_;
+  std::map<uint32_t, MemTable*> mems_;
 };
 
 struct DBImpl::CompactionState {
   Compaction* const compaction;
+  ColumnFamilyData* const cfd;
 
   // Sequence numbers < smallest_snapshot are not significant since we
   // will never have to service a snapshot below smallest_snapshot.
@@ -58,26 +176,45 @@ struct DBImpl::CompactionState {
   SequenceNumber smallest_snapshot;
 
   // Files produced by compaction
-  struct Output {
-    uint64_t number;
-    uint64_t file_size;
-    InternalKey smallest, largest;
-  };
+  // Files made by compaction: their number, size, bounds and stats
+  typedef FileMetaData Output;
   std::vector<Output> outputs;
 
+  // Range deletions to write to the outputs, with sequence numbers that
+  // no snapshot can tell apart merged away.  Those before
+  // "next_tombstone" have been written.  Those written to the current
+  // output are clipped to start at "output_lower", if there is one.
+  std::vector<RangeTombstoneList::Fragment> tombstones;
+  size_t next_tombstone;
+  bool has_output_lower;
+  std::string output_lower;
+
+  // A merge operand visible to every snapshot is held back to be combined
+  // with the older entries for its key.  pending_merge_key is its
+  // internal key and pending_merge_value the operands merged so far.
+  bool has_pending_merge;
+  std::string pending_merge_key;
+  std::string pending_merge_value;
+
   // State kept for output being generated
   WritableFile* outfile;
-  TableBuilder* builder;
+  TableWriter* builder;
 
   uint64_t total_bytes;
+  uint64_t filtered_entries;  // Removed by the compaction filter
 
   Output* current_output() { return &outputs[outputs.size()-1]; }
 
-  explicit CompactionState(Compaction* c)
+  CompactionState(Compaction* c, ColumnFamilyData* cfd)
       : compaction(c),
+        cfd(cfd),
+        next_tombstone(0),
+        has_output_lower(false),
+        has_pending_merge(false),
         outfile(NULL),
         builder(NULL),
-        total_bytes(0) {
+        total_bytes(0),
+        filtered_entries(0) {
   }
 };
 
@@ -98,6 +235,7 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
   ClipToRange(&result.max_file_size,     1<<20,                       1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.arena_block_size,  1<<10,                       64<<20);
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -114,28 +252,41 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
-DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
+DBImpl::DBImpl(const Options& raw_options, const std::string& dbname,
+               const std::string& secondary_path)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
-      options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor),
+      options_(SanitizeOptions(
+          secondary_path.empty() ? dbname : secondary_path,
+          &internal_comparator_, &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
+      secondary_(!secondary_path.empty()),
       db_lock_(NULL),
       shutting_down_(NULL),
       bg_cv_(&mutex_),
-      mem_(NULL),
-      imm_(NULL),
+      default_cf_(NULL),
       logfile_(NULL),
       logfile_number_(0),
       log_(NULL),
       seed_(0),
+      first_recyclable_log_(0),
       tmp_batch_(new WriteBatch),
       bg_compaction_scheduled_(false),
+      bg_stats_dump_scheduled_(false),
+      catching_up_(false),
+      bg_catch_up_scheduled_(false),
+      primary_log_number_(0),
+      primary_max_sequence_(0),
       manual_compaction_(NULL) {
   has_imm_.Release_Store(NULL);
+  next_stats_dump_nanos_.NoBarrier_Store(
+      env_->NowNanos() + options_.stats_dump_period_sec * 1000000000ull);
+  next_catch_up_nanos_.NoBarrier_Store(
+      env_->NowNanos() + options_.secondary_catch_up_period_ms * 1000000ull);
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
   const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
@@ -143,13 +294,18 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
 
   versions_ = new VersionSet(dbname_, &options_, table_cache_,
                              &internal_comparator_);
+
+  default_cf_ = new ColumnFamilyData(dbname_, &internal_comparator_,
+                                     &options_, table_cache_, versions_);
+  column_families_[0] = default_cf_;
 }
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
-  while (bg_compaction_scheduled_) {
+  while (bg_compaction_scheduled_ || bg_stats_dump_scheduled_ ||
+         bg_catch_up_scheduled_) {
     bg_cv_.Wait();
   }
   mutex_.Unlock();
@@ -158,9 +314,12 @@ DBImpl::~DBImpl() {
     env_->UnlockFile(db_lock_);
   }
 
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    delete it->second;
+  }
   delete versions_;
-  if (mem_ != NULL) mem_->Unref();
-  if (imm_ != NULL) imm_->Unref();
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -174,14 +333,15 @@ DBImpl::~DBImpl() {
   }
 }
 
-Status DBImpl::NewDB() {
+Status DBImpl::NewDB(const std::string& dbname, const Comparator* ucmp,
+                     uint64_t log_number) {
   VersionEdit new_db;
-  new_db.SetComparatorName(user_comparator()->Name());
-  new_db.SetLogNumber(0);
-  new_db.SetNextFile(2);
+  new_db.SetComparatorName(ucmp->Name());
+  new_db.SetLogNumber(log_number);
+  new_db.SetNextFile(std::max<uint64_t>(2, log_number + 1));
   new_db.SetLastSequence(0);
 
-  const std::string manifest = DescriptorFileName(dbname_, 1);
+  const std::string manifest = DescriptorFileName(dbname, 1);
   WritableFile* file;
   Status s = env_->NewWritableFile(manifest, &file);
   if (!s.ok()) {
@@ -199,7 +359,7 @@ Status DBImpl::NewDB() {
   delete file;
   if (s.ok()) {
     // Make "CURRENT" file that points to the new manifest file.
-    s = SetCurrentFile(env_, dbname_, 1);
+    s = SetCurrentFile(env_, dbname, 1);
   } else {
     env_->DeleteFile(manifest);
   }
@@ -222,56 +382,205 @@ void DBImpl::DeleteObsoleteFiles() {
     return;
   }
 
-  // Make a set of all of the live files
-  std::set<uint64_t> live = pending_outputs_;
-  versions_->AddLiveFiles(&live);
+  // The logs are shared by all column families, while the other files
+  // are in the directory of the family they belong to.
+  const uint64_t min_log = MinLogNumber();
+  std::vector<uint64_t> obsolete_logs;
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    ColumnFamilyData* cfd = it->second;
 
-  std::vector<std::string> filenames;
-  env_->GetChildren(dbname_, &filenames); // Ignoring errors on purpose
-  uint64_t number;
-  FileType type;
-  for (size_t i = 0; i < filenames.size(); i++) {
-    if (ParseFileName(filenames[i], &number, &type)) {
-      bool keep = true;
-      switch (type) {
-        case kLogFile:
-          keep = ((number >= versions_->LogNumber()) ||
-                  (number == versions_->PrevLogNumber()));
-          break;
-        case kDescriptorFile:
-          // Keep my manifest file, and any newer incarnations'
-          // (in case there is a race that allows other incarnations)
-          keep = (number >= versions_->ManifestFileNumber());
-          break;
-        case kTableFile:
-          keep = (live.find(number) != live.end());
-          break;
-        case kTempFile:
-          // Any temp files that are currently being written to must
-          // be recorded in pending_outputs_, which is inserted into "live"
-          keep = (live.find(number) != live.end());
-          break;
-        case kCurrentFile:
-        case kDBLockFile:
-        case kInfoLogFile:
-          keep = true;
-          break;
-      }
+    // Make a set of all of the live files
+    std::set<uint64_t> live = cfd->pending_outputs;
+    cfd->versions->AddLiveFiles(&live);
+
+    std::vector<std::string> filenames;
+    env_->GetChildren(cfd->dbname, &filenames); // Ignoring errors on purpose
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type)) {
+        bool keep = true;
+        switch (type) {
+          case kLogFile:
+            if (number < min_log && number != versions_->PrevLogNumber()) {
+              obsolete_logs.push_back(number);  // See PurgeObsoleteLogs()
+            }
+            break;
+          case kDescriptorFile:
+            // Keep my manifest file, and any newer incarnations'
+            // (in case there is a race that allows other incarnations)
+            keep = (number >= cfd->versions->ManifestFileNumber());
+            break;
+          case kTableFile:
+            keep = (live.find(number) != live.end());
+            break;
+          case kTempFile:
+            // Any temp files that are currently being written to must
+            // be recorded in pending_outputs, which is inserted into "live"
+            keep = (live.find(number) != live.end());
+            break;
+          case kCurrentFile:
+          case kDBLockFile:
+          case kInfoLogFile:
+          case kColumnFamilyDir:
+          case kIdentityFile:
+            keep = true;
+            break;
+        }
 
-      if (!keep) {
-        if (type == kTableFile) {
-          table_cache_->Evict(number);
+        if (!keep) {
+          if (type == kTableFile) {
+            cfd->table_cache->Evict(number);
+          }
+          Log(options_.info_log, "Delete type=%d #%lld\n",
+              int(type),
+              static_cast<unsigned long long>(number));
+          env_->DeleteFile(cfd->dbname + "/" + filenames[i]);
         }
-        Log(options_.info_log, "Delete type=%d #%lld\n",
-            int(type),
-            static_cast<unsigned long long>(number));
-        env_->DeleteFile(dbname_ + "/" + filenames[i]);
       }
     }
   }
+  PurgeObsoleteLogs(&obsolete_logs);
+}
+
+void DBImpl::PurgeObsoleteLogs(std::vector<uint64_t>* logs) {
+  mutex_.AssertHeld();
+  const bool retain = (options_.wal_ttl_seconds > 0 ||
+                       options_.wal_size_limit_mb > 0);
+  const uint64_t now = env_->NowMicros();
+  const uint64_t ttl_micros = options_.wal_ttl_seconds * 1000000;
+  const uint64_t size_limit = options_.wal_size_limit_mb << 20;
+
+  // Newest first, so that the size limit drops the oldest logs
+  std::sort(logs->begin(), logs->end());
+  std::map<uint64_t, RetainedLog> retained;
+  uint64_t retained_size = 0;
+  for (size_t i = logs->size(); i-- > 0; ) {
+    const uint64_t number = (*logs)[i];
+    const std::string fname = LogFileName(dbname_, number);
+    if (retain &&
+        std::find(logs_to_recycle_.begin(), logs_to_recycle_.end(),
+                  number) == logs_to_recycle_.end()) {
+      RetainedLog log;
+      std::map<uint64_t, RetainedLog>::const_iterator it =
+          retained_logs_.find(number);
+      if (it != retained_logs_.end()) {
+        log = it->second;
+      } else {
+        log.obsolete_micros = now;
+        log.size = 0;
+        env_->GetFileSize(fname, &log.size);  // Ignoring errors on purpose
+      }
+      retained_size += log.size;
+      const bool expired = (ttl_micros > 0 &&
+                            now - log.obsolete_micros >= ttl_micros);
+      const bool over_limit = (size_limit > 0 && retained_size > size_limit);
+      if (!expired && !over_limit) {
+        retained[number] = log;
+        continue;
+      }
+    }
+    if (!KeepLogForRecycling(number)) {
+      Log(options_.info_log, "Delete type=%d #%lld\n",
+          int(kLogFile),
+          static_cast<unsigned long long>(number));
+      env_->DeleteFile(fname);
+    }
+  }
+  retained_logs_.swap(retained);
+}
+
+uint64_t DBImpl::MinLogNumber() const {
+  uint64_t min_log = versions_->LogNumber();
+  for (std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    min_log = std::min(min_log, it->second->versions->LogNumber());
+  }
+  return min_log;
+}
+
+bool DBImpl::KeepLogForRecycling(uint64_t number) {
+  mutex_.AssertHeld();
+  if (std::find(logs_to_recycle_.begin(), logs_to_recycle_.end(), number) !=
+      logs_to_recycle_.end()) {
+    return true;
+  }
+  // Logs from before this DBImpl (or reused by it) may hold records that
+  // cannot be told apart from new ones, so are never recycled.
+  if (first_recyclable_log_ == 0 || number < first_recyclable_log_ ||
+      logs_to_recycle_.size() >= options_.recycle_log_file_num) {
+    return false;
+  }
+  Log(options_.info_log, "Keeping log #%llu for recycling\n",
+      static_cast<unsigned long long>(number));
+  logs_to_recycle_.push_back(number);
+  return true;
+}
+
+MemTable* DBImpl::NewMemTable(const ColumnFamilyData* cfd) const {
+  MemTable* mem = new MemTable(*cfd->icmp, cfd->options->arena_block_size,
+                               cfd->options->memtable_huge_page_size);
+  mem->set_base_sequence(versions_->LastSequence());
+  return mem;
+}
+
+Status DBImpl::LogAndApply(ColumnFamilyData* cfd, VersionEdit* edit) {
+  mutex_.AssertHeld();
+  if (cfd != default_cf_) {
+    // Sequence numbers and log numbers are allocated by the default
+    // family's descriptor; keep this one's counters past them.
+    cfd->versions->SetLastSequence(std::max(cfd->versions->LastSequence(),
+                                            versions_->LastSequence()));
+    cfd->versions->MarkFileNumberUsed(logfile_number_);
+  }
+  return cfd->versions->LogAndApply(edit, &mutex_);
+}
+
+Status DBImpl::NewLogFile(uint64_t number) {
+  mutex_.AssertHeld();
+  const std::string fname = LogFileName(dbname_, number);
+  WritableFile* lfile = NULL;
+  Status s;
+  if (!logs_to_recycle_.empty()) {
+    const uint64_t old_number = logs_to_recycle_.front();
+    logs_to_recycle_.pop_front();
+    s = env_->ReuseWritableFile(fname, LogFileName(dbname_, old_number),
+                                &lfile);
+    Log(options_.info_log, "Recycling log #%llu as #%llu: %s\n",
+        static_cast<unsigned long long>(old_number),
+        static_cast<unsigned long long>(number),
+        s.ToString().c_str());
+  }
+  if (lfile == NULL) {
+    s = env_->NewWritableFile(fname, &lfile);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  // The log grows to about the size of the memtable it backs.  Ignore
+  // errors since this is only a hint.
+  lfile->Preallocate(options_.write_buffer_size +
+                     options_.write_buffer_size / 10);
+
+  const bool recyclable = (options_.recycle_log_file_num > 0);
+  if (recyclable && first_recyclable_log_ == 0) {
+    first_recyclable_log_ = number;
+  }
+  delete log_;
+  delete logfile_;
+  logfile_ = lfile;
+  logfile_number_ = number;
+  log_ = new log::Writer(lfile, 0, number, recyclable,
+                         options_.manual_wal_flush);
+  return s;
 }
 
-Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
+Status DBImpl::Recover(
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    std::map<uint32_t, VersionEdit>* edits, bool *save_manifest) {
   mutex_.AssertHeld();
 
   // Ignore error from CreateDir since the creation of the DB is
@@ -286,7 +595,7 @@ Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
 
   if (!env_->FileExists(CurrentFileName(dbname_))) {
     if (options_.create_if_missing) {
-      s = NewDB();
+      s = NewDB(dbname_, user_comparator(), 0);
       if (!s.ok()) {
         return s;
       }
@@ -301,52 +610,116 @@ Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
     }
   }
 
+  s = SetupIdentity(true);
+  if (!s.ok()) {
+    return s;
+  }
+
+  const uint64_t manifest_start = env_->NowMicros();
   s = versions_->Recover(save_manifest);
   if (!s.ok()) {
     return s;
   }
-  SequenceNumber max_sequence(0);
+  SequenceNumber max_sequence(versions_->LastSequence());
+
+  // Every column family of the DB must be opened, and only those
+  const std::map<uint32_t, std::string>& registered =
+      versions_->column_families();
+  for (size_t i = 0; i < column_families.size(); i++) {
+    bool found = false;
+    for (std::map<uint32_t, std::string>::const_iterator it =
+             registered.begin();
+         it != registered.end(); ++it) {
+      found = found || (it->second == column_families[i].name);
+    }
+    if (!found) {
+      return Status::InvalidArgument(column_families[i].name,
+                                     "column family does not exist");
+    }
+  }
+  for (std::map<uint32_t, std::string>::const_iterator it = registered.begin();
+       s.ok() && it != registered.end(); ++it) {
+    const ColumnFamilyDescriptor* desc = NULL;
+    for (size_t i = 0; i < column_families.size(); i++) {
+      if (column_families[i].name == it->second) {
+        desc = &column_families[i];
+      }
+    }
+    if (desc == NULL) {
+      return Status::InvalidArgument(it->second,
+                                     "column family was not opened");
+    }
+    s = AddColumnFamily(it->first, it->second, desc->options,
+                        false, save_manifest);
+    if (s.ok()) {
+      max_sequence = std::max(
+          max_sequence, column_families_[it->first]->versions->LastSequence());
+    }
+  }
+  open_stats_.manifest_micros = env_->NowMicros() - manifest_start;
+  if (!s.ok()) {
+    return s;
+  }
 
   // Recover from all newer log files than the ones named in the
-  // descriptor (new log files may have been added by the previous
+  // descriptors (new log files may have been added by the previous
   // incarnation without registering them in the descriptor).
   //
   // Note that PrevLogNumber() is no longer used, but we pay
   // attention to it in case we are recovering a database
   // produced by an older version of leveldb.
-  const uint64_t min_log = versions_->LogNumber();
+  const uint64_t min_log = MinLogNumber();
   const uint64_t prev_log = versions_->PrevLogNumber();
-  std::vector<std::string> filenames;
-  s = env_->GetChildren(dbname_, &filenames);
-  if (!s.ok()) {
-    return s;
-  }
-  std::set<uint64_t> expected;
-  versions_->AddLiveFiles(&expected);
-  uint64_t number;
-  FileType type;
   std::vector<uint64_t> logs;
-  for (size_t i = 0; i < filenames.size(); i++) {
-    if (ParseFileName(filenames[i], &number, &type)) {
-      expected.erase(number);
-      if (type == kLogFile && ((number >= min_log) || (number == prev_log)))
-        logs.push_back(number);
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    ColumnFamilyData* cfd = it->second;
+    std::vector<std::string> filenames;
+    s = env_->GetChildren(cfd->dbname, &filenames);
+    if (!s.ok()) {
+      return s;
+    }
+    std::set<uint64_t> expected;
+    cfd->versions->AddLiveFiles(&expected);
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type)) {
+        if (type != kColumnFamilyDir) {
+          expected.erase(number);
+        }
+        if (type == kLogFile && ((number >= min_log) || (number == prev_log)))
+          logs.push_back(number);
+      }
+    }
+    if (!expected.empty()) {
+      char buf[50];
+      snprintf(buf, sizeof(buf), "%d missing files; e.g.",
+               static_cast<int>(expected.size()));
+      return Status::Corruption(buf, TableFileName(cfd->dbname,
+                                                   *(expected.begin())));
     }
-  }
-  if (!expected.empty()) {
-    char buf[50];
-    snprintf(buf, sizeof(buf), "%d missing files; e.g.",
-             static_cast<int>(expected.size()));
-    return Status::Corruption(buf, TableFileName(dbname_, *(expected.begin())));
   }
 
-  // Recover in the order in which the logs were generated
+  // Recover in the order in which the logs were generated.  Later logs
+  // are decoded in the background while earlier ones are applied.
   std::sort(logs.begin(), logs.end());
+  const uint64_t log_start = env_->NowMicros();
+  std::deque<LogToRecover*> pending;
+  size_t next_log = 0;
   for (size_t i = 0; i < logs.size(); i++) {
-    s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest, edit,
+    while (next_log < logs.size() &&
+           next_log < i + kMaxLogsReadAhead) {
+      pending.push_back(StartLogRecovery(logs[next_log++]));
+    }
+    LogToRecover* log = pending.front();
+    pending.pop_front();
+    s = RecoverLogFile(log, (i == logs.size() - 1), save_manifest, edits,
                        &max_sequence);
+    delete log;
     if (!s.ok()) {
-      return s;
+      break;
     }
 
     // The previous incarnation may not have written any MANIFEST
@@ -354,6 +727,14 @@ Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
     // update the file number allocation counter in VersionSet.
     versions_->MarkFileNumberUsed(logs[i]);
   }
+  for (size_t i = 0; i < pending.size(); i++) {
+    delete pending[i];
+  }
+  open_stats_.log_micros = env_->NowMicros() - log_start;
+  open_stats_.log_files = static_cast<int>(logs.size());
+  if (!s.ok()) {
+    return s;
+  }
 
   if (versions_->LastSequence() < max_sequence) {
     versions_->SetLastSequence(max_sequence);
@@ -362,56 +743,119 @@ Status DBImpl::Recover(VersionEdit* edit, bool *save_manifest) {
   return Status::OK();
 }
 
-Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
-                              bool* save_manifest, VersionEdit* edit,
-                              SequenceNumber* max_sequence) {
-  struct LogReporter : public log::Reader::Reporter {
-    Env* env;
-    Logger* info_log;
-    const char* fname;
-    Status* status;  // NULL if options_.paranoid_checks==false
-    virtual void Corruption(size_t bytes, const Status& s) {
-      Log(info_log, "%s%s: dropping %d bytes; %s",
-          (this->status == NULL ? "(ignoring error) " : ""),
-          fname, static_cast<int>(bytes), s.ToString().c_str());
-      if (this->status != NULL && this->status->ok()) *this->status = s;
-    }
-  };
+Status DBImpl::SetupIdentity(bool create) {
+  const std::string fname = IdentityFileName(dbname_);
+  std::string id;
+  Status s;
+  if (create && !env_->FileExists(fname)) {
+    // New, or made by a version that did not write the file
+    s = SetIdentityFile(env_, dbname_, &id);
+  } else {
+    s = ReadFileToString(env_, fname, &id);
+    if (s.ok() && !id.empty() && id[id.size() - 1] == '\n') {
+      id.resize(id.size() - 1);
+    }
+  }
+  if (s.ok() && id.empty()) {
+    s = Status::Corruption(fname, "empty");
+  }
+  if (s.ok()) {
+    db_id_ = id;
+    table_cache_->SetCacheKeyPrefix(CacheKeyPrefix(0));
+  }
+  return s;
+}
+
+std::string DBImpl::CacheKeyPrefix(uint32_t family_id) const {
+  std::string prefix = db_id_;
+  PutFixed32(&prefix, family_id);
+  return prefix;
+}
+
+Status DBImpl::AddColumnFamily(uint32_t id, const std::string& name,
+                               const Options& options, bool create,
+                               bool* save_manifest) {
+  mutex_.AssertHeld();
+  const std::string dir = ColumnFamilyDirName(dbname_, id);
+  const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
+  ColumnFamilyData* cfd = new ColumnFamilyData(id, name, dir, options_,
+                                               options, table_cache_size);
+  if (!db_id_.empty()) {
+    cfd->table_cache->SetCacheKeyPrefix(CacheKeyPrefix(id));
+  }
+  Status s;
+  if (create) {
+    // Remove what a failed earlier attempt may have left behind
+    DestroyDB(dir, options_);
+    env_->CreateDir(dir);
+    s = NewDB(dir, cfd->user_comparator(), logfile_number_);
+  }
+  if (s.ok()) {
+    s = cfd->versions->Recover(save_manifest);
+  }
+  if (s.ok()) {
+    column_families_[id] = cfd;
+  } else {
+    delete cfd;
+  }
+  return s;
+}
+
+DBImpl::LogToRecover* DBImpl::StartLogRecovery(uint64_t log_number) {
+  LogToRecover* log = new LogToRecover;
+  log->number = log_number;
+  log->fname = LogFileName(dbname_, log_number);
+  log->status = env_->NewSequentialFile(log->fname, &log->file);
+  if (log->status.ok()) {
+    log->reporter.env = env_;
+    log->reporter.info_log = options_.info_log;
+    log->reporter.fname = log->fname.c_str();
+    log->reporter.status = NULL;  // The reader reports via its status()
+    // We intentionally make log::Reader do checksumming even if
+    // paranoid_checks==false so that corruptions cause entire commits
+    // to be skipped instead of propagating bad information (like overly
+    // large sequence numbers).
+    log->reader = new log::BackgroundReader(
+        log->file, &log->reporter, true/*checksum*/,
+        options_.paranoid_checks/*stop_on_corruption*/,
+        kLogReadBufferBytes, log_number);
+    log->reader->Start(env_);
+  }
+  return log;
+}
 
+Status DBImpl::RecoverLogFile(LogToRecover* log, bool last_log,
+                              bool* save_manifest,
+                              std::map<uint32_t, VersionEdit>* edits,
+                              SequenceNumber* max_sequence) {
   mutex_.AssertHeld();
 
-  // Open the log file
-  std::string fname = LogFileName(dbname_, log_number);
-  SequentialFile* file;
-  Status status = env_->NewSequentialFile(fname, &file);
+  const uint64_t log_number = log->number;
+  const std::string& fname = log->fname;
+  Status status = log->status;
   if (!status.ok()) {
     MaybeIgnoreError(&status);
     return status;
   }
 
-  // Create the log reader.
+  // Reports corruptions found while applying records.
   LogReporter reporter;
   reporter.env = env_;
   reporter.info_log = options_.info_log;
   reporter.fname = fname.c_str();
   reporter.status = (options_.paranoid_checks ? &status : NULL);
-  // We intentionally make log::Reader do checksumming even if
-  // paranoid_checks==false so that corruptions cause entire commits
-  // to be skipped instead of propagating bad information (like overly
-  // large sequence numbers).
-  log::Reader reader(file, &reporter, true/*checksum*/,
-                     0/*initial_offset*/);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long) log_number);
 
-  // Read all the records and add to a memtable
-  std::string scratch;
-  Slice record;
+  // Read all the records and add to a memtable per column family
+  std::string record;
   WriteBatch batch;
   int compactions = 0;
-  MemTable* mem = NULL;
-  while (reader.ReadRecord(&record, &scratch) &&
-         status.ok()) {
+  RecoveryMemTables memtables(this, log_number);
+  std::map<uint32_t, MemTable*>* mems = memtables.mems();
+  while (status.ok() && log->reader->ReadRecord(&record)) {
+    open_stats_.log_records++;
+    open_stats_.log_bytes += record.size();
     if (record.size() < 12) {
       reporter.Corruption(
           record.size(), Status::Corruption("log record too small", fname));
@@ -419,11 +863,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     }
     WriteBatchInternal::SetContents(&batch, record);
 
-    if (mem == NULL) {
-      mem = new MemTable(internal_comparator_);
-      mem->Ref();
-    }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
+    status = WriteBatchInternal::InsertInto(&batch, &memtables);
     MaybeIgnoreError(&status);
     if (!status.ok()) {
       break;
@@ -435,71 +875,107 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
       *max_sequence = last_seq;
     }
 
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      compactions++;
-      *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, NULL);
-      mem->Unref();
-      mem = NULL;
-      if (!status.ok()) {
+    for (std::map<uint32_t, MemTable*>::iterator it = mems->begin();
+         status.ok() && it != mems->end(); ++it) {
+      ColumnFamilyData* cfd = column_families_[it->first];
+      MemTable* mem = it->second;
+      if (mem != NULL &&
+          mem->ApproximateMemoryUsage() > cfd->options->write_buffer_size) {
+        compactions++;
+        *save_manifest = true;
+        const uint64_t flush_start = env_->NowMicros();
         // Reflect errors immediately so that conditions like full
         // file-systems cause the DB::Open() to fail.
-        break;
+        status = WriteLevel0Table(cfd, mem, &(*edits)[it->first], NULL);
+        open_stats_.flush_micros += env_->NowMicros() - flush_start;
+        mem->Unref();
+        it->second = NULL;
       }
     }
   }
 
-  delete file;
-
-  // See if we should keep reusing the last log file.
+  if (status.ok()) {
+    // Picks up corruptions if paranoid_checks is set.
+    status = log->reader->status();
+  }
+  const uint64_t end_offset = log->reader->LastRecordEndOffset();
+  delete log->reader;
+  log->reader = NULL;
+  delete log->file;
+  log->file = NULL;
+
+  // See if we should keep reusing the last log file.  Only a log that
+  // ended cleanly can be appended to: after damage, or the leftovers of
+  // an earlier use of a recycled file, new records would not be read.
   if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
     assert(logfile_ == NULL);
     assert(log_ == NULL);
-    assert(mem_ == NULL);
     uint64_t lfile_size;
     if (env_->GetFileSize(fname, &lfile_size).ok() &&
+        lfile_size == end_offset &&
         env_->NewAppendableFile(fname, &logfile_).ok()) {
       Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
-      log_ = new log::Writer(logfile_, lfile_size);
+      log_ = new log::Writer(logfile_, lfile_size, log_number,
+                             options_.recycle_log_file_num > 0,
+                             options_.manual_wal_flush);
       logfile_number_ = log_number;
-      if (mem != NULL) {
-        mem_ = mem;
+      for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+               column_families_.begin();
+           it != column_families_.end(); ++it) {
+        ColumnFamilyData* cfd = it->second;
+        assert(cfd->mem == NULL);
+        // The memtable can be missing if the log holds nothing for cfd.
+        MemTable*& mem = (*mems)[it->first];
+        if (mem == NULL) {
+          mem = NewMemTable(cfd);
+          mem->Ref();
+        }
+        cfd->mem = mem;
+        cfd->mem_log_number = log_number;
         mem = NULL;
-      } else {
-        // mem can be NULL if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
-        mem_->Ref();
       }
     }
   }
 
-  if (mem != NULL) {
-    // mem did not get reused; compact it.
-    if (status.ok()) {
+  for (std::map<uint32_t, MemTable*>::iterator it = mems->begin();
+       status.ok() && it != mems->end(); ++it) {
+    if (it->second != NULL) {
+      // The memtable did not get reused; compact it.
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, NULL);
+      const uint64_t flush_start = env_->NowMicros();
+      status = WriteLevel0Table(column_families_[it->first], it->second,
+                                &(*edits)[it->first], NULL);
+      open_stats_.flush_micros += env_->NowMicros() - flush_start;
     }
-    mem->Unref();
   }
 
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+Status DBImpl::WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                                VersionEdit* edit, Version* base) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
-  meta.number = versions_->NewFileNumber();
-  pending_outputs_.insert(meta.number);
+  meta.number = cfd->versions->NewFileNumber();
+  cfd->pending_outputs.insert(meta.number);
   Iterator* iter = mem->NewIterator();
-  Log(options_.info_log, "Level-0 table #%llu: started",
-      (unsigned long long) meta.number);
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+  Log(options_.info_log, "Level-0 table #%llu: started (%s)",
+      (unsigned long long) meta.number, cfd->name.c_str());
+
+  FlushJobInfo info;
+  info.db_name = dbname_;
+  info.file_number = meta.number;
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    if (options_.listener != NULL) {
+      options_.listener->OnFlushBegin(info);
+    }
+    s = BuildTable(cfd->dbname, env_, *cfd->options, cfd->table_cache, iter,
+                   range_del_iter, &meta);
     mutex_.Lock();
   }
 
@@ -508,8 +984,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
-
+  delete range_del_iter;
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -520,26 +995,39 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     if (base != NULL) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size,
-                  meta.smallest, meta.largest);
+    edit->AddFile(level, meta);
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
-  stats_[level].Add(stats);
+  cfd->stats[level].Add(stats);
+
+  if (options_.listener != NULL) {
+    info.level = level;
+    info.file_size = meta.file_size;
+    info.micros = stats.micros;
+    info.status = s;
+    mutex_.Unlock();
+    options_.listener->OnFlushCompleted(info);
+    mutex_.Lock();
+  }
+
+  // Only now, since the listener ran without the lock and the file must
+  // not look obsolete in the meantime.
+  cfd->pending_outputs.erase(meta.number);
   return s;
 }
 
-void DBImpl::CompactMemTable() {
+void DBImpl::CompactMemTable(ColumnFamilyData* cfd) {
   mutex_.AssertHeld();
-  assert(imm_ != NULL);
+  assert(cfd->imm != NULL);
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
-  Version* base = versions_->current();
+  Version* base = cfd->versions->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  Status s = WriteLevel0Table(cfd, cfd->imm, &edit, base);
   base->Unref();
 
   if (s.ok() && shutting_down_.Acquire_Load()) {
@@ -549,15 +1037,23 @@ void DBImpl::CompactMemTable() {
   // Replace immutable memtable with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    // Earlier logs are no longer needed by this column family
+    edit.SetLogNumber(cfd->mem_log_number);
+    s = LogAndApply(cfd, &edit);
   }
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = NULL;
+    cfd->imm->Unref();
+    cfd->imm = NULL;
     has_imm_.Release_Store(NULL);
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      if (it->second->imm != NULL) {
+        has_imm_.Release_Store(it->second->imm);
+      }
+    }
     DeleteObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -565,29 +1061,47 @@ void DBImpl::CompactMemTable() {
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
+  CompactRange(default_cf_, begin, end);
+}
+
+void DBImpl::CompactRange(ColumnFamilyHandle* column_family,
+                          const Slice* begin, const Slice* end) {
+  if (secondary_) {
+    return;
+  }
+  ColumnFamilyData* cfd = reinterpret_cast<ColumnFamilyData*>(column_family);
+  // TODO(sanjay): Skip if memtable does not overlap
+  TEST_CompactMemTable(cfd);
   int max_level_with_files = 1;
   {
     MutexLock l(&mutex_);
-    Version* base = versions_->current();
+    Version* base = cfd->versions->current();
     for (int level = 1; level < config::kNumLevels; level++) {
       if (base->OverlapInLevel(level, begin, end)) {
         max_level_with_files = level;
       }
     }
   }
-  TEST_CompactMemTable(); // TODO(sanjay): Skip if memtable does not overlap
+  if (cfd->options->compaction_filter != NULL &&
+      max_level_with_files + 1 < config::kNumLevels) {
+    // Also rewrite the last level so that the filter sees every value
+    max_level_with_files++;
+  }
   for (int level = 0; level < max_level_with_files; level++) {
-    TEST_CompactRange(level, begin, end);
+    TEST_CompactRange(level, begin, end, cfd);
   }
 }
 
-void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
+void DBImpl::TEST_CompactRange(int level, const Slice* begin, const Slice* end,
+                               ColumnFamilyHandle* column_family) {
   assert(level >= 0);
   assert(level + 1 < config::kNumLevels);
 
   InternalKey begin_storage, end_storage;
 
   ManualCompaction manual;
+  manual.cfd = (column_family != NULL)
+      ? reinterpret_cast<ColumnFamilyData*>(column_family) : default_cf_;
   manual.level = level;
   manual.done = false;
   if (begin == NULL) {
@@ -618,16 +1132,18 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
   }
 }
 
-Status DBImpl::TEST_CompactMemTable() {
+Status DBImpl::TEST_CompactMemTable(ColumnFamilyHandle* column_family) {
+  ColumnFamilyData* cfd = (column_family != NULL)
+      ? reinterpret_cast<ColumnFamilyData*>(column_family) : default_cf_;
   // NULL batch means just wait for earlier writes to be done
-  Status s = Write(WriteOptions(), NULL);
+  Status s = WriteImpl(WriteOptions(), NULL, cfd);
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != NULL && bg_error_.ok()) {
+    while (cfd->imm != NULL && bg_error_.ok()) {
       bg_cv_.Wait();
     }
-    if (imm_ != NULL) {
+    if (cfd->imm != NULL) {
       s = bg_error_;
     }
   }
@@ -642,98 +1158,375 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
-void DBImpl::MaybeScheduleCompaction() {
+void DBImpl::RecordLatency(LatencyOp op, uint64_t start_nanos) {
+  const uint64_t now = env_->NowNanos();
+  latency_[op].Add(now > start_nanos ? now - start_nanos : 0);
+  if (options_.stats_dump_period_sec > 0 &&
+      now >= next_stats_dump_nanos_.NoBarrier_Load()) {
+    MutexLock l(&mutex_);
+    MaybeScheduleStatsDump(now);
+  }
+  if (secondary_ && options_.secondary_catch_up_period_ms > 0 &&
+      now >= next_catch_up_nanos_.NoBarrier_Load()) {
+    MutexLock l(&mutex_);
+    MaybeScheduleCatchUp(now);
+  }
+}
+
+void DBImpl::MaybeScheduleStatsDump(uint64_t now_nanos) {
   mutex_.AssertHeld();
-  if (bg_compaction_scheduled_) {
+  if (bg_stats_dump_scheduled_) {
     // Already scheduled
   } else if (shutting_down_.Acquire_Load()) {
-    // DB is being deleted; no more background compactions
-  } else if (!bg_error_.ok()) {
-    // Already got an error; no more changes
-  } else if (imm_ == NULL &&
-             manual_compaction_ == NULL &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
+    // DB is being deleted
+  } else if (now_nanos < next_stats_dump_nanos_.NoBarrier_Load()) {
+    // Another thread got here first
   } else {
-    bg_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    next_stats_dump_nanos_.NoBarrier_Store(
+        now_nanos + options_.stats_dump_period_sec * 1000000000ull);
+    bg_stats_dump_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGStatsDump, this);
   }
 }
 
-void DBImpl::BGWork(void* db) {
-  reinterpret_cast<DBImpl*>(db)->BackgroundCall();
+void DBImpl::BGStatsDump(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundStatsDump();
 }
 
-void DBImpl::BackgroundCall() {
+void DBImpl::BackgroundStatsDump() {
+  if (!shutting_down_.Acquire_Load()) {
+    std::string stats, perf;
+    GetProperty("leveldb.stats", &stats);
+    GetProperty("leveldb.perf", &perf);
+    stats.append(perf);
+    if (options_.stats_dump_callback != NULL) {
+      (*options_.stats_dump_callback)(options_.stats_dump_arg, stats);
+    } else {
+      Log(options_.info_log, "Stats:\n%s", stats.c_str());
+    }
+  }
+
   MutexLock l(&mutex_);
-  assert(bg_compaction_scheduled_);
-  if (shutting_down_.Acquire_Load()) {
-    // No more background work when shutting down.
-  } else if (!bg_error_.ok()) {
-    // No more background work after a background error.
-  } else {
-    BackgroundCompaction();
+  assert(bg_stats_dump_scheduled_);
+  bg_stats_dump_scheduled_ = false;
+  bg_cv_.SignalAll();
+}
+
+Status DBImpl::TryCatchUpWithPrimary() {
+  if (!secondary_) {
+    return Status::NotSupported("not a secondary instance");
   }
+  MutexLock l(&mutex_);
+  return CatchUpWithPrimary();
+}
 
-  bg_compaction_scheduled_ = false;
+Status DBImpl::CatchUpWithPrimary() {
+  mutex_.AssertHeld();
+  assert(secondary_);
+  while (catching_up_) {
+    bg_cv_.Wait();
+  }
+  catching_up_ = true;
+
+  // Once the primary has flushed a log and recorded that in its
+  // descriptor, it may delete the log at any time.  So read the
+  // descriptor again after the logs: if it has changed, a log may have
+  // been missed or failed to open, and the logs are read again for the
+  // new descriptor.
+  bool changed;
+  Status s = versions_->CatchUpWithPrimary(&mutex_, &changed);
+  for (int attempt = 0; s.ok() && attempt < kMaxCatchUpAttempts;
+       attempt++) {
+    Status logs = CatchUpWithLogs();
+    s = versions_->CatchUpWithPrimary(&mutex_, &changed);
+    if (s.ok() && !changed) {
+      s = logs;
+      break;
+    }
+  }
 
-  // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  catching_up_ = false;
   bg_cv_.SignalAll();
+  return s;
 }
 
-void DBImpl::BackgroundCompaction() {
+Status DBImpl::CatchUpWithLogs() {
   mutex_.AssertHeld();
-
-  if (imm_ != NULL) {
-    CompactMemTable();
-    return;
+  const uint64_t log_number = versions_->LogNumber();
+  MemTable* mem = default_cf_->mem;
+  std::map<uint64_t, uint64_t> offsets;
+  SequenceNumber max_sequence = 0;
+  const bool fresh = (mem == NULL || log_number != primary_log_number_);
+  if (fresh) {
+    // The records of the older logs are in the tables of the version
+    mem = NewMemTable(default_cf_);
+  } else {
+    // No other thread adds to the memtable while catching_up_ is set
+    offsets = primary_log_offsets_;
+    max_sequence = primary_max_sequence_;
   }
+  mem->Ref();
+  mutex_.Unlock();
 
-  Compaction* c;
-  bool is_manual = (manual_compaction_ != NULL);
-  InternalKey manual_end;
-  if (is_manual) {
-    ManualCompaction* m = manual_compaction_;
-    c = versions_->CompactRange(m->level, m->begin, m->end);
-    m->done = (c == NULL);
-    if (c != NULL) {
-      manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
+  std::vector<std::string> filenames;
+  Status s = env_->GetChildren(dbname_, &filenames);
+  std::vector<uint64_t> logs;
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) &&
+        type == kLogFile && number >= log_number) {
+      logs.push_back(number);
     }
-    Log(options_.info_log,
-        "Manual compaction at level-%d from %s .. %s; will stop at %s\n",
-        m->level,
-        (m->begin ? m->begin->DebugString().c_str() : "(begin)"),
-        (m->end ? m->end->DebugString().c_str() : "(end)"),
-        (m->done ? "(end)" : manual_end.DebugString().c_str()));
-  } else {
-    c = versions_->PickCompaction();
+  }
+  std::sort(logs.begin(), logs.end());
+  for (size_t i = 0; s.ok() && i < logs.size(); i++) {
+    s = ReadPrimaryLog(logs[i], mem, &offsets[logs[i]], &max_sequence);
   }
 
-  Status status;
-  if (c == NULL) {
-    // Nothing to do
+  mutex_.Lock();
+  if (s.ok()) {
+    if (fresh) {
+      if (default_cf_->mem != NULL) {
+        default_cf_->mem->Unref();
+      }
+      default_cf_->mem = mem;
+      default_cf_->mem_log_number = log_number;
+      mem->Ref();
+    }
+    primary_log_number_ = log_number;
+    primary_log_offsets_.swap(offsets);
+    primary_max_sequence_ = max_sequence;
+    if (versions_->LastSequence() < max_sequence) {
+      versions_->SetLastSequence(max_sequence);
+    }
+  }
+  mem->Unref();
+  return s;
+}
+
+Status DBImpl::ReadPrimaryLog(uint64_t number, MemTable* mem,
+                              uint64_t* offset, SequenceNumber* max_sequence) {
+  const std::string fname = LogFileName(dbname_, number);
+  SequentialFile* file;
+  Status s = env_->NewSequentialFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  LogReporter reporter;
+  reporter.env = env_;
+  reporter.info_log = options_.info_log;
+  reporter.fname = fname.c_str();
+  reporter.status = NULL;
+
+  // Start again at the last record read, which the primary may have
+  // been in the middle of writing, and skip the batches already added.
+  log::Reader reader(file, &reporter, true/*checksum*/, *offset, number);
+  Slice record;
+  std::string scratch;
+  WriteBatch batch;
+  while (reader.ReadRecord(&record, &scratch)) {
+    if (record.size() < 12) {
+      reporter.Corruption(
+          record.size(), Status::Corruption("log record too small", fname));
+      continue;
+    }
+    *offset = reader.LastRecordOffset();
+    WriteBatchInternal::SetContents(&batch, record);
+    const SequenceNumber last_seq =
+        WriteBatchInternal::Sequence(&batch) +
+        WriteBatchInternal::Count(&batch) - 1;
+    if (last_seq <= *max_sequence) {
+      continue;
+    }
+    // The records of other column families are skipped
+    s = WriteBatchInternal::InsertInto(&batch, mem);
+    if (!s.ok()) {
+      break;
+    }
+    *max_sequence = last_seq;
+  }
+  delete file;
+  return s;
+}
+
+void DBImpl::MaybeScheduleCatchUp(uint64_t now_nanos) {
+  mutex_.AssertHeld();
+  if (bg_catch_up_scheduled_) {
+    // Already scheduled
+  } else if (shutting_down_.Acquire_Load()) {
+    // DB is being deleted
+  } else if (now_nanos < next_catch_up_nanos_.NoBarrier_Load()) {
+    // Another thread got here first
+  } else {
+    next_catch_up_nanos_.NoBarrier_Store(
+        now_nanos + options_.secondary_catch_up_period_ms * 1000000ull);
+    bg_catch_up_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGCatchUp, this);
+  }
+}
+
+void DBImpl::BGCatchUp(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundCatchUp();
+}
+
+void DBImpl::BackgroundCatchUp() {
+  MutexLock l(&mutex_);
+  assert(bg_catch_up_scheduled_);
+  if (!shutting_down_.Acquire_Load()) {
+    Status s = CatchUpWithPrimary();
+    if (!s.ok()) {
+      Log(options_.info_log, "Catching up with primary: %s",
+          s.ToString().c_str());
+    }
+  }
+  bg_catch_up_scheduled_ = false;
+  bg_cv_.SignalAll();
+}
+
+void DBImpl::MaybeScheduleCompaction() {
+  mutex_.AssertHeld();
+  if (bg_compaction_scheduled_) {
+    // Already scheduled
+  } else if (shutting_down_.Acquire_Load()) {
+    // DB is being deleted; no more background compactions
+  } else if (!bg_error_.ok()) {
+    // Already got an error; no more changes
+  } else if (secondary_) {
+    // Only the primary changes the files
+  } else {
+    bool needed = (manual_compaction_ != NULL);
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             column_families_.begin();
+         !needed && it != column_families_.end(); ++it) {
+      needed = (it->second->imm != NULL ||
+                it->second->versions->NeedsCompaction());
+    }
+    if (needed) {
+      bg_compaction_scheduled_ = true;
+      env_->Schedule(&DBImpl::BGWork, this);
+    }
+  }
+}
+
+void DBImpl::BGWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundCall();
+}
+
+void DBImpl::BackgroundCall() {
+  MutexLock l(&mutex_);
+  assert(bg_compaction_scheduled_);
+  if (shutting_down_.Acquire_Load()) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else {
+    BackgroundCompaction();
+  }
+
+  bg_compaction_scheduled_ = false;
+
+  // Previous compaction may have produced too many files in a level,
+  // so reschedule another compaction if needed.
+  MaybeScheduleCompaction();
+  bg_cv_.SignalAll();
+}
+
+// Fill in the fields of "*info" that are known before "c" is run.
+static void StartCompactionJobInfo(const std::string& dbname, Compaction* c,
+                                   bool is_manual, CompactionJobInfo* info) {
+  info->db_name = dbname;
+  info->level = c->level();
+  info->is_manual = is_manual;
+  for (int i = 0; i < c->num_input_files(0); i++) {
+    info->input_files.push_back(c->input(0, i)->number);
+  }
+  for (int i = 0; i < c->num_input_files(1); i++) {
+    info->input_files_next_level.push_back(c->input(1, i)->number);
+  }
+}
+
+void DBImpl::BackgroundCompaction() {
+  mutex_.AssertHeld();
+
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    if (it->second->imm != NULL) {
+      CompactMemTable(it->second);
+      return;
+    }
+  }
+
+  Compaction* c = NULL;
+  ColumnFamilyData* cfd = default_cf_;
+  bool is_manual = (manual_compaction_ != NULL);
+  InternalKey manual_end;
+  if (is_manual) {
+    ManualCompaction* m = manual_compaction_;
+    cfd = m->cfd;
+    c = cfd->versions->CompactRange(m->level, m->begin, m->end);
+    m->done = (c == NULL);
+    if (c != NULL) {
+      manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
+    }
+    Log(options_.info_log,
+        "Manual compaction at level-%d from %s .. %s; will stop at %s\n",
+        m->level,
+        (m->begin ? m->begin->DebugString().c_str() : "(begin)"),
+        (m->end ? m->end->DebugString().c_str() : "(end)"),
+        (m->done ? "(end)" : manual_end.DebugString().c_str()));
+  } else {
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      if (it->second->versions->NeedsCompaction()) {
+        cfd = it->second;
+        c = cfd->versions->PickCompaction();
+        break;
+      }
+    }
+  }
+
+  Status status;
+  if (c == NULL) {
+    // Nothing to do
   } else if (!is_manual && c->IsTrivialMove()) {
     // Move file to next level
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
+    CompactionJobInfo info;
+    if (options_.listener != NULL) {
+      StartCompactionJobInfo(dbname_, c, is_manual, &info);
+      info.is_trivial_move = true;
+      mutex_.Unlock();
+      options_.listener->OnCompactionBegin(info);
+      mutex_.Lock();
+    }
+    const uint64_t start_micros = env_->NowMicros();
     c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    c->edit()->AddFile(c->level() + 1, *f);
+    status = LogAndApply(cfd, c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
+    if (options_.listener != NULL) {
+      info.output_files.push_back(f->number);
+      info.micros = env_->NowMicros() - start_micros;
+      info.status = status;
+      mutex_.Unlock();
+      options_.listener->OnCompactionCompleted(info);
+      mutex_.Lock();
+    }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
         static_cast<unsigned long long>(f->number),
         c->level() + 1,
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(),
-        versions_->LevelSummary(&tmp));
+        cfd->versions->LevelSummary(&tmp));
   } else {
-    CompactionState* compact = new CompactionState(c);
+    CompactionState* compact = new CompactionState(c, cfd);
     status = DoCompactionWork(compact);
     if (!status.ok()) {
       RecordBackgroundError(status);
@@ -780,38 +1573,254 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
   delete compact->outfile;
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    pending_outputs_.erase(out.number);
+    compact->cfd->pending_outputs.erase(out.number);
   }
   delete compact;
 }
 
+Status DBImpl::PrepareCompactionTombstones(CompactionState* compact,
+                                           RangeTombstoneList* tombstones) {
+  Compaction* c = compact->compaction;
+  Status s;
+  for (int i = 0; s.ok() && i < c->num_input_files(0); i++) {
+    const FileMetaData* f = c->input(0, i);
+    if (f->has_range_deletions) {
+      s = compact->cfd->table_cache->AddRangeTombstones(f->number,
+                                                        f->file_size,
+                                                        tombstones);
+    }
+  }
+  tombstones->Finish();
+
+  // Files at level+1 are older than the deletions at level, so one whose
+  // whole key range is deleted for every snapshot holds nothing visible
+  // and need not be read at all.
+  for (int i = 0; s.ok() && !tombstones->empty() &&
+                  i < c->num_input_files(1); ) {
+    const FileMetaData* f = c->input(1, i);
+    // A largest key at kMaxSequenceNumber is the exclusive end of one of
+    // the file's own range deletions.
+    ParsedInternalKey largest;
+    const bool end_exclusive =
+        ParseInternalKey(f->largest.Encode(), &largest) &&
+        largest.sequence == kMaxSequenceNumber;
+    if (tombstones->Covers(f->smallest.user_key(), f->largest.user_key(),
+                           end_exclusive, compact->smallest_snapshot)) {
+      Log(options_.info_log, "Dropping #%llu@%d: covered by range deletions",
+          static_cast<unsigned long long>(f->number), c->level() + 1);
+      c->DropInput(i);
+    } else {
+      i++;
+    }
+  }
+  for (int i = 0; s.ok() && i < c->num_input_files(1); i++) {
+    const FileMetaData* f = c->input(1, i);
+    if (f->has_range_deletions) {
+      s = compact->cfd->table_cache->AddRangeTombstones(f->number,
+                                                        f->file_size,
+                                                        tombstones);
+    }
+  }
+  tombstones->Finish();
+
+  // As for point entries, only the newest deletion visible to the oldest
+  // snapshot matters, and not even that one once nothing older can exist.
+  const std::vector<RangeTombstoneList::Fragment>& fragments =
+      tombstones->fragments();
+  for (size_t i = 0; s.ok() && i < fragments.size(); i++) {
+    const RangeTombstoneList::Fragment& f = fragments[i];
+    RangeTombstoneList::Fragment kept;
+    for (size_t j = 0; j < f.seqs.size(); j++) {
+      if (f.seqs[j] <= compact->smallest_snapshot) {
+        if (!c->IsBaseLevelForRange(f.begin, f.end)) {
+          kept.seqs.push_back(f.seqs[j]);
+        }
+        break;
+      }
+      kept.seqs.push_back(f.seqs[j]);
+    }
+    if (!kept.seqs.empty()) {
+      kept.begin = f.begin;
+      kept.end = f.end;
+      compact->tombstones.push_back(kept);
+    }
+  }
+  return s;
+}
+
 Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   assert(compact != NULL);
   assert(compact->builder == NULL);
   uint64_t file_number;
   {
     mutex_.Lock();
-    file_number = versions_->NewFileNumber();
-    pending_outputs_.insert(file_number);
+    file_number = compact->cfd->versions->NewFileNumber();
+    compact->cfd->pending_outputs.insert(file_number);
     CompactionState::Output out;
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_deletions = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
 
   // Make the output file
-  std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  const Options& options = *compact->cfd->options;
+  std::string fname = TableFileName(compact->cfd->dbname, file_number);
+  Status s = NewTableOutputFile(env_, options, fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder =
+        GetTableFactory(options)->NewTableWriter(options, compact->outfile);
   }
   return s;
 }
 
+Status DBImpl::AddToCompactionOutput(CompactionState* compact,
+                                     const Slice& key, const Slice& value) {
+  if (compact->builder == NULL) {
+    Status s = OpenCompactionOutputFile(compact);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+  compact->builder->Add(key, value);
+  return Status::OK();
+}
+
+Status DBImpl::CombinePendingMerge(CompactionState* compact,
+                                   const ParsedInternalKey& ikey,
+                                   const Slice& value, bool deleted) {
+  assert(compact->has_pending_merge);
+  if (ikey.type == kTypeMerge && !deleted) {
+    // Merge operands are associative: combine the two into one
+    std::string merged;
+    const MergeOperator* merge_operator = compact->cfd->options->merge_operator;
+    if (!merge_operator->Merge(ikey.user_key, &value,
+                               compact->pending_merge_value, &merged)) {
+      return Status::Corruption("merge operator failed for ", ikey.user_key);
+    }
+    compact->pending_merge_value.swap(merged);
+    return Status::OK();
+  }
+  // A value or deletion is what the operands apply to
+  return WritePendingMergeAsValue(
+      compact, (ikey.type == kTypeValue && !deleted) ? &value : NULL);
+}
+
+Status DBImpl::FlushPendingMerge(CompactionState* compact) {
+  if (!compact->has_pending_merge) {
+    return Status::OK();
+  }
+  const Slice user_key = ExtractUserKey(compact->pending_merge_key);
+  if (compact->compaction->IsBaseLevelForKey(user_key)) {
+    // No older entries for the key exist anywhere
+    return WritePendingMergeAsValue(compact, NULL);
+  }
+  compact->has_pending_merge = false;
+  return AddToCompactionOutput(compact, compact->pending_merge_key,
+                               compact->pending_merge_value);
+}
+
+Status DBImpl::WritePendingMergeAsValue(CompactionState* compact,
+                                        const Slice* base) {
+  assert(compact->has_pending_merge);
+  compact->has_pending_merge = false;
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(compact->pending_merge_key, &ikey)) {
+    return Status::Corruption("bad merge operand key");
+  }
+  std::string value;
+  const MergeOperator* merge_operator = compact->cfd->options->merge_operator;
+  if (!merge_operator->Merge(ikey.user_key, base,
+                             compact->pending_merge_value, &value)) {
+    return Status::Corruption("merge operator failed for ", ikey.user_key);
+  }
+  std::string key;
+  AppendInternalKey(&key, ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                            kTypeValue));
+  return AddToCompactionOutput(compact, key, value);
+}
+
+Status DBImpl::FilterCompactionValue(CompactionState* compact,
+                                     const ParsedInternalKey& ikey,
+                                     const Slice& value) {
+  const CompactionFilter* filter = compact->cfd->options->compaction_filter;
+  std::string new_value;
+  bool value_changed = false;
+  if (filter->Filter(compact->compaction->level(), ikey.user_key, value,
+                     &new_value, &value_changed)) {
+    compact->filtered_entries++;
+    if (compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+      // No older entries for the key exist anywhere
+      return Status::OK();
+    }
+    // Keep hiding the older entries in deeper levels
+    std::string key;
+    AppendInternalKey(&key, ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                              kTypeDeletion));
+    return AddToCompactionOutput(compact, key, Slice());
+  }
+  std::string key;
+  AppendInternalKey(&key, ikey);
+  return AddToCompactionOutput(compact, key,
+                               value_changed ? Slice(new_value) : value);
+}
+
+void DBImpl::AddCompactionTombstones(CompactionState* compact,
+                                     const Slice* upper) {
+  const InternalKeyComparator* icmp = compact->cfd->icmp;
+  const Comparator* ucmp = icmp->user_comparator();
+  CompactionState::Output* out = compact->current_output();
+  TableWriter* builder = compact->builder;
+  bool has_bounds = (builder->NumEntries() > 0);
+  while (compact->next_tombstone < compact->tombstones.size()) {
+    const RangeTombstoneList::Fragment& f =
+        compact->tombstones[compact->next_tombstone];
+    if (upper != NULL && ucmp->Compare(f.begin, *upper) >= 0) {
+      break;  // Belongs to a later output
+    }
+    Slice begin = f.begin;
+    if (compact->has_output_lower &&
+        ucmp->Compare(begin, compact->output_lower) < 0) {
+      begin = compact->output_lower;
+    }
+    const bool continues = (upper != NULL && ucmp->Compare(f.end, *upper) > 0);
+    Slice end = continues ? *upper : Slice(f.end);
+
+    InternalKey largest(end, kMaxSequenceNumber, kValueTypeForSeek);
+    for (size_t i = 0; i < f.seqs.size(); i++) {
+      InternalKey key(begin, f.seqs[i], kTypeRangeDeletion);
+      builder->AddRangeTombstone(key.Encode(), end);
+      if (!has_bounds ||
+          icmp->Compare(key, out->smallest) < 0) {
+        out->smallest = key;
+      }
+      if (!has_bounds ||
+          icmp->Compare(largest, out->largest) > 0) {
+        out->largest = largest;
+      }
+      has_bounds = true;
+    }
+    out->has_range_deletions = true;
+    if (continues) {
+      break;  // The rest goes to the next output
+    }
+    compact->next_tombstone++;
+  }
+  if (upper != NULL) {
+    compact->has_output_lower = true;
+    compact->output_lower.assign(upper->data(), upper->size());
+  }
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* next_user_key) {
   assert(compact != NULL);
   assert(compact->outfile != NULL);
   assert(compact->builder != NULL);
@@ -821,7 +1830,11 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   // Check for iterator errors
   Status s = input->status();
-  const uint64_t current_entries = compact->builder->NumEntries();
+  if (s.ok()) {
+    AddCompactionTombstones(compact, next_user_key);
+  }
+  const uint64_t current_entries = compact->builder->NumEntries() +
+                                   compact->builder->NumRangeTombstones();
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
@@ -829,6 +1842,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   }
   const uint64_t current_bytes = compact->builder->FileSize();
   compact->current_output()->file_size = current_bytes;
+  compact->current_output()->SetStats(compact->builder->GetProperties());
   compact->total_bytes += current_bytes;
   delete compact->builder;
   compact->builder = NULL;
@@ -845,9 +1859,9 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
-    Iterator* iter = table_cache_->NewIterator(ReadOptions(),
-                                               output_number,
-                                               current_bytes);
+    Iterator* iter = compact->cfd->table_cache->NewIterator(ReadOptions(),
+                                                            output_number,
+                                                            current_bytes);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -865,28 +1879,29 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
-  Log(options_.info_log,  "Compacted %d@%d + %d@%d files => %lld bytes",
+  Log(options_.info_log,  "Compacted %d@%d + %d@%d files => %lld bytes"
+      " (%lld filtered)",
       compact->compaction->num_input_files(0),
       compact->compaction->level(),
       compact->compaction->num_input_files(1),
       compact->compaction->level() + 1,
-      static_cast<long long>(compact->total_bytes));
+      static_cast<long long>(compact->total_bytes),
+      static_cast<long long>(compact->filtered_entries));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
   const int level = compact->compaction->level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
-    const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(
-        level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
+    compact->compaction->edit()->AddFile(level + 1, compact->outputs[i]);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->cfd, compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
+  int64_t imm_micros = 0;  // Micros spent doing imm compactions
+  ColumnFamilyData* cfd = compact->cfd;
+  const Comparator* ucmp = cfd->user_comparator();
 
   Log(options_.info_log,  "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0),
@@ -894,7 +1909,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       compact->compaction->num_input_files(1),
       compact->compaction->level() + 1);
 
-  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+  assert(cfd->versions->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == NULL);
   assert(compact->outfile == NULL);
   if (snapshots_.empty()) {
@@ -903,58 +1918,89 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
   }
 
+  CompactionJobInfo info;
+  if (options_.listener != NULL) {
+    StartCompactionJobInfo(dbname_, compact->compaction,
+                           manual_compaction_ != NULL, &info);
+  }
+
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  if (options_.listener != NULL) {
+    options_.listener->OnCompactionBegin(info);
+  }
+
+  RangeTombstoneList tombstones(ucmp);
+  Status status = PrepareCompactionTombstones(compact, &tombstones);
+  Iterator* input = cfd->versions->MakeInputIterator(compact->compaction);
   input->SeekToFirst();
-  Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-  for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
+  for (; status.ok() && input->Valid() && !shutting_down_.Acquire_Load(); ) {
     // Prioritize immutable compaction work
     if (has_imm_.NoBarrier_Load() != NULL) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != NULL) {
-        CompactMemTable();
-        bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+      for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+               column_families_.begin();
+           it != column_families_.end(); ++it) {
+        if (it->second->imm != NULL) {
+          CompactMemTable(it->second);
+          bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+        }
       }
       mutex_.Unlock();
       imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != NULL) {
-      status = FinishCompactionOutputFile(compact, input);
-      if (!status.ok()) {
-        break;
-      }
-    }
 
     // Handle key/value, add to state, etc.
     bool drop = false;
+    bool first_for_key = false;
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
+      status = FlushPendingMerge(compact);
       current_user_key.clear();
       has_current_user_key = false;
       last_sequence_for_key = kMaxSequenceNumber;
     } else {
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key,
-                                     Slice(current_user_key)) != 0) {
+          ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
         // First occurrence of this user key
+        status = FlushPendingMerge(compact);
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
         last_sequence_for_key = kMaxSequenceNumber;
+        first_for_key = true;
+      } else if (compact->has_pending_merge) {
+        // An older entry for a held back merge operand, so also visible
+        // to every snapshot: fold it into the operand.
+        const bool deleted =
+            !tombstones.empty() &&
+            tombstones.MaxCoveringSequence(
+                ikey.user_key, compact->smallest_snapshot) > ikey.sequence;
+        status = CombinePendingMerge(compact, ikey, input->value(), deleted);
+        if (!compact->has_pending_merge) {
+          // Now a value, which hides the remaining entries by rule (A)
+          last_sequence_for_key = ikey.sequence;
+        }
+        input->Next();
+        continue;
       }
 
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;    // (A)
+      } else if (!tombstones.empty() &&
+                 tombstones.MaxCoveringSequence(
+                     ikey.user_key, compact->smallest_snapshot) >
+                     ikey.sequence) {
+        // Deleted by a range deletion that every snapshot sees
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
                  compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
@@ -968,7 +2014,13 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;
       }
 
-      last_sequence_for_key = ikey.sequence;
+      if (ikey.type != kTypeMerge) {
+        // A merge operand does not hide the entries it applies to
+        last_sequence_for_key = ikey.sequence;
+      }
+    }
+    if (!status.ok()) {
+      break;
     }
 #if 0
     Log(options_.info_log,
@@ -980,27 +2032,47 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
+    // Outputs are only split between user keys, so that a range deletion
+    // clipped at the split never misses entries of the key it ends at.
+    if (first_for_key &&
+        compact->compaction->ShouldStopBefore(key) &&
+        compact->builder != NULL) {
+      Slice next_user_key = ikey.user_key;
+      status = FinishCompactionOutputFile(compact, input, &next_user_key);
+      if (!status.ok()) {
+        break;
+      }
+    }
+
     if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == NULL) {
-        status = OpenCompactionOutputFile(compact);
+      if (first_for_key && compact->builder != NULL &&
+          compact->builder->FileSize() >=
+              compact->compaction->MaxOutputFileSize()) {
+        // Close output file since it is big enough
+        Slice next_user_key = ikey.user_key;
+        status = FinishCompactionOutputFile(compact, input, &next_user_key);
         if (!status.ok()) {
           break;
         }
       }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
-      }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
 
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+      if (has_current_user_key && ikey.type == kTypeMerge &&
+          ikey.sequence <= compact->smallest_snapshot &&
+          cfd->options->merge_operator != NULL) {
+        // Hold the operand back to combine it with the older entries
+        compact->has_pending_merge = true;
+        compact->pending_merge_key.assign(key.data(), key.size());
+        compact->pending_merge_value.assign(input->value().data(),
+                                            input->value().size());
+      } else if (first_for_key && ikey.type == kTypeValue &&
+                 ikey.sequence <= compact->smallest_snapshot &&
+                 cfd->options->compaction_filter != NULL) {
+        status = FilterCompactionValue(compact, ikey, input->value());
+      } else {
+        status = AddToCompactionOutput(compact, key, input->value());
+      }
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -1010,8 +2082,16 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.Acquire_Load()) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok()) {
+    status = FlushPendingMerge(compact);
+  }
+  if (status.ok() && compact->builder == NULL &&
+      compact->next_tombstone < compact->tombstones.size()) {
+    // Range deletions are left over but no entries needed writing
+    status = OpenCompactionOutputFile(compact);
+  }
   if (status.ok() && compact->builder != NULL) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, NULL);
   }
   if (status.ok()) {
     status = input->status();
@@ -1031,7 +2111,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   }
 
   mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+  cfd->stats[compact->compaction->level() + 1].Add(stats);
 
   if (status.ok()) {
     status = InstallCompactionResults(compact);
@@ -1041,7 +2121,28 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   }
   VersionSet::LevelSummaryStorage tmp;
   Log(options_.info_log,
-      "compacted to: %s", versions_->LevelSummary(&tmp));
+      "compacted to: %s", cfd->versions->LevelSummary(&tmp));
+
+  if (options_.listener != NULL) {
+    uint64_t level_bytes_read = 0;
+    for (int i = 0; i < compact->compaction->num_input_files(0); i++) {
+      level_bytes_read += compact->compaction->input(0, i)->file_size;
+    }
+    for (size_t i = 0; i < compact->outputs.size(); i++) {
+      info.output_files.push_back(compact->outputs[i].number);
+    }
+    info.bytes_read = stats.bytes_read;
+    info.bytes_written = stats.bytes_written;
+    info.micros = stats.micros;
+    if (level_bytes_read > 0) {
+      info.write_amplification =
+          static_cast<double>(stats.bytes_written) / level_bytes_read;
+    }
+    info.status = status;
+    mutex_.Unlock();
+    options_.listener->OnCompactionCompleted(info);
+    mutex_.Lock();
+  }
   return status;
 }
 
@@ -1065,40 +2166,67 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 }  // namespace
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
+                                      ColumnFamilyData* cfd,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeTombstoneList* mem_tombstones,
+                                      const RangeTombstoneList**
+                                          version_tombstones) {
   IterState* cleanup = new IterState;
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != NULL) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
-  }
-  versions_->current()->AddIterators(options, &list);
+  list.push_back(cfd->mem->NewIterator());
+  cfd->mem->Ref();
+  if (cfd->imm != NULL) {
+    list.push_back(cfd->imm->NewIterator());
+    cfd->imm->Ref();
+  }
+  Version* current = cfd->versions->current();
+  current->AddIterators(options, &list);
   Iterator* internal_iter =
-      NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
+      NewMergingIterator(cfd->icmp, &list[0], list.size());
+  current->Ref();
 
   cleanup->mu = &mutex_;
-  cleanup->mem = mem_;
-  cleanup->imm = imm_;
-  cleanup->version = versions_->current();
+  cleanup->mem = cfd->mem;
+  cleanup->imm = cfd->imm;
+  cleanup->version = current;
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, NULL);
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (mem_tombstones != NULL) {
+    // The memtables and version are kept alive by the iterator.  Only
+    // the memtable tombstones are fragmented per iterator.
+    Iterator* mem_iter = cleanup->mem->NewRangeTombstoneIterator();
+    Status s = mem_tombstones->AddFrom(mem_iter);
+    delete mem_iter;
+    if (s.ok() && cleanup->imm != NULL) {
+      Iterator* imm_iter = cleanup->imm->NewRangeTombstoneIterator();
+      s = mem_tombstones->AddFrom(imm_iter);
+      delete imm_iter;
+    }
+    mem_tombstones->Finish();
+    if (s.ok()) {
+      s = cleanup->version->GetRangeTombstones(version_tombstones);
+    }
+    if (!s.ok()) {
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+  }
   return internal_iter;
 }
 
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
   uint32_t ignored_seed;
-  return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed);
+  return NewInternalIterator(ReadOptions(), default_cf_, &ignored,
+                             &ignored_seed);
 }
 
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
@@ -1109,6 +2237,15 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
+  return Get(options, default_cf_, key, value);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   ColumnFamilyHandle* column_family,
+                   const Slice& key,
+                   std::string* value) {
+  LatencyTimer latency(this, kGetOp);
+  ColumnFamilyData* cfd = reinterpret_cast<ColumnFamilyData*>(column_family);
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -1118,9 +2255,9 @@ Status DBImpl::Get(const ReadOptions& options,
     snapshot = versions_->LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
+  MemTable* mem = cfd->mem;
+  MemTable* imm = cfd->imm;
+  Version* current = cfd->versions->current();
   mem->Ref();
   if (imm != NULL) imm->Ref();
   current->Ref();
@@ -1133,14 +2270,26 @@ Status DBImpl::Get(const ReadOptions& options,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
+    PerfTimer memtable_timer(&PerfContext::get_from_memtable_time);
+    PerfCounterAdd(&PerfContext::get_from_memtable_count, 1);
+    std::vector<std::string> operands;
+    bool done = mem->Get(lkey, value, &s, &operands);
+    if (!done && imm != NULL) {
+      PerfCounterAdd(&PerfContext::get_from_memtable_count, 1);
+      done = imm->Get(lkey, value, &s, &operands);
+    }
+    memtable_timer.Stop();
+    if (!done) {
+      PerfTimer files_timer(&PerfContext::get_from_output_files_time);
+      s = current->Get(options, lkey, value, &stats, &operands);
       have_stat_update = true;
     }
+    if (!operands.empty() && (s.ok() || s.IsNotFound())) {
+      // Apply the merge operands to the value found below them, if any
+      const Slice existing = *value;
+      s = ApplyMergeOperands(cfd->options->merge_operator, key,
+                             s.ok() ? &existing : NULL, operands, value);
+    }
     mutex_.Lock();
   }
 
@@ -1153,21 +2302,62 @@ Status DBImpl::Get(const ReadOptions& options,
   return s;
 }
 
+static void DeleteInternalBound(void* arg1, void* arg2) {
+  delete reinterpret_cast<std::string*>(arg1);
+  delete reinterpret_cast<Slice*>(arg2);
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+  return NewIterator(options, default_cf_);
+}
+
+Iterator* DBImpl::NewIterator(const ReadOptions& options,
+                              ColumnFamilyHandle* column_family) {
+  ColumnFamilyData* cfd = reinterpret_cast<ColumnFamilyData*>(column_family);
+  // The internal iterators compare internal keys, so they are handed the
+  // smallest internal key for the user's upper bound.
+  ReadOptions internal_options = options;
+  std::string* internal_bound = NULL;
+  if (options.iterate_upper_bound != NULL) {
+    internal_bound = new std::string;
+    AppendInternalKey(internal_bound,
+                      ParsedInternalKey(*options.iterate_upper_bound,
+                                        kMaxSequenceNumber,
+                                        kValueTypeForSeek));
+    internal_options.iterate_upper_bound = new Slice(*internal_bound);
+  }
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(
-      this, user_comparator(), iter,
+  RangeTombstoneList* mem_tombstones =
+      new RangeTombstoneList(cfd->user_comparator());
+  const RangeTombstoneList* version_tombstones = NULL;
+  Iterator* iter = NewInternalIterator(internal_options, cfd,
+                                       &latest_snapshot, &seed,
+                                       mem_tombstones, &version_tombstones);
+  if (mem_tombstones->empty()) {
+    delete mem_tombstones;
+    mem_tombstones = NULL;
+  }
+  Iterator* result = NewDBIterator(
+      this, cfd, cfd->user_comparator(), iter,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot),
-      seed);
+      seed, options.iterate_upper_bound,
+      options.prefix_same_as_start ? cfd->options->prefix_extractor : NULL,
+      cfd->options->merge_operator, mem_tombstones, version_tombstones);
+  if (internal_bound != NULL) {
+    result->RegisterCleanup(&DeleteInternalBound, internal_bound,
+                            const_cast<Slice*>(
+                                internal_options.iterate_upper_bound));
+  }
+  return result;
 }
 
-void DBImpl::RecordReadSample(Slice key) {
+void DBImpl::RecordReadSample(ColumnFamilyHandle* column_family, Slice key) {
+  ColumnFamilyData* cfd = reinterpret_cast<ColumnFamilyData*>(column_family);
   MutexLock l(&mutex_);
-  if (versions_->current()->RecordReadSample(key)) {
+  if (cfd->versions->current()->RecordReadSample(key)) {
     MaybeScheduleCompaction();
   }
 }
@@ -1191,23 +2381,71 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
-Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
-  Writer w(&mutex_);
+Status DBImpl::Put(const WriteOptions& o, ColumnFamilyHandle* column_family,
+                   const Slice& key, const Slice& val) {
+  return DB::Put(o, column_family, key, val);
+}
+
+Status DBImpl::Delete(const WriteOptions& options,
+                      ColumnFamilyHandle* column_family, const Slice& key) {
+  return DB::Delete(options, column_family, key);
+}
+
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == NULL) {
+    return Status::NotSupported("Merge() requires Options::merge_operator");
+  }
+  return DB::Merge(options, key, value);
+}
+
+Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
+  return WriteImpl(options, my_batch, (my_batch == NULL) ? default_cf_ : NULL);
+}
+
+Status DBImpl::WriteIfUnchanged(const WriteOptions& options,
+                                const Snapshot* snapshot,
+                                const std::vector<Slice>& keys,
+                                WriteBatch* updates) {
+  return WriteImpl(options, updates, NULL, &keys,
+                   reinterpret_cast<const SnapshotImpl*>(snapshot)->number_);
+}
+
+Status DBImpl::WriteImpl(const WriteOptions& options, WriteBatch* my_batch,
+                         ColumnFamilyData* force_flush,
+                         const std::vector<Slice>* check_keys,
+                         SequenceNumber check_seq) {
+  if (secondary_) {
+    return Status::NotSupported("secondary instances are read-only");
+  }
+  // A NULL batch only waits for earlier writes and is not counted.
+  LatencyTimer latency(this, kWriteOp, my_batch != NULL);
+  Writer w(&mutex_);
   w.batch = my_batch;
   w.sync = options.sync;
   w.done = false;
+  w.check_keys = check_keys;
+  w.check_seq = check_seq;
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
+  PerfTimer wait_timer(&PerfContext::write_wait_time);
   while (!w.done && &w != writers_.front()) {
     w.cv.Wait();
   }
+  wait_timer.Stop();
   if (w.done) {
     return w.status;
   }
 
   // May temporarily unlock and wait.
-  Status status = MakeRoomForWrite(my_batch == NULL);
+  PerfTimer delay_timer(&PerfContext::write_delay_time);
+  Status status = MakeRoomForWrite(force_flush);
+  delay_timer.Stop();
+  if (status.ok() && check_keys != NULL) {
+    // Leading the group, so every earlier write has been applied
+    status = CheckUnchanged(*check_keys, check_seq);
+  }
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && my_batch != NULL) {  // NULL batch is for compactions
@@ -1215,22 +2453,31 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(updates);
 
-    // Add to log and apply to memtable.  We can release the lock
+    // Add to log and apply to memtables.  We can release the lock
     // during this phase since &w is currently responsible for logging
     // and protects against concurrent loggers and concurrent writes
-    // into mem_.
+    // into the memtables.
     {
       mutex_.Unlock();
+      PerfTimer wal_timer(&PerfContext::write_wal_time);
       status = log_->AddRecord(WriteBatchInternal::Contents(updates));
       bool sync_error = false;
       if (status.ok() && options.sync) {
-        status = logfile_->Sync();
+        if (options_.manual_wal_flush) {
+          status = logfile_->Flush();
+        }
+        if (status.ok()) {
+          status = logfile_->Sync();
+        }
         if (!status.ok()) {
           sync_error = true;
         }
       }
+      wal_timer.Stop();
       if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(updates, mem_);
+        PerfTimer memtable_timer(&PerfContext::write_memtable_time);
+        WriteMemTables memtables(this);
+        status = WriteBatchInternal::InsertInto(updates, &memtables);
       }
       mutex_.Lock();
       if (sync_error) {
@@ -1264,6 +2511,317 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   return status;
 }
 
+Status DBImpl::CheckUnchanged(const std::vector<Slice>& keys,
+                              SequenceNumber seq) {
+  mutex_.AssertHeld();
+  ColumnFamilyData* cfd = default_cf_;
+  MemTable* mem = cfd->mem;
+  MemTable* imm = cfd->imm;
+  // Usually the memtables hold every write made since "seq"; if one
+  // has been flushed since, the tables must be searched as well.
+  const bool in_memtables =
+      ((imm != NULL) ? imm : mem)->base_sequence() <= seq;
+  mem->Ref();
+  if (imm != NULL) imm->Ref();
+
+  Status s;
+  {
+    mutex_.Unlock();
+    Iterator* iter = NULL;
+    RangeTombstoneList* mem_tombstones = NULL;
+    const RangeTombstoneList* version_tombstones = NULL;
+    if (!in_memtables) {
+      SequenceNumber ignored;
+      uint32_t ignored_seed;
+      mem_tombstones = new RangeTombstoneList(cfd->user_comparator());
+      iter = NewInternalIterator(ReadOptions(), cfd, &ignored, &ignored_seed,
+                                 mem_tombstones, &version_tombstones);
+      s = iter->status();
+    }
+    for (size_t i = 0; s.ok() && i < keys.size(); i++) {
+      SequenceNumber newest;
+      if (in_memtables) {
+        newest = mem->NewestSequence(keys[i]);
+        if (imm != NULL) {
+          newest = std::max(newest, imm->NewestSequence(keys[i]));
+        }
+      } else {
+        newest = mem_tombstones->MaxCoveringSequence(keys[i],
+                                                     kMaxSequenceNumber);
+        if (version_tombstones != NULL) {
+          newest = std::max(newest, version_tombstones->MaxCoveringSequence(
+                                        keys[i], kMaxSequenceNumber));
+        }
+        InternalKey target(keys[i], kMaxSequenceNumber, kValueTypeForSeek);
+        iter->Seek(target.Encode());
+        ParsedInternalKey parsed;
+        if (iter->Valid() && ParseInternalKey(iter->key(), &parsed) &&
+            cfd->user_comparator()->Compare(parsed.user_key, keys[i]) == 0) {
+          newest = std::max(newest, parsed.sequence);
+        }
+        s = iter->status();
+      }
+      if (s.ok() && newest > seq) {
+        s = Status::Busy("written since the snapshot: ", keys[i]);
+      }
+    }
+    delete iter;
+    delete mem_tombstones;
+    mutex_.Lock();
+  }
+
+  mem->Unref();
+  if (imm != NULL) imm->Unref();
+  return s;
+}
+
+Status DBImpl::FlushWAL(bool sync) {
+  if (secondary_) {
+    return Status::NotSupported("secondary instances are read-only");
+  }
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = sync;
+  w.done = false;
+  w.exclusive = true;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  // Being at the front of the writer queue, we own the log.
+  Status status = bg_error_;
+  if (status.ok()) {
+    WritableFile* logfile = logfile_;
+    mutex_.Unlock();
+    status = logfile->Flush();
+    if (status.ok() && sync) {
+      status = logfile->Sync();
+    }
+    mutex_.Lock();
+    if (!status.ok()) {
+      // As for a failed sync in Write(), the log is now indeterminate.
+      RecordBackgroundError(status);
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return status;
+}
+
+Status DBImpl::CreateColumnFamily(const Options& options,
+                                  const std::string& name,
+                                  ColumnFamilyHandle** handle) {
+  *handle = NULL;
+  if (secondary_) {
+    return Status::NotSupported("secondary instances are read-only");
+  }
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = false;
+  w.done = false;
+  w.exclusive = true;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  // Being at the front of the writer queue, no batch can name the new
+  // family before its memtable is in place.
+  Status s = bg_error_;
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       s.ok() && it != column_families_.end(); ++it) {
+    if (it->second->name == name) {
+      s = Status::InvalidArgument(name, "column family already exists");
+    }
+  }
+  if (s.ok()) {
+    const uint32_t id = column_families_.rbegin()->first + 1;
+    bool ignored;
+    s = AddColumnFamily(id, name, options, true, &ignored);
+    if (s.ok()) {
+      ColumnFamilyData* cfd = column_families_[id];
+      cfd->mem = NewMemTable(cfd);
+      cfd->mem->Ref();
+      cfd->mem_log_number = logfile_number_;
+
+      // The family exists once it is recorded in the DB's descriptor
+      VersionEdit edit;
+      edit.AddColumnFamily(id, name);
+      s = versions_->LogAndApply(&edit, &mutex_);
+      if (s.ok()) {
+        *handle = cfd;
+      } else {
+        column_families_.erase(id);
+        delete cfd;
+      }
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
+namespace {
+
+// Collects the records of a descriptor that is built in memory.
+class StringDest : public WritableFile {
+ public:
+  std::string contents_;
+
+  virtual Status Append(const Slice& slice) {
+    contents_.append(slice.data(), slice.size());
+    return Status::OK();
+  }
+  virtual Status Close() { return Status::OK(); }
+  virtual Status Flush() { return Status::OK(); }
+  virtual Status Sync() { return Status::OK(); }
+  virtual std::string GetName() const { return "[descriptor]"; }
+};
+
+static bool IsEmpty(MemTable* mem) {
+  Iterator* iter = mem->NewIterator();
+  iter->SeekToFirst();
+  bool empty = !iter->Valid();
+  delete iter;
+  if (empty) {
+    iter = mem->NewRangeTombstoneIterator();
+    iter->SeekToFirst();
+    empty = !iter->Valid();
+    delete iter;
+  }
+  return empty;
+}
+
+}  // namespace
+
+Status DBImpl::GetUpdatesSince(uint64_t seq, TransactionLogIterator** iter) {
+  return NewTransactionLogIterator(env_, options_, dbname_, seq, iter);
+}
+
+Status DBImpl::GetCheckpointFiles(CheckpointHandler* handler) {
+  if (secondary_) {
+    return Status::NotSupported("secondary instances are read-only");
+  }
+  Writer w(&mutex_);
+  w.batch = NULL;
+  w.sync = false;
+  w.done = false;
+  w.exclusive = true;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  // Being at the front of the writer queue, no write reaches a memtable
+  // until all of them are flushed.
+  Status s = bg_error_;
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       s.ok() && it != column_families_.end(); ++it) {
+    if (!IsEmpty(it->second->mem)) {
+      s = MakeRoomForWrite(it->second);
+    }
+  }
+  bool flushing = true;
+  while (s.ok() && flushing) {
+    flushing = false;
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      flushing = flushing || (it->second->imm != NULL);
+    }
+    if (flushing) {
+      bg_cv_.Wait();
+      s = bg_error_;
+    }
+  }
+
+  // Hold on to the current versions, whose tables cannot be deleted
+  // while they are in use, and describe each of them in a descriptor of
+  // its own, as a new descriptor would start.
+  std::vector<std::pair<ColumnFamilyData*, Version*> > versions;
+  std::vector<std::pair<std::string, std::string> > files;  // Name, contents
+  for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+           column_families_.begin();
+       s.ok() && it != column_families_.end(); ++it) {
+    ColumnFamilyData* cfd = it->second;
+    Version* v = cfd->versions->current();
+    v->Ref();
+    versions.push_back(std::make_pair(cfd, v));
+
+    VersionEdit edit;
+    cfd->versions->SaveSnapshot(&edit);
+    cfd->versions->MarkFileNumberUsed(logfile_number_);
+    const uint64_t manifest_number = cfd->versions->NewFileNumber();
+    edit.SetLogNumber(cfd->versions->LogNumber());
+    edit.SetPrevLogNumber(0);
+    edit.SetNextFile(manifest_number + 1);
+    edit.SetLastSequence(versions_->LastSequence());
+    std::string record;
+    edit.EncodeTo(&record);
+    StringDest dest;
+    log::Writer writer(&dest);
+    s = writer.AddRecord(record);
+
+    const std::string dir = cfd->dbname.substr(dbname_.size());
+    const std::string manifest = DescriptorFileName(dir, manifest_number);
+    files.push_back(std::make_pair(manifest.substr(1), dest.contents_));
+    files.push_back(std::make_pair(
+        CurrentFileName(dir).substr(1),
+        manifest.substr(dir.size() + 1) + "\n"));
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  if (s.ok()) {
+    mutex_.Unlock();
+    for (size_t i = 0; s.ok() && i < versions.size(); i++) {
+      const std::string& dir = versions[i].first->dbname;
+      for (int level = 0; s.ok() && level < config::kNumLevels; level++) {
+        const std::vector<FileMetaData*>& tables =
+            versions[i].second->files(level);
+        for (size_t j = 0; s.ok() && j < tables.size(); j++) {
+          std::string path = TableFileName(dir, tables[j]->number);
+          if (!env_->FileExists(path)) {
+            path = SSTTableFileName(dir, tables[j]->number);
+          }
+          s = handler->AddTable(path, path.substr(dbname_.size() + 1),
+                                tables[j]->file_size);
+        }
+      }
+    }
+    for (size_t i = 0; s.ok() && i < files.size(); i++) {
+      s = handler->AddFile(files[i].first, files[i].second);
+    }
+    mutex_.Lock();
+  }
+  for (size_t i = 0; i < versions.size(); i++) {
+    versions[i].second->Unref();
+  }
+  return s;
+}
+
+ColumnFamilyHandle* DBImpl::DefaultColumnFamily() const {
+  return default_cf_;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-NULL batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1292,6 +2850,16 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
+    if (w->exclusive) {
+      // FlushWAL() must run on its own, after the writes before it.
+      break;
+    }
+
+    if (w->check_keys != NULL) {
+      // Its check must see the writes of this group
+      break;
+    }
+
     if (w->batch != NULL) {
       size += WriteBatchInternal::ByteSize(w->batch);
       if (size > max_size) {
@@ -1313,72 +2881,143 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   return result;
 }
 
+int DBImpl::MaxLevel0Files() const {
+  int result = 0;
+  for (std::map<uint32_t, ColumnFamilyData*>::const_iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    result = std::max(result, it->second->versions->NumLevelFiles(0));
+  }
+  return result;
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
-Status DBImpl::MakeRoomForWrite(bool force) {
+Status DBImpl::MakeRoomForWrite(ColumnFamilyData* force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
-  bool allow_delay = !force;
+  bool allow_delay = (force == NULL);
+  WriteStall stall;
   Status s;
   while (true) {
+    // Find a column family whose memtable must be switched.  Families
+    // share the log, so each one is checked against its own buffer size.
+    ColumnFamilyData* cfd = NULL;
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      ColumnFamilyData* c = it->second;
+      if (c == force ||
+          c->mem->ApproximateMemoryUsage() > c->options->write_buffer_size) {
+        cfd = c;
+        break;
+      }
+    }
+
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
     } else if (
         allow_delay &&
-        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
+        MaxLevel0Files() >= config::kL0_SlowdownWritesTrigger) {
       // We are getting close to hitting a hard limit on the number of
       // L0 files.  Rather than delaying a single write by several
       // seconds when we hit the hard limit, start delaying each
       // individual write by 1ms to reduce latency variance.  Also,
       // this delay hands over some CPU to the compaction thread in
       // case it is sharing the same core as the writer.
+      BeginWriteStall(&stall, kStallLevel0Slowdown);
       mutex_.Unlock();
       env_->SleepForMicroseconds(1000);
       allow_delay = false;  // Do not delay a single write more than once
       mutex_.Lock();
-    } else if (!force &&
-               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
-      // There is room in current memtable
+    } else if (cfd == NULL) {
+      // There is room in every memtable
       break;
-    } else if (imm_ != NULL) {
+    } else if (cfd->imm != NULL) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
+      if (BeginWriteStall(&stall, kStallMemtableFull)) {
+        continue;  // mutex_ was released, so check again before waiting
+      }
       Log(options_.info_log, "Current memtable full; waiting...\n");
       bg_cv_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+    } else if (cfd->versions->NumLevelFiles(0) >=
+               config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
+      if (BeginWriteStall(&stall, kStallLevel0Stop)) {
+        continue;  // mutex_ was released, so check again before waiting
+      }
       Log(options_.info_log, "Too many L0 files; waiting...\n");
       bg_cv_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
       uint64_t new_log_number = versions_->NewFileNumber();
-      WritableFile* lfile = NULL;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      s = NewLogFile(new_log_number);
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
         break;
       }
-      delete log_;
-      delete logfile_;
-      logfile_ = lfile;
-      logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
-      imm_ = mem_;
-      has_imm_.Release_Store(imm_);
-      mem_ = new MemTable(internal_comparator_);
-      mem_->Ref();
-      force = false;   // Do not force another compaction if have room
+      cfd->imm = cfd->mem;
+      has_imm_.Release_Store(cfd->imm);
+      cfd->mem = NewMemTable(cfd);
+      cfd->mem->Ref();
+      cfd->mem_log_number = new_log_number;
+      if (cfd == force) {
+        force = NULL;  // Do not force another compaction if have room
+      }
       MaybeScheduleCompaction();
     }
   }
+  EndWriteStall(&stall);
   return s;
 }
 
+bool DBImpl::BeginWriteStall(WriteStall* stall, WriteStallCause cause) {
+  mutex_.AssertHeld();
+  if (options_.listener == NULL || (stall->active && stall->cause == cause)) {
+    return false;
+  }
+  EndWriteStall(stall);
+  WriteStallInfo info;
+  info.db_name = dbname_;
+  info.cause = cause;
+  info.level0_files = MaxLevel0Files();
+  stall->active = true;
+  stall->cause = cause;
+  stall->start_micros = env_->NowMicros();
+  mutex_.Unlock();
+  options_.listener->OnWriteStallBegin(info);
+  mutex_.Lock();
+  return true;
+}
+
+void DBImpl::EndWriteStall(WriteStall* stall) {
+  mutex_.AssertHeld();
+  if (!stall->active) {
+    return;
+  }
+  WriteStallInfo info;
+  info.db_name = dbname_;
+  info.cause = stall->cause;
+  info.level0_files = MaxLevel0Files();
+  info.micros = env_->NowMicros() - stall->start_micros;
+  stall->active = false;
+  mutex_.Unlock();
+  options_.listener->OnWriteStallEnd(info);
+  mutex_.Lock();
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
+  return GetProperty(default_cf_, property, value);
+}
+
+bool DBImpl::GetProperty(ColumnFamilyHandle* column_family,
+                         const Slice& property, std::string* value) {
+  ColumnFamilyData* cfd = reinterpret_cast<ColumnFamilyData*>(column_family);
   value->clear();
 
   MutexLock l(&mutex_);
@@ -1396,7 +3035,7 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     } else {
       char buf[100];
       snprintf(buf, sizeof(buf), "%d",
-               versions_->NumLevelFiles(static_cast<int>(level)));
+               cfd->versions->NumLevelFiles(static_cast<int>(level)));
       *value = buf;
       return true;
     }
@@ -1409,31 +3048,79 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
              );
     value->append(buf);
     for (int level = 0; level < config::kNumLevels; level++) {
-      int files = versions_->NumLevelFiles(level);
-      if (stats_[level].micros > 0 || files > 0) {
+      int files = cfd->versions->NumLevelFiles(level);
+      const CompactionStats& stats = cfd->stats[level];
+      if (stats.micros > 0 || files > 0) {
         snprintf(
             buf, sizeof(buf),
             "%3d %8d %8.0f %9.0f %8.0f %9.0f\n",
             level,
             files,
-            versions_->NumLevelBytes(level) / 1048576.0,
-            stats_[level].micros / 1e6,
-            stats_[level].bytes_read / 1048576.0,
-            stats_[level].bytes_written / 1048576.0);
+            cfd->versions->NumLevelBytes(level) / 1048576.0,
+            stats.micros / 1e6,
+            stats.bytes_read / 1048576.0,
+            stats.bytes_written / 1048576.0);
         value->append(buf);
       }
     }
     return true;
+  } else if (in == "perf") {
+    static const char* kOpNames[kNumLatencyOps] = {
+      "Get", "Write", "Seek", "Next"
+    };
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "                             Latency (micros)\n"
+             "Op         Count      Avg      P50      P99    P99.9      Max\n"
+             "-------------------------------------------------------------\n"
+             );
+    value->append(buf);
+    for (int op = 0; op < kNumLatencyOps; op++) {
+      Histogram h;
+      latency_[op].Snapshot(&h);
+      snprintf(buf, sizeof(buf),
+               "%-5s %10.0f %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+               kOpNames[op], h.Count(), h.Average() / 1e3,
+               h.Median() / 1e3, h.Percentile(99) / 1e3,
+               h.Percentile(99.9) / 1e3, h.Max() / 1e3);
+      value->append(buf);
+    }
+    return true;
   } else if (in == "sstables") {
-    *value = versions_->current()->DebugString();
+    *value = cfd->versions->current()->DebugString();
+    return true;
+  } else if (in == "open-stats") {
+    const OpenStats& st = open_stats_;
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "Total open time (ms): %.3f\n"
+             "  Descriptor recovery: %.3f\n",
+             st.total_micros / 1e3, st.manifest_micros / 1e3);
+    value->append(buf);
+    snprintf(buf, sizeof(buf),
+             "  Log replay: %.3f (%d files, %lld records, %.1f MB)\n"
+             "    of which level-0 flushes: %.3f\n",
+             st.log_micros / 1e3, st.log_files,
+             static_cast<long long>(st.log_records),
+             st.log_bytes / 1048576.0, st.flush_micros / 1e3);
+    value->append(buf);
+    snprintf(buf, sizeof(buf),
+             "  Table preload: %.3f (%d tables)\n",
+             st.preload_micros / 1e3, st.tables_preloaded);
+    value->append(buf);
     return true;
   } else if (in == "approximate-memory-usage") {
+    // The block cache is shared, so this covers all column families.
     size_t total_usage = options_.block_cache->TotalCharge();
-    if (mem_) {
-      total_usage += mem_->ApproximateMemoryUsage();
-    }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             column_families_.begin();
+         it != column_families_.end(); ++it) {
+      if (it->second->mem) {
+        total_usage += it->second->mem->ApproximateMemoryReserved();
+      }
+      if (it->second->imm) {
+        total_usage += it->second->imm->ApproximateMemoryReserved();
+      }
     }
     char buf[50];
     snprintf(buf, sizeof(buf), "%llu",
@@ -1471,6 +3158,205 @@ void DBImpl::GetApproximateSizes(
   }
 }
 
+Status DBImpl::GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+  props->clear();
+  Version* v;
+  {
+    MutexLock l(&mutex_);
+    versions_->current()->Ref();
+    v = versions_->current();
+  }
+
+  // The tables of "v" stay in place while it is referenced
+  Status s;
+  for (int level = 0; s.ok() && level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = v->files(level);
+    for (size_t i = 0; s.ok() && i < files.size(); i++) {
+      TableProperties p;
+      s = table_cache_->GetTableProperties(files[i]->number,
+                                           files[i]->file_size, &p);
+      if (s.ok()) {
+        (*props)[TableFileName(dbname_, files[i]->number)] = p;
+      }
+    }
+  }
+
+  {
+    MutexLock l(&mutex_);
+    v->Unref();
+  }
+  return s;
+}
+
+namespace {
+
+// Work shared by the threads of a ParallelScan().
+struct ParallelScanState {
+  DB* db;
+  ReadOptions options;               // Reads the snapshot of the scan
+  ScanHandler* handler;
+  std::vector<std::string> bounds;   // Shard i is [bounds[i], bounds[i+1])
+  port::AtomicPointer stop;          // Non-NULL once the scan should end
+  port::Mutex mu;
+  port::CondVar cv;
+  int next;         // Protected by mu
+  int running;      // Protected by mu
+  Status status;    // Protected by mu
+
+  ParallelScanState() : stop(NULL), cv(&mu), next(0), running(0) { }
+
+  int shards() const { return bounds.size() - 1; }
+};
+
+struct UserKeyLess {
+  const Comparator* ucmp;
+  explicit UserKeyLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+
+static Status ScanShard(ParallelScanState* state, int shard) {
+  ReadOptions options = state->options;
+  const Slice limit(state->bounds[shard + 1]);
+  if (!limit.empty()) {
+    options.iterate_upper_bound = &limit;
+  }
+  Iterator* iter = state->db->NewIterator(options);
+  for (iter->Seek(state->bounds[shard]);
+       iter->Valid() && state->stop.Acquire_Load() == NULL;
+       iter->Next()) {
+    if (!state->handler->Process(shard, iter->key(), iter->value())) {
+      state->stop.Release_Store(state);
+    }
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+static void ParallelScanWork(void* arg) {
+  ParallelScanState* state = reinterpret_cast<ParallelScanState*>(arg);
+  MutexLock l(&state->mu);
+  while (state->next < state->shards() && state->status.ok()) {
+    const int shard = state->next++;
+    state->mu.Unlock();
+    Status s = ScanShard(state, shard);
+    state->mu.Lock();
+    if (!s.ok() && state->status.ok()) {
+      state->status = s;
+      state->stop.Release_Store(state);
+    }
+  }
+  state->running--;
+  state->cv.SignalAll();
+}
+
+// Scans the shards of "state" with up to "threads" threads started from
+// "env", or on the calling thread if "env" is NULL.
+static Status RunParallelScan(ParallelScanState* state, Env* env,
+                              int threads) {
+  const Snapshot* snapshot = NULL;
+  if (state->options.snapshot == NULL) {
+    snapshot = state->db->GetSnapshot();
+    state->options.snapshot = snapshot;
+  }
+  threads = std::min(threads, state->shards());
+  if (env == NULL || threads <= 1) {
+    for (int i = 0; i < state->shards() && state->status.ok() &&
+             state->stop.Acquire_Load() == NULL; i++) {
+      state->status = ScanShard(state, i);
+    }
+  } else {
+    MutexLock l(&state->mu);
+    state->running = threads;
+    for (int i = 0; i < threads; i++) {
+      env->StartThread(&ParallelScanWork, state);
+    }
+    while (state->running > 0) {
+      state->cv.Wait();
+    }
+  }
+  if (snapshot != NULL) {
+    state->db->ReleaseSnapshot(snapshot);
+  }
+  return state->status;
+}
+
+}  // namespace
+
+Status DBImpl::ParallelScan(const ReadOptions& options, const Range& range,
+                            int n, ScanHandler* handler) {
+  ParallelScanState state;
+  state.db = this;
+  state.options = options;
+  state.handler = handler;
+  state.bounds.push_back(range.start.ToString());
+
+  if (n > 1) {
+    // The largest keys of the tables inside the range are the candidate
+    // split points.  Entries still in the memtable are not weighed.
+    const Comparator* ucmp = user_comparator();
+    const bool bounded = !range.limit.empty();
+    InternalKey begin(range.start, kMaxSequenceNumber, kValueTypeForSeek);
+    InternalKey end(range.limit, kMaxSequenceNumber, kValueTypeForSeek);
+    std::vector<std::string> candidates;
+    Version* v;
+    {
+      MutexLock l(&mutex_);
+      v = versions_->current();
+      v->Ref();
+      for (int level = 0; level < config::kNumLevels; level++) {
+        std::vector<FileMetaData*> files;
+        v->GetOverlappingInputs(level, &begin, bounded ? &end : NULL, &files);
+        for (size_t i = 0; i < files.size(); i++) {
+          const Slice k = files[i]->largest.user_key();
+          if (ucmp->Compare(k, range.start) > 0 &&
+              (!bounded || ucmp->Compare(k, range.limit) < 0)) {
+            candidates.push_back(k.ToString());
+          }
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(), UserKeyLess(ucmp));
+
+    // Cut where the data before a candidate first reaches i/n of the range
+    const uint64_t start_offset = versions_->ApproximateOffsetOf(v, begin);
+    uint64_t end_offset = 0;
+    if (bounded) {
+      end_offset = versions_->ApproximateOffsetOf(v, end);
+    } else {
+      for (int level = 0; level < config::kNumLevels; level++) {
+        const std::vector<FileMetaData*>& files = v->files(level);
+        for (size_t i = 0; i < files.size(); i++) {
+          end_offset += files[i]->file_size;
+        }
+      }
+    }
+    const uint64_t total =
+        (end_offset > start_offset ? end_offset - start_offset : 0);
+    int shard = 1;
+    for (size_t i = 0; i < candidates.size() && shard < n; i++) {
+      if (ucmp->Compare(candidates[i], state.bounds.back()) <= 0) {
+        continue;
+      }
+      InternalKey k(candidates[i], kMaxSequenceNumber, kValueTypeForSeek);
+      const uint64_t offset = versions_->ApproximateOffsetOf(v, k);
+      if (offset >= start_offset &&
+          offset - start_offset >= total * shard / n) {
+        state.bounds.push_back(candidates[i]);
+        shard++;
+      }
+    }
+    {
+      MutexLock l(&mutex_);
+      v->Unref();
+    }
+  }
+  state.bounds.push_back(range.limit.ToString());
+  return RunParallelScan(&state, env_, n);
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 Status DB::Put(const WriteOptions& opt, const Slice& key, const Slice& value) {
@@ -1485,45 +3371,246 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Put(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+               const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Put(column_family, key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Delete(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+                  const Slice& key) {
+  WriteBatch batch;
+  batch.Delete(column_family, key);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions& opt,
+                       const Slice& begin, const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::ParallelScan(const ReadOptions& options, const Range& range,
+                        int n, ScanHandler* handler) {
+  ParallelScanState state;
+  state.db = this;
+  state.options = options;
+  state.handler = handler;
+  state.bounds.push_back(range.start.ToString());
+  state.bounds.push_back(range.limit.ToString());
+  return RunParallelScan(&state, NULL, 1);
+}
+
+Status DB::WriteIfUnchanged(const WriteOptions& options,
+                            const Snapshot* snapshot,
+                            const std::vector<Slice>& keys,
+                            WriteBatch* updates) {
+  return Status::NotSupported("conditional writes");
+}
+
+Status DB::GetCheckpointFiles(CheckpointHandler* handler) {
+  return Status::NotSupported("checkpoints");
+}
+
+Status DB::GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+  return Status::NotSupported("table properties");
+}
+
+Status DB::TryCatchUpWithPrimary() {
+  return Status::NotSupported("secondary instances");
+}
+
+Status DB::GetUpdatesSince(uint64_t seq, TransactionLogIterator** iter) {
+  return Status::NotSupported("update streams");
+}
+
 DB::~DB() { }
 
+ScanHandler::~ScanHandler() { }
+
+namespace {
+
+// Work shared by the threads started by DBImpl::PreloadTables().
+struct TablePreloadState {
+  TableCache* table_cache;
+  std::vector<std::pair<uint64_t, uint64_t> > files;  // (number, size)
+  port::Mutex mu;
+  port::CondVar cv;
+  size_t next;      // Protected by mu
+  int running;      // Protected by mu
+  int loaded;       // Protected by mu
+
+  TablePreloadState() : cv(&mu), next(0), running(0), loaded(0) { }
+};
+
+static void PreloadTablesWork(void* arg) {
+  TablePreloadState* state = reinterpret_cast<TablePreloadState*>(arg);
+  MutexLock l(&state->mu);
+  while (state->next < state->files.size()) {
+    const std::pair<uint64_t, uint64_t> f = state->files[state->next++];
+    state->mu.Unlock();
+    // Errors are ignored here; they resurface when the table is read.
+    Status s = state->table_cache->Preload(f.first, f.second);
+    state->mu.Lock();
+    if (s.ok()) {
+      state->loaded++;
+    }
+  }
+  state->running--;
+  state->cv.SignalAll();
+}
+
+}  // namespace
+
+void DBImpl::PreloadTables() {
+  const uint64_t start_micros = env_->NowMicros();
+  TablePreloadState state;
+  state.table_cache = table_cache_;
+
+  // Hold on to the current version so that its files cannot be deleted
+  // by a compaction while they are being opened.
+  mutex_.Lock();
+  Version* v = versions_->current();
+  v->Ref();
+  const size_t capacity = options_.max_open_files - kNumNonTableCacheFiles;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = v->files(level);
+    for (size_t i = 0; i < files.size() && state.files.size() < capacity;
+         i++) {
+      state.files.push_back(std::make_pair(files[i]->number,
+                                           files[i]->file_size));
+    }
+  }
+  mutex_.Unlock();
+
+  const int threads = std::min(options_.table_preload_threads,
+                               static_cast<int>(state.files.size()));
+  {
+    MutexLock l(&state.mu);
+    state.running = threads;
+    for (int i = 0; i < threads; i++) {
+      env_->StartThread(&PreloadTablesWork, &state);
+    }
+    while (state.running > 0) {
+      state.cv.Wait();
+    }
+  }
+
+  MutexLock l(&mutex_);
+  v->Unref();
+  open_stats_.tables_preloaded = state.loaded;
+  open_stats_.preload_micros = env_->NowMicros() - start_micros;
+}
+
 Status DB::Open(const Options& options, const std::string& dbname,
                 DB** dbptr) {
+  std::vector<ColumnFamilyHandle*> handles;
+  return DB::Open(options, dbname, std::vector<ColumnFamilyDescriptor>(),
+                  &handles, dbptr);
+}
+
+Status DB::Open(const Options& options, const std::string& dbname,
+                const std::vector<ColumnFamilyDescriptor>& column_families,
+                std::vector<ColumnFamilyHandle*>* handles,
+                DB** dbptr) {
   *dbptr = NULL;
+  handles->clear();
 
+  const uint64_t start_micros = options.env->NowMicros();
   DBImpl* impl = new DBImpl(options, dbname);
   impl->mutex_.Lock();
-  VersionEdit edit;
+  std::map<uint32_t, VersionEdit> edits;
   // Recover handles create_if_missing, error_if_exists
   bool save_manifest = false;
-  Status s = impl->Recover(&edit, &save_manifest);
-  if (s.ok() && impl->mem_ == NULL) {
-    // Create new log and a corresponding memtable.
+  Status s = impl->Recover(column_families, &edits, &save_manifest);
+  if (s.ok() && impl->default_cf_->mem == NULL) {
+    // Create new log and the corresponding memtables.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
-    WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    s = impl->NewLogFile(new_log_number);
     if (s.ok()) {
-      edit.SetLogNumber(new_log_number);
-      impl->logfile_ = lfile;
-      impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
-      impl->mem_->Ref();
+      for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+               impl->column_families_.begin();
+           it != impl->column_families_.end(); ++it) {
+        ColumnFamilyData* cfd = it->second;
+        edits[cfd->id].SetLogNumber(new_log_number);
+        cfd->mem = impl->NewMemTable(cfd);
+        cfd->mem->Ref();
+        cfd->mem_log_number = new_log_number;
+      }
     }
   }
   if (s.ok() && save_manifest) {
-    edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
-    edit.SetLogNumber(impl->logfile_number_);
-    s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+    for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+             impl->column_families_.begin();
+         s.ok() && it != impl->column_families_.end(); ++it) {
+      VersionEdit* edit = &edits[it->first];
+      edit->SetPrevLogNumber(0);  // No older logs needed after recovery.
+      edit->SetLogNumber(impl->logfile_number_);
+      s = impl->LogAndApply(it->second, edit);
+    }
   }
   if (s.ok()) {
     impl->DeleteObsoleteFiles();
     impl->MaybeScheduleCompaction();
+    for (size_t i = 0; i < column_families.size(); i++) {
+      for (std::map<uint32_t, ColumnFamilyData*>::iterator it =
+               impl->column_families_.begin();
+           it != impl->column_families_.end(); ++it) {
+        if (it->second->name == column_families[i].name) {
+          handles->push_back(it->second);
+        }
+      }
+    }
   }
   impl->mutex_.Unlock();
   if (s.ok()) {
-    assert(impl->mem_ != NULL);
+    assert(impl->default_cf_->mem != NULL);
+    if (options.table_preload_threads > 0) {
+      impl->PreloadTables();
+    }
+    impl->mutex_.Lock();
+    impl->open_stats_.total_micros = options.env->NowMicros() - start_micros;
+    impl->mutex_.Unlock();
+    *dbptr = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+Status DB::OpenAsSecondary(const Options& options, const std::string& dbname,
+                           const std::string& secondary_path, DB** dbptr) {
+  *dbptr = NULL;
+  if (secondary_path.empty() || secondary_path == dbname) {
+    return Status::InvalidArgument(
+        secondary_path, "secondary path must differ from the DB's");
+  }
+  if (!options.env->FileExists(CurrentFileName(dbname))) {
+    return Status::InvalidArgument(dbname, "does not exist");
+  }
+
+  // Never append to the primary's descriptor or logs
+  Options secondary_options = options;
+  secondary_options.reuse_logs = false;
+  DBImpl* impl = new DBImpl(secondary_options, dbname, secondary_path);
+  impl->mutex_.Lock();
+  // Without the primary's id, tables do not use Options::persistent_cache
+  impl->SetupIdentity(false);
+  Status s = impl->CatchUpWithPrimary();
+  impl->mutex_.Unlock();
+  if (s.ok()) {
+    if (options.table_preload_threads > 0) {
+      impl->PreloadTables();
+    }
     *dbptr = impl;
   } else {
     delete impl;
@@ -1551,6 +3638,12 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
     FileType type;
     for (size_t i = 0; i < filenames.size(); i++) {
       if (ParseFileName(filenames[i], &number, &type) &&
+          type == kColumnFamilyDir) {
+        Status del = DestroyDB(dbname + "/" + filenames[i], options);
+        if (result.ok() && !del.ok()) {
+          result = del;
+        }
+      } else if (ParseFileName(filenames[i], &number, &type) &&
           type != kDBLockFile) {  // Lock file will be deleted at end
         Status del = env->DeleteFile(dbname + "/" + filenames[i]);
         if (result.ok() && !del.ok()) {
@@ -6,18 +6,23 @@
 #define STORAGE_LEVELDB_DB_DB_IMPL_H_
 
 #include <deque>
+#include <map>
 #include <set>
+#include "db/column_family.h"
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/listener.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/histogram.h"
 
 namespace leveldb {
 
 class MemTable;
+class RangeTombstoneList;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -25,13 +30,22 @@ class VersionSet;
 
 class DBImpl : public DB {
  public:
-  DBImpl(const Options& options, const std::string& dbname);
+  // A non-empty "secondary_path" makes a secondary instance (see
+  // DB::OpenAsSecondary), which keeps its info log there.
+  DBImpl(const Options& options, const std::string& dbname,
+         const std::string& secondary_path = std::string());
   virtual ~DBImpl();
 
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
+  virtual Status WriteIfUnchanged(const WriteOptions& options,
+                                  const Snapshot* snapshot,
+                                  const std::vector<Slice>& keys,
+                                  WriteBatch* updates);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
@@ -40,15 +54,42 @@ class DBImpl : public DB {
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
+  virtual Status GetPropertiesOfAllTables(TablePropertiesCollection* props);
+  virtual Status ParallelScan(const ReadOptions& options, const Range& range,
+                              int n, ScanHandler* handler);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status FlushWAL(bool sync);
+  virtual Status TryCatchUpWithPrimary();
+  virtual Status GetCheckpointFiles(CheckpointHandler* handler);
+  virtual Status GetUpdatesSince(uint64_t seq, TransactionLogIterator** iter);
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle);
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const;
+  virtual Status Put(const WriteOptions&, ColumnFamilyHandle* column_family,
+                     const Slice& key, const Slice& value);
+  virtual Status Delete(const WriteOptions&, ColumnFamilyHandle* column_family,
+                        const Slice& key);
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key,
+                     std::string* value);
+  virtual Iterator* NewIterator(const ReadOptions&,
+                                ColumnFamilyHandle* column_family);
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value);
+  virtual void CompactRange(ColumnFamilyHandle* column_family,
+                            const Slice* begin, const Slice* end);
 
   // Extra methods (for testing) that are not in the public DB interface
 
   // Compact any files in the named level that overlap [*begin,*end]
-  void TEST_CompactRange(int level, const Slice* begin, const Slice* end);
+  // (of the default column family if "column_family" is NULL).
+  void TEST_CompactRange(int level, const Slice* begin, const Slice* end,
+                         ColumnFamilyHandle* column_family = NULL);
 
   // Force current memtable contents to be compacted.
-  Status TEST_CompactMemTable();
+  Status TEST_CompactMemTable(ColumnFamilyHandle* column_family = NULL);
 
   // Return an internal iterator over the current state of the database.
   // The keys of this iterator are internal keys (see format.h).
@@ -59,26 +100,93 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
-  // Record a sample of bytes read at the specified internal key.
-  // Samples are taken approximately once every config::kReadBytesPeriod
-  // bytes.
-  void RecordReadSample(Slice key);
+  // Record a sample of bytes read at the specified internal key of
+  // "column_family".  Samples are taken approximately once every
+  // config::kReadBytesPeriod bytes.
+  void RecordReadSample(ColumnFamilyHandle* column_family, Slice key);
+
+  // Operations whose latencies are reported by "leveldb.perf".
+  enum LatencyOp {
+    kGetOp,
+    kWriteOp,
+    kSeekOp,     // Iterator Seek(), SeekToFirst() and SeekToLast()
+    kNextOp,     // Iterator Next()
+    kNumLatencyOps
+  };
+
+  // Records the time from its construction to its destruction as the
+  // latency of one operation.  Must be destroyed without holding mutex_.
+  class LatencyTimer {
+   public:
+    LatencyTimer(DBImpl* db, LatencyOp op, bool enabled = true)
+        : db_(enabled ? db : NULL),
+          op_(op),
+          start_nanos_(enabled ? db->env_->NowNanos() : 0) {
+    }
+    ~LatencyTimer() {
+      if (db_ != NULL) {
+        db_->RecordLatency(op_, start_nanos_);
+      }
+    }
+
+   private:
+    DBImpl* const db_;
+    const LatencyOp op_;
+    const uint64_t start_nanos_;
+
+    // No copying allowed
+    LatencyTimer(const LatencyTimer&);
+    void operator=(const LatencyTimer&);
+  };
 
  private:
   friend class DB;
   struct CompactionState;
   struct Writer;
+  struct LogToRecover;
+  class RecoveryMemTables;
+  class WriteMemTables;
+
+  // If "mem_tombstones" is non-NULL, the range deletions of the
+  // memtables the iterator reads are added to it, and
+  // *version_tombstones is set to the shared list of its Version's
+  // tables (see Version::GetRangeTombstones()), which lives as long as
+  // the iterator.
+  Iterator* NewInternalIterator(
+      const ReadOptions&, ColumnFamilyData* cfd,
+      SequenceNumber* latest_snapshot, uint32_t* seed,
+      RangeTombstoneList* mem_tombstones = NULL,
+      const RangeTombstoneList** version_tombstones = NULL);
+
+  // Create the descriptor of an empty DB or column family in "dbname",
+  // whose logs before "log_number" are not needed.
+  Status NewDB(const std::string& dbname, const Comparator* user_comparator,
+               uint64_t log_number);
+
+  // Recover the descriptor from persistent storage, and those of the
+  // column families, which must be the ones in "column_families".  May
+  // do a significant amount of work to recover recently logged updates.
+  // Any changes to be made to the descriptor of a family are added to
+  // (*edits)[id].
+  Status Recover(const std::vector<ColumnFamilyDescriptor>& column_families,
+                 std::map<uint32_t, VersionEdit>* edits, bool* save_manifest)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Iterator* NewInternalIterator(const ReadOptions&,
-                                SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
-
-  Status NewDB();
-
-  // Recover the descriptor from persistent storage.  May do a significant
-  // amount of work to recover recently logged updates.  Any changes to
-  // be made to the descriptor are added to *edit.
-  Status Recover(VersionEdit* edit, bool* save_manifest)
+  // Read the unique id of the DB from its IDENTITY file, writing one
+  // first if there is none and "create" is true, and key the tables in
+  // Options::persistent_cache with it.
+  Status SetupIdentity(bool create) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return the prefix of the persistent cache keys of the tables of
+  // column family "family_id" (see TableCache::SetCacheKeyPrefix()).
+  std::string CacheKeyPrefix(uint32_t family_id) const;
+
+  // Open column family "id" and add it to column_families_.  If
+  // "create", an empty family is made on disk first, whose logs before
+  // the current one are not needed.
+  Status AddColumnFamily(uint32_t id, const std::string& name,
+                         const Options& options, bool create,
+                         bool* save_manifest)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void MaybeIgnoreError(Status* s) const;
@@ -86,24 +194,123 @@ class DBImpl : public DB {
   // Delete any unneeded files and stale in-memory entries.
   void DeleteObsoleteFiles();
 
-  // Compact the in-memory write buffer to disk.  Switches to a new
-  // log-file/memtable and writes a new descriptor iff successful.
-  // Errors are recorded in bg_error_.
-  void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Delete the logs that recovery no longer needs, in *logs, except for
+  // those kept for GetUpdatesSince() or for recycling.
+  void PurgeObsoleteLogs(std::vector<uint64_t>* logs)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return the oldest log that may hold entries not yet in the tables of
+  // some column family.
+  uint64_t MinLogNumber() const EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return the largest number of level-0 files in any column family.
+  int MaxLevel0Files() const EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Compact the immutable memtable of "cfd" to disk and write a new
+  // descriptor iff successful.  Errors are recorded in bg_error_.
+  void CompactMemTable(ColumnFamilyData* cfd) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return a new, unreferenced memtable laid out as the options of "cfd"
+  // ask.
+  MemTable* NewMemTable(const ColumnFamilyData* cfd) const;
+
+  // Apply "edit" to the descriptor of "cfd", which, unlike the default
+  // family, does not keep the last sequence number up to date itself.
+  Status LogAndApply(ColumnFamilyData* cfd, VersionEdit* edit)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Write "updates", first switching "force_flush" (if non-NULL) to a
+  // new memtable.  If "check_keys" is non-NULL, write only if none of
+  // them has been written after sequence number "check_seq".
+  Status WriteImpl(const WriteOptions& options, WriteBatch* updates,
+                   ColumnFamilyData* force_flush,
+                   const std::vector<Slice>* check_keys = NULL,
+                   SequenceNumber check_seq = 0);
+
+  // Return a Busy status if any of "keys" in the default column family
+  // has an entry or range deletion numbered after "seq".  Releases
+  // mutex_ while looking; the caller must be at the front of writers_.
+  Status CheckUnchanged(const std::vector<Slice>& keys, SequenceNumber seq)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Make a new log file numbered "number" the current log, overwriting
+  // one of logs_to_recycle_ if there are any.
+  Status NewLogFile(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return true if obsolete log file "number" is to be kept for recycling.
+  bool KeepLogForRecycling(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
-                        VersionEdit* edit, SequenceNumber* max_sequence)
+  // Start reading and checksumming log file "log_number" in the
+  // background.  The result is consumed by RecoverLogFile().
+  LogToRecover* StartLogRecovery(uint64_t log_number);
+
+  Status RecoverLogFile(LogToRecover* log, bool last_log, bool* save_manifest,
+                        std::map<uint32_t, VersionEdit>* edits,
+                        SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Open the table files of the current version on
+  // options_.table_preload_threads threads (see Options).
+  void PreloadTables() LOCKS_EXCLUDED(mutex_);
+
+  Status WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                          VersionEdit* edit, Version* base)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status MakeRoomForWrite(bool force /* compact even if there is room? */)
+  // Switch any column family whose memtable is full, and "force" (if
+  // non-NULL) even if there is room, to a new memtable and log.
+  Status MakeRoomForWrite(ColumnFamilyData* force)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // The write stall, if any, that options_.listener was last told about
+  // by a call of MakeRoomForWrite().
+  struct WriteStall {
+    bool active;
+    WriteStallCause cause;
+    uint64_t start_micros;
+    WriteStall() : active(false), cause(kStallLevel0Slowdown),
+                   start_micros(0) { }
+  };
+  // If there is a listener and *stall does not already have "cause", end
+  // it and begin a stall for "cause", releasing mutex_ while the listener
+  // runs, and return true.  Else return false.
+  bool BeginWriteStall(WriteStall* stall, WriteStallCause cause)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Tell the listener that *stall, if active, has ended.  May release
+  // mutex_.
+  void EndWriteStall(WriteStall* stall) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer);
 
   void RecordBackgroundError(const Status& s);
 
+  void RecordLatency(LatencyOp op, uint64_t start_nanos) LOCKS_EXCLUDED(mutex_);
+
+  // Schedule a dump of the stats if options_.stats_dump_period_sec has
+  // passed since the last one.
+  void MaybeScheduleStatsDump(uint64_t now_nanos)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGStatsDump(void* db);
+  void BackgroundStatsDump() LOCKS_EXCLUDED(mutex_);
+
+  // Secondary instances only: read the descriptor and logs of the
+  // primary and install the state they record.  Releases mutex_ while
+  // reading; catch-ups run one at a time.
+  Status CatchUpWithPrimary() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Add the records of the default column family from the logs the
+  // current descriptor still needs to its memtable, or to a new one if
+  // the primary has flushed the logs the memtable was built from.
+  Status CatchUpWithLogs() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Add the records of log "number" from *offset on that are numbered
+  // after *max_sequence to "mem", advancing both.
+  Status ReadPrimaryLog(uint64_t number, MemTable* mem, uint64_t* offset,
+                        SequenceNumber* max_sequence) LOCKS_EXCLUDED(mutex_);
+  // Schedule a catch-up if options_.secondary_catch_up_period_ms has
+  // passed since the last one.
+  void MaybeScheduleCatchUp(uint64_t now_nanos)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGCatchUp(void* db);
+  void BackgroundCatchUp() LOCKS_EXCLUDED(mutex_);
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
@@ -113,8 +320,37 @@ class DBImpl : public DB {
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Gather the range deletions of the compaction inputs into *tombstones,
+  // drop the inputs they wholly cover, and fill compact->tombstones.
+  Status PrepareCompactionTombstones(CompactionState* compact,
+                                     RangeTombstoneList* tombstones);
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Add an entry to the current output, opening one if necessary.
+  Status AddToCompactionOutput(CompactionState* compact,
+                               const Slice& key, const Slice& value);
+  // Combine the held back merge operand with "ikey", an older entry for
+  // its key, which is treated as a deletion if "deleted".  Writes the
+  // result out if it is a value.
+  Status CombinePendingMerge(CompactionState* compact,
+                             const ParsedInternalKey& ikey,
+                             const Slice& value, bool deleted);
+  // Write out the held back merge operand, if any.
+  Status FlushPendingMerge(CompactionState* compact);
+  // Apply the held back merge operand to *base (NULL if none) and write
+  // the result out as a value.
+  Status WritePendingMergeAsValue(CompactionState* compact, const Slice* base);
+  // Pass the value "ikey" to the compaction filter and write out what it
+  // leaves of it.
+  Status FilterCompactionValue(CompactionState* compact,
+                               const ParsedInternalKey& ikey,
+                               const Slice& value);
+  // Write the pending range deletions that start before "upper", or all
+  // of them if it is NULL, to the current output.
+  void AddCompactionTombstones(CompactionState* compact, const Slice* upper);
+  // "next_user_key" is the first user key of the next output, or NULL
+  // if this is the last.
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* next_user_key);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -127,9 +363,16 @@ class DBImpl : public DB {
   bool owns_cache_;
   const std::string dbname_;
 
+  // Set for an instance opened by DB::OpenAsSecondary(), which follows
+  // the files of a primary instance and never changes any.
+  const bool secondary_;
+
   // table_cache_ provides its own synchronization
   TableCache* table_cache_;
 
+  // Contents of the IDENTITY file, or empty if unknown
+  std::string db_id_;
+
   // Lock over the persistent DB state.  Non-NULL iff successfully acquired.
   FileLock* db_lock_;
 
@@ -137,29 +380,66 @@ class DBImpl : public DB {
   port::Mutex mutex_;
   port::AtomicPointer shutting_down_;
   port::CondVar bg_cv_;          // Signalled when background work finishes
-  MemTable* mem_;
-  MemTable* imm_;                // Memtable being compacted
-  port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+  ColumnFamilyData* default_cf_;
+  std::map<uint32_t, ColumnFamilyData*> column_families_;  // By id
+  port::AtomicPointer has_imm_;  // So bg thread can detect a non-NULL imm
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
   uint32_t seed_;                // For sampling.
 
+  // Obsolete log files kept to be overwritten by new logs, oldest first
+  // (see Options::recycle_log_file_num).
+  std::deque<uint64_t> logs_to_recycle_;
+  // Logs numbered this or higher were written by this DBImpl in the
+  // recyclable format, so may be recycled.  Zero until there is one.
+  uint64_t first_recyclable_log_;
+
+  // Logs that recovery no longer needs, kept for GetUpdatesSince() (see
+  // Options::wal_ttl_seconds), by number.
+  struct RetainedLog {
+    uint64_t obsolete_micros;  // When the log was found to be obsolete
+    uint64_t size;
+  };
+  std::map<uint64_t, RetainedLog> retained_logs_;
+
   // Queue of writers.
   std::deque<Writer*> writers_;
   WriteBatch* tmp_batch_;
 
   SnapshotList snapshots_;
 
-  // Set of table files to protect from deletion because they are
-  // part of ongoing compactions.
-  std::set<uint64_t> pending_outputs_;
-
   // Has a background compaction been scheduled or is running?
   bool bg_compaction_scheduled_;
 
+  // Has a stats dump been scheduled or is running?
+  bool bg_stats_dump_scheduled_;
+
+  // Secondary instances only.  Is a catch-up with the primary running,
+  // and has a periodic one been scheduled or is running?
+  bool catching_up_;
+  bool bg_catch_up_scheduled_;
+  // Earliest Env::NowNanos() at which the next periodic catch-up may be
+  // scheduled.  Read without holding mutex_.
+  port::AtomicUint64 next_catch_up_nanos_;
+  // The log number of the default family's descriptor when its memtable
+  // was started, the offset of the last record read from each log since,
+  // and the largest sequence number in the memtable.
+  uint64_t primary_log_number_;
+  std::map<uint64_t, uint64_t> primary_log_offsets_;
+  SequenceNumber primary_max_sequence_;
+
+  // Earliest Env::NowNanos() at which the next stats dump may be
+  // scheduled.  Read without holding mutex_.
+  port::AtomicUint64 next_stats_dump_nanos_;
+
+  // Latencies in nanoseconds of each LatencyOp, for "leveldb.perf".
+  // Updated without holding mutex_.
+  AtomicHistogram latency_[kNumLatencyOps];
+
   // Information for a manual compaction
   struct ManualCompaction {
+    ColumnFamilyData* cfd;
     int level;
     bool done;
     const InternalKey* begin;   // NULL means beginning of key range
@@ -168,27 +448,31 @@ class DBImpl : public DB {
   };
   ManualCompaction* manual_compaction_;
 
+  // The descriptor of the default column family, which also records the
+  // log file numbers, last sequence number and column families of the DB.
   VersionSet* versions_;
 
   // Have we encountered a background error in paranoid mode?
   Status bg_error_;
 
-  // Per level compaction stats.  stats_[level] stores the stats for
-  // compactions that produced data for the specified "level".
-  struct CompactionStats {
-    int64_t micros;
-    int64_t bytes_read;
-    int64_t bytes_written;
-
-    CompactionStats() : micros(0), bytes_read(0), bytes_written(0) { }
-
-    void Add(const CompactionStats& c) {
-      this->micros += c.micros;
-      this->bytes_read += c.bytes_read;
-      this->bytes_written += c.bytes_written;
-    }
+  // Where DB::Open spent its time; reported by "leveldb.open-stats".
+  struct OpenStats {
+    int64_t total_micros;
+    int64_t manifest_micros;    // Recovering the descriptor
+    int64_t log_micros;         // Replaying logs, including flushes
+    int64_t flush_micros;       // Writing level-0 tables during replay
+    int64_t preload_micros;     // Opening tables (table_preload_threads)
+    int log_files;
+    int64_t log_records;
+    int64_t log_bytes;
+    int tables_preloaded;
+
+    OpenStats()
+        : total_micros(0), manifest_micros(0), log_micros(0), flush_micros(0),
+          preload_micros(0), log_files(0), log_records(0), log_bytes(0),
+          tables_preloaded(0) { }
   };
-  CompactionStats stats_[config::kNumLevels];
+  OpenStats open_stats_;
 
   // No copying allowed
   DBImpl(const DBImpl&);
@@ -4,14 +4,19 @@
 
 #include "db/db_iter.h"
 
+#include <algorithm>
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
 #include "util/random.h"
 
 namespace leveldb {
@@ -43,33 +48,52 @@ class DBIter: public Iterator {
   //     the exact entry that yields this->key(), this->value()
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
+  // The exception is a value merged from operands while moving forward:
+  // it is kept in saved_key_/saved_value_, and the internal iterator is
+  // positioned after the entries that were merged.
   enum Direction {
     kForward,
     kReverse
   };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, ColumnFamilyHandle* column_family,
+         const Comparator* cmp, Iterator* iter, SequenceNumber s,
+         uint32_t seed, const Slice* upper_bound,
+         const SliceTransform* prefix_extractor,
+         const MergeOperator* merge_operator,
+         RangeTombstoneList* mem_tombstones,
+         const RangeTombstoneList* version_tombstones)
       : db_(db),
+        column_family_(column_family),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        upper_bound_(upper_bound),
+        prefix_extractor_(prefix_extractor),
+        merge_operator_(merge_operator),
+        mem_tombstones_(mem_tombstones),
+        version_tombstones_(version_tombstones),
+        prefix_active_(false),
         direction_(kForward),
         valid_(false),
+        merged_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()) {
   }
   virtual ~DBIter() {
     delete iter_;
+    delete mem_tombstones_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ?
+        ExtractUserKey(iter_->key()) : saved_key_;
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ?
+        iter_->value() : saved_value_;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -88,8 +112,54 @@ class DBIter: public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeValuesNewToOld();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Return true if "user_key" is at or past the upper bound, or lacks
+  // the prefix of the last Seek() target in prefix mode.  Forward
+  // iteration stops at the first such key.
+  bool OutOfRange(const Slice& user_key) const {
+    if (upper_bound_ != NULL &&
+        user_comparator_->Compare(user_key, *upper_bound_) >= 0) {
+      return true;
+    }
+    return prefix_active_ &&
+        !(prefix_extractor_->InDomain(user_key) &&
+          prefix_extractor_->Transform(user_key) == Slice(prefix_));
+  }
+
+  // Return the type of entry "ikey" as seen by this iterator: a value
+  // or merge operand covered by a newer range deletion reads as a
+  // deletion.
+  ValueType EntryType(const ParsedInternalKey& ikey) const {
+    if (ikey.type != kTypeValue && ikey.type != kTypeMerge) {
+      return ikey.type;
+    }
+    if ((mem_tombstones_ != NULL &&
+         mem_tombstones_->MaxCoveringSequence(ikey.user_key, sequence_) >
+             ikey.sequence) ||
+        (version_tombstones_ != NULL &&
+         version_tombstones_->MaxCoveringSequence(ikey.user_key, sequence_) >
+             ikey.sequence)) {
+      return kTypeDeletion;
+    }
+    return ikey.type;
+  }
+
+  // Reverse iteration is not supported in prefix mode.
+  bool ReverseNotSupported() {
+    if (prefix_extractor_ == NULL) {
+      return false;
+    }
+    status_ = Status::NotSupported(
+        "reverse iteration with ReadOptions::prefix_same_as_start");
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    direction_ = kForward;
+    return true;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -109,15 +179,25 @@ class DBIter: public Iterator {
   }
 
   DBImpl* db_;
+  ColumnFamilyHandle* const column_family_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const Slice* const upper_bound_;                 // May be NULL
+  const SliceTransform* const prefix_extractor_;   // NULL unless prefix mode
+  const MergeOperator* const merge_operator_;      // May be NULL
+  RangeTombstoneList* const mem_tombstones_;       // May be NULL
+  const RangeTombstoneList* const version_tombstones_;  // May be NULL
+  std::string prefix_;        // Prefix of the last Seek() target
+  bool prefix_active_;        // Keys must match prefix_
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool merged_;               // Current entry was merged while moving forward
+  std::vector<std::string> operands_;  // Scratch space for merging
 
   Random rnd_;
   ssize_t bytes_counter_;
@@ -133,7 +213,7 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   bytes_counter_ -= n;
   while (bytes_counter_ < 0) {
     bytes_counter_ += RandomPeriod();
-    db_->RecordReadSample(k);
+    db_->RecordReadSample(column_family_, k);
   }
   if (!ParseInternalKey(k, ikey)) {
     status_ = Status::Corruption("corrupted internal key in DBIter");
@@ -145,6 +225,8 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
 
 void DBIter::Next() {
   assert(valid_);
+  DBImpl::LatencyTimer latency(db_, DBImpl::kNextOp);
+  PerfCounterAdd(&PerfContext::iter_next_count, 1);
 
   if (direction_ == kReverse) {  // Switch directions?
     direction_ = kForward;
@@ -162,6 +244,16 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // saved_key_ already holds the current key, and iter_ is past the
+    // entries that were merged.
+    merged_ = false;
+    ClearSavedValue();
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -174,26 +266,40 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  PerfTimer timer(&PerfContext::find_next_user_entry_time);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+    const bool parsed = ParseKey(&ikey);
+    if (parsed && OutOfRange(ikey.user_key)) {
+      break;
+    }
+    if (parsed && ikey.sequence <= sequence_) {
+      switch (EntryType(ikey)) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
           SaveKey(ikey.user_key, skip);
           skipping = true;
+          PerfCounterAdd(&PerfContext::internal_delete_skipped_count, 1);
           break;
         case kTypeValue:
+        case kTypeMerge:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+            PerfCounterAdd(&PerfContext::internal_key_skipped_count, 1);
+          } else if (ikey.type == kTypeMerge) {
+            MergeValuesNewToOld();
+            return;
           } else {
             valid_ = true;
             saved_key_.clear();
             return;
           }
           break;
+        case kTypeRangeDeletion:
+          // Never found among point entries
+          break;
       }
     }
     iter_->Next();
@@ -202,14 +308,71 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::MergeValuesNewToOld() {
+  // iter_ is at the newest visible merge operand of its key.  Collect
+  // operands until the value or deletion they apply to, and leave iter_
+  // at that entry or past the key.
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  operands_.clear();
+  operands_.push_back(iter_->value().ToString());
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey)) {
+      break;
+    }
+    if (user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    const ValueType type = EntryType(ikey);
+    if (type == kTypeMerge) {
+      operands_.push_back(iter_->value().ToString());
+    } else {
+      if (type == kTypeValue) {
+        Slice raw_value = iter_->value();
+        saved_value_.assign(raw_value.data(), raw_value.size());
+        has_base = true;
+      }
+      break;
+    }
+  }
+  Slice base = saved_value_;
+  Status s = ApplyMergeOperands(merge_operator_, saved_key_,
+                                has_base ? &base : NULL, operands_,
+                                &saved_value_);
+  if (status_.ok() && !s.ok()) {
+    status_ = s;
+  }
+  if (!status_.ok()) {
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    return;
+  }
+  merged_ = true;
+  valid_ = true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
+  if (ReverseNotSupported()) {
+    return;
+  }
 
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    if (merged_) {
+      // saved_key_ holds the current key; iter_ is past some of its
+      // entries and possibly past the end.
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -232,7 +395,12 @@ void DBIter::Prev() {
 void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
+  // Entries for a key are seen from oldest to newest.  Merge operands
+  // are collected in operands_ on top of the value in saved_value_ (if
+  // has_base) and applied once the newest entry has been seen.
   ValueType value_type = kTypeDeletion;
+  bool has_base = false;
+  operands_.clear();
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
@@ -242,10 +410,20 @@ void DBIter::FindPrevUserEntry() {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
-        if (value_type == kTypeDeletion) {
+        const ValueType type = EntryType(ikey);
+        if (type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          operands_.clear();
+        } else if (type == kTypeMerge) {
+          if (value_type == kTypeDeletion) {
+            SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+            ClearSavedValue();
+            has_base = false;
+          } else if (value_type == kTypeValue) {
+            has_base = true;
+          }
+          operands_.push_back(iter_->value().ToString());
         } else {
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
@@ -254,12 +432,28 @@ void DBIter::FindPrevUserEntry() {
           }
           SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
           saved_value_.assign(raw_value.data(), raw_value.size());
+          operands_.clear();
         }
+        value_type = type;
       }
       iter_->Prev();
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeMerge) {
+    std::reverse(operands_.begin(), operands_.end());
+    Slice base = saved_value_;
+    Status s = ApplyMergeOperands(merge_operator_, saved_key_,
+                                  has_base ? &base : NULL, operands_,
+                                  &saved_value_);
+    if (!s.ok()) {
+      if (status_.ok()) {
+        status_ = s;
+      }
+      value_type = kTypeDeletion;
+    }
+  }
+
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -272,12 +466,25 @@ void DBIter::FindPrevUserEntry() {
 }
 
 void DBIter::Seek(const Slice& target) {
+  DBImpl::LatencyTimer latency(db_, DBImpl::kSeekOp);
+  PerfCounterAdd(&PerfContext::iter_seek_count, 1);
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   saved_key_.clear();
+  if (prefix_extractor_ != NULL) {
+    prefix_active_ = prefix_extractor_->InDomain(target);
+    if (prefix_active_) {
+      Slice prefix = prefix_extractor_->Transform(target);
+      prefix_.assign(prefix.data(), prefix.size());
+    }
+  }
   AppendInternalKey(
       &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
-  iter_->Seek(saved_key_);
+  {
+    PerfTimer timer(&PerfContext::seek_internal_time);
+    iter_->Seek(saved_key_);
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -286,9 +493,16 @@ void DBIter::Seek(const Slice& target) {
 }
 
 void DBIter::SeekToFirst() {
+  DBImpl::LatencyTimer latency(db_, DBImpl::kSeekOp);
+  PerfCounterAdd(&PerfContext::iter_seek_count, 1);
   direction_ = kForward;
+  merged_ = false;
+  prefix_active_ = false;
   ClearSavedValue();
-  iter_->SeekToFirst();
+  {
+    PerfTimer timer(&PerfContext::seek_internal_time);
+    iter_->SeekToFirst();
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -297,9 +511,31 @@ void DBIter::SeekToFirst() {
 }
 
 void DBIter::SeekToLast() {
+  DBImpl::LatencyTimer latency(db_, DBImpl::kSeekOp);
+  PerfCounterAdd(&PerfContext::iter_seek_count, 1);
+  if (ReverseNotSupported()) {
+    return;
+  }
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
-  iter_->SeekToLast();
+  PerfTimer timer(&PerfContext::seek_internal_time);
+  if (upper_bound_ == NULL) {
+    iter_->SeekToLast();
+  } else {
+    // Position just before every entry for user keys >= *upper_bound_
+    std::string bound;
+    AppendInternalKey(&bound, ParsedInternalKey(*upper_bound_,
+                                                kMaxSequenceNumber,
+                                                kValueTypeForSeek));
+    iter_->Seek(bound);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  }
+  timer.Stop();
   FindPrevUserEntry();
 }
 
@@ -307,11 +543,19 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(
     DBImpl* db,
+    ColumnFamilyHandle* column_family,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+    uint32_t seed,
+    const Slice* upper_bound,
+    const SliceTransform* prefix_extractor,
+    const MergeOperator* merge_operator,
+    RangeTombstoneList* mem_tombstones,
+    const RangeTombstoneList* version_tombstones) {
+  return new DBIter(db, column_family, user_key_comparator, internal_iter,
+                    sequence, seed, upper_bound, prefix_extractor,
+                    merge_operator, mem_tombstones, version_tombstones);
 }
 
 }  // namespace leveldb
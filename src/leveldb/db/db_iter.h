@@ -12,16 +12,38 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
+class RangeTombstoneList;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Read samples are charged to the tables
+// of "column_family".
+//
+// If "upper_bound" is non-NULL, only user keys before "*upper_bound" are
+// yielded.  If "prefix_extractor" is non-NULL, each Seek() to a key in its
+// domain yields only the user keys with the same prefix as the target,
+// and reverse iteration is not supported.
+//
+// Merge operands are applied with "merge_operator"; if it is NULL, the
+// iterator fails with NotSupported when it meets one.
+//
+// Values covered by the range deletions of "mem_tombstones" or
+// "version_tombstones" are treated as deleted; either may be NULL.  The
+// iterator takes ownership of "mem_tombstones" only; "version_tombstones"
+// must outlive "internal_iter".
 extern Iterator* NewDBIterator(
     DBImpl* db,
+    ColumnFamilyHandle* column_family,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed);
+    uint32_t seed,
+    const Slice* upper_bound,
+    const SliceTransform* prefix_extractor,
+    const MergeOperator* merge_operator,
+    RangeTombstoneList* mem_tombstones,
+    const RangeTombstoneList* version_tombstones);
 
 }  // namespace leveldb
 
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "db/db_impl.h"
@@ -9,8 +10,20 @@
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/env.h"
+#include "leveldb/listener.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
+#include "leveldb/table_factory.h"
+#include "leveldb/table_properties.h"
+#include "leveldb/transaction_log.h"
+#include "leveldb/write_batch.h"
+#include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -52,6 +65,69 @@ class AtomicCounter {
 void DelayMilliseconds(int millis) {
   Env::Default()->SleepForMicroseconds(millis * 1000);
 }
+
+// Appends operands to the value, separated by commas.
+class StringAppendOperator : public MergeOperator {
+ public:
+  virtual const char* Name() const { return "StringAppendOperator"; }
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& value, std::string* new_value) const {
+    new_value->clear();
+    if (existing_value != NULL) {
+      new_value->assign(existing_value->data(), existing_value->size());
+      new_value->push_back(',');
+    }
+    new_value->append(value.data(), value.size());
+    return true;
+  }
+};
+
+// Removes the values "drop" and replaces the values "change".
+class TestCompactionFilter : public CompactionFilter {
+ public:
+  virtual const char* Name() const { return "TestCompactionFilter"; }
+  virtual bool Filter(int level, const Slice& key, const Slice& value,
+                      std::string* new_value, bool* value_changed) const {
+    if (value == "drop") {
+      return true;
+    }
+    if (value == "change") {
+      *new_value = "changed";
+      *value_changed = true;
+    }
+    return false;
+  }
+};
+
+// Records the keys of each shard of a ParallelScan().
+class ScanCollector : public ScanHandler {
+ public:
+  port::Mutex mu_;
+  std::vector<std::vector<std::string> > shards_;
+  int stop_after_;  // Stop after this many entries if positive
+  int entries_;
+
+  ScanCollector() : stop_after_(0), entries_(0) { }
+
+  virtual bool Process(int shard, const Slice& key, const Slice& value) {
+    MutexLock l(&mu_);
+    if (shard >= static_cast<int>(shards_.size())) {
+      shards_.resize(shard + 1);
+    }
+    shards_[shard].push_back(key.ToString());
+    entries_++;
+    return stop_after_ <= 0 || entries_ < stop_after_;
+  }
+
+  // Keys of all shards, in shard order
+  std::vector<std::string> Keys() const {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < shards_.size(); i++) {
+      keys.insert(keys.end(), shards_[i].begin(), shards_[i].end());
+    }
+    return keys;
+  }
+};
 }
 
 // Special Env used to delay background operations
@@ -119,6 +195,7 @@ class SpecialEnv : public EnvWrapper {
         }
         return base_->Sync();
       }
+      std::string GetName() const { return base_->GetName(); }
     };
     class ManifestFile : public WritableFile {
      private:
@@ -143,6 +220,7 @@ class SpecialEnv : public EnvWrapper {
           return base_->Sync();
         }
       }
+      std::string GetName() const { return base_->GetName(); }
     };
 
     if (non_writable_.Acquire_Load() != NULL) {
@@ -176,6 +254,7 @@ class SpecialEnv : public EnvWrapper {
         counter_->Increment();
         return target_->Read(offset, n, result, scratch);
       }
+      virtual std::string GetName() const { return ""; }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
@@ -189,6 +268,8 @@ class SpecialEnv : public EnvWrapper {
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  TableFactory* plain_table_factory_;
+  const SliceTransform* prefix_extractor_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
@@ -196,6 +277,7 @@ class DBTest {
     kReuse,
     kFilter,
     kUncompressed,
+    kPlainTable,
     kEnd
   };
   int option_config_;
@@ -210,6 +292,8 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    plain_table_factory_ = NewPlainTableFactory();
+    prefix_extractor_ = NewFixedPrefixTransform(3);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -221,6 +305,8 @@ class DBTest {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete plain_table_factory_;
+    delete prefix_extractor_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -249,6 +335,10 @@ class DBTest {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPlainTable:
+        options.table_factory = plain_table_factory_;
+        options.prefix_extractor = prefix_extractor_;
+        break;
       default:
         break;
     }
@@ -367,6 +457,11 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            default:
+              break;
           }
         }
         iter->Next();
@@ -489,6 +584,21 @@ class DBTest {
     return false;
   }
 
+  std::vector<uint64_t> LogFileNumbers() {
+    std::vector<std::string> filenames;
+    ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+    std::vector<uint64_t> result;
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kLogFile) {
+        result.push_back(number);
+      }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
   // Returns number of files renamed.
   int RenameLDBToSST() {
     std::vector<std::string> filenames;
@@ -574,6 +684,29 @@ TEST(DBTest, GetMemUsage) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, HugePageMemTable) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 1 << 20;
+  options.arena_block_size = 64 << 10;
+  options.memtable_huge_page_size = 2 << 20;
+  Reopen(&options);
+
+  ASSERT_OK(Put("foo", "v1"));
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.approximate-memory-usage", &val));
+  ASSERT_GE(atoi(val.c_str()), 64 << 10);
+
+  // Flushes are still triggered by the memory in use, not reserved.
+  for (int i = 0; i < 3000; i++) {
+    ASSERT_OK(Put(NumberToString(i), std::string(1000, 'v')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(TotalTableFiles(), 1);
+  for (int i = 0; i < 3000; i += 100) {
+    ASSERT_EQ(std::string(1000, 'v'), Get(NumberToString(i)));
+  }
+}
+
 TEST(DBTest, GetSnapshot) {
   do {
     // Try with both a short key and a long key
@@ -864,6 +997,131 @@ TEST(DBTest, IterMultiWithDelete) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, IterUpperBound) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+
+    // Check the memtable first, then a table file
+    for (int pass = 0; pass < 2; pass++) {
+      if (pass == 1) {
+        dbfull()->TEST_CompactMemTable();
+      }
+      Slice bound("c");
+      ReadOptions ro;
+      ro.iterate_upper_bound = &bound;
+      Iterator* iter = db_->NewIterator(ro);
+      iter->SeekToFirst();
+      ASSERT_EQ(IterStatus(iter), "a->va");
+      iter->Next();
+      ASSERT_EQ(IterStatus(iter), "b->vb");
+      iter->Next();
+      ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+      iter->Seek("bb");
+      ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+      iter->SeekToLast();
+      ASSERT_EQ(IterStatus(iter), "b->vb");
+      iter->Prev();
+      ASSERT_EQ(IterStatus(iter), "a->va");
+      iter->Next();
+      ASSERT_EQ(IterStatus(iter), "b->vb");
+      iter->Next();
+      ASSERT_EQ(IterStatus(iter), "(invalid)");
+      ASSERT_OK(iter->status());
+      delete iter;
+    }
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, PrefixSeek) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  Reopen(&options);
+
+  // Prefixes "p000".."p099", except every one ending in 5
+  const std::string value(100, 'v');
+  for (int p = 0; p < 100; p++) {
+    if (p % 10 == 5) continue;
+    for (int j = 0; j < 10; j++) {
+      char key[100];
+      snprintf(key, sizeof(key), "p%03d/%d", p, j);
+      ASSERT_OK(Put(key, value));
+    }
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+
+  ReadOptions ro;
+  ro.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(ro);
+  int count = 0;
+  for (iter->Seek("p003"); iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(iter->key().starts_with("p003/"));
+    count++;
+  }
+  ASSERT_EQ(10, count);
+  ASSERT_OK(iter->status());
+
+  // A missing prefix is ruled out by the filter without reading a block
+  env_->random_read_counter_.Reset();
+  iter->Seek("p045");
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+
+  // Reverse iteration is not supported in prefix mode
+  iter->Seek("p007/3");
+  ASSERT_EQ(IterStatus(iter), "p007/3->" + value);
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+
+  // Without prefix mode the seek moves on to the next prefix
+  iter = db_->NewIterator(ReadOptions());
+  iter->Seek("p045");
+  ASSERT_EQ(IterStatus(iter), "p046/0->" + value);
+  delete iter;
+
+  // A bounded scan reads only a fraction of the blocks
+  ro = ReadOptions();
+  ro.readahead_blocks = 0;
+  iter = db_->NewIterator(ro);
+  env_->random_read_counter_.Reset();
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+  const int full_reads = env_->random_read_counter_.Read();
+  ASSERT_EQ(900, count);
+  delete iter;
+
+  Slice bound("p010");
+  ro.iterate_upper_bound = &bound;
+  iter = db_->NewIterator(ro);
+  env_->random_read_counter_.Reset();
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+  const int bounded_reads = env_->random_read_counter_.Read();
+  ASSERT_EQ(90, count);
+  delete iter;
+  ASSERT_LE(bounded_reads, full_reads / 5);
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
 TEST(DBTest, Recover) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -976,6 +1234,362 @@ TEST(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST(DBTest, RecycleLogFiles) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.recycle_log_file_num = 2;
+  options.paranoid_checks = true;
+  Reopen(&options);
+
+  // Every memtable switch either recycles a log or keeps the old one
+  // for recycling, so the number of log files is bounded.
+  const std::string value(1000, 'v');
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(Put(Key(i), value));
+    ASSERT_LE(LogFileNumbers().size(), 4);
+  }
+  dbfull()->TEST_CompactMemTable();
+  std::vector<uint64_t> logs = LogFileNumbers();
+  ASSERT_GE(logs.size(), 2);  // The current log plus those kept for reuse
+
+  // The current log is a recycled file whose old records must not be
+  // replayed or reported as corruption.
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Delete(Key(0)));
+  uint64_t current_size;
+  ASSERT_OK(env_->GetFileSize(LogFileName(dbname_, logs.back()),
+                              &current_size));
+  ASSERT_GT(current_size, 50000);
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ(value, Get(Key(999)));
+}
+
+TEST(DBTest, ReuseRecycledLog) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.recycle_log_file_num = 1;
+  options.reuse_logs = true;
+  DestroyAndReopen(&options);
+
+  // Make the current log a recycled file with old records after the
+  // new ones
+  const std::string value(1000, 'v');
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 10; j++) {
+      ASSERT_OK(Put(Key(j), value));
+    }
+    db_->CompactRange(NULL, NULL);
+  }
+  ASSERT_OK(Put("k1", "v1"));
+
+  // Records written after reopening must not be appended behind the
+  // leftovers, where they would not be replayed
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("k1"));
+  ASSERT_OK(Put("after", "v2"));
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("k1"));
+  ASSERT_EQ("v2", Get("after"));
+}
+
+TEST(DBTest, ManualWALFlush) {
+  Options options = CurrentOptions();
+  options.manual_wal_flush = true;
+  Reopen(&options);
+  std::vector<uint64_t> logs = LogFileNumbers();
+  ASSERT_EQ(1, logs.size());
+  const std::string log = LogFileName(dbname_, logs[0]);
+
+  uint64_t size;
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Put("bar", "v2"));
+  ASSERT_OK(env_->GetFileSize(log, &size));
+  ASSERT_EQ(0, size);
+  ASSERT_EQ("v1", Get("foo"));
+
+  ASSERT_OK(db_->FlushWAL(false));
+  ASSERT_OK(env_->GetFileSize(log, &size));
+  ASSERT_GT(size, 0);
+  const uint64_t flushed_size = size;
+
+  // A sync write writes out the buffer itself
+  ASSERT_OK(Put("baz", "v3"));
+  ASSERT_OK(env_->GetFileSize(log, &size));
+  ASSERT_EQ(flushed_size, size);
+  WriteOptions sync;
+  sync.sync = true;
+  ASSERT_OK(db_->Put(sync, "qux", "v4"));
+  ASSERT_OK(env_->GetFileSize(log, &size));
+  ASSERT_GT(size, flushed_size);
+  ASSERT_OK(db_->FlushWAL(true));
+
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v3", Get("baz"));
+  ASSERT_EQ("v4", Get("qux"));
+}
+
+TEST(DBTest, OpenStatsAndTablePreload) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put(Key(i), std::string(10000, 'a' + i % 26)));
+  }
+
+  // Leave a log with more than one chunk of records behind, then replay it
+  // while opening the resulting tables on several threads.
+  options.write_buffer_size = 10000000;
+  Reopen(&options);
+  for (int i = 50; i < 150; i++) {
+    ASSERT_OK(Put(Key(i), std::string(10000, 'a' + i % 26)));
+  }
+  options.table_preload_threads = 3;
+  Reopen(&options);
+  for (int i = 0; i < 150; i++) {
+    ASSERT_EQ(std::string(10000, 'a' + i % 26), Get(Key(i)));
+  }
+
+  int files = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    files += NumTableFilesAtLevel(level);
+  }
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.open-stats", &stats));
+  char expected[100];
+  snprintf(expected, sizeof(expected), "(%d tables)", files);
+  ASSERT_TRUE(stats.find(expected) != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find("100 records") != std::string::npos) << stats;
+}
+
+namespace {
+struct StatsDumpState {
+  port::Mutex mu;
+  int dumps;
+  std::string last;
+};
+
+static void RecordStatsDump(void* arg, const std::string& stats) {
+  StatsDumpState* state = reinterpret_cast<StatsDumpState*>(arg);
+  MutexLock l(&state->mu);
+  state->dumps++;
+  state->last = stats;
+}
+
+static int StatsDumps(StatsDumpState* state) {
+  MutexLock l(&state->mu);
+  return state->dumps;
+}
+}  // namespace
+
+TEST(DBTest, PerfContextAndLatencyStats) {
+  StatsDumpState dump_state;
+  dump_state.dumps = 0;
+  Options options = CurrentOptions();
+  options.block_cache = NewLRUCache(1 << 20);
+  options.stats_dump_period_sec = 1;
+  options.stats_dump_callback = &RecordStatsDump;
+  options.stats_dump_arg = &dump_state;
+  Reopen(&options);
+
+  SetPerfLevel(kEnableTime);
+  PerfContext* perf = GetPerfContext();
+  perf->Reset();
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_GT(perf->write_memtable_time, 0);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(1, perf->get_from_memtable_count);
+  ASSERT_EQ(0, perf->get_from_output_files_time);
+
+  // Reads from a table file go to the file on a block cache miss.
+  // (Blocks of memory-mapped files are not cached.)
+  dbfull()->TEST_CompactMemTable();
+  perf->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_GT(perf->get_from_output_files_time, 0);
+  ASSERT_EQ(1, perf->block_cache_miss_count);
+  ASSERT_EQ(1, perf->block_read_count);
+  ASSERT_GT(perf->block_read_byte, 0);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(2, perf->block_cache_hit_count + perf->block_cache_miss_count);
+  ASSERT_EQ(perf->block_cache_miss_count, perf->block_read_count);
+
+  perf->Reset();
+  ASSERT_OK(Put("bar", "v2"));
+  ASSERT_OK(Delete("baz"));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+  ASSERT_EQ(2, count);
+  delete iter;
+  ASSERT_EQ(1, perf->iter_seek_count);
+  ASSERT_EQ(2, perf->iter_next_count);
+  ASSERT_EQ(1, perf->internal_delete_skipped_count);
+  ASSERT_TRUE(perf->ToString().find("iter_next_count = 2") !=
+              std::string::npos) << perf->ToString();
+
+  // Per-thread counting can be turned off
+  SetPerfLevel(kDisablePerf);
+  perf->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("", perf->ToString());
+  SetPerfLevel(kEnableCount);
+
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.perf", &stats));
+  ASSERT_TRUE(stats.find("Get            4") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find("Seek           1") != std::string::npos) << stats;
+
+  // Operations after the dump period has passed trigger a dump
+  env_->SleepForMicroseconds(1100000);
+  ASSERT_EQ("v1", Get("foo"));
+  for (int i = 0; i < 1000 && StatsDumps(&dump_state) == 0; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  Close();  // Waits for any dump in progress
+  ASSERT_EQ(1, dump_state.dumps);
+  ASSERT_TRUE(dump_state.last.find("Compactions") != std::string::npos);
+  ASSERT_TRUE(dump_state.last.find("Get            5") != std::string::npos)
+      << dump_state.last;
+  delete options.block_cache;
+}
+
+namespace {
+class RecordingListener : public EventListener {
+ public:
+  port::Mutex mu;
+  std::vector<FlushJobInfo> flushes_begun;
+  std::vector<FlushJobInfo> flushes;
+  std::vector<CompactionJobInfo> compactions_begun;
+  std::vector<CompactionJobInfo> compactions;
+  std::vector<WriteStallInfo> stalls_begun;
+  std::vector<WriteStallInfo> stalls;
+
+  virtual void OnFlushBegin(const FlushJobInfo& info) {
+    MutexLock l(&mu);
+    flushes_begun.push_back(info);
+  }
+  virtual void OnFlushCompleted(const FlushJobInfo& info) {
+    MutexLock l(&mu);
+    flushes.push_back(info);
+  }
+  virtual void OnCompactionBegin(const CompactionJobInfo& info) {
+    MutexLock l(&mu);
+    compactions_begun.push_back(info);
+  }
+  virtual void OnCompactionCompleted(const CompactionJobInfo& info) {
+    MutexLock l(&mu);
+    compactions.push_back(info);
+  }
+  virtual void OnWriteStallBegin(const WriteStallInfo& info) {
+    MutexLock l(&mu);
+    stalls_begun.push_back(info);
+  }
+  virtual void OnWriteStallEnd(const WriteStallInfo& info) {
+    MutexLock l(&mu);
+    stalls.push_back(info);
+  }
+};
+
+struct StalledWrite {
+  DB* db;
+  port::AtomicPointer done;
+};
+
+static void StalledWriteBody(void* arg) {
+  StalledWrite* w = reinterpret_cast<StalledWrite*>(arg);
+  w->db->Put(WriteOptions(), "k3", std::string(100000, 'z'));
+  w->done.Release_Store(w);
+}
+}  // namespace
+
+TEST(DBTest, EventListener) {
+  RecordingListener listener;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;
+  options.listener = &listener;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "v1"));
+  ASSERT_OK(Put("z", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("a", "v2"));
+  ASSERT_OK(Put("z", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  {
+    MutexLock l(&listener.mu);
+    ASSERT_EQ(2, listener.flushes_begun.size());
+    ASSERT_EQ(2, listener.flushes.size());
+    for (int i = 0; i < 2; i++) {
+      const FlushJobInfo& f = listener.flushes[i];
+      ASSERT_EQ(dbname_, f.db_name);
+      ASSERT_EQ(listener.flushes_begun[i].file_number, f.file_number);
+      ASSERT_OK(f.status);
+      ASSERT_GT(f.file_size, 0);
+    }
+  }
+
+  // The second table overlaps the first, so lands just above it
+  const FlushJobInfo first = listener.flushes[0];
+  const FlushJobInfo second = listener.flushes[1];
+  ASSERT_EQ(first.level - 1, second.level);
+  dbfull()->TEST_CompactRange(second.level, NULL, NULL);
+  {
+    MutexLock l(&listener.mu);
+    ASSERT_EQ(1, listener.compactions_begun.size());
+    ASSERT_EQ(1, listener.compactions.size());
+    const CompactionJobInfo& c = listener.compactions[0];
+    ASSERT_EQ(second.level, c.level);
+    ASSERT_TRUE(c.is_manual);
+    ASSERT_TRUE(!c.is_trivial_move);
+    ASSERT_EQ(1, c.input_files.size());
+    ASSERT_EQ(second.file_number, c.input_files[0]);
+    ASSERT_EQ(1, c.input_files_next_level.size());
+    ASSERT_EQ(first.file_number, c.input_files_next_level[0]);
+    ASSERT_EQ(1, c.output_files.size());
+    ASSERT_TRUE(listener.compactions_begun[0].output_files.empty());
+    ASSERT_EQ(first.file_size + second.file_size, c.bytes_read);
+    ASSERT_GT(c.bytes_written, 0);
+    ASSERT_EQ(static_cast<double>(c.bytes_written) / second.file_size,
+              c.write_amplification);
+    ASSERT_OK(c.status);
+  }
+
+  // Block the flush of a full memtable so that the next write stalls
+  env_->delay_data_sync_.Release_Store(env_);
+  ASSERT_OK(Put("k1", std::string(100000, 'x')));
+  ASSERT_OK(Put("k2", std::string(100000, 'y')));
+  StalledWrite w;
+  w.db = db_;
+  w.done.Release_Store(NULL);
+  env_->StartThread(StalledWriteBody, &w);
+  bool stalled = false;
+  for (int i = 0; i < 1000 && !stalled; i++) {
+    DelayMilliseconds(10);
+    MutexLock l(&listener.mu);
+    stalled = !listener.stalls_begun.empty();
+  }
+  ASSERT_TRUE(stalled);
+  DelayMilliseconds(10);
+  ASSERT_TRUE(w.done.Acquire_Load() == NULL);
+  env_->delay_data_sync_.Release_Store(NULL);
+  while (w.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+  {
+    MutexLock l(&listener.mu);
+    ASSERT_EQ(1, listener.stalls_begun.size());
+    ASSERT_EQ(1, listener.stalls.size());
+    ASSERT_EQ(kStallMemtableFull, listener.stalls_begun[0].cause);
+    ASSERT_EQ(kStallMemtableFull, listener.stalls[0].cause);
+    ASSERT_GE(listener.stalls[0].micros, 10000);
+  }
+  Close();
+}
+
 TEST(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;        // Large write buffer
@@ -1002,6 +1616,36 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, DirectIOAndRateLimiterForCompaction) {
+  RateLimiter* limiter = NewRateLimiter(env_, 100 << 20);
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.use_direct_io_for_flush_and_compaction = true;
+  options.rate_limiter = limiter;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 40; i++) {
+    values.push_back(RandomString(&rnd, 100000));
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+
+  // Reopening flushes the memtable; then compact the result.
+  Reopen(&options);
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_GT(NumTableFilesAtLevel(1), 0);
+  for (int i = 0; i < 40; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+  // Both the flush and the compaction wrote through the limiter.
+  ASSERT_GE(limiter->GetTotalBytesThrough(), 2 * 40 * 100000);
+
+  Close();
+  delete limiter;
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1310,6 +1954,320 @@ TEST(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
+TEST(DBTest, DeleteRange) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_EQ("(a->va)(d->vd)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("vc", Get("c", snapshot));
+
+    // Later writes to the range are visible
+    ASSERT_OK(Put("c", "vc2"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vb", Get("b", snapshot));
+
+    // Recovered from the log
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "c", "z"));
+    db_->ReleaseSnapshot(snapshot);
+    Reopen();
+    ASSERT_EQ("(a->va)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("(a->va)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("d"));
+    ASSERT_EQ("[ ]", AllEntriesFor("d"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, DeleteRangeCompaction) {
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // A table holding only the range deletion lands above the data
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(10), Key(90)));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get(Key(50)));
+  ASSERT_EQ("v", Get(Key(90)));
+
+  // Covered entries go, and so does the deletion at the base level
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(50)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(50)));
+  ASSERT_EQ("v", Get(Key(9)));
+  int count = 0;
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(20, count);
+}
+
+TEST(DBTest, DeleteRangeDropsFiles) {
+  for (int i = 100; i < 200; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // A snapshot that can see the data keeps the file alive
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(0), Key(1000)));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get(Key(150)));
+  ASSERT_EQ("v", Get(Key(150), snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Without it the file is deleted without being read
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(0), Key(1000)));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("", FilesPerLevel());
+  ASSERT_EQ("", Contents());
+}
+
+TEST(DBTest, Merge) {
+  StringAppendOperator merge_operator;
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.merge_operator = &merge_operator;
+    DestroyAndReopen(&options);
+
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+    ASSERT_OK(Put("b", "x"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "b", "y"));
+    ASSERT_EQ("1,2", Get("a"));
+    ASSERT_EQ("x,y", Get("b"));
+    ASSERT_EQ("(a->1,2)(b->x,y)", Contents());
+
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "3"));
+    ASSERT_EQ("1,2,3", Get("a"));
+    ASSERT_EQ("1,2", Get("a", snapshot));
+
+    // Operands in the memtable apply on top of those in tables
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "4"));
+    ASSERT_EQ("1,2,3,4", Get("a"));
+    ASSERT_EQ("1,2", Get("a", snapshot));
+
+    // A deletion, or a range deletion, ends the operands
+    ASSERT_OK(Delete("b"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "b", "z"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "c", "1"));
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "c", "d"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "c", "2"));
+    ASSERT_EQ("(a->1,2,3,4)(b->z)(c->2)", Contents());
+    db_->ReleaseSnapshot(snapshot);
+
+    Reopen(&options);
+    ASSERT_EQ("(a->1,2,3,4)(b->z)(c->2)", Contents());
+
+    // Compactions only merge what every snapshot sees
+    snapshot = db_->GetSnapshot();
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "5"));
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("[ MERGE(5), 1,2,3,4 ]", AllEntriesFor("a"));
+    ASSERT_EQ("[ z ]", AllEntriesFor("b"));
+    ASSERT_EQ("[ 2 ]", AllEntriesFor("c"));
+    ASSERT_EQ("1,2,3,4", Get("a", snapshot));
+    db_->ReleaseSnapshot(snapshot);
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "6"));
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("[ 1,2,3,4,5,6 ]", AllEntriesFor("a"));
+    ASSERT_EQ("(a->1,2,3,4,5,6)(b->z)(c->2)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, MergeIteratorDirections) {
+  StringAppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = &merge_operator;
+  DestroyAndReopen(&options);
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "2"));
+  ASSERT_OK(Put("c", "vc"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_EQ("b->1,2", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("a->va", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("b->1,2", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("c->vc", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("b->1,2", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("c->vc", IterStatus(iter));
+
+  // Merged key at the end of the database
+  ASSERT_OK(db_->Merge(WriteOptions(), "d", "1"));
+  delete iter;
+  iter = db_->NewIterator(ReadOptions());
+  iter->Seek("d");
+  ASSERT_EQ("d->1", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("c->vc", IterStatus(iter));
+  iter->Seek("d");
+  iter->Next();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  delete iter;
+}
+
+TEST(DBTest, MergeWithoutOperator) {
+  ASSERT_TRUE(db_->Merge(WriteOptions(), "a", "1").IsNotSupportedError());
+  WriteBatch batch;
+  batch.Merge("a", "1");
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  std::string value;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "a", &value).IsNotSupportedError());
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+}
+
+TEST(DBTest, MergeCounter) {
+  const MergeOperator* merge_operator = NewUInt64AddOperator();
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = merge_operator;
+  options.write_buffer_size = 100000;
+  DestroyAndReopen(&options);
+  std::string one;
+  PutFixed64(&one, 1);
+  for (int i = 0; i < 10000; i++) {
+    ASSERT_OK(db_->Merge(WriteOptions(), Key(i % 10), one));
+  }
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(1000u, DecodeFixed64(Get(Key(i)).data()));
+  }
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(1000u, DecodeFixed64(Get(Key(3)).data()));
+  Close();
+  delete merge_operator;
+}
+
+TEST(DBTest, CompactionFilter) {
+  TestCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "drop"));
+  ASSERT_OK(Put("b", "change"));
+  ASSERT_OK(Put("c", "keep"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("d", "drop"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("drop", Get("a"));  // Memtable flushes are not filtered
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ changed ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ keep ]", AllEntriesFor("c"));
+  ASSERT_EQ("[ drop ]", AllEntriesFor("d"));  // Newer than the snapshot
+  db_->ReleaseSnapshot(snapshot);
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("d"));
+  ASSERT_EQ("(b->changed)(c->keep)", Contents());
+}
+
+TEST(DBTest, CompactionFilterKeepsOlderEntriesHidden) {
+  TestCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  ASSERT_OK(Put("e", "old"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(2, NULL, NULL);
+  ASSERT_OK(Put("d", "v"));
+  ASSERT_OK(Put("f", "v"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("e", "drop"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1,1", FilesPerLevel());
+
+  // The removed value turns into a deletion, since "old" is deeper down
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("[ DEL, old ]", AllEntriesFor("e"));
+  ASSERT_EQ("NOT_FOUND", Get("e"));
+}
+
+TEST(DBTest, ParallelScan) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.max_file_size = 1 << 20;  // Several tables to split between
+  Reopen(&options);
+  Random rnd(301);
+  const int N = 5000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  db_->CompactRange(NULL, NULL);
+  ASSERT_OK(Put(Key(N), "in memtable"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Delete(Key(0)));  // Not seen through the snapshot
+
+  ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  ScanCollector all;
+  ASSERT_OK(db_->ParallelScan(read_options, Range("", ""), 4, &all));
+  ASSERT_EQ(4, all.shards_.size());
+  std::vector<std::string> keys = all.Keys();
+  ASSERT_EQ(N + 1, keys.size());
+  for (int i = 0; i <= N; i++) {
+    ASSERT_EQ(Key(i), keys[i]);
+  }
+  for (size_t i = 0; i < all.shards_.size(); i++) {
+    ASSERT_GT(all.shards_[i].size(), N / 8);
+  }
+  db_->ReleaseSnapshot(snapshot);
+
+  ScanCollector part;
+  ASSERT_OK(db_->ParallelScan(ReadOptions(), Range(Key(0), Key(3000)), 3,
+                              &part));
+  keys = part.Keys();
+  ASSERT_EQ(2999, keys.size());
+  ASSERT_EQ(Key(1), keys.front());
+  ASSERT_EQ(Key(2999), keys.back());
+
+  // Returning false stops every shard
+  ScanCollector stopped;
+  stopped.stop_after_ = 10;
+  ASSERT_OK(db_->ParallelScan(ReadOptions(), Range("", ""), 4, &stopped));
+  ASSERT_LT(stopped.entries_, 50);
+}
+
 TEST(DBTest, OverlapInLevel0) {
   do {
     ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
@@ -1708,6 +2666,320 @@ TEST(DBTest, FilesDeletedAfterCompaction) {
   ASSERT_EQ(CountFiles(), num_files);
 }
 
+TEST(DBTest, TableProperties) {
+  ASSERT_OK(Put("a", "v1"));
+  ASSERT_OK(Put("b", "v2"));
+  ASSERT_OK(Delete("c"));
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "x", "z"));
+  dbfull()->TEST_CompactMemTable();
+
+  TablePropertiesCollection props;
+  ASSERT_OK(db_->GetPropertiesOfAllTables(&props));
+  ASSERT_EQ(1, static_cast<int>(props.size()));
+  const TableProperties p = props.begin()->second;
+  ASSERT_EQ(3u, p.num_entries);
+  ASSERT_EQ(1u, p.num_deletions);
+  ASSERT_EQ(1u, p.num_range_deletions);
+  ASSERT_EQ(3u * (1 + 8), p.raw_key_size);
+  ASSERT_EQ(4u, p.raw_value_size);
+  ASSERT_EQ(1u, p.num_data_blocks);
+  ASSERT_GT(p.data_size, 0u);
+  ASSERT_GT(p.index_size, 0u);
+  ASSERT_EQ(1u, p.smallest_seqno);
+  ASSERT_EQ(4u, p.largest_seqno);
+
+  // The properties are read back from the table
+  Reopen();
+  ASSERT_OK(db_->GetPropertiesOfAllTables(&props));
+  ASSERT_EQ(1, static_cast<int>(props.size()));
+  ASSERT_EQ(p.ToString(), props.begin()->second.ToString());
+}
+
+static std::string GetFrom(DB* db, const std::string& k) {
+  std::string result;
+  Status s = db->Get(ReadOptions(), k, &result);
+  if (s.IsNotFound()) {
+    result = "NOT_FOUND";
+  } else if (!s.ok()) {
+    result = s.ToString();
+  }
+  return result;
+}
+
+TEST(DBTest, OpenAsSecondary) {
+  ASSERT_OK(Put("a", "v1"));
+  ASSERT_OK(Put("b", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("c", "v3"));  // Only in the log
+
+  // The primary keeps its lock
+  const std::string secondary_path = test::TmpDir() + "/db_test_secondary";
+  DB* secondary;
+  ASSERT_OK(DB::OpenAsSecondary(CurrentOptions(), dbname_, secondary_path,
+                                &secondary));
+  ASSERT_EQ("v1", GetFrom(secondary, "a"));
+  ASSERT_EQ("v3", GetFrom(secondary, "c"));
+  ASSERT_TRUE(secondary->Put(WriteOptions(), "d", "x").IsNotSupportedError());
+  ASSERT_TRUE(db_->TryCatchUpWithPrimary().IsNotSupportedError());
+
+  // New log records show after catching up, but not in old snapshots
+  const Snapshot* snapshot = secondary->GetSnapshot();
+  ASSERT_OK(Put("c", "v4"));
+  ASSERT_OK(Delete("a"));
+  ASSERT_EQ("v3", GetFrom(secondary, "c"));
+  ASSERT_OK(secondary->TryCatchUpWithPrimary());
+  ASSERT_EQ("v4", GetFrom(secondary, "c"));
+  ASSERT_EQ("NOT_FOUND", GetFrom(secondary, "a"));
+  ReadOptions snapshot_options;
+  snapshot_options.snapshot = snapshot;
+  std::string value;
+  ASSERT_OK(secondary->Get(snapshot_options, "a", &value));
+  ASSERT_EQ("v1", value);
+  secondary->ReleaseSnapshot(snapshot);
+
+  // So do flushes and compactions, which delete the files they replace
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("e", "v5"));
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_OK(secondary->TryCatchUpWithPrimary());
+  ASSERT_EQ("NOT_FOUND", GetFrom(secondary, "a"));
+  ASSERT_EQ("v2", GetFrom(secondary, "b"));
+  ASSERT_EQ("v4", GetFrom(secondary, "c"));
+  ASSERT_EQ("v5", GetFrom(secondary, "e"));
+
+  // And a new descriptor written by reopening the primary
+  Reopen();
+  ASSERT_OK(Put("f", "v6"));
+  ASSERT_OK(secondary->TryCatchUpWithPrimary());
+  ASSERT_EQ("v6", GetFrom(secondary, "f"));
+  Iterator* iter = secondary->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(4, count);
+  delete iter;
+  delete secondary;
+
+  // Reads catch up in the background when asked to
+  Options options = CurrentOptions();
+  options.secondary_catch_up_period_ms = 1;
+  ASSERT_OK(DB::OpenAsSecondary(options, dbname_, secondary_path,
+                                &secondary));
+  ASSERT_OK(Put("g", "v7"));
+  for (int i = 0; i < 5000 && GetFrom(secondary, "g") != "v7"; i++) {
+    DelayMilliseconds(1);
+  }
+  ASSERT_EQ("v7", GetFrom(secondary, "g"));
+  delete secondary;
+  DestroyDB(secondary_path, Options());
+}
+
+TEST(DBTest, PlainTableFormat) {
+  TableFactory* plain = NewPlainTableFactory();
+  const SliceTransform* prefix = NewFixedPrefixTransform(3);
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.table_factory = plain;
+  options.prefix_extractor = prefix;
+  DestroyAndReopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+    ASSERT_OK(Put("p" + Key(i), "x"));
+  }
+  ASSERT_OK(Delete(Key(10)));
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(20), Key(30)));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put(Key(5), "new"));
+  dbfull()->TEST_CompactMemTable();
+
+  ASSERT_EQ("new", Get(Key(5)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(10)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(25)));
+  ASSERT_EQ(Key(30), Get(Key(30)));
+  ASSERT_EQ("x", Get("p" + Key(99)));
+  ASSERT_EQ("NOT_FOUND", Get("zzz"));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(200 - 1 - 10, count);
+  iter->Seek(Key(20));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(30), iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ(Key(19), iter->key().ToString());
+  delete iter;
+
+  TablePropertiesCollection props;
+  ASSERT_OK(db_->GetPropertiesOfAllTables(&props));
+  ASSERT_EQ(2, static_cast<int>(props.size()));
+
+  // The tables stay readable when the DB goes back to block-based
+  // tables, and compaction rewrites them in that format.
+  Reopen();
+  ASSERT_EQ("new", Get(Key(5)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(25)));
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("new", Get(Key(5)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(25)));
+  ASSERT_EQ("x", Get("p" + Key(0)));
+
+  Close();
+  delete prefix;
+  delete plain;
+}
+
+// Apply to "follower" the batches from "iter", and return the last
+// sequence number applied, or "last" if there were none.
+static uint64_t ApplyUpdates(TransactionLogIterator* iter, DB* follower,
+                             uint64_t last) {
+  for (; iter->Valid(); iter->Next()) {
+    ASSERT_EQ(last + 1, iter->sequence());
+    WriteBatch batch = iter->batch();
+    ASSERT_OK(follower->Write(WriteOptions(), &batch));
+    last = iter->last_sequence();
+  }
+  ASSERT_OK(iter->status());
+  return last;
+}
+
+TEST(DBTest, GetUpdatesSince) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.wal_ttl_seconds = 3600;
+  DestroyAndReopen(&options);
+  const std::string follower_path = test::TmpDir() + "/db_test_follower";
+  DestroyDB(follower_path, Options());
+  DB* follower;
+  ASSERT_OK(DB::Open(options, follower_path, &follower));
+
+  ASSERT_OK(Put("a", "v1"));
+  WriteBatch batch;
+  batch.Put("b", "v2");
+  batch.Put("c", "v3");
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  dbfull()->TEST_CompactMemTable();  // The logs are kept all the same
+  ASSERT_OK(Delete("a"));
+  Reopen(&options);
+  ASSERT_OK(Put("d", "v4"));
+
+  TransactionLogIterator* iter;
+  ASSERT_OK(db_->GetUpdatesSince(1, &iter));
+  ASSERT_TRUE(iter->Valid());
+  uint64_t last = ApplyUpdates(iter, follower, 0);
+  delete iter;
+  ASSERT_EQ(5, last);
+  ASSERT_EQ("NOT_FOUND", GetFrom(follower, "a"));
+  ASSERT_EQ("v2", GetFrom(follower, "b"));
+  ASSERT_EQ("v3", GetFrom(follower, "c"));
+  ASSERT_EQ("v4", GetFrom(follower, "d"));
+
+  // Resume after the last batch seen
+  ASSERT_OK(db_->GetUpdatesSince(last + 1, &iter));
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+  delete iter;
+  ASSERT_OK(Put("e", "v5"));
+  ASSERT_OK(db_->GetUpdatesSince(last + 1, &iter));
+  last = ApplyUpdates(iter, follower, last);
+  delete iter;
+  ASSERT_EQ(6, last);
+  ASSERT_EQ("v5", GetFrom(follower, "e"));
+
+  // Starting in the middle of a batch returns all of it
+  ASSERT_OK(db_->GetUpdatesSince(3, &iter));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(2, iter->sequence());
+  ASSERT_EQ(3, iter->last_sequence());
+  delete iter;
+  delete follower;
+  DestroyDB(follower_path, Options());
+
+  // Without retention the flushed updates are gone
+  options.wal_ttl_seconds = 0;
+  Reopen(&options);
+  ASSERT_OK(Put("f", "v6"));
+  ASSERT_OK(db_->GetUpdatesSince(1, &iter));
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotFound());
+  delete iter;
+}
+
+static void DeleteDirContents(Env* env, const std::string& dir) {
+  std::vector<std::string> children;
+  env->GetChildren(dir, &children);
+  for (size_t i = 0; i < children.size(); i++) {
+    env->DeleteFile(dir + "/" + children[i]);
+  }
+  env->DeleteDir(dir);
+}
+
+// Reads into the caller's buffer even where the base Env would hand out
+// a pointer into an mmap'ed file, whose blocks are not cached.
+class CopyingEnv : public EnvWrapper {
+ public:
+  explicit CopyingEnv(Env* base) : EnvWrapper(base) { }
+
+  Status NewRandomAccessFile(const std::string& f, RandomAccessFile** r) {
+    class CopyingFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+     public:
+      explicit CopyingFile(RandomAccessFile* target) : target_(target) { }
+      virtual ~CopyingFile() { delete target_; }
+      virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                          char* scratch) const {
+        Status s = target_->Read(offset, n, result, scratch);
+        if (s.ok() && result->data() != scratch) {
+          memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
+      }
+      virtual std::string GetName() const { return ""; }
+    };
+
+    Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok()) {
+      *r = new CopyingFile(*r);
+    }
+    return s;
+  }
+};
+
+TEST(DBTest, PersistentCacheOutlivesDB) {
+  const std::string cache_dir = test::TmpDir() + "/db_test_pcache";
+  DeleteDirContents(env_, cache_dir);
+  CopyingEnv env(env_);
+  for (int run = 0; run < 2; run++) {
+    // Each run makes the DB afresh, with the same file numbers
+    PersistentCache* cache;
+    ASSERT_OK(NewFilePersistentCache(env_, cache_dir, 1 << 20, &cache));
+    Options options = CurrentOptions();
+    options.env = &env;
+    options.create_if_missing = true;
+    options.persistent_cache = cache;
+    DestroyAndReopen(&options);
+    const std::string value = (run == 0 ? "first" : "other");
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), value));
+    }
+    dbfull()->TEST_CompactMemTable();
+    Reopen(&options);  // Empties the block cache
+    ASSERT_EQ(value, Get(Key(50)));
+    Close();
+    delete cache;
+  }
+  DeleteDirContents(env_, cache_dir);
+}
+
 TEST(DBTest, BloomFilter) {
   env_->count_random_reads_ = true;
   Options options = CurrentOptions();
@@ -1907,6 +3179,12 @@ class ModelDB: public DB {
       virtual void Delete(const Slice& key) {
         map_->erase(key.ToString());
       }
+      virtual void DeleteRange(const Slice& begin, const Slice& end) {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -1923,6 +3201,34 @@ class ModelDB: public DB {
   }
   virtual void CompactRange(const Slice* start, const Slice* end) {
   }
+  virtual Status FlushWAL(bool sync) {
+    return Status::OK();
+  }
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle) {
+    return Status::NotSupported("column families");
+  }
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const {
+    return NULL;
+  }
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key, std::string* value) {
+    assert(false);      // Not implemented
+    return Status::NotFound(key);
+  }
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family) {
+    return NewIterator(options);
+  }
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value) {
+    return false;
+  }
+  virtual void CompactRange(ColumnFamilyHandle* column_family,
+                            const Slice* start, const Slice* end) {
+  }
 
  private:
   class ModelIter: public Iterator {
@@ -2056,6 +3362,8 @@ TEST(DBTest, Randomized) {
           if (rnd.OneIn(2)) {
             v = RandomString(&rnd, rnd.Uniform(10));
             b.Put(k, v);
+          } else if (rnd.OneIn(10)) {
+            b.DeleteRange(k, RandomKey(&rnd));
           } else {
             b.Delete(k);
           }
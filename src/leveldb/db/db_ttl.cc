@@ -0,0 +1,319 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/ttl.h"
+
+#include <stdint.h>
+#include "leveldb/compaction_filter.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/write_batch.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// Every value is followed by the time it was written, in seconds since
+// the epoch, as a fixed32.
+static const size_t kTimestampSize = sizeof(uint32_t);
+
+static Slice StripTimestamp(const Slice& value) {
+  return Slice(value.data(), value.size() - kTimestampSize);
+}
+
+static Status MissingTimestamp() {
+  return Status::Corruption("value without TTL timestamp");
+}
+
+// Removes the values that are older than the time-to-live, and passes
+// the others to the user's filter, if any.
+class TTLCompactionFilter : public CompactionFilter {
+ public:
+  TTLCompactionFilter(Env* env, int ttl, const CompactionFilter* user_filter)
+      : env_(env), ttl_(ttl), user_filter_(user_filter) { }
+
+  virtual const char* Name() const {
+    return "leveldb.TTL";
+  }
+
+  virtual bool Filter(int level, const Slice& key,
+                      const Slice& existing_value,
+                      std::string* new_value,
+                      bool* value_changed) const {
+    if (existing_value.size() < kTimestampSize) {
+      return false;  // Not written through the TTL database; keep it
+    }
+    const uint32_t written = DecodeFixed32(
+        existing_value.data() + existing_value.size() - kTimestampSize);
+    if (ttl_ > 0) {
+      const uint64_t now = env_->NowMicros() / 1000000;
+      if (static_cast<uint64_t>(written) + ttl_ < now) {
+        return true;
+      }
+    }
+    if (user_filter_ == NULL) {
+      return false;
+    }
+    if (user_filter_->Filter(level, key, StripTimestamp(existing_value),
+                             new_value, value_changed)) {
+      return true;
+    }
+    if (*value_changed) {
+      PutFixed32(new_value, written);
+    }
+    return false;
+  }
+
+ private:
+  Env* const env_;
+  const int ttl_;
+  const CompactionFilter* const user_filter_;
+};
+
+// Rewrites a batch with the current time after every value.
+class TimestampInserter : public WriteBatch::Handler {
+ public:
+  WriteBatch* batch_;
+  std::string timestamp_;
+  Status status_;
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    std::string v(value.data(), value.size());
+    v.append(timestamp_);
+    batch_->Put(key, v);
+  }
+  virtual void Delete(const Slice& key) {
+    batch_->Delete(key);
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    batch_->DeleteRange(begin, end);
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    Unsupported();
+  }
+  virtual void PutCF(uint32_t id, const Slice& key, const Slice& value) {
+    Unsupported();
+  }
+  virtual void DeleteCF(uint32_t id, const Slice& key) {
+    Unsupported();
+  }
+  virtual void DeleteRangeCF(uint32_t id, const Slice& begin,
+                             const Slice& end) {
+    Unsupported();
+  }
+  virtual void MergeCF(uint32_t id, const Slice& key, const Slice& value) {
+    Unsupported();
+  }
+
+ private:
+  void Unsupported() {
+    if (status_.ok()) {
+      status_ = Status::NotSupported("operation on a database with TTL");
+    }
+  }
+};
+
+// Stops with a Corruption status at a value without a timestamp, as
+// TTLDB::Get() reports one.
+class TTLIterator : public Iterator {
+ public:
+  explicit TTLIterator(Iterator* iter) : iter_(iter) { }
+  virtual ~TTLIterator() { delete iter_; }
+
+  virtual bool Valid() const { return status_.ok() && iter_->Valid(); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); CheckValue(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); CheckValue(); }
+  virtual void Seek(const Slice& target) { iter_->Seek(target); CheckValue(); }
+  virtual void Next() { iter_->Next(); CheckValue(); }
+  virtual void Prev() { iter_->Prev(); CheckValue(); }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return StripTimestamp(iter_->value()); }
+  virtual Status status() const {
+    return status_.ok() ? iter_->status() : status_;
+  }
+
+ private:
+  void CheckValue() {
+    if (status_.ok() && iter_->Valid() &&
+        iter_->value().size() < kTimestampSize) {
+      status_ = MissingTimestamp();
+    }
+  }
+
+  Iterator* const iter_;
+  Status status_;
+
+  // No copying allowed
+  TTLIterator(const TTLIterator&);
+  void operator=(const TTLIterator&);
+};
+
+// Hands the user's handler the values without their timestamps, and
+// stops the scan at a value without one.
+class TTLScanHandler : public ScanHandler {
+ public:
+  explicit TTLScanHandler(ScanHandler* handler) : handler_(handler) { }
+
+  virtual bool Process(int shard, const Slice& key, const Slice& value) {
+    if (value.size() < kTimestampSize) {
+      MutexLock l(&mu_);
+      status_ = MissingTimestamp();
+      return false;
+    }
+    return handler_->Process(shard, key, StripTimestamp(value));
+  }
+
+  Status status() {
+    MutexLock l(&mu_);
+    return status_;
+  }
+
+ private:
+  ScanHandler* const handler_;
+  port::Mutex mu_;
+  Status status_;  // Protected by mu_
+};
+
+class TTLDB : public DB {
+ public:
+  TTLDB(Env* env, TTLCompactionFilter* filter)
+      : env_(env), filter_(filter), db_(NULL) { }
+
+  virtual ~TTLDB() {
+    delete db_;       // Stops compactions, which use filter_
+    delete filter_;
+  }
+
+  Status Open(const Options& options, const std::string& name) {
+    Options opts = options;
+    opts.compaction_filter = filter_;
+    return DB::Open(opts, name, &db_);
+  }
+
+  virtual Status Put(const WriteOptions& o, const Slice& k, const Slice& v) {
+    return DB::Put(o, k, v);
+  }
+  virtual Status Delete(const WriteOptions& o, const Slice& key) {
+    return DB::Delete(o, key);
+  }
+  virtual Status Write(const WriteOptions& options, WriteBatch* updates) {
+    if (updates == NULL) {
+      return db_->Write(options, NULL);
+    }
+    WriteBatch batch;
+    TimestampInserter inserter;
+    inserter.batch_ = &batch;
+    PutFixed32(&inserter.timestamp_,
+               static_cast<uint32_t>(env_->NowMicros() / 1000000));
+    Status s = updates->Iterate(&inserter);
+    if (s.ok()) {
+      s = inserter.status_;
+    }
+    if (s.ok()) {
+      s = db_->Write(options, &batch);
+    }
+    return s;
+  }
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key, std::string* value) {
+    return Get(options, db_->DefaultColumnFamily(), key, value);
+  }
+  virtual Iterator* NewIterator(const ReadOptions& options) {
+    return new TTLIterator(db_->NewIterator(options));
+  }
+  virtual const Snapshot* GetSnapshot() {
+    return db_->GetSnapshot();
+  }
+  virtual void ReleaseSnapshot(const Snapshot* snapshot) {
+    db_->ReleaseSnapshot(snapshot);
+  }
+  virtual bool GetProperty(const Slice& property, std::string* value) {
+    return db_->GetProperty(property, value);
+  }
+  virtual void GetApproximateSizes(const Range* range, int n,
+                                   uint64_t* sizes) {
+    db_->GetApproximateSizes(range, n, sizes);
+  }
+  virtual Status ParallelScan(const ReadOptions& options, const Range& range,
+                              int n, ScanHandler* handler) {
+    TTLScanHandler ttl_handler(handler);
+    Status s = db_->ParallelScan(options, range, n, &ttl_handler);
+    if (s.ok()) {
+      s = ttl_handler.status();
+    }
+    return s;
+  }
+  virtual void CompactRange(const Slice* begin, const Slice* end) {
+    db_->CompactRange(begin, end);
+  }
+  virtual Status FlushWAL(bool sync) {
+    return db_->FlushWAL(sync);
+  }
+  virtual Status GetCheckpointFiles(CheckpointHandler* handler) {
+    return db_->GetCheckpointFiles(handler);
+  }
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle) {
+    *handle = NULL;
+    return Status::NotSupported("column families with TTL");
+  }
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const {
+    return db_->DefaultColumnFamily();
+  }
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key, std::string* value) {
+    Status s = db_->Get(options, column_family, key, value);
+    if (s.ok()) {
+      if (value->size() < kTimestampSize) {
+        return MissingTimestamp();
+      }
+      value->resize(value->size() - kTimestampSize);
+    }
+    return s;
+  }
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family) {
+    return new TTLIterator(db_->NewIterator(options, column_family));
+  }
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value) {
+    return db_->GetProperty(column_family, property, value);
+  }
+  virtual void CompactRange(ColumnFamilyHandle* column_family,
+                            const Slice* begin, const Slice* end) {
+    db_->CompactRange(column_family, begin, end);
+  }
+
+ private:
+  Env* const env_;
+  TTLCompactionFilter* const filter_;
+  DB* db_;
+
+  // No copying allowed
+  TTLDB(const TTLDB&);
+  void operator=(const TTLDB&);
+};
+
+}  // namespace
+
+Status OpenDBWithTTL(const Options& options, const std::string& name,
+                     int ttl_seconds, DB** dbptr) {
+  *dbptr = NULL;
+  TTLDB* db = new TTLDB(options.env, new TTLCompactionFilter(
+      options.env, ttl_seconds, options.compaction_filter));
+  Status s = db->Open(options, name);
+  if (s.ok()) {
+    *dbptr = db;
+  } else {
+    delete db;
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -12,7 +12,7 @@
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 #include "leveldb/status.h"
-#include "leveldb/table.h"
+#include "leveldb/table_factory.h"
 #include "leveldb/write_batch.h"
 #include "util/logging.h"
 
@@ -20,7 +20,7 @@ namespace leveldb {
 
 namespace {
 
-bool GuessType(const std::string& fname, FileType* type) {
+bool GuessType(const std::string& fname, uint64_t* number, FileType* type) {
   size_t pos = fname.rfind('/');
   std::string basename;
   if (pos == std::string::npos) {
@@ -28,8 +28,12 @@ bool GuessType(const std::string& fname, FileType* type) {
   } else {
     basename = std::string(fname.data() + pos + 1, fname.size() - pos - 1);
   }
+  return ParseFileName(basename, number, type);
+}
+
+bool GuessType(const std::string& fname, FileType* type) {
   uint64_t ignored;
-  return ParseFileName(basename, &ignored, type);
+  return GuessType(fname, &ignored, type);
 }
 
 // Notified when log reader encounters corruption.
@@ -47,7 +51,9 @@ class CorruptionReporter : public log::Reader::Reporter {
 };
 
 // Print contents of a log file. (*func)() is called on every record.
+// "log_number" is that of a write-ahead log (see log::Reader), else 0.
 Status PrintLogContents(Env* env, const std::string& fname,
+                        uint64_t log_number,
                         void (*func)(uint64_t, Slice, WritableFile*),
                         WritableFile* dst) {
   SequentialFile* file;
@@ -57,7 +63,7 @@ Status PrintLogContents(Env* env, const std::string& fname,
   }
   CorruptionReporter reporter;
   reporter.dst_ = dst;
-  log::Reader reader(file, &reporter, true, 0);
+  log::Reader reader(file, &reporter, true, 0, log_number);
   Slice record;
   std::string scratch;
   while (reader.ReadRecord(&record, &scratch)) {
@@ -85,6 +91,51 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    std::string r = "  delrange '";
+    AppendEscapedStringTo(&r, begin);
+    r += "' '";
+    AppendEscapedStringTo(&r, end);
+    r += "'\n";
+    dst_->Append(r);
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    std::string r = "  merge '";
+    AppendEscapedStringTo(&r, key);
+    r += "' '";
+    AppendEscapedStringTo(&r, value);
+    r += "'\n";
+    dst_->Append(r);
+  }
+  virtual void PutCF(uint32_t id, const Slice& key, const Slice& value) {
+    PrintCF("put", id, key, &value);
+  }
+  virtual void DeleteCF(uint32_t id, const Slice& key) {
+    PrintCF("del", id, key, NULL);
+  }
+  virtual void DeleteRangeCF(uint32_t id, const Slice& begin,
+                             const Slice& end) {
+    PrintCF("delrange", id, begin, &end);
+  }
+  virtual void MergeCF(uint32_t id, const Slice& key, const Slice& value) {
+    PrintCF("merge", id, key, &value);
+  }
+
+ private:
+  void PrintCF(const char* op, uint32_t id, const Slice& a, const Slice* b) {
+    std::string r = "  ";
+    r += op;
+    r += " [cf ";
+    AppendNumberTo(&r, id);
+    r += "] '";
+    AppendEscapedStringTo(&r, a);
+    if (b != NULL) {
+      r += "' '";
+      AppendEscapedStringTo(&r, *b);
+    }
+    r += "'\n";
+    dst_->Append(r);
+  }
 };
 
 
@@ -116,7 +167,10 @@ static void WriteBatchPrinter(uint64_t pos, Slice record, WritableFile* dst) {
 }
 
 Status DumpLog(Env* env, const std::string& fname, WritableFile* dst) {
-  return PrintLogContents(env, fname, WriteBatchPrinter, dst);
+  uint64_t number = 0;
+  FileType type;
+  GuessType(fname, &number, &type);
+  return PrintLogContents(env, fname, number, WriteBatchPrinter, dst);
 }
 
 // Called on every log record (each one of which is a WriteBatch)
@@ -137,13 +191,13 @@ static void VersionEditPrinter(uint64_t pos, Slice record, WritableFile* dst) {
 }
 
 Status DumpDescriptor(Env* env, const std::string& fname, WritableFile* dst) {
-  return PrintLogContents(env, fname, VersionEditPrinter, dst);
+  return PrintLogContents(env, fname, 0, VersionEditPrinter, dst);
 }
 
 Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
   uint64_t file_size;
   RandomAccessFile* file = NULL;
-  Table* table = NULL;
+  TableReader* table = NULL;
   Status s = env->GetFileSize(fname, &file_size);
   if (s.ok()) {
     s = env->NewRandomAccessFile(fname, &file);
@@ -153,7 +207,9 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
     // comparator used in this database. However this should not cause
     // problems since we only use Table operations that do not require
     // any comparisons.  In particular, we do not call Seek or Prev.
-    s = Table::Open(Options(), file, file_size, &table);
+    // Both built-in table formats are recognized.
+    s = BlockBasedTableFactory()->NewTableReader(Options(), file, file_size,
+                                                 &table);
   }
   if (!s.ok()) {
     delete table;
@@ -185,6 +241,8 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
         r += "del";
       } else if (key.type == kTypeValue) {
         r += "val";
+      } else if (key.type == kTypeMerge) {
+        r += "merge";
       } else {
         AppendNumberTo(&r, key.type);
       }
@@ -7,6 +7,7 @@
 #include "db/filename.h"
 #include "db/dbformat.h"
 #include "leveldb/env.h"
+#include "util/hash.h"
 #include "util/logging.h"
 
 namespace leveldb {
@@ -60,6 +61,10 @@ std::string TempFileName(const std::string& dbname, uint64_t number) {
   return MakeFileName(dbname, number, "dbtmp");
 }
 
+std::string IdentityFileName(const std::string& dbname) {
+  return dbname + "/IDENTITY";
+}
+
 std::string InfoLogFileName(const std::string& dbname) {
   return dbname + "/LOG";
 }
@@ -69,14 +74,23 @@ std::string OldInfoLogFileName(const std::string& dbname) {
   return dbname + "/LOG.old";
 }
 
+std::string ColumnFamilyDirName(const std::string& dbname, uint32_t id) {
+  assert(id > 0);
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/cf-%06u", static_cast<unsigned int>(id));
+  return dbname + buf;
+}
+
 
 // Owned filenames have the form:
 //    dbname/CURRENT
+//    dbname/IDENTITY
 //    dbname/LOCK
 //    dbname/LOG
 //    dbname/LOG.old
 //    dbname/MANIFEST-[0-9]+
 //    dbname/[0-9]+.(log|sst|ldb)
+//    dbname/cf-[0-9]+
 bool ParseFileName(const std::string& fname,
                    uint64_t* number,
                    FileType* type) {
@@ -84,6 +98,9 @@ bool ParseFileName(const std::string& fname,
   if (rest == "CURRENT") {
     *number = 0;
     *type = kCurrentFile;
+  } else if (rest == "IDENTITY") {
+    *number = 0;
+    *type = kIdentityFile;
   } else if (rest == "LOCK") {
     *number = 0;
     *type = kDBLockFile;
@@ -101,6 +118,17 @@ bool ParseFileName(const std::string& fname,
     }
     *type = kDescriptorFile;
     *number = num;
+  } else if (rest.starts_with("cf-")) {
+    rest.remove_prefix(strlen("cf-"));
+    uint64_t num;
+    if (!ConsumeDecimalNumber(&rest, &num)) {
+      return false;
+    }
+    if (!rest.empty()) {
+      return false;
+    }
+    *type = kColumnFamilyDir;
+    *number = num;
   } else {
     // Avoid strtoull() to keep filename format independent of the
     // current locale
@@ -141,4 +169,25 @@ Status SetCurrentFile(Env* env, const std::string& dbname,
   return s;
 }
 
+Status SetIdentityFile(Env* env, const std::string& dbname,
+                       std::string* id) {
+  // Only one process can create a db at a time, so the time and the
+  // name of the db are enough to tell its incarnations and copies apart.
+  char buf[100];
+  snprintf(buf, sizeof(buf), "%016llx-%08x",
+           static_cast<unsigned long long>(env->NowMicros()),
+           static_cast<unsigned int>(Hash(dbname.data(), dbname.size(), 0)));
+  std::string tmp = TempFileName(dbname, 0);
+  Status s = WriteStringToFileSync(env, std::string(buf) + "\n", tmp);
+  if (s.ok()) {
+    s = env->RenameFile(tmp, IdentityFileName(dbname));
+  }
+  if (s.ok()) {
+    *id = buf;
+  } else {
+    env->DeleteFile(tmp);
+  }
+  return s;
+}
+
 }  // namespace leveldb
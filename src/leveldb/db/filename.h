@@ -24,7 +24,9 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kColumnFamilyDir,
+  kIdentityFile
 };
 
 // Return the name of the log file with the specified number
@@ -57,6 +59,10 @@ extern std::string CurrentFileName(const std::string& dbname);
 // "dbname".  The result will be prefixed with "dbname".
 extern std::string LockFileName(const std::string& dbname);
 
+// Return the name of the file that holds the unique id of the db named
+// by "dbname".  The result will be prefixed with "dbname".
+extern std::string IdentityFileName(const std::string& dbname);
+
 // Return the name of a temporary file owned by the db named "dbname".
 // The result will be prefixed with "dbname".
 extern std::string TempFileName(const std::string& dbname, uint64_t number);
@@ -67,6 +73,12 @@ extern std::string InfoLogFileName(const std::string& dbname);
 // Return the name of the old info log file for "dbname".
 extern std::string OldInfoLogFileName(const std::string& dbname);
 
+// Return the name of the directory that holds the tables and descriptor
+// of column family "id" of "dbname".  The result will be prefixed with
+// "dbname".
+extern std::string ColumnFamilyDirName(const std::string& dbname,
+                                       uint32_t id);
+
 // If filename is a leveldb file, store the type of the file in *type.
 // The number encoded in the filename is stored in *number.  If the
 // filename was successfully parsed, returns true.  Else return false.
@@ -79,6 +91,11 @@ extern bool ParseFileName(const std::string& filename,
 extern Status SetCurrentFile(Env* env, const std::string& dbname,
                              uint64_t descriptor_number);
 
+// Write a new unique id for the db named by "dbname" to its IDENTITY
+// file, and store it in *id.
+extern Status SetIdentityFile(Env* env, const std::string& dbname,
+                              std::string* id);
+
 
 }  // namespace leveldb
 
@@ -30,11 +30,13 @@ TEST(FileNameTest, Parse) {
     { "0.ldb",              0,     kTableFile },
     { "CURRENT",            0,     kCurrentFile },
     { "LOCK",               0,     kDBLockFile },
+    { "IDENTITY",           0,     kIdentityFile },
     { "MANIFEST-2",         2,     kDescriptorFile },
     { "MANIFEST-7",         7,     kDescriptorFile },
     { "LOG",                0,     kInfoLogFile },
     { "LOG.old",            0,     kInfoLogFile },
     { "18446744073709551615.log", 18446744073709551615ull, kLogFile },
+    { "cf-000003",          3,     kColumnFamilyDir },
   };
   for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
     std::string f = cases[i].fname;
@@ -66,7 +68,9 @@ TEST(FileNameTest, Parse) {
     "184467440737095516150.log",
     "100",
     "100.",
-    "100.lop"
+    "100.lop",
+    "cf-",
+    "cf-3x"
   };
   for (int i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
     std::string f = errors[i];
@@ -109,6 +113,12 @@ TEST(FileNameTest, Construction) {
   ASSERT_EQ(100, number);
   ASSERT_EQ(kDescriptorFile, type);
 
+  fname = ColumnFamilyDirName("bar", 7);
+  ASSERT_EQ("bar/", std::string(fname.data(), 4));
+  ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
+  ASSERT_EQ(7, number);
+  ASSERT_EQ(kColumnFamilyDir, type);
+
   fname = TempFileName("tmp", 999);
   ASSERT_EQ("tmp/", std::string(fname.data(), 4));
   ASSERT_TRUE(ParseFileName(fname.c_str() + 4, &number, &type));
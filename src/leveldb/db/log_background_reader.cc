@@ -0,0 +1,176 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/log_background_reader.h"
+
+#include "leveldb/env.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+namespace log {
+
+// Records are handed over in chunks of about this many bytes so that the
+// two threads synchronize once per chunk rather than once per record.
+static const size_t kChunkBytes = 256 * 1024;
+
+// Forwards corruptions to the user's reporter and remembers the first one.
+// Only used from the background thread.
+class BackgroundReader::CorruptionTracker : public Reader::Reporter {
+ public:
+  explicit CorruptionTracker(Reader::Reporter* reporter)
+      : reporter_(reporter) { }
+
+  virtual void Corruption(size_t bytes, const Status& s) {
+    if (reporter_ != NULL) {
+      reporter_->Corruption(bytes, s);
+    }
+    if (status_.ok()) {
+      status_ = s;
+    }
+  }
+
+  const Status& status() const { return status_; }
+
+ private:
+  Reader::Reporter* reporter_;
+  Status status_;
+};
+
+BackgroundReader::BackgroundReader(SequentialFile* file,
+                                   Reader::Reporter* reporter,
+                                   bool checksum, bool stop_on_corruption,
+                                   size_t max_buffered_bytes,
+                                   uint64_t log_number)
+    : file_(file),
+      reporter_(reporter),
+      checksum_(checksum),
+      log_number_(log_number),
+      stop_on_corruption_(stop_on_corruption),
+      max_buffered_bytes_(max_buffered_bytes),
+      started_(false),
+      current_(NULL),
+      current_pos_(0),
+      cv_(&mu_),
+      buffered_bytes_(0),
+      done_(false),
+      stop_(false),
+      end_offset_(0) {
+}
+
+BackgroundReader::~BackgroundReader() {
+  if (started_) {
+    MutexLock l(&mu_);
+    stop_ = true;
+    cv_.SignalAll();
+    while (!done_) {
+      cv_.Wait();
+    }
+  }
+  for (size_t i = 0; i < chunks_.size(); i++) {
+    delete chunks_[i];
+  }
+  delete current_;
+}
+
+void BackgroundReader::Start(Env* env) {
+  assert(!started_);
+  started_ = true;
+  env->StartThread(&BackgroundReader::BGThread, this);
+}
+
+void BackgroundReader::BGThread(void* arg) {
+  reinterpret_cast<BackgroundReader*>(arg)->Run();
+}
+
+void BackgroundReader::Run() {
+  CorruptionTracker tracker(reporter_);
+  Reader reader(file_, &tracker, checksum_, 0/*initial_offset*/,
+                log_number_);
+  Slice record;
+  std::string scratch;
+  Chunk* chunk = new Chunk;
+  chunk->bytes = 0;
+  bool stopped = false;
+  uint64_t end_offset = 0;
+  while (reader.ReadRecord(&record, &scratch)) {
+    if (stop_on_corruption_ && !tracker.status().ok()) {
+      break;
+    }
+    end_offset = reader.LastRecordEndOffset();
+    chunk->records.push_back(record.ToString());
+    chunk->bytes += record.size();
+    if (chunk->bytes >= kChunkBytes) {
+      if (!Publish(chunk)) {
+        stopped = true;
+        chunk = NULL;
+        break;
+      }
+      chunk = new Chunk;
+      chunk->bytes = 0;
+    }
+  }
+  if (!stopped && !chunk->records.empty()) {
+    Publish(chunk);
+  } else {
+    delete chunk;
+  }
+
+  MutexLock l(&mu_);
+  if (stop_on_corruption_) {
+    status_ = tracker.status();
+  }
+  end_offset_ = end_offset;
+  done_ = true;
+  cv_.SignalAll();
+}
+
+bool BackgroundReader::Publish(Chunk* chunk) {
+  MutexLock l(&mu_);
+  while (!stop_ && buffered_bytes_ >= max_buffered_bytes_) {
+    cv_.Wait();
+  }
+  if (stop_) {
+    delete chunk;
+    return false;
+  }
+  chunks_.push_back(chunk);
+  buffered_bytes_ += chunk->bytes;
+  cv_.SignalAll();
+  return true;
+}
+
+bool BackgroundReader::ReadRecord(std::string* record) {
+  assert(started_);
+  while (current_ == NULL || current_pos_ >= current_->records.size()) {
+    delete current_;
+    current_ = NULL;
+    MutexLock l(&mu_);
+    while (chunks_.empty() && !done_) {
+      cv_.Wait();
+    }
+    if (chunks_.empty()) {
+      return false;
+    }
+    current_ = chunks_.front();
+    chunks_.pop_front();
+    buffered_bytes_ -= current_->bytes;
+    current_pos_ = 0;
+    cv_.SignalAll();
+  }
+  record->swap(current_->records[current_pos_++]);
+  return true;
+}
+
+Status BackgroundReader::status() {
+  MutexLock l(&mu_);
+  return status_;
+}
+
+uint64_t BackgroundReader::LastRecordEndOffset() {
+  MutexLock l(&mu_);
+  return end_offset_;
+}
+
+}  // namespace log
+}  // namespace leveldb
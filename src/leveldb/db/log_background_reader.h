@@ -0,0 +1,104 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// BackgroundReader reads, reassembles and checksums the records of a log
+// file on a separate thread, so that decoding one log overlaps with the
+// caller applying the records of the same or an earlier log.  Records are
+// handed to the caller in log order.
+
+#ifndef STORAGE_LEVELDB_DB_LOG_BACKGROUND_READER_H_
+#define STORAGE_LEVELDB_DB_LOG_BACKGROUND_READER_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "db/log_reader.h"
+#include "port/port.h"
+
+namespace leveldb {
+
+class Env;
+
+namespace log {
+
+class BackgroundReader {
+ public:
+  // Create a reader for "*file", which must remain live while this
+  // BackgroundReader is live.  "*reporter" (if non-NULL) is notified of
+  // corruptions from the background thread, so it must be safe to call
+  // concurrently with the caller.  If "stop_on_corruption" is true,
+  // no records are returned past the first corruption and status()
+  // reports it.
+  //
+  // At most "max_buffered_bytes" of decoded records (plus one chunk) are
+  // held in memory; the background thread waits when the caller falls
+  // behind.
+  //
+  // "log_number" is passed on to the Reader (see log_reader.h).
+  BackgroundReader(SequentialFile* file, Reader::Reporter* reporter,
+                   bool checksum, bool stop_on_corruption,
+                   size_t max_buffered_bytes, uint64_t log_number = 0);
+
+  // Stops the background thread, if running, and waits for it to exit.
+  ~BackgroundReader();
+
+  // Start reading the file on a thread created with env->StartThread().
+  void Start(Env* env);
+
+  // Move the next record into *record and return true, or return false
+  // at the end of the input.  Blocks until a record is available.
+  // REQUIRES: Start() has been called
+  bool ReadRecord(std::string* record);
+
+  // Return the first corruption if stop_on_corruption was requested,
+  // else OK.  Only meaningful after ReadRecord() has returned false.
+  Status status();
+
+  // Return the offset just past the last record read (see
+  // Reader::LastRecordEndOffset()).  Only meaningful after ReadRecord()
+  // has returned false.
+  uint64_t LastRecordEndOffset();
+
+ private:
+  struct Chunk {
+    std::vector<std::string> records;
+    size_t bytes;
+  };
+
+  class CorruptionTracker;
+
+  static void BGThread(void* arg);
+  void Run();
+  bool Publish(Chunk* chunk);
+
+  SequentialFile* const file_;
+  Reader::Reporter* const reporter_;
+  const bool checksum_;
+  const uint64_t log_number_;
+  const bool stop_on_corruption_;
+  const size_t max_buffered_bytes_;
+  bool started_;
+
+  // Accessed only by the caller's thread
+  Chunk* current_;
+  size_t current_pos_;
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  std::deque<Chunk*> chunks_;    // Protected by mu_
+  size_t buffered_bytes_;        // Protected by mu_
+  bool done_;                    // Protected by mu_; thread has finished
+  bool stop_;                    // Protected by mu_; caller wants no more
+  Status status_;                // Protected by mu_
+  uint64_t end_offset_;          // Protected by mu_
+
+  // No copying allowed
+  BackgroundReader(const BackgroundReader&);
+  void operator=(const BackgroundReader&);
+};
+
+}  // namespace log
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_LOG_BACKGROUND_READER_H_
@@ -40,8 +40,13 @@ class Reader {
   //
   // The Reader will start reading at the first record located at physical
   // position >= initial_offset within the file.
+  //
+  // Records in the recyclable format are only returned if they carry
+  // "log_number".  The first one that does not, and any damage after
+  // one that does, is taken to be left over from an earlier use of a
+  // recycled file and ends the log without being reported.
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-         uint64_t initial_offset);
+         uint64_t initial_offset, uint64_t log_number = 0);
 
   ~Reader();
 
@@ -57,6 +62,13 @@ class Reader {
   // Undefined before the first call to ReadRecord.
   uint64_t LastRecordOffset();
 
+  // Returns the physical offset just past the last record returned by
+  // ReadRecord, or initial_offset if there is none.  Once ReadRecord has
+  // returned false, this is the size of the file if the log ended
+  // cleanly, and less if it ended in damage or in the leftovers of a
+  // recycled file.
+  uint64_t LastRecordEndOffset();
+
  private:
   SequentialFile* const file_;
   Reporter* const reporter_;
@@ -67,12 +79,20 @@ class Reader {
 
   // Offset of the last record returned by ReadRecord.
   uint64_t last_record_offset_;
+  // Offset just past the last record returned by ReadRecord.
+  uint64_t last_record_end_offset_;
   // Offset of the first location past the end of buffer_.
   uint64_t end_of_buffer_offset_;
 
   // Offset at which to start looking for the first record to return
   uint64_t const initial_offset_;
 
+  // Number that records in the recyclable format must carry
+  uint64_t const log_number_;
+
+  // True once a recyclable record carrying log_number_ has been read
+  bool recycled_;
+
   // True if we are resynchronizing after a seek (initial_offset_ > 0). In
   // particular, a run of kMiddleType and kLastType records can be silently
   // skipped in this mode
@@ -86,7 +106,9 @@ class Reader {
     // * The record has an invalid CRC (ReadPhysicalRecord reports a drop)
     // * The record is a 0-length record (No drop is reported)
     // * The record is below constructor's initial_offset (No drop is reported)
-    kBadRecord = kMaxRecordType + 2
+    kBadRecord = kMaxRecordType + 2,
+    // Returned when we find the leftovers of a recycled log file
+    kOldRecord = kMaxRecordType + 3
   };
 
   // Skips all blocks that are completely before "initial_offset_".
@@ -94,8 +116,10 @@ class Reader {
   // Returns true on success. Handles reporting.
   bool SkipToInitialBlock();
 
-  // Return type, or one of the preceding special values
-  unsigned int ReadPhysicalRecord(Slice* result);
+  // Return type, or one of the preceding special values.  Recyclable
+  // types are returned as their plain equivalents.  Stores the size of
+  // the record's header in *header_size.
+  unsigned int ReadPhysicalRecord(Slice* result, int* header_size);
 
   // Reports dropped bytes to the reporter.
   // buffer_ must be updated to remove the dropped bytes prior to invocation.
@@ -45,6 +45,7 @@ class LogTest {
     virtual Status Close() { return Status::OK(); }
     virtual Status Flush() { return Status::OK(); }
     virtual Status Sync() { return Status::OK(); }
+    virtual std::string GetName() const { return ""; }
     virtual Status Append(const Slice& slice) {
       contents_.append(slice.data(), slice.size());
       return Status::OK();
@@ -86,6 +87,8 @@ class LogTest {
 
       return Status::OK();
     }
+
+    virtual std::string GetName() const { return ""; }
   };
 
   class ReportCollector : public Reader::Reporter {
@@ -101,6 +104,7 @@ class LogTest {
   };
 
   StringDest dest_;
+  std::string old_contents_;  // Overwritten by StartRecycledLog()
   StringSource source_;
   ReportCollector report_;
   bool reading_;
@@ -129,6 +133,27 @@ class LogTest {
     writer_ = new Writer(&dest_, dest_.contents_.size());
   }
 
+  // Append what follows in the recyclable format, as log "log_number".
+  void ReopenForAppendRecyclable(uint64_t log_number) {
+    delete writer_;
+    writer_ = new Writer(&dest_, dest_.contents_.size(), log_number,
+                         true/*recyclable*/, false/*manual_flush*/);
+    delete reader_;
+    reader_ = new Reader(&source_, &report_, true/*checksum*/,
+                         0/*initial_offset*/, log_number);
+  }
+
+  // Write what follows in the recyclable format, as log "log_number",
+  // over the start of what has been written so far: the rest is left
+  // in place like the old contents of a recycled log file.
+  void StartRecycledLog(uint64_t log_number) {
+    if (dest_.contents_.size() > old_contents_.size()) {
+      old_contents_ = dest_.contents_;
+    }
+    dest_.contents_.clear();
+    ReopenForAppendRecyclable(log_number);
+  }
+
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
     writer_->AddRecord(Slice(msg));
@@ -141,6 +166,10 @@ class LogTest {
   std::string Read() {
     if (!reading_) {
       reading_ = true;
+      if (old_contents_.size() > dest_.contents_.size()) {
+        dest_.contents_.append(old_contents_, dest_.contents_.size(),
+                               std::string::npos);
+      }
       source_.contents_ = Slice(dest_.contents_);
     }
     std::string scratch;
@@ -359,6 +388,52 @@ TEST(LogTest, OpenForAppend) {
   ASSERT_EQ("EOF", Read());
 }
 
+TEST(LogTest, OpenForAppendRecyclable) {
+  Write("hello");
+  ReopenForAppendRecyclable(7);
+  Write("world");
+  ASSERT_EQ("hello", Read());
+  ASSERT_EQ("world", Read());
+  ASSERT_EQ("EOF", Read());
+}
+
+TEST(LogTest, RecycledLog) {
+  StartRecycledLog(1);
+  for (int i = 0; i < 100; i++) {
+    Write(BigString(NumberString(i), (i % 10 == 0) ? 50000 : 1000));
+  }
+  StartRecycledLog(2);
+  Write("foo");
+  Write(BigString("bar", 40000));
+  Write("baz");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ(BigString("bar", 40000), Read());
+  ASSERT_EQ("baz", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, EmptyRecycledLog) {
+  StartRecycledLog(1);
+  Write("foo");
+  Write("bar");
+  StartRecycledLog(2);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogTruncatedRecord) {
+  // The old log's records do not line up with the new ones, so reading
+  // runs into the middle of an old record
+  StartRecycledLog(1);
+  Write(BigString("x", 1000));
+  StartRecycledLog(2);
+  Write("foo");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
 TEST(LogTest, RandomRead) {
   const int N = 500;
   Random write_rnd(301);
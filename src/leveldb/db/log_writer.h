@@ -28,6 +28,16 @@ class Writer {
   // "*dest" must remain live while this Writer is in use.
   Writer(WritableFile* dest, uint64_t dest_length);
 
+  // Create a writer that will write data to "*dest", starting at offset
+  // "dest_length".  If "recyclable" is true, records use the recyclable
+  // format and carry "log_number", so that "*dest" may be a recycled log
+  // file holding old records past offset "dest_length".  If
+  // "manual_flush" is true, "*dest" is not flushed after each record and
+  // the caller must flush it.
+  // "*dest" must remain live while this Writer is in use.
+  Writer(WritableFile* dest, uint64_t dest_length, uint64_t log_number,
+         bool recyclable, bool manual_flush);
+
   ~Writer();
 
   Status AddRecord(const Slice& slice);
@@ -35,6 +45,9 @@ class Writer {
  private:
   WritableFile* dest_;
   int block_offset_;       // Current offset in block
+  const uint64_t log_number_;
+  const bool recyclable_;
+  const bool manual_flush_;
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
@@ -18,10 +18,14 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& cmp)
+MemTable::MemTable(const InternalKeyComparator& cmp,
+                   size_t arena_block_size, size_t huge_page_size)
     : comparator_(cmp),
       refs_(0),
-      table_(comparator_, &arena_) {
+      base_sequence_(kMaxSequenceNumber),
+      arena_(arena_block_size, huge_page_size),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_) {
 }
 
 MemTable::~MemTable() {
@@ -30,6 +34,10 @@ MemTable::~MemTable() {
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
 
+size_t MemTable::ApproximateMemoryReserved() {
+  return arena_.MemoryReserved();
+}
+
 int MemTable::KeyComparator::operator()(const char* aptr, const char* bptr)
     const {
   // Internal keys are encoded as length-prefixed strings.
@@ -79,6 +87,10 @@ Iterator* MemTable::NewIterator() {
   return new MemTableIterator(&table_);
 }
 
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type,
                    const Slice& key,
                    const Slice& value) {
@@ -102,14 +114,45 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.Insert(buf);
+  } else {
+    table_.Insert(buf);
+  }
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   std::vector<std::string>* operands) {
   Slice memkey = key.memtable_key();
+  const Comparator* ucmp = comparator_.comparator.user_comparator();
+
+  // Find the newest range tombstone visible to the lookup that covers the
+  // key.  Range deletions are rare and the memtable holds few of them, so
+  // a scan of those starting at or before the key is cheap enough.
+  SequenceNumber covering_seq = 0;
+  Table::Iterator range_iter(&range_del_table_);
+  range_iter.SeekToFirst();
+  if (range_iter.Valid()) {
+    const Slice internal_key = key.internal_key();
+    const SequenceNumber snapshot =
+        DecodeFixed64(internal_key.data() + internal_key.size() - 8) >> 8;
+    for (; range_iter.Valid(); range_iter.Next()) {
+      Slice begin = GetLengthPrefixedSlice(range_iter.key());
+      if (ucmp->Compare(ExtractUserKey(begin), key.user_key()) > 0) {
+        break;
+      }
+      const SequenceNumber seq =
+          DecodeFixed64(begin.data() + begin.size() - 8) >> 8;
+      Slice end = GetLengthPrefixedSlice(begin.data() + begin.size());
+      if (seq <= snapshot && seq > covering_seq &&
+          ucmp->Compare(key.user_key(), end) < 0) {
+        covering_seq = seq;
+      }
+    }
+  }
+
   Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  for (iter.Seek(memkey.data()); iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -122,24 +165,73 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     const char* entry = iter.key();
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
-    if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8),
-            key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    if (ucmp->Compare(Slice(key_ptr, key_length - 8),
+                      key.user_key()) != 0 ||
+        (tag >> 8) <= covering_seq) {
+      // Another user key, or hidden by a range deletion
+      break;
+    }
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue: {
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        value->assign(v.data(), v.size());
+        return true;
       }
+      case kTypeMerge: {
+        // Keep looking for the value the operand applies to
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        operands->push_back(v.ToString());
+        break;
+      }
+      default:
+        *s = Status::NotFound(Slice());
+        return true;
     }
   }
+  if (covering_seq > 0) {
+    // Older entries, here and in older tables, are all deleted
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
+SequenceNumber MemTable::NewestSequence(const Slice& user_key) {
+  const Comparator* ucmp = comparator_.comparator.user_comparator();
+  SequenceNumber result = 0;
+
+  Table::Iterator range_iter(&range_del_table_);
+  for (range_iter.SeekToFirst(); range_iter.Valid(); range_iter.Next()) {
+    Slice begin = GetLengthPrefixedSlice(range_iter.key());
+    if (ucmp->Compare(ExtractUserKey(begin), user_key) > 0) {
+      break;
+    }
+    const SequenceNumber seq =
+        DecodeFixed64(begin.data() + begin.size() - 8) >> 8;
+    Slice end = GetLengthPrefixedSlice(begin.data() + begin.size());
+    if (seq > result && ucmp->Compare(user_key, end) < 0) {
+      result = seq;
+    }
+  }
+
+  // The first entry at or after the newest possible one for the key
+  LookupKey lkey(user_key, kMaxSequenceNumber);
+  Table::Iterator iter(&table_);
+  iter.Seek(lkey.memtable_key().data());
+  if (iter.Valid()) {
+    const char* entry = iter.key();
+    uint32_t key_length;
+    const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
+    if (ucmp->Compare(Slice(key_ptr, key_length - 8), user_key) == 0) {
+      const SequenceNumber seq =
+          DecodeFixed64(key_ptr + key_length - 8) >> 8;
+      if (seq > result) {
+        result = seq;
+      }
+    }
+  }
+  return result;
+}
+
 }  // namespace leveldb
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
 #include <string>
+#include <vector>
 #include "leveldb/db.h"
 #include "db/dbformat.h"
 #include "db/skiplist.h"
@@ -20,8 +21,12 @@ class MemTableIterator;
 class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
-  // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  // is zero and the caller must call Ref() at least once.  Memory is
+  // allocated as described by Options::arena_block_size and
+  // Options::memtable_huge_page_size.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    size_t arena_block_size = Arena::kDefaultBlockSize,
+                    size_t huge_page_size = 0);
 
   // Increase reference count.
   void Ref() { ++refs_; }
@@ -35,10 +40,21 @@ class MemTable {
     }
   }
 
+  // Every write to the memtable's column family that is numbered after
+  // base_sequence() went into this memtable or a newer one.  Set by the
+  // DB when the memtable is created; kMaxSequenceNumber if unknown.
+  void set_base_sequence(SequenceNumber seq) { base_sequence_ = seq; }
+  SequenceNumber base_sequence() const { return base_sequence_; }
+
   // Returns an estimate of the number of bytes of data in use by this
   // data structure. It is safe to call when MemTable is being modified.
   size_t ApproximateMemoryUsage();
 
+  // Returns the number of bytes this memtable has taken from the system,
+  // which with huge pages may be more than ApproximateMemoryUsage().
+  // Also safe to call while the memtable is being modified.
+  size_t ApproximateMemoryReserved();
+
   // Return an iterator that yields the contents of the memtable.
   //
   // The caller must ensure that the underlying MemTable remains live
@@ -47,6 +63,11 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones added to the memtable,
+  // which NewIterator() does not yield.  Keys are internal keys holding
+  // the begin key of each deleted range and values are the end keys.
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
   // Typically value will be empty if type==kTypeDeletion.
@@ -55,10 +76,21 @@ class MemTable {
            const Slice& value);
 
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range deletion that
+  // covers it and is newer than any value for it here, store a NotFound()
+  // error in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  //
+  // Merge operands for key that are newer than the value or deletion
+  // are appended to *operands, newest first, for the caller to apply.
+  // If only operands are found, the caller must go on to older data.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           std::vector<std::string>* operands);
+
+  // Return the sequence number of the newest entry for "user_key" or of
+  // the newest range deletion covering it, whichever is larger, or zero
+  // if the memtable has neither.
+  SequenceNumber NewestSequence(const Slice& user_key);
 
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
@@ -75,8 +107,10 @@ class MemTable {
 
   KeyComparator comparator_;
   int refs_;
+  SequenceNumber base_sequence_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;     // Entries of type kTypeRangeDeletion
 
   // No copying allowed
   MemTable(const MemTable&);
@@ -0,0 +1,37 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include <assert.h>
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                          const Slice& user_key,
+                          const Slice* existing_value,
+                          const std::vector<std::string>& operands,
+                          std::string* result) {
+  assert(!operands.empty());
+  if (merge_operator == NULL) {
+    return Status::NotSupported("merge operand found but no merge_operator");
+  }
+  std::string merged, tmp;
+  Slice merged_slice;
+  const Slice* base = existing_value;
+  for (size_t i = operands.size(); i > 0; i--) {
+    tmp.clear();
+    if (!merge_operator->Merge(user_key, base, operands[i - 1], &tmp)) {
+      return Status::Corruption("merge operator failed for ", user_key);
+    }
+    merged.swap(tmp);
+    merged_slice = merged;
+    base = &merged_slice;
+  }
+  result->swap(merged);
+  return Status::OK();
+}
+
+}  // namespace leveldb
@@ -0,0 +1,32 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <string>
+#include <vector>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// Apply the merge operands of "user_key", ordered from newest to oldest,
+// to *existing_value (NULL if the key has no older value) and store the
+// result in *result.  existing_value may point into *result.
+// REQUIRES: !operands.empty()
+//
+// Returns NotSupported if "merge_operator" is NULL and Corruption if it
+// rejects an operand.
+extern Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                                 const Slice& user_key,
+                                 const Slice* existing_value,
+                                 const std::vector<std::string>& operands,
+                                 std::string* result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
@@ -0,0 +1,152 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/transaction.h"
+
+#include <assert.h>
+#include <map>
+#include <vector>
+#include "db/write_batch_internal.h"
+#include "leveldb/write_batch.h"
+
+namespace leveldb {
+
+namespace {
+
+class OptimisticTransaction : public Transaction {
+ public:
+  OptimisticTransaction(DB* db, const WriteOptions& options)
+      : db_(db),
+        options_(options),
+        snapshot_(db->GetSnapshot()) {
+  }
+
+  virtual ~OptimisticTransaction() {
+    Finish();
+  }
+
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     std::string* value) {
+    assert(snapshot_ != NULL);
+    const std::string k = key.ToString();
+    std::map<std::string, PendingWrite>::const_iterator it = keys_.find(k);
+    if (it != keys_.end() && it->second.written) {
+      if (it->second.deleted) {
+        return Status::NotFound(Slice());
+      }
+      value->assign(it->second.value);
+      return Status::OK();
+    }
+    keys_[k];  // Read set
+    ReadOptions read_options = options;
+    read_options.snapshot = snapshot_;
+    return db_->Get(read_options, key, value);
+  }
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    assert(snapshot_ != NULL);
+    PendingWrite* w = &keys_[key.ToString()];
+    w->written = true;
+    w->deleted = false;
+    w->value.assign(value.data(), value.size());
+    batch_.Put(key, value);
+  }
+
+  virtual void Delete(const Slice& key) {
+    assert(snapshot_ != NULL);
+    PendingWrite* w = &keys_[key.ToString()];
+    w->written = true;
+    w->deleted = true;
+    w->value.clear();
+    batch_.Delete(key);
+  }
+
+  virtual Status Commit() {
+    if (snapshot_ == NULL) {
+      return Status::InvalidArgument("transaction already finished");
+    }
+    Status s;
+    if (WriteBatchInternal::Count(&batch_) > 0) {
+      std::vector<Slice> keys;
+      keys.reserve(keys_.size());
+      for (std::map<std::string, PendingWrite>::const_iterator it =
+               keys_.begin();
+           it != keys_.end(); ++it) {
+        keys.push_back(it->first);
+      }
+      s = db_->WriteIfUnchanged(options_, snapshot_, keys, &batch_);
+    }
+    Finish();
+    return s;
+  }
+
+  virtual void Rollback() {
+    Finish();
+  }
+
+ private:
+  // A key the transaction has read or written.  Only a written key
+  // has a value of its own.
+  struct PendingWrite {
+    bool written;
+    bool deleted;
+    std::string value;
+    PendingWrite() : written(false), deleted(false) { }
+  };
+
+  void Finish() {
+    if (snapshot_ != NULL) {
+      db_->ReleaseSnapshot(snapshot_);
+      snapshot_ = NULL;
+    }
+    keys_.clear();
+    batch_.Clear();
+  }
+
+  DB* const db_;
+  const WriteOptions options_;
+  const Snapshot* snapshot_;   // NULL once finished
+  std::map<std::string, PendingWrite> keys_;
+  WriteBatch batch_;
+};
+
+class OptimisticTransactionDBImpl : public OptimisticTransactionDB {
+ public:
+  explicit OptimisticTransactionDBImpl(DB* db) : db_(db) { }
+
+  virtual ~OptimisticTransactionDBImpl() {
+    delete db_;
+  }
+
+  virtual Transaction* BeginTransaction(const WriteOptions& options) {
+    return new OptimisticTransaction(db_, options);
+  }
+
+  virtual DB* GetBaseDB() {
+    return db_;
+  }
+
+ private:
+  DB* const db_;
+};
+
+}  // namespace
+
+Transaction::~Transaction() { }
+
+OptimisticTransactionDB::~OptimisticTransactionDB() { }
+
+Status OptimisticTransactionDB::Open(const Options& options,
+                                     const std::string& name,
+                                     OptimisticTransactionDB** dbptr) {
+  *dbptr = NULL;
+  DB* db;
+  Status s = DB::Open(options, name, &db);
+  if (s.ok()) {
+    *dbptr = new OptimisticTransactionDBImpl(db);
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,208 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <functional>
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+namespace {
+struct UserKeyLess {
+  const Comparator* ucmp;
+  explicit UserKeyLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+
+struct UserKeyEqual {
+  const Comparator* ucmp;
+  explicit UserKeyEqual(const Comparator* c) : ucmp(c) { }
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) == 0;
+  }
+};
+}  // namespace
+
+struct RangeTombstoneList::TombstoneBeginLess {
+  const Comparator* ucmp;
+  explicit TombstoneBeginLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const Tombstone& a, const Tombstone& b) const {
+    return ucmp->Compare(a.begin, b.begin) < 0;
+  }
+};
+
+RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator)
+    : ucmp_(user_comparator) {
+}
+
+void RangeTombstoneList::Add(const Slice& begin, const Slice& end,
+                             SequenceNumber seq) {
+  if (ucmp_->Compare(begin, end) >= 0) {
+    return;
+  }
+  Tombstone t;
+  t.begin = begin.ToString();
+  t.end = end.ToString();
+  t.seq = seq;
+  pending_.push_back(t);
+}
+
+Status RangeTombstoneList::AddFrom(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeTombstoneList::AddFrom(const RangeTombstoneList& other) {
+  assert(other.pending_.empty());
+  for (size_t i = 0; i < other.fragments_.size(); i++) {
+    const Fragment& f = other.fragments_[i];
+    for (size_t j = 0; j < f.seqs.size(); j++) {
+      Add(f.begin, f.end, f.seqs[j]);
+    }
+  }
+}
+
+void RangeTombstoneList::Finish() {
+  if (pending_.empty()) {
+    return;
+  }
+
+  // Fragments from an earlier Finish() are re-split along with the new
+  // tombstones.
+  for (size_t i = 0; i < fragments_.size(); i++) {
+    const Fragment& f = fragments_[i];
+    for (size_t j = 0; j < f.seqs.size(); j++) {
+      Add(f.begin, f.end, f.seqs[j]);
+    }
+  }
+  fragments_.clear();
+
+  std::vector<std::string> bounds;
+  bounds.reserve(pending_.size() * 2);
+  for (size_t i = 0; i < pending_.size(); i++) {
+    bounds.push_back(pending_[i].begin);
+    bounds.push_back(pending_[i].end);
+  }
+  std::sort(bounds.begin(), bounds.end(), UserKeyLess(ucmp_));
+  bounds.erase(std::unique(bounds.begin(), bounds.end(), UserKeyEqual(ucmp_)),
+               bounds.end());
+  std::sort(pending_.begin(), pending_.end(), TombstoneBeginLess(ucmp_));
+
+  // Sweep the boundaries, keeping the tombstones that span the current
+  // one.  Each active tombstone reaches at least to the next boundary.
+  std::vector<const Tombstone*> active;
+  std::vector<SequenceNumber> seqs;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    const std::string& lower = bounds[i];
+    while (next < pending_.size() &&
+           ucmp_->Compare(pending_[next].begin, lower) <= 0) {
+      active.push_back(&pending_[next++]);
+    }
+    size_t kept = 0;
+    for (size_t j = 0; j < active.size(); j++) {
+      if (ucmp_->Compare(active[j]->end, lower) > 0) {
+        active[kept++] = active[j];
+      }
+    }
+    active.resize(kept);
+    if (active.empty()) {
+      continue;
+    }
+
+    seqs.clear();
+    for (size_t j = 0; j < active.size(); j++) {
+      seqs.push_back(active[j]->seq);
+    }
+    std::sort(seqs.begin(), seqs.end(), std::greater<SequenceNumber>());
+    seqs.erase(std::unique(seqs.begin(), seqs.end()), seqs.end());
+
+    if (!fragments_.empty() &&
+        ucmp_->Compare(fragments_.back().end, lower) == 0 &&
+        fragments_.back().seqs == seqs) {
+      // Same tombstones as the fragment just before: extend it
+      fragments_.back().end = bounds[i + 1];
+    } else {
+      Fragment f;
+      f.begin = lower;
+      f.end = bounds[i + 1];
+      f.seqs = seqs;
+      fragments_.push_back(f);
+    }
+  }
+  pending_.clear();
+}
+
+int RangeTombstoneList::FindFragment(const Slice& key) const {
+  assert(pending_.empty());
+  // Binary search for the last fragment with begin <= key
+  int left = 0;
+  int right = static_cast<int>(fragments_.size());
+  while (left < right) {
+    int mid = (left + right) / 2;
+    if (ucmp_->Compare(fragments_[mid].begin, key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left - 1;
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  const int index = FindFragment(user_key);
+  if (index < 0) {
+    return 0;
+  }
+  const Fragment& f = fragments_[index];
+  if (ucmp_->Compare(user_key, f.end) >= 0) {
+    return 0;
+  }
+  for (size_t i = 0; i < f.seqs.size(); i++) {
+    if (f.seqs[i] <= snapshot) {
+      return f.seqs[i];
+    }
+  }
+  return 0;
+}
+
+bool RangeTombstoneList::Covers(const Slice& begin, const Slice& end,
+                                bool end_exclusive,
+                                SequenceNumber snapshot) const {
+  const int index = FindFragment(begin);
+  if (index < 0 || ucmp_->Compare(begin, fragments_[index].end) >= 0) {
+    return false;
+  }
+  for (size_t i = index; i < fragments_.size(); i++) {
+    const Fragment& f = fragments_[i];
+    if (i > static_cast<size_t>(index) &&
+        ucmp_->Compare(f.begin, fragments_[i - 1].end) != 0) {
+      return false;  // Gap between fragments
+    }
+    if (f.seqs.back() > snapshot) {
+      return false;  // Not visible to the snapshot
+    }
+    const int r = ucmp_->Compare(end, f.end);
+    if (r < 0 || (r == 0 && end_exclusive)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace leveldb
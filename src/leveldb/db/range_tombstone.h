@@ -0,0 +1,91 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RangeTombstoneList answers "which range deletions cover this key"
+// for a set of tombstones written by WriteBatch::DeleteRange().
+//
+// Tombstones may overlap each other arbitrarily.  Finish() splits them
+// at every begin and end key into non-overlapping fragments, each of
+// which remembers the sequence numbers of all tombstones spanning it.
+// A lookup is then a binary search over the fragments.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+
+class RangeTombstoneList {
+ public:
+  struct Fragment {
+    std::string begin;                  // Inclusive
+    std::string end;                    // Exclusive
+    std::vector<SequenceNumber> seqs;   // Distinct, in decreasing order
+  };
+
+  explicit RangeTombstoneList(const Comparator* user_comparator);
+
+  // Record that keys in ["begin", "end") were deleted at "seq".  Empty
+  // ranges are ignored.  Finish() must be called before lookups.
+  void Add(const Slice& begin, const Slice& end, SequenceNumber seq);
+
+  // Add every tombstone in *iter, whose keys are internal keys of type
+  // kTypeRangeDeletion holding the begin key and whose values are the
+  // end keys.  Does not take ownership of iter.
+  Status AddFrom(Iterator* iter);
+
+  // Add all tombstones of a finished list.
+  void AddFrom(const RangeTombstoneList& other);
+
+  // Fragment the tombstones added so far.
+  void Finish();
+
+  bool empty() const { return fragments_.empty() && pending_.empty(); }
+
+  // Return the largest sequence number <= snapshot of a tombstone that
+  // covers "user_key", or zero if there is none.  An entry for the key
+  // with a smaller sequence number is deleted as of "snapshot".
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+  // Return true iff every key in ["begin", "end"], or in ["begin", "end")
+  // if "end_exclusive", is covered by some tombstone whose sequence
+  // number is <= snapshot.
+  bool Covers(const Slice& begin, const Slice& end, bool end_exclusive,
+              SequenceNumber snapshot) const;
+
+  // The fragments, sorted by key.
+  const std::vector<Fragment>& fragments() const { return fragments_; }
+
+ private:
+  struct Tombstone {
+    std::string begin;
+    std::string end;
+    SequenceNumber seq;
+  };
+  struct TombstoneBeginLess;
+
+  // Index of the fragment that may contain "key": the last one whose
+  // begin is <= key.  Returns -1 if there is none.
+  int FindFragment(const Slice& key) const;
+
+  const Comparator* const ucmp_;
+  std::vector<Tombstone> pending_;      // Added but not yet fragmented
+  std::vector<Fragment> fragments_;
+
+  // No copying allowed
+  RangeTombstoneList(const RangeTombstoneList&);
+  void operator=(const RangeTombstoneList&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
@@ -0,0 +1,178 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <ctype.h>
+#include "leveldb/comparator.h"
+#include "util/logging.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class RangeTombstoneTest {
+ public:
+  RangeTombstoneList list_;
+
+  RangeTombstoneTest() : list_(BytewiseComparator()) { }
+
+  std::string Fragments() {
+    std::string result;
+    const std::vector<RangeTombstoneList::Fragment>& f = list_.fragments();
+    for (size_t i = 0; i < f.size(); i++) {
+      result += "[" + f[i].begin + "," + f[i].end + ")";
+      for (size_t j = 0; j < f[i].seqs.size(); j++) {
+        result += (j == 0 ? "@" : ",");
+        AppendNumberTo(&result, f[i].seqs[j]);
+      }
+      result += " ";
+    }
+    return result;
+  }
+};
+
+TEST(RangeTombstoneTest, Empty) {
+  list_.Finish();
+  ASSERT_TRUE(list_.empty());
+  ASSERT_EQ(0, list_.MaxCoveringSequence("a", kMaxSequenceNumber));
+  ASSERT_TRUE(!list_.Covers("a", "b", false, kMaxSequenceNumber));
+}
+
+TEST(RangeTombstoneTest, EmptyRangesIgnored) {
+  list_.Add("b", "b", 5);
+  list_.Add("c", "a", 6);
+  list_.Finish();
+  ASSERT_TRUE(list_.empty());
+}
+
+TEST(RangeTombstoneTest, Fragments) {
+  list_.Add("a", "e", 10);
+  list_.Add("c", "g", 20);
+  list_.Add("c", "g", 20);
+  list_.Add("j", "l", 5);
+  list_.Finish();
+  ASSERT_EQ("[a,c)@10 [c,e)@20,10 [e,g)@20 [j,l)@5 ", Fragments());
+
+  // Adding more re-fragments
+  list_.Add("k", "m", 7);
+  list_.Finish();
+  ASSERT_EQ("[a,c)@10 [c,e)@20,10 [e,g)@20 [j,k)@5 [k,l)@7,5 [l,m)@7 ",
+            Fragments());
+}
+
+TEST(RangeTombstoneTest, AdjacentFragmentsMerged) {
+  list_.Add("a", "c", 3);
+  list_.Add("c", "e", 3);
+  list_.Finish();
+  ASSERT_EQ("[a,e)@3 ", Fragments());
+}
+
+// Orders keys ignoring case, so distinct strings can be equal keys.
+class CaseInsensitiveComparator : public Comparator {
+ public:
+  virtual const char* Name() const { return "CaseInsensitiveComparator"; }
+  virtual int Compare(const Slice& a, const Slice& b) const {
+    return Lower(a).compare(Lower(b));
+  }
+  virtual void FindShortestSeparator(std::string*, const Slice&) const { }
+  virtual void FindShortSuccessor(std::string*) const { }
+
+ private:
+  static std::string Lower(const Slice& s) {
+    std::string result = s.ToString();
+    for (size_t i = 0; i < result.size(); i++) {
+      result[i] = tolower(result[i]);
+    }
+    return result;
+  }
+};
+
+TEST(RangeTombstoneTest, BoundsEqualUnderComparator) {
+  CaseInsensitiveComparator cmp;
+  RangeTombstoneList list(&cmp);
+  list.Add("a", "c", 3);
+  list.Add("C", "e", 3);
+  list.Add("b", "f", 5);
+  list.Finish();
+  const std::vector<RangeTombstoneList::Fragment>& f = list.fragments();
+  for (size_t i = 0; i < f.size(); i++) {
+    ASSERT_LT(cmp.Compare(f[i].begin, f[i].end), 0);
+  }
+  ASSERT_EQ(3, list.MaxCoveringSequence("A", kMaxSequenceNumber));
+  ASSERT_EQ(5, list.MaxCoveringSequence("c", kMaxSequenceNumber));
+  ASSERT_TRUE(list.Covers("A", "E", true, 4));
+  ASSERT_TRUE(!list.Covers("A", "f", false, 4));
+}
+
+TEST(RangeTombstoneTest, MaxCoveringSequence) {
+  list_.Add("b", "d", 10);
+  list_.Add("c", "f", 20);
+  list_.Finish();
+  ASSERT_EQ(0, list_.MaxCoveringSequence("a", 100));
+  ASSERT_EQ(10, list_.MaxCoveringSequence("b", 100));
+  ASSERT_EQ(20, list_.MaxCoveringSequence("c", 100));
+  ASSERT_EQ(10, list_.MaxCoveringSequence("c", 15));
+  ASSERT_EQ(0, list_.MaxCoveringSequence("c", 9));
+  ASSERT_EQ(20, list_.MaxCoveringSequence("e", 100));
+  ASSERT_EQ(0, list_.MaxCoveringSequence("e", 15));
+  ASSERT_EQ(0, list_.MaxCoveringSequence("f", 100));
+  ASSERT_EQ(0, list_.MaxCoveringSequence("z", 100));
+}
+
+TEST(RangeTombstoneTest, Covers) {
+  list_.Add("b", "d", 10);
+  list_.Add("d", "f", 20);
+  list_.Add("g", "h", 5);
+  list_.Finish();
+  ASSERT_TRUE(list_.Covers("b", "c", false, 100));
+  ASSERT_TRUE(list_.Covers("b", "e", false, 100));
+  ASSERT_TRUE(!list_.Covers("b", "e", false, 15));   // [d,f) not visible
+  ASSERT_TRUE(!list_.Covers("b", "f", false, 100));  // End is exclusive
+  ASSERT_TRUE(list_.Covers("b", "f", true, 100));
+  ASSERT_TRUE(!list_.Covers("a", "c", false, 100));
+  ASSERT_TRUE(!list_.Covers("e", "g", false, 100));  // Gap at [f,g)
+  ASSERT_TRUE(list_.Covers("g", "g", false, 100));
+}
+
+TEST(RangeTombstoneTest, Random) {
+  // Compare against a brute force check of every tombstone.
+  struct Tombstone { std::string begin, end; SequenceNumber seq; };
+  Random rnd(301);
+  for (int iter = 0; iter < 20; iter++) {
+    RangeTombstoneList list(BytewiseComparator());
+    std::vector<Tombstone> all;
+    for (int i = 0; i < 30; i++) {
+      Tombstone t;
+      t.begin = std::string(1, 'a' + rnd.Uniform(26));
+      t.end = std::string(1, 'a' + rnd.Uniform(26));
+      t.seq = 1 + rnd.Uniform(100);
+      all.push_back(t);
+      list.Add(t.begin, t.end, t.seq);
+      if (rnd.OneIn(10)) {
+        list.Finish();
+      }
+    }
+    list.Finish();
+    for (char c = 'a'; c <= 'z'; c++) {
+      const std::string key(1, c);
+      for (SequenceNumber snapshot = 0; snapshot <= 100; snapshot += 7) {
+        SequenceNumber expected = 0;
+        for (size_t i = 0; i < all.size(); i++) {
+          if (all[i].begin <= key && key < all[i].end &&
+              all[i].seq <= snapshot && all[i].seq > expected) {
+            expected = all[i].seq;
+          }
+        }
+        ASSERT_EQ(expected, list.MaxCoveringSequence(key, snapshot));
+      }
+    }
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
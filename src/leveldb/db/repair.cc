@@ -31,12 +31,15 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/table_factory.h"
+#include "table/format.h"
 
 namespace leveldb {
 
@@ -48,7 +51,7 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
+        ipolicy_(options.filter_policy, options.prefix_extractor),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
@@ -191,7 +194,7 @@ class Repairer {
     // propagating bad information (like overly large sequence
     // numbers).
     log::Reader reader(lfile, &reporter, false/*do not checksum*/,
-                       0/*initial_offset*/);
+                       0/*initial_offset*/, log);
 
     // Read all the records and add to a memtable
     std::string scratch;
@@ -224,8 +227,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = NULL;
     if (status.ok()) {
@@ -306,6 +312,35 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // The key range also covers the range deletions.
+    RangeTombstoneList tombstones(icmp_.user_comparator());
+    if (status.ok()) {
+      status = table_cache_->AddRangeTombstones(t.meta.number,
+                                                t.meta.file_size,
+                                                &tombstones);
+      tombstones.Finish();
+    }
+    const std::vector<RangeTombstoneList::Fragment>& fragments =
+        tombstones.fragments();
+    for (size_t i = 0; status.ok() && i < fragments.size(); i++) {
+      const RangeTombstoneList::Fragment& f = fragments[i];
+      InternalKey begin(f.begin, f.seqs.front(), kTypeRangeDeletion);
+      InternalKey end(f.end, kMaxSequenceNumber, kValueTypeForSeek);
+      if (empty || icmp_.Compare(begin, t.meta.smallest) < 0) {
+        t.meta.smallest = begin;
+      }
+      if (empty || icmp_.Compare(end, t.meta.largest) > 0) {
+        t.meta.largest = end;
+      }
+      empty = false;
+      if (f.seqs.front() > t.max_sequence) {
+        t.max_sequence = f.seqs.front();
+      }
+      counter += f.seqs.size();
+      t.meta.has_range_deletions = true;
+    }
+
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long) t.meta.number,
         counter,
@@ -329,7 +364,8 @@ class Repairer {
     if (!s.ok()) {
       return;
     }
-    TableBuilder* builder = new TableBuilder(options_, file);
+    TableWriter* builder =
+        GetTableFactory(options_)->NewTableWriter(options_, file);
 
     // Copy data.
     Iterator* iter = NewTableIterator(t.meta);
@@ -340,6 +376,23 @@ class Repairer {
     }
     delete iter;
 
+    // Copy the range deletions too, if they are readable.
+    RangeTombstoneList tombstones(icmp_.user_comparator());
+    if (table_cache_->AddRangeTombstones(t.meta.number, t.meta.file_size,
+                                         &tombstones).ok()) {
+      tombstones.Finish();
+      const std::vector<RangeTombstoneList::Fragment>& fragments =
+          tombstones.fragments();
+      for (size_t i = 0; i < fragments.size(); i++) {
+        const RangeTombstoneList::Fragment& f = fragments[i];
+        for (size_t j = 0; j < f.seqs.size(); j++) {
+          InternalKey begin(f.begin, f.seqs[j], kTypeRangeDeletion);
+          builder->AddRangeTombstone(begin.Encode(), f.end);
+          counter++;
+        }
+      }
+    }
+
     ArchiveFile(src);
     if (counter == 0) {
       builder->Abandon();  // Nothing to save
@@ -395,8 +448,7 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+      edit_.AddFile(0, t.meta);
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
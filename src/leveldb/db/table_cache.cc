@@ -5,19 +5,23 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
-#include "leveldb/table.h"
+#include "leveldb/table_factory.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
 struct TableAndFile {
   RandomAccessFile* file;
-  Table* table;
+  TableReader* table;
+  RangeTombstoneList* tombstones;  // NULL if the table has none
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->tombstones;
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -42,6 +46,43 @@ TableCache::~TableCache() {
   delete cache_;
 }
 
+static void DeleteTableAndFile(void* arg1, void* arg2) {
+  delete reinterpret_cast<TableReader*>(arg1);
+  delete reinterpret_cast<RandomAccessFile*>(arg2);
+}
+
+Status TableCache::OpenTable(uint64_t file_number, uint64_t file_size,
+                             bool direct, RandomAccessFile** file,
+                             TableReader** table) {
+  *file = NULL;
+  *table = NULL;
+  std::string fname = TableFileName(dbname_, file_number);
+  Status s = direct ? env_->NewDirectRandomAccessFile(fname, file)
+                    : env_->NewRandomAccessFile(fname, file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    Status old_s = direct ? env_->NewDirectRandomAccessFile(old_fname, file)
+                          : env_->NewRandomAccessFile(old_fname, file);
+    if (old_s.ok()) {
+      s = Status::OK();
+    }
+  }
+  if (s.ok()) {
+    s = GetTableFactory(*options_)->NewTableReader(*options_, *file,
+                                                   file_size, table);
+  }
+  if (s.ok()) {
+    if (!cache_key_prefix_.empty()) {
+      (*table)->SetCacheKey(cache_key_prefix_, file_number);
+    }
+  } else {
+    assert(*table == NULL);
+    delete *file;
+    *file = NULL;
+  }
+  return s;
+}
+
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
                              Cache::Handle** handle) {
   Status s;
@@ -50,29 +91,36 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
   Slice key(buf, sizeof(buf));
   *handle = cache_->Lookup(key);
   if (*handle == NULL) {
-    std::string fname = TableFileName(dbname_, file_number);
-    RandomAccessFile* file = NULL;
-    Table* table = NULL;
-    s = env_->NewRandomAccessFile(fname, &file);
-    if (!s.ok()) {
-      std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
-        s = Status::OK();
-      }
-    }
+    RandomAccessFile* file;
+    TableReader* table;
+    s = OpenTable(file_number, file_size, false, &file, &table);
+    RangeTombstoneList* tombstones = NULL;
     if (s.ok()) {
-      s = Table::Open(*options_, file, file_size, &table);
+      // Fragment the range deletions once, for every lookup to share
+      const Comparator* ucmp = static_cast<const InternalKeyComparator*>(
+          options_->comparator)->user_comparator();
+      tombstones = new RangeTombstoneList(ucmp);
+      Iterator* iter = table->NewRangeTombstoneIterator();
+      s = tombstones->AddFrom(iter);
+      delete iter;
+      tombstones->Finish();
+      if (!s.ok() || tombstones->empty()) {
+        delete tombstones;
+        tombstones = NULL;
+      }
+      if (!s.ok()) {
+        delete table;
+        delete file;
+      }
     }
-
     if (!s.ok()) {
-      assert(table == NULL);
-      delete file;
       // We do not cache error results so that if the error is transient,
       // or somebody repairs the file, we recover automatically.
     } else {
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->tombstones = tombstones;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -82,7 +130,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
-                                  Table** tableptr) {
+                                  TableReader** tableptr) {
   if (tableptr != NULL) {
     *tableptr = NULL;
   }
@@ -93,7 +141,8 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
     return NewErrorIterator(s);
   }
 
-  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  TableReader* table =
+      reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
   Iterator* result = table->NewIterator(options);
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != NULL) {
@@ -102,22 +151,144 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewDirectIterator(const ReadOptions& options,
+                                        uint64_t file_number,
+                                        uint64_t file_size) {
+  RandomAccessFile* file;
+  TableReader* table;
+  Status s = OpenTable(file_number, file_size, true, &file, &table);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Iterator* result = table->NewIterator(options);
+  result->RegisterCleanup(&DeleteTableAndFile, table, file);
+  return result;
+}
+
+namespace {
+// Stands between TableReader::InternalGet() and the caller's saver when the
+// looked up key is covered by a range deletion in the table.
+struct RangeDeletionFilter {
+  const Comparator* ucmp;
+  Slice user_key;
+  SequenceNumber covering_seq;
+  void* arg;
+  bool (*saver)(void*, const Slice&, const Slice&);
+  bool done;          // The saver wants no more entries
+};
+}  // namespace
+
+static bool ReportDeletion(RangeDeletionFilter* f) {
+  std::string deletion;
+  AppendInternalKey(&deletion, ParsedInternalKey(f->user_key, f->covering_seq,
+                                                 kTypeDeletion));
+  (*f->saver)(f->arg, deletion, Slice());
+  f->done = true;
+  return false;
+}
+
+static bool FilterDeleted(void* arg, const Slice& k, const Slice& v) {
+  RangeDeletionFilter* f = reinterpret_cast<RangeDeletionFilter*>(arg);
+  ParsedInternalKey parsed;
+  if (!ParseInternalKey(k, &parsed) ||
+      (f->ucmp->Compare(parsed.user_key, f->user_key) == 0 &&
+       parsed.sequence > f->covering_seq)) {
+    const bool more = (*f->saver)(f->arg, k, v);
+    f->done = !more;
+    return more;
+  } else {
+    return ReportDeletion(f);
+  }
+}
+
 Status TableCache::Get(const ReadOptions& options,
                        uint64_t file_number,
                        uint64_t file_size,
                        const Slice& k,
                        void* arg,
-                       void (*saver)(void*, const Slice&, const Slice&)) {
+                       bool (*saver)(void*, const Slice&, const Slice&)) {
   Cache::Handle* handle = NULL;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
-    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, saver);
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    SequenceNumber covering_seq = 0;
+    if (tf->tombstones != NULL) {
+      covering_seq = tf->tombstones->MaxCoveringSequence(
+          ExtractUserKey(k), DecodeFixed64(k.data() + k.size() - 8) >> 8);
+    }
+    if (covering_seq == 0) {
+      s = tf->table->InternalGet(options, k, arg, saver);
+    } else {
+      RangeDeletionFilter filter;
+      filter.ucmp = static_cast<const InternalKeyComparator*>(
+          options_->comparator)->user_comparator();
+      filter.user_key = ExtractUserKey(k);
+      filter.covering_seq = covering_seq;
+      filter.arg = arg;
+      filter.saver = saver;
+      filter.done = false;
+      s = tf->table->InternalGet(options, k, &filter, &FilterDeleted);
+      if (s.ok() && !filter.done) {
+        ReportDeletion(&filter);
+      }
+    }
     cache_->Release(handle);
   }
   return s;
 }
 
+Status TableCache::AddRangeTombstones(uint64_t file_number,
+                                      uint64_t file_size,
+                                      RangeTombstoneList* list) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    if (tf->tombstones != NULL) {
+      list->AddFrom(*tf->tombstones);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::GetTableProperties(uint64_t file_number,
+                                      uint64_t file_size,
+                                      TableProperties* props) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    TableReader* t =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    *props = t->GetProperties();
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::Preload(uint64_t file_number, uint64_t file_size) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+bool TableCache::PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                                const Slice& seek_key,
+                                const Slice& prefix_key) {
+  Cache::Handle* handle = NULL;
+  if (!FindTable(file_number, file_size, &handle).ok()) {
+    return true;
+  }
+  TableReader* t =
+      reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  bool may_match = t->PrefixMayMatch(seek_key, prefix_key);
+  cache_->Release(handle);
+  return may_match;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -11,38 +11,76 @@
 #include <stdint.h>
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
-#include "leveldb/table.h"
+#include "leveldb/table_factory.h"
 #include "port/port.h"
 
 namespace leveldb {
 
 class Env;
+class RangeTombstoneList;
 
 class TableCache {
  public:
   TableCache(const std::string& dbname, const Options* options, int entries);
   ~TableCache();
 
+  // Set the prefix that, with the file number, names tables in
+  // Options::persistent_cache.  Until it is set, tables do not use that
+  // cache.  REQUIRES: no table has been opened yet.
+  void SetCacheKeyPrefix(const std::string& prefix) {
+    cache_key_prefix_ = prefix;
+  }
+
   // Return an iterator for the specified file number (the corresponding
   // file length must be exactly "file_size" bytes).  If "tableptr" is
-  // non-NULL, also sets "*tableptr" to point to the Table object
-  // underlying the returned iterator, or NULL if no Table object underlies
+  // non-NULL, also sets "*tableptr" to point to the table object
+  // underlying the returned iterator, or NULL if no table object underlies
   // the returned iterator.  The returned "*tableptr" object is owned by
   // the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
   Iterator* NewIterator(const ReadOptions& options,
                         uint64_t file_number,
                         uint64_t file_size,
-                        Table** tableptr = NULL);
+                        TableReader** tableptr = NULL);
+
+  // Like NewIterator(), but reads the file through
+  // Env::NewDirectRandomAccessFile() and does not add it to the cache.
+  // Meant for compaction inputs, which are read once from start to end.
+  Iterator* NewDirectIterator(const ReadOptions& options,
+                              uint64_t file_number,
+                              uint64_t file_size);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value), and again for
+  // each following entry while it returns true.  If a range deletion in
+  // the file that is visible at the sequence number of "k" covers its
+  // user key, entries older than the deletion are reported as a deletion
+  // of the key instead, even if the seek finds nothing.
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t file_size,
              const Slice& k,
              void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             bool (*handle_result)(void*, const Slice&, const Slice&));
+
+  // Return false if the filter of the specified file shows that no entry
+  // at or after internal key "seek_key" has the prefix held in the user
+  // key of internal key "prefix_key".  Errors are left for the iterator
+  // to report, so they yield true.
+  bool PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                      const Slice& seek_key, const Slice& prefix_key);
+
+  // Add the range deletions stored in the specified file to *list.
+  Status AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                            RangeTombstoneList* list);
+
+  // Store the properties of the specified file in *props.
+  Status GetTableProperties(uint64_t file_number, uint64_t file_size,
+                            TableProperties* props);
+
+  // Open the specified file, unless it is already in the cache, so that
+  // later lookups find its index and filter blocks in memory.
+  Status Preload(uint64_t file_number, uint64_t file_size);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
@@ -52,8 +90,11 @@ class TableCache {
   const std::string dbname_;
   const Options* options_;
   Cache* cache_;
+  std::string cache_key_prefix_;
 
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status OpenTable(uint64_t file_number, uint64_t file_size, bool direct,
+                   RandomAccessFile** file, TableReader** table);
 };
 
 }  // namespace leveldb
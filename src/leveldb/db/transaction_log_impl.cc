@@ -0,0 +1,231 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/transaction_log_impl.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+#include "db/filename.h"
+#include "db/log_reader.h"
+#include "db/write_batch_internal.h"
+#include "leveldb/env.h"
+#include "util/logging.h"
+
+namespace leveldb {
+
+TransactionLogIterator::~TransactionLogIterator() { }
+
+namespace {
+
+struct LogReporter : public log::Reader::Reporter {
+  Status* status;
+  virtual void Corruption(size_t bytes, const Status& s) {
+    if (status->ok()) *status = s;
+  }
+};
+
+class TransactionLogIteratorImpl : public TransactionLogIterator {
+ public:
+  TransactionLogIteratorImpl(Env* env, const std::string& dbname,
+                             const std::vector<uint64_t>& logs,
+                             SequenceNumber seq)
+      : env_(env),
+        dbname_(dbname),
+        logs_(logs),
+        next_log_(0),
+        file_(NULL),
+        reader_(NULL),
+        valid_(false),
+        started_(false),
+        seq_(seq),
+        next_seq_(seq) {
+    reporter_.status = &status_;
+    Next();
+  }
+
+  virtual ~TransactionLogIteratorImpl() {
+    CloseLog();
+  }
+
+  virtual bool Valid() const { return valid_; }
+
+  virtual void Next() {
+    valid_ = false;
+    Slice record;
+    while (status_.ok()) {
+      if (reader_ == NULL && !OpenNextLog()) {
+        break;
+      }
+      if (!reader_->ReadRecord(&record, &scratch_)) {
+        CloseLog();
+        continue;
+      }
+      if (record.size() < 12) {
+        status_ = Status::Corruption("log record too small");
+        break;
+      }
+      WriteBatchInternal::SetContents(&batch_, record);
+      const int count = WriteBatchInternal::Count(&batch_);
+      if (count == 0) {
+        continue;
+      }
+      const SequenceNumber first = WriteBatchInternal::Sequence(&batch_);
+      const SequenceNumber last = first + count - 1;
+      if (last < next_seq_) {
+        // Written before the update asked for, or recovered from a log
+        // that a later one repeats
+        continue;
+      }
+      if (first != next_seq_ && (started_ || first > seq_)) {
+        if (started_) {
+          status_ = Status::Corruption("gap in log sequence numbers");
+        } else {
+          status_ = Status::NotFound("update is no longer logged");
+        }
+        break;
+      }
+      sequence_ = first;
+      next_seq_ = last + 1;
+      started_ = true;
+      valid_ = true;
+      break;
+    }
+  }
+
+  virtual uint64_t sequence() const {
+    assert(valid_);
+    return sequence_;
+  }
+
+  virtual uint64_t last_sequence() const {
+    assert(valid_);
+    return next_seq_ - 1;
+  }
+
+  virtual const WriteBatch& batch() const {
+    assert(valid_);
+    return batch_;
+  }
+
+  virtual Status status() const { return status_; }
+
+ private:
+  // Open the next log in logs_ and return true, or return false after
+  // the last log or an error.
+  bool OpenNextLog() {
+    while (next_log_ < logs_.size()) {
+      const uint64_t number = logs_[next_log_++];
+      Status s = env_->NewSequentialFile(LogFileName(dbname_, number), &file_);
+      if (s.IsNotFound() && !started_) {
+        // Deleted since it was listed; the next log may still hold seq_
+        continue;
+      }
+      if (!s.ok()) {
+        status_ = s;
+        return false;
+      }
+      reader_ = new log::Reader(file_, &reporter_, true/*checksum*/,
+                                0/*initial_offset*/, number);
+      return true;
+    }
+    return false;
+  }
+
+  void CloseLog() {
+    delete reader_;
+    delete file_;
+    reader_ = NULL;
+    file_ = NULL;
+  }
+
+  Env* const env_;
+  const std::string dbname_;
+  const std::vector<uint64_t> logs_;
+  size_t next_log_;
+  SequentialFile* file_;
+  log::Reader* reader_;
+  LogReporter reporter_;
+  std::string scratch_;
+  Status status_;
+  bool valid_;
+  bool started_;          // Have we returned a batch yet?
+  const SequenceNumber seq_;
+  SequenceNumber next_seq_;
+  SequenceNumber sequence_;
+  WriteBatch batch_;
+};
+
+// Store in *seq the sequence number of the first batch in log "number",
+// or return false if it has none that can be read.
+static bool FirstSequence(Env* env, const std::string& dbname,
+                          uint64_t number, SequenceNumber* seq) {
+  SequentialFile* file;
+  if (!env->NewSequentialFile(LogFileName(dbname, number), &file).ok()) {
+    return false;
+  }
+  Status status;
+  LogReporter reporter;
+  reporter.status = &status;
+  log::Reader reader(file, &reporter, true/*checksum*/, 0/*initial_offset*/,
+                     number);
+  Slice record;
+  std::string scratch;
+  WriteBatch batch;
+  bool found = false;
+  while (!found && reader.ReadRecord(&record, &scratch) && status.ok()) {
+    if (record.size() >= 12) {
+      WriteBatchInternal::SetContents(&batch, record);
+      if (WriteBatchInternal::Count(&batch) > 0) {
+        *seq = WriteBatchInternal::Sequence(&batch);
+        found = true;
+      }
+    }
+  }
+  delete file;
+  return found;
+}
+
+}  // namespace
+
+Status NewTransactionLogIterator(Env* env, const Options& options,
+                                 const std::string& dbname,
+                                 SequenceNumber seq,
+                                 TransactionLogIterator** result) {
+  *result = NULL;
+  std::vector<std::string> filenames;
+  Status s = env->GetChildren(dbname, &filenames);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<uint64_t> logs;
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == kLogFile) {
+      logs.push_back(number);
+    }
+  }
+  std::sort(logs.begin(), logs.end());
+
+  // Start with the newest log that begins at or before seq, so that only
+  // the first records of the logs after it are read to find it.
+  size_t start = 0;
+  for (size_t i = logs.size(); i-- > 0; ) {
+    SequenceNumber first = 0;
+    if (FirstSequence(env, dbname, logs[i], &first) && first <= seq) {
+      start = i;
+      break;
+    }
+  }
+  Log(options.info_log, "Replicating from update %llu, log #%llu of %d\n",
+      static_cast<unsigned long long>(seq),
+      static_cast<unsigned long long>(logs.empty() ? 0 : logs[start]),
+      static_cast<int>(logs.size()));
+  std::vector<uint64_t> to_read(logs.begin() + start, logs.end());
+  *result = new TransactionLogIteratorImpl(env, dbname, to_read, seq);
+  return Status::OK();
+}
+
+}  // namespace leveldb
@@ -0,0 +1,28 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_TRANSACTION_LOG_IMPL_H_
+#define STORAGE_LEVELDB_DB_TRANSACTION_LOG_IMPL_H_
+
+#include <string>
+#include "db/dbformat.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "leveldb/transaction_log.h"
+
+namespace leveldb {
+
+class Env;
+
+// Store in *result an iterator over the batches in the logs of database
+// "dbname", starting with the one that holds update "seq".  The logs are
+// listed when the iterator is made; logs made later are not read.
+extern Status NewTransactionLogIterator(Env* env, const Options& options,
+                                        const std::string& dbname,
+                                        SequenceNumber seq,
+                                        TransactionLogIterator** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_TRANSACTION_LOG_IMPL_H_
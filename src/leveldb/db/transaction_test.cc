@@ -0,0 +1,263 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/transaction.h"
+
+#include <stdlib.h>
+#include "leveldb/env.h"
+#include "leveldb/write_batch.h"
+#include "port/port.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class TransactionTest {
+ public:
+  std::string dbname_;
+  Options options_;
+  OptimisticTransactionDB* txn_db_;
+  DB* db_;
+
+  TransactionTest() {
+    dbname_ = test::TmpDir() + "/transaction_test";
+    options_.create_if_missing = true;
+    DestroyDB(dbname_, options_);
+    ASSERT_OK(OptimisticTransactionDB::Open(options_, dbname_, &txn_db_));
+    db_ = txn_db_->GetBaseDB();
+  }
+
+  ~TransactionTest() {
+    delete txn_db_;
+    DestroyDB(dbname_, options_);
+  }
+
+  std::string Get(const std::string& key) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), key, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  std::string Get(Transaction* txn, const std::string& key) {
+    std::string result;
+    Status s = txn->Get(ReadOptions(), key, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  // Flush the memtable, so that conflict checks must search the tables
+  void Flush() {
+    db_->CompactRange(NULL, NULL);
+  }
+};
+
+TEST(TransactionTest, ReadYourOwnWrites) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  ASSERT_OK(db_->Put(WriteOptions(), "b", "2"));
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("1", Get(txn, "a"));
+  txn->Put("a", "10");
+  txn->Delete("b");
+  txn->Put("c", "3");
+  ASSERT_EQ("10", Get(txn, "a"));
+  ASSERT_EQ("NOT_FOUND", Get(txn, "b"));
+  ASSERT_EQ("3", Get(txn, "c"));
+
+  // Nothing is visible outside until the commit
+  ASSERT_EQ("1", Get("a"));
+  ASSERT_EQ("2", Get("b"));
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("10", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("3", Get("c"));
+  ASSERT_TRUE(txn->Commit().IsInvalidArgument());
+  delete txn;
+}
+
+TEST(TransactionTest, ReadsFromSnapshot) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "2"));
+  ASSERT_EQ("1", Get(txn, "a"));
+  delete txn;
+}
+
+TEST(TransactionTest, ReadWriteConflict) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("1", Get(txn, "a"));
+  txn->Put("b", "from txn");
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "2"));
+  ASSERT_TRUE(txn->Commit().IsBusy());
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  delete txn;
+}
+
+TEST(TransactionTest, WriteWriteConflict) {
+  Transaction* txn1 = txn_db_->BeginTransaction(WriteOptions());
+  Transaction* txn2 = txn_db_->BeginTransaction(WriteOptions());
+  txn1->Put("x", "1");
+  txn2->Put("x", "2");
+  ASSERT_OK(txn1->Commit());
+  ASSERT_TRUE(txn2->Commit().IsBusy());
+  ASSERT_EQ("1", Get("x"));
+  delete txn1;
+  delete txn2;
+}
+
+TEST(TransactionTest, DisjointKeys) {
+  Transaction* txn1 = txn_db_->BeginTransaction(WriteOptions());
+  Transaction* txn2 = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("NOT_FOUND", Get(txn1, "a"));
+  ASSERT_EQ("NOT_FOUND", Get(txn2, "b"));
+  txn1->Put("a", "1");
+  txn2->Put("b", "2");
+  ASSERT_OK(db_->Put(WriteOptions(), "c", "3"));
+  ASSERT_OK(txn1->Commit());
+  ASSERT_OK(txn2->Commit());
+  ASSERT_EQ("1", Get("a"));
+  ASSERT_EQ("2", Get("b"));
+  delete txn1;
+  delete txn2;
+}
+
+TEST(TransactionTest, RollbackAndReadOnly) {
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  txn->Put("a", "1");
+  txn->Rollback();
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  delete txn;
+
+  // A transaction without writes commits despite conflicting writes
+  txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("NOT_FOUND", Get(txn, "a"));
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "2"));
+  ASSERT_OK(txn->Commit());
+  delete txn;
+}
+
+TEST(TransactionTest, ConflictAfterFlush) {
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  Transaction* txn1 = txn_db_->BeginTransaction(WriteOptions());
+  Transaction* txn2 = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("1", Get(txn1, "a"));
+  ASSERT_EQ("1", Get(txn2, "a"));
+  txn1->Put("b", "1");
+  txn2->Put("c", "1");
+
+  // The conflicting write of "a" reaches a table before the commits
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "2"));
+  ASSERT_OK(db_->Put(WriteOptions(), "z", "2"));
+  Flush();
+  ASSERT_TRUE(txn1->Commit().IsBusy());
+
+  // A write of another key does not conflict, even from a table
+  Transaction* txn3 = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("2", Get(txn3, "a"));
+  txn3->Put("d", "1");
+  ASSERT_OK(db_->Put(WriteOptions(), "z", "3"));
+  Flush();
+  ASSERT_OK(txn3->Commit());
+  ASSERT_EQ("1", Get("d"));
+
+  ASSERT_TRUE(txn2->Commit().IsBusy());
+  delete txn1;
+  delete txn2;
+  delete txn3;
+}
+
+TEST(TransactionTest, RangeDeletionConflicts) {
+  ASSERT_OK(db_->Put(WriteOptions(), "key5", "1"));
+  Transaction* txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("1", Get(txn, "key5"));
+  txn->Put("other", "1");
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "key0", "key9"));
+  ASSERT_TRUE(txn->Commit().IsBusy());
+  delete txn;
+
+  txn = txn_db_->BeginTransaction(WriteOptions());
+  ASSERT_EQ("NOT_FOUND", Get(txn, "key5"));
+  txn->Put("key5", "2");
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "b"));
+  ASSERT_OK(txn->Commit());
+  ASSERT_EQ("2", Get("key5"));
+  delete txn;
+}
+
+namespace {
+
+static const int kNumThreads = 4;
+static const int kIncrementsPerThread = 100;
+
+struct CounterThread {
+  OptimisticTransactionDB* txn_db;
+  int errors;
+  port::AtomicPointer done;
+};
+
+// Increments the shared counter in transactions, retrying on conflicts
+static void CounterBody(void* arg) {
+  CounterThread* t = reinterpret_cast<CounterThread*>(arg);
+  for (int i = 0; i < kIncrementsPerThread; i++) {
+    while (true) {
+      Transaction* txn = t->txn_db->BeginTransaction(WriteOptions());
+      std::string value;
+      Status s = txn->Get(ReadOptions(), "counter", &value);
+      int n = 0;
+      if (s.ok()) {
+        n = atoi(value.c_str());
+      } else if (!s.IsNotFound()) {
+        t->errors++;
+      }
+      char buf[20];
+      snprintf(buf, sizeof(buf), "%d", n + 1);
+      txn->Put("counter", buf);
+      s = txn->Commit();
+      delete txn;
+      if (s.ok()) {
+        break;
+      } else if (!s.IsBusy()) {
+        t->errors++;
+        break;
+      }
+    }
+  }
+  t->done.Release_Store(t);
+}
+
+}  // namespace
+
+TEST(TransactionTest, ConcurrentIncrements) {
+  CounterThread threads[kNumThreads];
+  for (int id = 0; id < kNumThreads; id++) {
+    threads[id].txn_db = txn_db_;
+    threads[id].errors = 0;
+    threads[id].done.Release_Store(NULL);
+    Env::Default()->StartThread(CounterBody, &threads[id]);
+  }
+  for (int id = 0; id < kNumThreads; id++) {
+    while (threads[id].done.Acquire_Load() == NULL) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+    ASSERT_EQ(0, threads[id].errors);
+  }
+  char expected[20];
+  snprintf(expected, sizeof(expected), "%d",
+           kNumThreads * kIncrementsPerThread);
+  ASSERT_EQ(expected, Get("counter"));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
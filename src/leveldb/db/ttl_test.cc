@@ -0,0 +1,195 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/ttl.h"
+
+#include "leveldb/compaction_filter.h"
+#include "leveldb/env.h"
+#include "leveldb/write_batch.h"
+#include "port/port.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+// Env whose clock is set by the test
+class ClockEnv : public EnvWrapper {
+ public:
+  port::AtomicPointer now_seconds_;  // Holds an integer
+
+  ClockEnv() : EnvWrapper(Env::Default()) {
+    SetTime(1000000);
+  }
+  void SetTime(uintptr_t seconds) {
+    now_seconds_.Release_Store(reinterpret_cast<void*>(seconds));
+  }
+  virtual uint64_t NowMicros() {
+    return reinterpret_cast<uintptr_t>(now_seconds_.Acquire_Load()) *
+           1000000ull;
+  }
+};
+
+// Appends "!" to every value
+class BangFilter : public CompactionFilter {
+ public:
+  virtual const char* Name() const { return "BangFilter"; }
+  virtual bool Filter(int level, const Slice& key, const Slice& value,
+                      std::string* new_value, bool* value_changed) const {
+    new_value->assign(value.data(), value.size());
+    new_value->push_back('!');
+    *value_changed = true;
+    return false;
+  }
+};
+
+// Concatenates the entries of a single shard scan
+class ScanContents : public ScanHandler {
+ public:
+  std::string result_;
+  virtual bool Process(int shard, const Slice& key, const Slice& value) {
+    result_ += key.ToString() + "=" + value.ToString() + " ";
+    return true;
+  }
+};
+}  // namespace
+
+class TTLTest {
+ public:
+  std::string dbname_;
+  ClockEnv env_;
+  Options options_;
+  DB* db_;
+
+  TTLTest() : db_(NULL) {
+    dbname_ = test::TmpDir() + "/ttl_test";
+    options_.env = &env_;
+    options_.create_if_missing = true;
+    DestroyDB(dbname_, options_);
+  }
+
+  ~TTLTest() {
+    delete db_;
+    DestroyDB(dbname_, options_);
+  }
+
+  void Open(int ttl) {
+    delete db_;
+    db_ = NULL;
+    ASSERT_OK(OpenDBWithTTL(options_, dbname_, ttl, &db_));
+  }
+
+  std::string Get(const std::string& key) {
+    std::string result;
+    Status s = db_->Get(ReadOptions(), key, &result);
+    if (s.IsNotFound()) {
+      result = "NOT_FOUND";
+    } else if (!s.ok()) {
+      result = s.ToString();
+    }
+    return result;
+  }
+
+  std::string Contents() {
+    std::string result;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+    }
+    delete iter;
+    return result;
+  }
+};
+
+TEST(TTLTest, ValuesReadBack) {
+  Open(100);
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  WriteBatch batch;
+  batch.Put("b", "2");
+  batch.Put("c", "");
+  batch.Delete("a");
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("2", Get("b"));
+  ASSERT_EQ("", Get("c"));
+  ASSERT_EQ("b=2 c= ", Contents());
+
+  ScanContents scan;
+  ASSERT_OK(db_->ParallelScan(ReadOptions(), Range("", ""), 1, &scan));
+  ASSERT_EQ("b=2 c= ", scan.result_);
+}
+
+TEST(TTLTest, ExpiresOnCompaction) {
+  Open(100);
+  ASSERT_OK(db_->Put(WriteOptions(), "old", "1"));
+  env_.SetTime(1000050);
+  ASSERT_OK(db_->Put(WriteOptions(), "new", "2"));
+
+  env_.SetTime(1000120);
+  ASSERT_EQ("1", Get("old"));  // Read as usual until compacted
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("NOT_FOUND", Get("old"));
+  ASSERT_EQ("new=2 ", Contents());
+
+  // The time-to-live applies after reopening too
+  Open(100);
+  env_.SetTime(1000200);
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("", Contents());
+}
+
+TEST(TTLTest, NoExpiry) {
+  Open(0);
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  env_.SetTime(2000000000);
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("1", Get("a"));
+}
+
+TEST(TTLTest, UserFilter) {
+  BangFilter filter;
+  options_.compaction_filter = &filter;
+  Open(100);
+  ASSERT_OK(db_->Put(WriteOptions(), "a", "1"));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("1!", Get("a"));
+
+  // The filtered value keeps its write time
+  env_.SetTime(1000101);
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+}
+
+TEST(TTLTest, ValueWithoutTimestamp) {
+  DB* db;
+  ASSERT_OK(DB::Open(options_, dbname_, &db));
+  ASSERT_OK(db->Put(WriteOptions(), "a", "xy"));
+  delete db;
+
+  Open(100);
+  std::string value;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "a", &value).IsCorruption());
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsCorruption());
+  delete iter;
+  ScanContents scan;
+  ASSERT_TRUE(db_->ParallelScan(ReadOptions(), Range("", ""), 1, &scan)
+              .IsCorruption());
+  ASSERT_EQ("", scan.result_);
+}
+
+TEST(TTLTest, Unsupported) {
+  Open(100);
+  ASSERT_TRUE(db_->Merge(WriteOptions(), "a", "1").IsNotSupportedError());
+  ColumnFamilyHandle* handle;
+  ASSERT_TRUE(db_->CreateColumnFamily(options_, "cf", &handle)
+              .IsNotSupportedError());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
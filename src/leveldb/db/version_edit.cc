@@ -20,7 +20,11 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  // Like kNewFile, for tables with range deletions.  Older versions
+  // refuse to open the DB rather than ignore the deletions.
+  kNewFileWithRangeDeletions = 10,
+  kColumnFamily         = 11
 };
 
 void VersionEdit::Clear() {
@@ -36,6 +40,7 @@ void VersionEdit::Clear() {
   has_last_sequence_ = false;
   deleted_files_.clear();
   new_files_.clear();
+  new_column_families_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -76,13 +81,20 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    PutVarint32(dst, f.has_range_deletions ? kNewFileWithRangeDeletions
+                                           : kNewFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
   }
+
+  for (size_t i = 0; i < new_column_families_.size(); i++) {
+    PutVarint32(dst, kColumnFamily);
+    PutVarint32(dst, new_column_families_[i].first);
+    PutLengthPrefixedSlice(dst, new_column_families_[i].second);
+  }
 }
 
 static bool GetInternalKey(Slice* input, InternalKey* dst) {
@@ -118,6 +130,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   FileMetaData f;
   Slice str;
   InternalKey key;
+  uint32_t id;
 
   while (msg == NULL && GetVarint32(&input, &tag)) {
     switch (tag) {
@@ -181,17 +194,28 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileWithRangeDeletions:
         if (GetLevel(&input, &level) &&
             GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.has_range_deletions = (tag == kNewFileWithRangeDeletions);
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kColumnFamily:
+        if (GetVarint32(&input, &id) &&
+            GetLengthPrefixedSlice(&input, &str)) {
+          new_column_families_.push_back(std::make_pair(id, str.ToString()));
+        } else {
+          msg = "column family";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -258,6 +282,15 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.has_range_deletions) {
+      r.append(" (range deletions)");
+    }
+  }
+  for (size_t i = 0; i < new_column_families_.size(); i++) {
+    r.append("\n  ColumnFamily: ");
+    AppendNumberTo(&r, new_column_families_[i].first);
+    r.append(" ");
+    r.append(new_column_families_[i].second);
   }
   r.append("\n}\n");
   return r;
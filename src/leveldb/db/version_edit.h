@@ -6,9 +6,11 @@
 #define STORAGE_LEVELDB_DB_VERSION_EDIT_H_
 
 #include <set>
+#include <string>
 #include <utility>
 #include <vector>
 #include "db/dbformat.h"
+#include "leveldb/table_properties.h"
 
 namespace leveldb {
 
@@ -21,8 +23,25 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
-
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  bool has_range_deletions;   // Table has a block of range tombstones
+
+  // Counts taken from the table's properties, which let compactions
+  // favor files with many deletions.  Not saved in the descriptor:
+  // VersionSet loads them for files written before the DB was opened.
+  bool has_stats;
+  uint64_t num_entries;       // Entries plus range deletions
+  uint64_t num_deletions;     // Deletions plus range deletions
+
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0),
+        has_range_deletions(false), has_stats(false),
+        num_entries(0), num_deletions(0) { }
+
+  void SetStats(const TableProperties& props) {
+    has_stats = true;
+    num_entries = props.num_entries + props.num_range_deletions;
+    num_deletions = props.num_deletions + props.num_range_deletions;
+  }
 };
 
 class VersionEdit {
@@ -58,16 +77,24 @@ class VersionEdit {
 
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
-  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file,
+  // including the bounds of any range deletions
   void AddFile(int level, uint64_t file,
                uint64_t file_size,
                const InternalKey& smallest,
-               const InternalKey& largest) {
+               const InternalKey& largest,
+               bool has_range_deletions = false) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_deletions = has_range_deletions;
+    new_files_.push_back(std::make_pair(level, f));
+  }
+
+  // Add file "f" at the specified level, along with its stats.
+  void AddFile(int level, const FileMetaData& f) {
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -76,6 +103,12 @@ class VersionEdit {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
+  // Register column family "id" named "name".  Only recorded in the
+  // descriptor of the default family.
+  void AddColumnFamily(uint32_t id, const std::string& name) {
+    new_column_families_.push_back(std::make_pair(id, name));
+  }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(const Slice& src);
 
@@ -100,6 +133,7 @@ class VersionEdit {
   std::vector< std::pair<int, InternalKey> > compact_pointers_;
   DeletedFileSet deleted_files_;
   std::vector< std::pair<int, FileMetaData> > new_files_;
+  std::vector< std::pair<uint32_t, std::string> > new_column_families_;
 };
 
 }  // namespace leveldb
@@ -10,16 +10,30 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
+// Maximum number of data blocks compaction input iterators read ahead.
+static const int kCompactionReadaheadBlocks = 32;
+
+// Maximum number of tables whose stats LogAndApply() loads from their
+// properties, for files written before the DB was opened.
+static const int kMaxStatsLoadsPerVersion = 20;
+
+// Files in which at least this fraction of the entries are deletions
+// are compacted ahead of the other files of their level.
+static const double kDeletionHeavyRatio = 0.5;
+
 static size_t TargetFileSize(const Options* options) {
   return options->max_file_size;
 }
@@ -63,6 +77,63 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
   return sum;
 }
 
+// The size of a file for the purpose of compaction scores.  Each
+// deletion in the file is expected to remove an entry of average size
+// from the levels below once compacted, so it counts twice.
+static uint64_t CompensatedFileSize(const FileMetaData* f) {
+  if (f->num_entries == 0) {
+    return f->file_size;
+  }
+  return f->file_size + static_cast<uint64_t>(
+      static_cast<double>(f->file_size) * f->num_deletions / f->num_entries);
+}
+
+static int64_t TotalCompensatedFileSize(
+    const std::vector<FileMetaData*>& files) {
+  int64_t sum = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    sum += CompensatedFileSize(files[i]);
+  }
+  return sum;
+}
+
+// Return the file of "files" with the largest fraction of deletions, if
+// that fraction is at least kDeletionHeavyRatio, else NULL.
+static FileMetaData* MostDeletionHeavyFile(
+    const std::vector<FileMetaData*>& files) {
+  FileMetaData* result = NULL;
+  double result_ratio = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    FileMetaData* f = files[i];
+    if (f->num_entries == 0) continue;
+    const double ratio =
+        static_cast<double>(f->num_deletions) / f->num_entries;
+    if (ratio >= kDeletionHeavyRatio &&
+        (result == NULL || ratio > result_ratio)) {
+      result = f;
+      result_ratio = ratio;
+    }
+  }
+  return result;
+}
+
+// Add to *files up to kMaxStatsLoadsPerVersion files from the lists of
+// files per level in "levels" whose stats have not been loaded, starting
+// with the lowest levels.
+static void AddFilesWithoutStats(const std::vector<FileMetaData*>* levels,
+                                 std::vector<FileMetaData*>* files) {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (size_t i = 0; i < levels[level].size(); i++) {
+      if (files->size() >= static_cast<size_t>(kMaxStatsLoadsPerVersion)) {
+        return;
+      }
+      if (!levels[level][i]->has_stats) {
+        files->push_back(levels[level][i]);
+      }
+    }
+  }
+}
+
 Version::~Version() {
   assert(refs_ == 0);
 
@@ -81,6 +152,7 @@ Version::~Version() {
       }
     }
   }
+  delete tombstones_;
 }
 
 int FindFile(const InternalKeyComparator& icmp,
@@ -224,20 +296,135 @@ static Iterator* GetFileIterator(void* arg,
   }
 }
 
+static Iterator* GetDirectFileIterator(void* arg,
+                                       const ReadOptions& options,
+                                       const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewDirectIterator(options,
+                                    DecodeFixed64(file_value.data()),
+                                    DecodeFixed64(file_value.data() + 8));
+  }
+}
+
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
       new LevelFileNumIterator(vset_->icmp_, &files_[level]),
-      &GetFileIterator, vset_->table_cache_, options);
+      &GetFileIterator, vset_->table_cache_, options, &vset_->icmp_);
 }
 
+namespace {
+
+// Wraps the iterator over one level-0 file or one whole level > 0 for a
+// prefix seek (see ReadOptions::prefix_same_as_start).  Seek() consults
+// the filter of the file that would hold the first entry at or after the
+// target, and leaves the iterator invalid without reading any data
+// blocks if that file has no key with the target's prefix.  Since keys
+// with a common prefix are contiguous, no later file can have one either.
+// Other positioning methods are passed through unchanged.
+class PrefixFilterIterator : public Iterator {
+ public:
+  // If "file_index" is negative, "*files" is a sorted level > 0 and the
+  // file is found by binary search; otherwise it is (*files)[file_index].
+  PrefixFilterIterator(Iterator* iter, TableCache* table_cache,
+                       const InternalKeyComparator& icmp,
+                       const SliceTransform* prefix_extractor,
+                       const std::vector<FileMetaData*>* files,
+                       int file_index)
+      : iter_(iter),
+        table_cache_(table_cache),
+        icmp_(icmp),
+        prefix_extractor_(prefix_extractor),
+        files_(files),
+        file_index_(file_index),
+        filtered_(false) {
+  }
+  virtual ~PrefixFilterIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const { return !filtered_ && iter_->Valid(); }
+  virtual void Seek(const Slice& target) {
+    filtered_ = !MayMatch(target);
+    if (!filtered_) {
+      iter_->Seek(target);
+    }
+  }
+  virtual void SeekToFirst() {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  virtual void SeekToLast() {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  virtual void Next() {
+    assert(Valid());
+    iter_->Next();
+  }
+  virtual void Prev() {
+    assert(Valid());
+    iter_->Prev();
+  }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  bool MayMatch(const Slice& target) {
+    Slice user_key = ExtractUserKey(target);
+    if (!prefix_extractor_->InDomain(user_key)) {
+      return true;
+    }
+    size_t index;
+    if (file_index_ >= 0) {
+      index = file_index_;
+    } else {
+      index = FindFile(icmp_, *files_, target);
+      if (index >= files_->size()) {
+        return false;
+      }
+    }
+    const FileMetaData* f = (*files_)[index];
+    InternalKey prefix_key(prefix_extractor_->Transform(user_key),
+                           kMaxSequenceNumber, kValueTypeForSeek);
+    return table_cache_->PrefixMayMatch(f->number, f->file_size,
+                                        target, prefix_key.Encode());
+  }
+
+  Iterator* const iter_;
+  TableCache* const table_cache_;
+  const InternalKeyComparator icmp_;
+  const SliceTransform* const prefix_extractor_;
+  const std::vector<FileMetaData*>* const files_;
+  const int file_index_;
+  bool filtered_;   // Last Seek() was ruled out by the filter
+
+  // No copying allowed
+  PrefixFilterIterator(const PrefixFilterIterator&);
+  void operator=(const PrefixFilterIterator&);
+};
+
+}  // namespace
+
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
+  const SliceTransform* prefix_extractor =
+      options.prefix_same_as_start ? vset_->options_->prefix_extractor : NULL;
+
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(
-        vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+    Iterator* iter = vset_->table_cache_->NewIterator(
+        options, files_[0][i]->number, files_[0][i]->file_size);
+    if (prefix_extractor != NULL) {
+      iter = new PrefixFilterIterator(iter, vset_->table_cache_, vset_->icmp_,
+                                      prefix_extractor, &files_[0], i);
+    }
+    iters->push_back(iter);
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -245,11 +432,47 @@ void Version::AddIterators(const ReadOptions& options,
   // lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
     if (!files_[level].empty()) {
-      iters->push_back(NewConcatenatingIterator(options, level));
+      Iterator* iter = NewConcatenatingIterator(options, level);
+      if (prefix_extractor != NULL) {
+        iter = new PrefixFilterIterator(iter, vset_->table_cache_,
+                                        vset_->icmp_, prefix_extractor,
+                                        &files_[level], -1);
+      }
+      iters->push_back(iter);
     }
   }
 }
 
+Status Version::GetRangeTombstones(const RangeTombstoneList** list) {
+  MutexLock l(&tombstones_mu_);
+  Status s;
+  if (!tombstones_built_) {
+    RangeTombstoneList* tombstones =
+        new RangeTombstoneList(vset_->icmp_.user_comparator());
+    for (int level = 0; s.ok() && level < config::kNumLevels; level++) {
+      for (size_t i = 0; s.ok() && i < files_[level].size(); i++) {
+        const FileMetaData* f = files_[level][i];
+        if (f->has_range_deletions) {
+          s = vset_->table_cache_->AddRangeTombstones(f->number, f->file_size,
+                                                      tombstones);
+        }
+      }
+    }
+    tombstones->Finish();
+    if (!s.ok() || tombstones->empty()) {
+      delete tombstones;
+      tombstones = NULL;
+    }
+    if (s.ok()) {
+      // Errors are not cached, so that a transient one is retried
+      tombstones_built_ = true;
+      tombstones_ = tombstones;
+    }
+  }
+  *list = tombstones_;
+  return s;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -263,21 +486,28 @@ struct Saver {
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  std::vector<std::string>* operands;
 };
 }
-static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+static bool SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
   if (!ParseInternalKey(ikey, &parsed_key)) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
+      if (parsed_key.type == kTypeMerge) {
+        // Collect the operand and go on to the older entries
+        s->operands->push_back(v.ToString());
+        return true;
+      }
       s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
       if (s->state == kFound) {
         s->value->assign(v.data(), v.size());
       }
     }
   }
+  return false;
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
@@ -332,7 +562,8 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
-                    GetStats* stats) {
+                    GetStats* stats,
+                    std::vector<std::string>* operands) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
@@ -405,6 +636,7 @@ Status Version::Get(const ReadOptions& options,
       saver.ucmp = ucmp;
       saver.user_key = user_key;
       saver.value = value;
+      saver.operands = operands;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
                                    ikey, &saver, SaveValue);
       if (!s.ok()) {
@@ -789,7 +1021,8 @@ VersionSet::VersionSet(const std::string& dbname,
       descriptor_file_(NULL),
       descriptor_log_(NULL),
       dummy_versions_(this),
-      current_(NULL) {
+      current_(NULL),
+      read_descriptor_size_(0) {
   AppendVersion(new Version(this));
 }
 
@@ -838,7 +1071,13 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     builder.Apply(edit);
     builder.SaveTo(v);
   }
-  Finalize(v);
+
+  // Some files of a DB that was just opened have no stats yet.  Read
+  // them from the tables while the mutex is released below, and fill
+  // them in once it is held again.
+  std::vector<FileMetaData*> stats_files;
+  AddFilesWithoutStats(v->files_, &stats_files);
+  std::vector<TableProperties> stats(stats_files.size());
 
   // Initialize new descriptor log file if necessary by creating
   // a temporary file that contains a snapshot of the current version.
@@ -861,6 +1100,12 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   {
     mu->Unlock();
 
+    for (size_t i = 0; i < stats_files.size(); i++) {
+      // A table that cannot be read is left with zero counts
+      table_cache_->GetTableProperties(stats_files[i]->number,
+                                       stats_files[i]->file_size, &stats[i]);
+    }
+
     // Write new record to MANIFEST log
     if (s.ok()) {
       std::string record;
@@ -883,11 +1128,18 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     mu->Lock();
   }
 
+  for (size_t i = 0; i < stats_files.size(); i++) {
+    stats_files[i]->SetStats(stats[i]);
+  }
+
   // Install the new version
   if (s.ok()) {
+    Finalize(v);
     AppendVersion(v);
     log_number_ = edit->log_number_;
     prev_log_number_ = edit->prev_log_number_;
+    column_families_.insert(edit->new_column_families_.begin(),
+                            edit->new_column_families_.end());
   } else {
     delete v;
     if (!new_manifest_file.empty()) {
@@ -902,14 +1154,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   return s;
 }
 
-Status VersionSet::Recover(bool *save_manifest) {
-  struct LogReporter : public log::Reader::Reporter {
-    Status* status;
-    virtual void Corruption(size_t bytes, const Status& s) {
-      if (this->status->ok()) *this->status = s;
-    }
-  };
-
+Status VersionSet::ReadCurrentFile(std::string* dscbase) {
   // Read "CURRENT" file, which contains a pointer to the current manifest file
   std::string current;
   Status s = ReadFileToString(env_, CurrentFileName(dbname_), &current);
@@ -920,10 +1165,24 @@ Status VersionSet::Recover(bool *save_manifest) {
     return Status::Corruption("CURRENT file does not end with newline");
   }
   current.resize(current.size() - 1);
+  dscbase->swap(current);
+  return Status::OK();
+}
+
+Status VersionSet::ReadDescriptor(
+    const std::string& dscname, Builder* builder,
+    std::map<uint32_t, std::string>* column_families,
+    uint64_t* next_file, uint64_t* last_sequence,
+    uint64_t* log_number, uint64_t* prev_log_number) {
+  struct LogReporter : public log::Reader::Reporter {
+    Status* status;
+    virtual void Corruption(size_t bytes, const Status& s) {
+      if (this->status->ok()) *this->status = s;
+    }
+  };
 
-  std::string dscname = dbname_ + "/" + current;
   SequentialFile* file;
-  s = env_->NewSequentialFile(dscname, &file);
+  Status s = env_->NewSequentialFile(dscname, &file);
   if (!s.ok()) {
     return s;
   }
@@ -932,11 +1191,10 @@ Status VersionSet::Recover(bool *save_manifest) {
   bool have_prev_log_number = false;
   bool have_next_file = false;
   bool have_last_sequence = false;
-  uint64_t next_file = 0;
-  uint64_t last_sequence = 0;
-  uint64_t log_number = 0;
-  uint64_t prev_log_number = 0;
-  Builder builder(this, current_);
+  *next_file = 0;
+  *last_sequence = 0;
+  *log_number = 0;
+  *prev_log_number = 0;
 
   {
     LogReporter reporter;
@@ -957,32 +1215,33 @@ Status VersionSet::Recover(bool *save_manifest) {
       }
 
       if (s.ok()) {
-        builder.Apply(&edit);
+        builder->Apply(&edit);
+        column_families->insert(edit.new_column_families_.begin(),
+                                edit.new_column_families_.end());
       }
 
       if (edit.has_log_number_) {
-        log_number = edit.log_number_;
+        *log_number = edit.log_number_;
         have_log_number = true;
       }
 
       if (edit.has_prev_log_number_) {
-        prev_log_number = edit.prev_log_number_;
+        *prev_log_number = edit.prev_log_number_;
         have_prev_log_number = true;
       }
 
       if (edit.has_next_file_number_) {
-        next_file = edit.next_file_number_;
+        *next_file = edit.next_file_number_;
         have_next_file = true;
       }
 
       if (edit.has_last_sequence_) {
-        last_sequence = edit.last_sequence_;
+        *last_sequence = edit.last_sequence_;
         have_last_sequence = true;
       }
     }
   }
   delete file;
-  file = NULL;
 
   if (s.ok()) {
     if (!have_next_file) {
@@ -994,14 +1253,31 @@ Status VersionSet::Recover(bool *save_manifest) {
     }
 
     if (!have_prev_log_number) {
-      prev_log_number = 0;
+      *prev_log_number = 0;
     }
+  }
+  return s;
+}
 
-    MarkFileNumberUsed(prev_log_number);
-    MarkFileNumberUsed(log_number);
+Status VersionSet::Recover(bool *save_manifest) {
+  std::string current;
+  Status s = ReadCurrentFile(&current);
+  if (!s.ok()) {
+    return s;
   }
 
+  std::string dscname = dbname_ + "/" + current;
+  uint64_t dscsize = 0;
+  env_->GetFileSize(dscname, &dscsize);  // Only needed by secondaries
+  uint64_t next_file, last_sequence, log_number, prev_log_number;
+  Builder builder(this, current_);
+  s = ReadDescriptor(dscname, &builder, &column_families_, &next_file,
+                     &last_sequence, &log_number, &prev_log_number);
+
   if (s.ok()) {
+    MarkFileNumberUsed(prev_log_number);
+    MarkFileNumberUsed(log_number);
+
     Version* v = new Version(this);
     builder.SaveTo(v);
     // Install recovered version
@@ -1012,6 +1288,8 @@ Status VersionSet::Recover(bool *save_manifest) {
     last_sequence_ = last_sequence;
     log_number_ = log_number;
     prev_log_number_ = prev_log_number;
+    read_descriptor_ = current;
+    read_descriptor_size_ = dscsize;
 
     // See if we can reuse the existing MANIFEST file.
     if (ReuseManifest(dscname, current)) {
@@ -1024,6 +1302,53 @@ Status VersionSet::Recover(bool *save_manifest) {
   return s;
 }
 
+Status VersionSet::CatchUpWithPrimary(port::Mutex* mu, bool* changed) {
+  mu->AssertHeld();
+  *changed = false;
+  mu->Unlock();
+
+  // The primary only ever appends to a descriptor or replaces it, so an
+  // unchanged name and size mean that there is nothing new.  The size is
+  // taken first so that records appended while reading are read again.
+  std::string current;
+  uint64_t dscsize = 0;
+  Status s = ReadCurrentFile(&current);
+  const std::string dscname = dbname_ + "/" + current;
+  if (s.ok()) {
+    s = env_->GetFileSize(dscname, &dscsize);
+  }
+  Version* v = NULL;
+  std::map<uint32_t, std::string> column_families;
+  uint64_t next_file, last_sequence, log_number, prev_log_number;
+  if (s.ok() &&
+      (current != read_descriptor_ || dscsize != read_descriptor_size_)) {
+    // Rebuild the state from scratch, not on top of the current version
+    Builder builder(this, new Version(this));
+    s = ReadDescriptor(dscname, &builder, &column_families, &next_file,
+                       &last_sequence, &log_number, &prev_log_number);
+    if (s.ok()) {
+      v = new Version(this);
+      builder.SaveTo(v);
+    }
+  }
+
+  mu->Lock();
+  if (v != NULL) {
+    Finalize(v);
+    AppendVersion(v);
+    MarkFileNumberUsed(next_file);
+    // Keep the last sequence number past the log records already read
+    last_sequence_ = std::max(last_sequence_, last_sequence);
+    log_number_ = log_number;
+    prev_log_number_ = prev_log_number;
+    column_families_.insert(column_families.begin(), column_families.end());
+    read_descriptor_ = current;
+    read_descriptor_size_ = dscsize;
+    *changed = true;
+  }
+  return s;
+}
+
 bool VersionSet::ReuseManifest(const std::string& dscname,
                                const std::string& dscbase) {
   if (!options_->reuse_logs) {
@@ -1083,8 +1408,9 @@ void VersionSet::Finalize(Version* v) {
       score = v->files_[level].size() /
           static_cast<double>(config::kL0_CompactionTrigger);
     } else {
-      // Compute the ratio of current size to size limit.
-      const uint64_t level_bytes = TotalFileSize(v->files_[level]);
+      // Compute the ratio of current size to size limit.  Files with
+      // many deletions count for more than their size.
+      const uint64_t level_bytes = TotalCompensatedFileSize(v->files_[level]);
       score =
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
@@ -1101,17 +1427,23 @@ void VersionSet::Finalize(Version* v) {
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
   // TODO: Break up into multiple records to reduce memory usage on recovery?
+  VersionEdit edit;
+  SaveSnapshot(&edit);
+  std::string record;
+  edit.EncodeTo(&record);
+  return log->AddRecord(record);
+}
 
+void VersionSet::SaveSnapshot(VersionEdit* edit) const {
   // Save metadata
-  VersionEdit edit;
-  edit.SetComparatorName(icmp_.user_comparator()->Name());
+  edit->SetComparatorName(icmp_.user_comparator()->Name());
 
   // Save compaction pointers
   for (int level = 0; level < config::kNumLevels; level++) {
     if (!compact_pointer_[level].empty()) {
       InternalKey key;
       key.DecodeFrom(compact_pointer_[level]);
-      edit.SetCompactPointer(level, key);
+      edit->SetCompactPointer(level, key);
     }
   }
 
@@ -1120,13 +1452,17 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit->AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                    f->has_range_deletions);
     }
   }
 
-  std::string record;
-  edit.EncodeTo(&record);
-  return log->AddRecord(record);
+  // Save column families
+  for (std::map<uint32_t, std::string>::const_iterator it =
+           column_families_.begin();
+       it != column_families_.end(); ++it) {
+    edit->AddColumnFamily(it->first, it->second);
+  }
 }
 
 int VersionSet::NumLevelFiles(int level) const {
@@ -1169,7 +1505,7 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
       } else {
         // "ikey" falls in the range for this table.  Add the
         // approximate offset of "ikey" within the table.
-        Table* tableptr;
+        TableReader* tableptr;
         Iterator* iter = table_cache_->NewIterator(
             ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
         if (tableptr != NULL) {
@@ -1259,6 +1595,14 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  // Compaction inputs are always read sequentially, so read further
+  // ahead than an ordinary scan would.
+  options.readahead_blocks = kCompactionReadaheadBlocks;
+  const bool direct = options_->use_direct_io_for_flush_and_compaction;
+  if (direct) {
+    // Direct files do their own large aligned reads.
+    options.readahead_blocks = 0;
+  }
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1271,14 +1615,20 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(
-              options, files[i]->number, files[i]->file_size);
+          if (direct) {
+            list[num++] = table_cache_->NewDirectIterator(
+                options, files[i]->number, files[i]->file_size);
+          } else {
+            list[num++] = table_cache_->NewIterator(
+                options, files[i]->number, files[i]->file_size);
+          }
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
             new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            direct ? &GetDirectFileIterator : &GetFileIterator,
+            table_cache_, options);
       }
     }
   }
@@ -1302,13 +1652,21 @@ Compaction* VersionSet::PickCompaction() {
     assert(level+1 < config::kNumLevels);
     c = new Compaction(options_, level);
 
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
+    // Compacting a file that is mostly deletions frees the space of the
+    // entries it deletes, and speeds up scans over them, so such files
+    // go first.  Otherwise pick the first file that comes after
+    // compact_pointer_[level].
+    FileMetaData* deletion_heavy = MostDeletionHeavyFile(
+        current_->files_[level]);
+    if (deletion_heavy != NULL) {
+      c->inputs_[0].push_back(deletion_heavy);
+    }
+    for (size_t i = 0;
+         c->inputs_[0].empty() && i < current_->files_[level].size(); i++) {
       FileMetaData* f = current_->files_[level][i];
       if (compact_pointer_[level].empty() ||
           icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
         c->inputs_[0].push_back(f);
-        break;
       }
     }
     if (c->inputs_[0].empty()) {
@@ -1479,6 +1837,14 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
       edit->DeleteFile(level_ + which, inputs_[which][i]->number);
     }
   }
+  for (size_t i = 0; i < dropped_.size(); i++) {
+    edit->DeleteFile(level_ + 1, dropped_[i]->number);
+  }
+}
+
+void Compaction::DropInput(int i) {
+  dropped_.push_back(inputs_[1][i]);
+  inputs_[1].erase(inputs_[1].begin() + i);
 }
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
@@ -1502,6 +1868,15 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
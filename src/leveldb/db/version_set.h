@@ -30,6 +30,7 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class RangeTombstoneList;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -63,15 +64,23 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Set *list to the fragmented range deletions of every file in this
+  // Version, or to NULL if there are none.  The list is built on the
+  // first call and stays valid while the Version is referenced.
+  // REQUIRES: lock is not held
+  Status GetRangeTombstones(const RangeTombstoneList** list);
+
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
+  // Merge operands found on the way are appended to *operands, newest
+  // first, and are left for the caller to apply.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, std::vector<std::string>* operands);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -110,6 +119,11 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Return the files at the specified level.
+  const std::vector<FileMetaData*>& files(int level) const {
+    return files_[level];
+  }
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -147,12 +161,19 @@ class Version {
   double compaction_score_;
   int compaction_level_;
 
+  // Range deletions of all files, built by GetRangeTombstones().
+  port::Mutex tombstones_mu_;
+  bool tombstones_built_;
+  RangeTombstoneList* tombstones_;  // NULL if there are none
+
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_level_(-1),
+        tombstones_built_(false),
+        tombstones_(NULL) {
   }
 
   ~Version();
@@ -181,6 +202,16 @@ class VersionSet {
   // Recover the last saved descriptor from persistent storage.
   Status Recover(bool *save_manifest);
 
+  // Read the descriptor again, as it is being written by another
+  // process (the primary), and if it has changed since the last call or
+  // Recover(), install the state it records as the current version and
+  // set *changed.  Never writes the descriptor.  Will release *mu while
+  // reading the file.
+  // REQUIRES: *mu is held on entry.
+  // REQUIRES: no other thread concurrently calls CatchUpWithPrimary()
+  Status CatchUpWithPrimary(port::Mutex* mu, bool* changed)
+      EXCLUSIVE_LOCKS_REQUIRED(mu);
+
   // Return the current version.
   Version* current() const { return current_; }
 
@@ -224,6 +255,17 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
+  // Add to *edit the comparator name, compaction pointers, files and
+  // column families of the current version, which a new descriptor
+  // starts with.
+  void SaveSnapshot(VersionEdit* edit) const;
+
+  // Return the names of the registered column families by id (see
+  // VersionEdit::AddColumnFamily).
+  const std::map<uint32_t, std::string>& column_families() const {
+    return column_families_;
+  }
+
   // Pick level and inputs for a new compaction.
   // Returns NULL if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
@@ -276,6 +318,17 @@ class VersionSet {
 
   bool ReuseManifest(const std::string& dscname, const std::string& dscbase);
 
+  // Store in *dscbase the name of the descriptor that CURRENT points to.
+  Status ReadCurrentFile(std::string* dscbase);
+
+  // Apply the edits of descriptor "dscname" to *builder, add the column
+  // families they register to *column_families and store the counters
+  // they record in the remaining arguments.
+  Status ReadDescriptor(const std::string& dscname, Builder* builder,
+                        std::map<uint32_t, std::string>* column_families,
+                        uint64_t* next_file, uint64_t* last_sequence,
+                        uint64_t* log_number, uint64_t* prev_log_number);
+
   void Finalize(Version* v);
 
   void GetRange(const std::vector<FileMetaData*>& inputs,
@@ -311,6 +364,13 @@ class VersionSet {
   Version dummy_versions_;  // Head of circular doubly-linked list of versions.
   Version* current_;        // == dummy_versions_.prev_
 
+  // The descriptor last read by Recover() or CatchUpWithPrimary(), and
+  // its size before it was read.
+  std::string read_descriptor_;
+  uint64_t read_descriptor_size_;
+
+  std::map<uint32_t, std::string> column_families_;
+
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
@@ -346,14 +406,23 @@ class Compaction {
   // moving a single input file to the next level (no merging or splitting)
   bool IsTrivialMove() const;
 
-  // Add all inputs to this compaction as delete operations to *edit.
+  // Add all inputs to this compaction, including dropped ones, as delete
+  // operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Remove the ith input file at "level+1" from the inputs because its
+  // whole contents are known to be obsolete.  The file is not read by the
+  // compaction but is still deleted by AddInputDeletions().
+  void DropInput(int i);
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Like IsBaseLevelForKey(), for all user keys in ["begin", "end"].
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
@@ -375,6 +444,7 @@ class Compaction {
 
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];      // The two sets of inputs
+  std::vector<FileMetaData*> dropped_;        // See DropInput()
 
   // State used to check for number of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
@@ -8,7 +8,10 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeRangeDeletion varstring varstring |
+//    kTypeMerge varstring varstring         |
+//    kColumnFamilyTag varint32 record
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -26,6 +29,10 @@ namespace leveldb {
 // WriteBatch header has an 8-byte sequence number followed by a 4-byte count.
 static const size_t kHeader = 12;
 
+// Prefixes a record of a column family other than the default one with
+// the family's id.  Not a ValueType, so never stored in a table.
+static const char kColumnFamilyTag = 0x10;
+
 WriteBatch::WriteBatch() {
   Clear();
 }
@@ -34,6 +41,29 @@ WriteBatch::~WriteBatch() { }
 
 WriteBatch::Handler::~Handler() { }
 
+void WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end) {
+}
+
+void WriteBatch::Handler::Merge(const Slice& key, const Slice& value) {
+}
+
+void WriteBatch::Handler::PutCF(uint32_t column_family_id,
+                                const Slice& key, const Slice& value) {
+}
+
+void WriteBatch::Handler::DeleteCF(uint32_t column_family_id,
+                                   const Slice& key) {
+}
+
+void WriteBatch::Handler::DeleteRangeCF(uint32_t column_family_id,
+                                        const Slice& begin,
+                                        const Slice& end) {
+}
+
+void WriteBatch::Handler::MergeCF(uint32_t column_family_id,
+                                  const Slice& key, const Slice& value) {
+}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -52,22 +82,63 @@ Status WriteBatch::Iterate(Handler* handler) const {
     found++;
     char tag = input[0];
     input.remove_prefix(1);
+    uint32_t column_family = 0;
+    if (tag == kColumnFamilyTag) {
+      if (!GetVarint32(&input, &column_family) || column_family == 0 ||
+          input.empty()) {
+        return Status::Corruption("bad WriteBatch column family");
+      }
+      tag = input[0];
+      input.remove_prefix(1);
+    }
     switch (tag) {
       case kTypeValue:
         if (GetLengthPrefixedSlice(&input, &key) &&
             GetLengthPrefixedSlice(&input, &value)) {
-          handler->Put(key, value);
+          if (column_family == 0) {
+            handler->Put(key, value);
+          } else {
+            handler->PutCF(column_family, key, value);
+          }
         } else {
           return Status::Corruption("bad WriteBatch Put");
         }
         break;
       case kTypeDeletion:
         if (GetLengthPrefixedSlice(&input, &key)) {
-          handler->Delete(key);
+          if (column_family == 0) {
+            handler->Delete(key);
+          } else {
+            handler->DeleteCF(column_family, key);
+          }
         } else {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          if (column_family == 0) {
+            handler->DeleteRange(key, value);
+          } else {
+            handler->DeleteRangeCF(column_family, key, value);
+          }
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
+      case kTypeMerge:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          if (column_family == 0) {
+            handler->Merge(key, value);
+          } else {
+            handler->MergeCF(column_family, key, value);
+          }
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -108,28 +179,134 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeMerge));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+// Start a record of "column_family", prefixed with its id unless it is
+// the default family.
+static void PutRecordTag(std::string* rep, ColumnFamilyHandle* column_family,
+                         ValueType type) {
+  const uint32_t id = column_family->GetID();
+  if (id != 0) {
+    rep->push_back(kColumnFamilyTag);
+    PutVarint32(rep, id);
+  }
+  rep->push_back(static_cast<char>(type));
+}
+
+void WriteBatch::Put(ColumnFamilyHandle* column_family,
+                     const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  PutRecordTag(&rep_, column_family, kTypeValue);
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::Delete(ColumnFamilyHandle* column_family, const Slice& key) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  PutRecordTag(&rep_, column_family, kTypeDeletion);
+  PutLengthPrefixedSlice(&rep_, key);
+}
+
+void WriteBatch::DeleteRange(ColumnFamilyHandle* column_family,
+                             const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  PutRecordTag(&rep_, column_family, kTypeRangeDeletion);
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
+void WriteBatch::Merge(ColumnFamilyHandle* column_family,
+                       const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  PutRecordTag(&rep_, column_family, kTypeMerge);
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+ColumnFamilyMemTables::~ColumnFamilyMemTables() { }
+
 namespace {
 class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
-  MemTable* mem_;
+  ColumnFamilyMemTables* memtables_;
 
-  virtual void Put(const Slice& key, const Slice& value) {
-    mem_->Add(sequence_, kTypeValue, key, value);
+  // Records of families without a memtable are skipped, but still use
+  // up their sequence numbers.
+  void Add(uint32_t column_family, ValueType type,
+           const Slice& key, const Slice& value) {
+    MemTable* mem = memtables_->GetMemTable(column_family);
+    if (mem != NULL) {
+      mem->Add(sequence_, type, key, value);
+    }
     sequence_++;
   }
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    Add(0, kTypeValue, key, value);
+  }
   virtual void Delete(const Slice& key) {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
-    sequence_++;
+    Add(0, kTypeDeletion, key, Slice());
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    Add(0, kTypeRangeDeletion, begin, end);
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    Add(0, kTypeMerge, key, value);
+  }
+  virtual void PutCF(uint32_t column_family,
+                     const Slice& key, const Slice& value) {
+    Add(column_family, kTypeValue, key, value);
+  }
+  virtual void DeleteCF(uint32_t column_family, const Slice& key) {
+    Add(column_family, kTypeDeletion, key, Slice());
+  }
+  virtual void DeleteRangeCF(uint32_t column_family,
+                             const Slice& begin, const Slice& end) {
+    Add(column_family, kTypeRangeDeletion, begin, end);
+  }
+  virtual void MergeCF(uint32_t column_family,
+                       const Slice& key, const Slice& value) {
+    Add(column_family, kTypeMerge, key, value);
   }
 };
+
+// Only the default column family, in a single memtable.
+class DefaultMemTable : public ColumnFamilyMemTables {
+ public:
+  explicit DefaultMemTable(MemTable* mem) : mem_(mem) { }
+  virtual MemTable* GetMemTable(uint32_t column_family) {
+    return (column_family == 0) ? mem_ : NULL;
+  }
+
+ private:
+  MemTable* mem_;
+};
 }  // namespace
 
 Status WriteBatchInternal::InsertInto(const WriteBatch* b,
                                       MemTable* memtable) {
+  DefaultMemTable memtables(memtable);
+  return InsertInto(b, &memtables);
+}
+
+Status WriteBatchInternal::InsertInto(const WriteBatch* b,
+                                      ColumnFamilyMemTables* memtables) {
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
-  inserter.mem_ = memtable;
+  inserter.memtables_ = memtables;
   return b->Iterate(&inserter);
 }
 
@@ -12,6 +12,17 @@ namespace leveldb {
 
 class MemTable;
 
+// Maps the column families of the records of a batch to the memtables
+// they are inserted into.
+class ColumnFamilyMemTables {
+ public:
+  virtual ~ColumnFamilyMemTables();
+
+  // Return the memtable for the records of family "column_family", or
+  // NULL if they are to be skipped.
+  virtual MemTable* GetMemTable(uint32_t column_family) = 0;
+};
+
 // WriteBatchInternal provides static methods for manipulating a
 // WriteBatch that we don't want in the public WriteBatch interface.
 class WriteBatchInternal {
@@ -39,8 +50,13 @@ class WriteBatchInternal {
 
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
+  // Insert the records of the default column family into "memtable";
+  // those of other families are skipped.
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  static Status InsertInto(const WriteBatch* batch,
+                           ColumnFamilyMemTables* memtables);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
@@ -38,11 +38,35 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        count++;
+        break;
+      default:
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem->NewRangeTombstoneIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    ASSERT_EQ(kTypeRangeDeletion, ikey.type);
+    state.append("DeleteRange(");
+    state.append(ikey.user_key.ToString());
+    state.append(", ");
+    state.append(iter->value().ToString());
+    state.append(")@");
+    state.append(NumberToString(ikey.sequence));
+    count++;
+  }
+  delete iter;
   if (!s.ok()) {
     state.append("ParseError()");
   } else if (count != WriteBatchInternal::Count(b)) {
@@ -74,6 +98,100 @@ TEST(WriteBatchTest, Multiple) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("g"));
+  batch.Delete(Slice("box"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Delete(box)@102"
+            "Put(foo, bar)@100"
+            "DeleteRange(a, g)@101",
+            PrintContents(&batch));
+}
+
+TEST(WriteBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Merge(Slice("foo"), Slice("a"));
+  batch.Put(Slice("baz"), Slice("boo"));
+  batch.Merge(Slice("foo"), Slice("b"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Put(baz, boo)@101"
+            "Merge(foo, b)@102"
+            "Merge(foo, a)@100",
+            PrintContents(&batch));
+}
+
+namespace {
+class TestColumnFamily : public ColumnFamilyHandle {
+ public:
+  explicit TestColumnFamily(uint32_t id) : id_(id), name_("test") { }
+  virtual const std::string& GetName() const { return name_; }
+  virtual uint32_t GetID() const { return id_; }
+
+ private:
+  uint32_t id_;
+  std::string name_;
+};
+
+class ColumnFamilyPrinter : public WriteBatch::Handler {
+ public:
+  std::string state_;
+  virtual void Put(const Slice& key, const Slice& value) {
+    state_ += "Put(" + key.ToString() + ")";
+  }
+  virtual void Delete(const Slice& key) {
+    state_ += "Delete(" + key.ToString() + ")";
+  }
+  virtual void PutCF(uint32_t id, const Slice& key, const Slice& value) {
+    state_ += "PutCF(" + NumberToString(id) + ", " + key.ToString() + ")";
+  }
+  virtual void DeleteCF(uint32_t id, const Slice& key) {
+    state_ += "DeleteCF(" + NumberToString(id) + ", " + key.ToString() + ")";
+  }
+  virtual void MergeCF(uint32_t id, const Slice& key, const Slice& value) {
+    state_ += "MergeCF(" + NumberToString(id) + ", " + key.ToString() + ")";
+  }
+};
+}  // namespace
+
+TEST(WriteBatchTest, ColumnFamilies) {
+  TestColumnFamily default_cf(0), cf(3);
+  WriteBatch batch;
+  batch.Put(&cf, Slice("foo"), Slice("bar"));
+  batch.Put(&default_cf, Slice("baz"), Slice("boo"));
+  batch.Delete(&cf, Slice("box"));
+  batch.Merge(&cf, Slice("cnt"), Slice("1"));
+  batch.Delete(Slice("bax"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(5, WriteBatchInternal::Count(&batch));
+
+  ColumnFamilyPrinter printer;
+  ASSERT_OK(batch.Iterate(&printer));
+  ASSERT_EQ("PutCF(3, foo)Put(baz)DeleteCF(3, box)MergeCF(3, cnt)"
+            "Delete(bax)", printer.state_);
+
+  // A single memtable gets only the default family's records, but they
+  // keep their place in the sequence.
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* mem = new MemTable(cmp);
+  mem->Ref();
+  ASSERT_OK(WriteBatchInternal::InsertInto(&batch, mem));
+  std::string state;
+  Iterator* iter = mem->NewIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    state += ikey.user_key.ToString() + "@" + NumberToString(ikey.sequence);
+    state += " ";
+  }
+  delete iter;
+  mem->Unref();
+  ASSERT_EQ("bax@104 baz@101 ", state);
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
@@ -7,7 +7,9 @@
 #include "leveldb/env.h"
 #include "leveldb/status.h"
 #include "port/port.h"
+#include "util/hash.h"
 #include "util/mutexlock.h"
+#include <deque>
 #include <map>
 #include <string.h>
 #include <string>
@@ -21,7 +23,7 @@ class FileState {
  public:
   // FileStates are reference counted. The initial reference count is zero
   // and the caller must call Ref() at least once.
-  FileState() : refs_(0), size_(0) {}
+  FileState() : refs_(0), size_(0), end_(0) {}
 
   // Increase the reference count.
   void Ref() {
@@ -47,9 +49,15 @@ class FileState {
     }
   }
 
-  uint64_t Size() const { return size_; }
+  uint64_t Size() const {
+    MutexLock lock(&blocks_mutex_);
+    return size_;
+  }
 
+  // Blocks are never freed or moved while the file lives, so a result
+  // that lies within one block points straight into it.
   Status Read(uint64_t offset, size_t n, Slice* result, char* scratch) const {
+    MutexLock lock(&blocks_mutex_);
     if (offset > size_) {
       return Status::IOError("Offset greater than file size.");
     }
@@ -62,11 +70,11 @@ class FileState {
       return Status::OK();
     }
 
-    assert(offset / kBlockSize <= SIZE_MAX);
-    size_t block = static_cast<size_t>(offset / kBlockSize);
-    size_t block_offset = offset % kBlockSize;
+    size_t block;
+    size_t block_offset;
+    FindBlock(offset, &block, &block_offset);
 
-    if (n <= kBlockSize - block_offset) {
+    if (n <= BlockSize(block) - block_offset) {
       // The requested bytes are all in the first block.
       *result = Slice(blocks_[block] + block_offset, n);
       return Status::OK();
@@ -76,7 +84,7 @@ class FileState {
     char* dst = scratch;
 
     while (bytes_to_copy > 0) {
-      size_t avail = kBlockSize - block_offset;
+      size_t avail = BlockSize(block) - block_offset;
       if (avail > bytes_to_copy) {
         avail = bytes_to_copy;
       }
@@ -96,17 +104,21 @@ class FileState {
     const char* src = data.data();
     size_t src_len = data.size();
 
+    MutexLock lock(&blocks_mutex_);
     while (src_len > 0) {
       size_t avail;
-      size_t offset = size_ % kBlockSize;
-
-      if (offset != 0) {
+      size_t offset;
+      if (size_ < end_) {
         // There is some room in the last block.
-        avail = kBlockSize - offset;
+        offset = BlockSize(blocks_.size() - 1) - (end_ - size_);
+        avail = end_ - size_;
       } else {
         // No room in the last block; push new one.
-        blocks_.push_back(new char[kBlockSize]);
-        avail = kBlockSize;
+        const size_t block_size = BlockSize(blocks_.size());
+        blocks_.push_back(new char[block_size]);
+        end_ += block_size;
+        offset = 0;
+        avail = block_size;
       }
 
       if (avail > src_len) {
@@ -130,6 +142,40 @@ class FileState {
     }
   }
 
+  // Block sizes double from kMinBlockSize up to kMaxBlockSize, so small
+  // files stay small while reads from large ones, such as table blocks,
+  // seldom straddle two blocks and need a copy.
+  enum {
+    kMinBlockSize = 8 * 1024,
+    kGrowthSteps = 7,
+    kMaxBlockSize = kMinBlockSize << kGrowthSteps
+  };
+
+  static size_t BlockSize(size_t block) {
+    return (block < kGrowthSteps) ? (kMinBlockSize << block) : kMaxBlockSize;
+  }
+
+  // Store the block holding byte "offset" and the position of the byte
+  // within it in *block and *block_offset.
+  static void FindBlock(uint64_t offset, size_t* block, size_t* block_offset) {
+    const uint64_t growth_bytes =
+        static_cast<uint64_t>(kMinBlockSize) * ((1 << kGrowthSteps) - 1);
+    if (offset >= growth_bytes) {
+      const uint64_t rest = offset - growth_bytes;
+      assert(rest / kMaxBlockSize <= SIZE_MAX - kGrowthSteps);
+      *block = kGrowthSteps + static_cast<size_t>(rest / kMaxBlockSize);
+      *block_offset = static_cast<size_t>(rest % kMaxBlockSize);
+      return;
+    }
+    size_t b = 0;
+    while (offset >= BlockSize(b)) {
+      offset -= BlockSize(b);
+      b++;
+    }
+    *block = b;
+    *block_offset = static_cast<size_t>(offset);
+  }
+
   // No copying allowed.
   FileState(const FileState&);
   void operator=(const FileState&);
@@ -137,13 +183,12 @@ class FileState {
   port::Mutex refs_mutex_;
   int refs_;  // Protected by refs_mutex_;
 
-  // The following fields are not protected by any mutex. They are only mutable
-  // while the file is being written, and concurrent access is not allowed
-  // to writable files.
-  std::vector<char*> blocks_;
-  uint64_t size_;
-
-  enum { kBlockSize = 8 * 1024 };
+  // Only one writer appends to a file at a time, but readers may look
+  // at it meanwhile, for instance to tail a log.
+  mutable port::Mutex blocks_mutex_;
+  std::vector<char*> blocks_;  // Protected by blocks_mutex_
+  uint64_t size_;              // Protected by blocks_mutex_
+  uint64_t end_;               // Capacity of blocks_; protected as well
 };
 
 class SequentialFileImpl : public SequentialFile {
@@ -232,49 +277,70 @@ class NoOpLogger : public Logger {
 
 class InMemoryEnv : public EnvWrapper {
  public:
-  explicit InMemoryEnv(Env* base_env) : EnvWrapper(base_env) { }
+  InMemoryEnv(Env* base_env, int background_threads)
+      : EnvWrapper(base_env),
+        background_threads_(background_threads),
+        bg_cv_(&bg_mu_),
+        bg_started_(false),
+        bg_shutting_down_(false),
+        bg_running_(0) { }
 
   virtual ~InMemoryEnv() {
-    for (FileSystem::iterator i = file_map_.begin(); i != file_map_.end(); ++i){
-      i->second->Unref();
+    // Let the pool finish the work already scheduled, then exit
+    bg_mu_.Lock();
+    bg_shutting_down_ = true;
+    bg_cv_.SignalAll();
+    while (bg_running_ > 0) {
+      bg_cv_.Wait();
+    }
+    bg_mu_.Unlock();
+
+    for (int i = 0; i < kNumShards; i++) {
+      FileSystem& files = shards_[i].files;
+      for (FileSystem::iterator it = files.begin(); it != files.end(); ++it) {
+        it->second->Unref();
+      }
     }
   }
 
   // Partial implementation of the Env interface.
   virtual Status NewSequentialFile(const std::string& fname,
                                    SequentialFile** result) {
-    MutexLock lock(&mutex_);
-    if (file_map_.find(fname) == file_map_.end()) {
+    Shard* shard = ShardFor(fname);
+    MutexLock lock(&shard->mu);
+    FileSystem::iterator it = shard->files.find(fname);
+    if (it == shard->files.end()) {
       *result = NULL;
       return Status::IOError(fname, "File not found");
     }
 
-    *result = new SequentialFileImpl(file_map_[fname]);
+    *result = new SequentialFileImpl(it->second);
     return Status::OK();
   }
 
   virtual Status NewRandomAccessFile(const std::string& fname,
                                      RandomAccessFile** result) {
-    MutexLock lock(&mutex_);
-    if (file_map_.find(fname) == file_map_.end()) {
+    Shard* shard = ShardFor(fname);
+    MutexLock lock(&shard->mu);
+    FileSystem::iterator it = shard->files.find(fname);
+    if (it == shard->files.end()) {
       *result = NULL;
       return Status::IOError(fname, "File not found");
     }
 
-    *result = new RandomAccessFileImpl(file_map_[fname]);
+    *result = new RandomAccessFileImpl(it->second);
     return Status::OK();
   }
 
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) {
-    MutexLock lock(&mutex_);
-    if (file_map_.find(fname) != file_map_.end()) {
-      DeleteFileInternal(fname);
-    }
+    Shard* shard = ShardFor(fname);
+    MutexLock lock(&shard->mu);
+    DeleteFileInternal(shard, fname);
 
     FileState* file = new FileState();
     file->Ref();
-    file_map_[fname] = file;
+    shard->files[fname] = file;
 
     *result = new WritableFileImpl(file);
     return Status::OK();
@@ -282,55 +348,51 @@ class InMemoryEnv : public EnvWrapper {
 
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result) {
-    MutexLock lock(&mutex_);
-    FileState** sptr = &file_map_[fname];
+    Shard* shard = ShardFor(fname);
+    MutexLock lock(&shard->mu);
+    FileState** sptr = &shard->files[fname];
     FileState* file = *sptr;
     if (file == NULL) {
       file = new FileState();
       file->Ref();
+      *sptr = file;
     }
     *result = new WritableFileImpl(file);
     return Status::OK();
   }
 
   virtual bool FileExists(const std::string& fname) {
-    MutexLock lock(&mutex_);
-    return file_map_.find(fname) != file_map_.end();
+    Shard* shard = ShardFor(fname);
+    MutexLock lock(&shard->mu);
+    return shard->files.find(fname) != shard->files.end();
   }
 
   virtual Status GetChildren(const std::string& dir,
                              std::vector<std::string>* result) {
-    MutexLock lock(&mutex_);
     result->clear();
 
-    for (FileSystem::iterator i = file_map_.begin(); i != file_map_.end(); ++i){
-      const std::string& filename = i->first;
-
-      if (filename.size() >= dir.size() + 1 && filename[dir.size()] == '/' &&
-          Slice(filename).starts_with(Slice(dir))) {
-        result->push_back(filename.substr(dir.size() + 1));
+    for (int i = 0; i < kNumShards; i++) {
+      MutexLock lock(&shards_[i].mu);
+      const FileSystem& files = shards_[i].files;
+      // The names under "dir/" are adjacent in the sorted map
+      const std::string prefix = dir + "/";
+      for (FileSystem::const_iterator it = files.lower_bound(prefix);
+           it != files.end() && Slice(it->first).starts_with(prefix); ++it) {
+        result->push_back(it->first.substr(prefix.size()));
       }
     }
 
     return Status::OK();
   }
 
-  void DeleteFileInternal(const std::string& fname) {
-    if (file_map_.find(fname) == file_map_.end()) {
-      return;
-    }
-
-    file_map_[fname]->Unref();
-    file_map_.erase(fname);
-  }
-
   virtual Status DeleteFile(const std::string& fname) {
-    MutexLock lock(&mutex_);
-    if (file_map_.find(fname) == file_map_.end()) {
+    Shard* shard = ShardFor(fname);
+    MutexLock lock(&shard->mu);
+    if (shard->files.find(fname) == shard->files.end()) {
       return Status::IOError(fname, "File not found");
     }
 
-    DeleteFileInternal(fname);
+    DeleteFileInternal(shard, fname);
     return Status::OK();
   }
 
@@ -343,25 +405,49 @@ class InMemoryEnv : public EnvWrapper {
   }
 
   virtual Status GetFileSize(const std::string& fname, uint64_t* file_size) {
-    MutexLock lock(&mutex_);
-    if (file_map_.find(fname) == file_map_.end()) {
+    Shard* shard = ShardFor(fname);
+    MutexLock lock(&shard->mu);
+    FileSystem::iterator it = shard->files.find(fname);
+    if (it == shard->files.end()) {
       return Status::IOError(fname, "File not found");
     }
 
-    *file_size = file_map_[fname]->Size();
+    *file_size = it->second->Size();
     return Status::OK();
   }
 
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) {
-    MutexLock lock(&mutex_);
-    if (file_map_.find(src) == file_map_.end()) {
+    Shard* src_shard = ShardFor(src);
+    Shard* target_shard = ShardFor(target);
+    TwoShardLock lock(src_shard, target_shard);
+    FileSystem::iterator it = src_shard->files.find(src);
+    if (it == src_shard->files.end()) {
       return Status::IOError(src, "File not found");
     }
 
-    DeleteFileInternal(target);
-    file_map_[target] = file_map_[src];
-    file_map_.erase(src);
+    FileState* file = it->second;
+    src_shard->files.erase(it);
+    DeleteFileInternal(target_shard, target);
+    target_shard->files[target] = file;
+    return Status::OK();
+  }
+
+  virtual Status LinkFile(const std::string& src, const std::string& target) {
+    Shard* src_shard = ShardFor(src);
+    Shard* target_shard = ShardFor(target);
+    TwoShardLock lock(src_shard, target_shard);
+    FileSystem::iterator it = src_shard->files.find(src);
+    if (it == src_shard->files.end()) {
+      return Status::IOError(src, "File not found");
+    }
+    if (target_shard->files.find(target) != target_shard->files.end()) {
+      return Status::IOError(target, "File exists");
+    }
+
+    FileState* file = it->second;
+    file->Ref();
+    target_shard->files[target] = file;
     return Status::OK();
   }
 
@@ -385,17 +471,123 @@ class InMemoryEnv : public EnvWrapper {
     return Status::OK();
   }
 
+  virtual void Schedule(void (*function)(void*), void* arg) {
+    if (background_threads_ <= 0) {
+      target()->Schedule(function, arg);
+      return;
+    }
+
+    MutexLock lock(&bg_mu_);
+    if (!bg_started_) {
+      bg_started_ = true;
+      for (int i = 0; i < background_threads_; i++) {
+        bg_running_++;
+        target()->StartThread(&InMemoryEnv::BGThreadWrapper, this);
+      }
+    }
+    bg_queue_.push_back(BGItem());
+    bg_queue_.back().function = function;
+    bg_queue_.back().arg = arg;
+    bg_cv_.SignalAll();
+  }
+
  private:
-  // Map from filenames to FileState objects, representing a simple file system.
+  // Map from filenames to FileState objects, representing a simple file
+  // system.  Files are spread over shards by the hash of their names, so
+  // that threads working on different files seldom wait for each other.
   typedef std::map<std::string, FileState*> FileSystem;
-  port::Mutex mutex_;
-  FileSystem file_map_;  // Protected by mutex_.
+  enum { kNumShards = 16 };
+  struct Shard {
+    port::Mutex mu;
+    FileSystem files;  // Protected by mu
+  };
+
+  Shard* ShardFor(const std::string& fname) {
+    return &shards_[Hash(fname.data(), fname.size(), 0) % kNumShards];
+  }
+
+  // Holds the locks of two shards, which may be the same one, taking
+  // them in a fixed order.
+  class TwoShardLock {
+   public:
+    TwoShardLock(Shard* a, Shard* b) {
+      first_ = (a < b) ? a : b;
+      second_ = (a < b) ? b : a;
+      first_->mu.Lock();
+      if (second_ != first_) second_->mu.Lock();
+    }
+    ~TwoShardLock() {
+      if (second_ != first_) second_->mu.Unlock();
+      first_->mu.Unlock();
+    }
+
+   private:
+    Shard* first_;
+    Shard* second_;
+
+    // No copying allowed
+    TwoShardLock(const TwoShardLock&);
+    void operator=(const TwoShardLock&);
+  };
+
+  // REQUIRES: shard->mu is held
+  void DeleteFileInternal(Shard* shard, const std::string& fname) {
+    FileSystem::iterator it = shard->files.find(fname);
+    if (it == shard->files.end()) {
+      return;
+    }
+
+    it->second->Unref();
+    shard->files.erase(it);
+  }
+
+  // Runs scheduled work until the env is deleted.
+  void BGThread() {
+    MutexLock lock(&bg_mu_);
+    while (true) {
+      while (bg_queue_.empty() && !bg_shutting_down_) {
+        bg_cv_.Wait();
+      }
+      if (bg_queue_.empty()) {
+        break;
+      }
+      void (*function)(void*) = bg_queue_.front().function;
+      void* arg = bg_queue_.front().arg;
+      bg_queue_.pop_front();
+
+      bg_mu_.Unlock();
+      (*function)(arg);
+      bg_mu_.Lock();
+    }
+    bg_running_--;
+    bg_cv_.SignalAll();
+  }
+  static void BGThreadWrapper(void* arg) {
+    reinterpret_cast<InMemoryEnv*>(arg)->BGThread();
+  }
+
+  Shard shards_[kNumShards];
+
+  // Threads of our own that run the work passed to Schedule(), started
+  // on its first call.  Without them, the work goes to the base env.
+  const int background_threads_;
+  struct BGItem { void* arg; void (*function)(void*); };
+  port::Mutex bg_mu_;
+  port::CondVar bg_cv_;            // Signalled on new work and thread exit
+  std::deque<BGItem> bg_queue_;    // Protected by bg_mu_
+  bool bg_started_;                // Protected by bg_mu_
+  bool bg_shutting_down_;          // Protected by bg_mu_
+  int bg_running_;                 // Threads not yet exited; ditto
 };
 
 }  // namespace
 
 Env* NewMemEnv(Env* base_env) {
-  return new InMemoryEnv(base_env);
+  return new InMemoryEnv(base_env, 0);
+}
+
+Env* NewMemEnv(Env* base_env, int background_threads) {
+  return new InMemoryEnv(base_env, background_threads);
 }
 
 }  // namespace leveldb
@@ -15,6 +15,12 @@ class Env;
 // *base_env must remain live while the result is in use.
 Env* NewMemEnv(Env* base_env);
 
+// Like NewMemEnv(), but the work passed to Schedule() runs on a pool of
+// "background_threads" threads of the result's own instead of base_env's
+// background thread.  Deleting the result waits for the work already
+// scheduled to finish.
+Env* NewMemEnv(Env* base_env, int background_threads);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_HELPERS_MEMENV_MEMENV_H_
@@ -7,7 +7,11 @@
 #include "db/db_impl.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
 #include "util/testharness.h"
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -158,6 +162,19 @@ TEST(MemEnvTest, Misc) {
   delete writable_file;
 }
 
+TEST(MemEnvTest, LinkFile) {
+  ASSERT_OK(WriteStringToFile(env_, "data", "/dir/f"));
+  ASSERT_OK(env_->LinkFile("/dir/f", "/dir/g"));
+  ASSERT_TRUE(!env_->LinkFile("/dir/f", "/dir/g").ok());
+  ASSERT_TRUE(!env_->LinkFile("/dir/missing", "/dir/h").ok());
+
+  // The link keeps the data after the original name is gone
+  ASSERT_OK(env_->DeleteFile("/dir/f"));
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, "/dir/g", &contents));
+  ASSERT_EQ("data", contents);
+}
+
 TEST(MemEnvTest, LargeWrite) {
   const size_t kWriteSize = 300 * 1024;
   char* scratch = new char[kWriteSize * 2];
@@ -191,6 +208,91 @@ TEST(MemEnvTest, LargeWrite) {
   delete [] scratch;
 }
 
+TEST(MemEnvTest, RandomReads) {
+  // Enough data for blocks of every size
+  const size_t kSize = 3 * 1024 * 1024;
+  std::string data(kSize, '\0');
+  for (size_t i = 0; i < kSize; i++) {
+    data[i] = static_cast<char>(i * 7 + (i >> 12));
+  }
+  WritableFile* writable_file;
+  ASSERT_OK(env_->NewWritableFile("/dir/f", &writable_file));
+  for (size_t pos = 0; pos < kSize; pos += 1000) {
+    ASSERT_OK(writable_file->Append(
+        Slice(data.data() + pos, std::min<size_t>(1000, kSize - pos))));
+  }
+  delete writable_file;
+
+  RandomAccessFile* file;
+  ASSERT_OK(env_->NewRandomAccessFile("/dir/f", &file));
+  char scratch[10000];
+  Random rnd(301);
+  int copies = 0;
+  for (int i = 0; i < 10000; i++) {
+    const uint64_t offset = rnd.Uniform(kSize);
+    const size_t n = rnd.Uniform(sizeof(scratch));
+    Slice result;
+    ASSERT_OK(file->Read(offset, n, &result, scratch));
+    ASSERT_EQ(std::min<uint64_t>(n, kSize - offset), result.size());
+    ASSERT_EQ(0, memcmp(result.data(), data.data() + offset, result.size()));
+    if (result.data() == scratch) copies++;
+  }
+  // Most reads lie within one block and are not copied
+  ASSERT_LT(copies, 1000);
+  delete file;
+}
+
+TEST(MemEnvTest, AppendToNewFile) {
+  WritableFile* writable_file;
+  ASSERT_OK(env_->NewAppendableFile("/dir/f", &writable_file));
+  ASSERT_OK(writable_file->Append("abc"));
+  delete writable_file;
+  ASSERT_TRUE(env_->FileExists("/dir/f"));
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, "/dir/f", &contents));
+  ASSERT_EQ("abc", contents);
+}
+
+namespace {
+struct PoolState {
+  port::Mutex mu;
+  port::CondVar cv;
+  int started;
+  int finished;
+  PoolState() : cv(&mu), started(0), finished(0) { }
+};
+
+static const int kPoolThreads = 3;
+
+// Returns only once every pool thread runs one of these
+static void WaitForOthers(void* arg) {
+  PoolState* state = reinterpret_cast<PoolState*>(arg);
+  MutexLock l(&state->mu);
+  state->started++;
+  state->cv.SignalAll();
+  while (state->started < kPoolThreads) {
+    state->cv.Wait();
+  }
+  state->finished++;
+  state->cv.SignalAll();
+}
+}  // namespace
+
+TEST(MemEnvTest, ThreadPool) {
+  Env* env = NewMemEnv(Env::Default(), kPoolThreads);
+  PoolState state;
+  for (int i = 0; i < kPoolThreads; i++) {
+    env->Schedule(&WaitForOthers, &state);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.finished < kPoolThreads) {
+      state.cv.Wait();
+    }
+  }
+  delete env;
+}
+
 TEST(MemEnvTest, DBTest) {
   Options options;
   options.create_if_missing = true;
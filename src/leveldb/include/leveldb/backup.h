@@ -0,0 +1,87 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A BackupEngine keeps backups of one database in a directory of its
+// own.  Table files never change once written, so a new backup copies
+// only the tables that no earlier backup has, judged by name, size and
+// checksum, and the backups share the rest.  Every file is stored with
+// its checksum, which restores verify.
+//
+// A BackupEngine is not safe for concurrent use.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_BACKUP_H_
+#define STORAGE_LEVELDB_INCLUDE_BACKUP_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class DB;
+class Env;
+
+struct BackupOptions {
+  // Env used to read the database and to write the backups.
+  // Default: Env::Default()
+  Env* env;
+
+  // Number of threads that copy and checksum files at once.
+  // Default: 4
+  int max_background_operations;
+
+  // Create a BackupOptions object with default values for all fields.
+  BackupOptions();
+};
+
+struct BackupInfo {
+  uint32_t backup_id;
+  uint64_t timestamp;      // Seconds since the epoch
+  uint64_t size;           // Bytes in the files of the backup
+  uint32_t number_files;
+
+  BackupInfo() : backup_id(0), timestamp(0), size(0), number_files(0) { }
+};
+
+class BackupEngine {
+ public:
+  // Open the backups kept in directory "backup_dir", which is created if
+  // it does not exist.  Stores a pointer to a heap-allocated engine in
+  // *result and returns OK on success.
+  static Status Open(const BackupOptions& options,
+                     const std::string& backup_dir,
+                     BackupEngine** result);
+
+  BackupEngine() { }
+  virtual ~BackupEngine();
+
+  // Back up the current state of "db", as DB::GetCheckpointFiles()
+  // describes it.
+  virtual Status CreateNewBackup(DB* db) = 0;
+
+  // Store in *info a description of each backup, oldest first.
+  virtual void GetBackupInfo(std::vector<BackupInfo>* info) = 0;
+
+  // Check the sizes and checksums of all files of backup "backup_id".
+  virtual Status VerifyBackup(uint32_t backup_id) = 0;
+
+  // Delete all but the newest "num_backups_to_keep" backups, and the
+  // tables that only the deleted ones used.
+  virtual Status PurgeOldBackups(int num_backups_to_keep) = 0;
+
+  // Replace the database in "db_dir", which must not be open, with the
+  // contents of backup "backup_id".  Checksums are verified on the way.
+  virtual Status RestoreDBFromBackup(uint32_t backup_id,
+                                     const std::string& db_dir) = 0;
+
+ private:
+  // No copying allowed
+  BackupEngine(const BackupEngine&);
+  void operator=(const BackupEngine&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_BACKUP_H_
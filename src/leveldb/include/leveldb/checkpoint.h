@@ -0,0 +1,50 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A checkpoint is a copy of an open database, as of one point in time,
+// that DB::Open() can open on its own.  Table files never change once
+// written, so a checkpoint on the same file system shares them with the
+// database through hard links and takes next to no space or time.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_CHECKPOINT_H_
+#define STORAGE_LEVELDB_INCLUDE_CHECKPOINT_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class DB;
+class Env;
+class Slice;
+
+// Receives the files of a checkpoint from DB::GetCheckpointFiles().
+class CheckpointHandler {
+ public:
+  virtual ~CheckpointHandler();
+
+  // Called for each table file.  "fname" is its name relative to the
+  // database directory, such as "000005.ldb" or "cf-000001/000007.ldb",
+  // and "path" is where it is now.  The file stays there until the
+  // handler has returned from its last call.
+  virtual Status AddTable(const std::string& path, const std::string& fname,
+                          uint64_t size) = 0;
+
+  // Called after all tables for each descriptor and CURRENT file, which
+  // are written afresh for the checkpoint.  "fname" is relative to the
+  // database directory, and the CURRENT file of a directory comes after
+  // the descriptor it names.
+  virtual Status AddFile(const std::string& fname, const Slice& contents) = 0;
+};
+
+// Create in directory "checkpoint_dir", which must not exist yet, a
+// checkpoint of "db", which was opened with "env".  Tables are linked
+// with Env::LinkFile() when possible, and copied otherwise.
+extern Status CreateCheckpoint(Env* env, DB* db,
+                               const std::string& checkpoint_dir);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_CHECKPOINT_H_
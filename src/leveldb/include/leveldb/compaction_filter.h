@@ -0,0 +1,44 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionFilter lets an application drop or rewrite values while
+// they are compacted, e.g. to expire old data without reading it back
+// and deleting it.  See Options::compaction_filter.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+class CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // Return the name of this filter, for logging.
+  virtual const char* Name() const = 0;
+
+  // Called for the newest value of "key" when it is older than every
+  // snapshot and is compacted out of "level"; snapshots see the result
+  // too.  Return true to remove the key, which then reads as deleted.
+  // Otherwise, to replace the value, store the new one in *new_value and
+  // set *value_changed to true.
+  //
+  // Deletions and merge operands are not passed to the filter, nor are
+  // values still in the memtable or in level-0 files that were never
+  // compacted.  Called from the background compaction thread, possibly
+  // while other threads use the DB.
+  virtual bool Filter(int level,
+                      const Slice& key,
+                      const Slice& existing_value,
+                      std::string* new_value,
+                      bool* value_changed) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
@@ -7,8 +7,11 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/table_properties.h"
 
 namespace leveldb {
 
@@ -19,6 +22,8 @@ static const int kMinorVersion = 20;
 struct Options;
 struct ReadOptions;
 struct WriteOptions;
+class CheckpointHandler;
+class TransactionLogIterator;
 class WriteBatch;
 
 // Abstract handle to particular state of a DB.
@@ -38,6 +43,48 @@ struct Range {
   Range(const Slice& s, const Slice& l) : start(s), limit(l) { }
 };
 
+// Receives the entries found by DB::ParallelScan().
+class ScanHandler {
+ public:
+  virtual ~ScanHandler();
+
+  // Called for every entry of shard "shard", in key order.  Shards are
+  // numbered in key order and scanned by several threads at once, so
+  // implementations must be thread-safe.  Return false to stop the scan.
+  virtual bool Process(int shard, const Slice& key, const Slice& value) = 0;
+};
+
+// Name of the column family that every DB has.
+extern const std::string kDefaultColumnFamilyName;
+
+// A column family is a separate key space of a DB, with its own
+// memtable, tables and table settings.  All families share the DB's
+// log, so a WriteBatch that spans families is applied atomically.
+// Handles are owned by the DB and stay valid until it is deleted.
+class ColumnFamilyHandle {
+ public:
+  virtual const std::string& GetName() const = 0;
+  virtual uint32_t GetID() const = 0;
+
+ protected:
+  virtual ~ColumnFamilyHandle();
+};
+
+// A column family to open along with a DB.  These fields of "options"
+// apply to the family: comparator, write_buffer_size, arena_block_size,
+// memtable_huge_page_size, block_size, block_restart_interval,
+// max_file_size, compression, filter_policy, prefix_extractor,
+// merge_operator and compaction_filter.  The rest are taken from the
+// options of the DB.
+struct ColumnFamilyDescriptor {
+  std::string name;
+  Options options;
+
+  ColumnFamilyDescriptor() { }
+  ColumnFamilyDescriptor(const std::string& n, const Options& o)
+      : name(n), options(o) { }
+};
+
 // A DB is a persistent ordered map from keys to values.
 // A DB is safe for concurrent access from multiple threads without
 // any external synchronization.
@@ -52,6 +99,33 @@ class DB {
                      const std::string& name,
                      DB** dbptr);
 
+  // Open the database, which has the column families listed in
+  // "column_families" besides the default one, whose options are
+  // "options".  Every family the database has must be listed.  Stores
+  // a handle for each family in *handles, in the order listed.
+  static Status Open(const Options& options,
+                     const std::string& name,
+                     const std::vector<ColumnFamilyDescriptor>& column_families,
+                     std::vector<ColumnFamilyHandle*>* handles,
+                     DB** dbptr);
+
+  // Open the database "name" for reading while another process, the
+  // primary, may have it open with DB::Open() and keep writing it.
+  // The secondary instance does not take the lock of the database.  It
+  // serves the state that the primary's descriptor and logs record when
+  // it is opened, and newer state after each TryCatchUpWithPrimary().
+  // Only the default column family can be read; writes, compactions and
+  // other calls that would change the files return NotSupported.  The
+  // info log of the secondary is kept in directory "secondary_path".
+  //
+  // The primary deletes the files it no longer needs regardless of any
+  // secondary, so a secondary that has fallen behind may fail to read
+  // tables it has not opened yet until it catches up.
+  static Status OpenAsSecondary(const Options& options,
+                                const std::string& name,
+                                const std::string& secondary_path,
+                                DB** dbptr);
+
   DB() { }
   virtual ~DB();
 
@@ -68,11 +142,39 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for all keys in ["begin", "end").
+  // Returns OK on success, and a non-OK status on error.  The range is
+  // recorded as a single tombstone, so the cost does not depend on the
+  // number of keys removed.  Keys written afterwards are not affected.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin, const Slice& end);
+
+  // Combine "value" with the current value of "key" using
+  // Options::merge_operator, without reading the current value.
+  // Returns OK on success, and a non-OK status on error.  Returns
+  // NotSupported if the database has no merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options,
+                       const Slice& key, const Slice& value);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
   virtual Status Write(const WriteOptions& options, WriteBatch* updates) = 0;
 
+  // Apply "updates" like Write(), but only if none of "keys" has been
+  // written or deleted since "snapshot" was taken.  Otherwise nothing is
+  // written and a Busy status is returned.  No other write is applied
+  // between the check and this one.  The keys belong to the default
+  // column family.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status WriteIfUnchanged(const WriteOptions& options,
+                                  const Snapshot* snapshot,
+                                  const std::vector<Slice>& keys,
+                                  WriteBatch* updates);
+
   // If the database contains an entry for "key" store the
   // corresponding value in *value and return OK.
   //
@@ -116,7 +218,14 @@ class DB {
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
-  //     bytes of memory in use by the DB.
+  //     bytes of memory in use by the DB: the block cache's contents plus
+  //     the memory the memtables have taken from the system.
+  //  "leveldb.open-stats" - returns a multi-line string that breaks down
+  //     the time DB::Open spent recovering the descriptor, replaying log
+  //     files and preloading tables.
+  //  "leveldb.perf" - returns a multi-line string with the latency
+  //     distribution of Get, Write and iterator Seek and Next calls since
+  //     the DB was opened.  See also leveldb/perf_context.h.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -130,6 +239,24 @@ class DB {
   virtual void GetApproximateSizes(const Range* range, int n,
                                    uint64_t* sizes) = 0;
 
+  // Fill *props with the properties of every table of the default
+  // column family (see leveldb/table_properties.h), keyed by file name.
+  // Data still in the memtables is not included.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status GetPropertiesOfAllTables(TablePropertiesCollection* props);
+
+  // Pass every entry in "[range.start .. range.limit)" to "handler",
+  // scanning up to "n" shards of about the same size on their own
+  // threads.  An empty range.limit means the end of the database.  All
+  // shards read options.snapshot, or an implicit snapshot if it is NULL.
+  // Returns the first error met by any shard.
+  //
+  // The default implementation scans the range as a single shard on
+  // the calling thread.
+  virtual Status ParallelScan(const ReadOptions& options, const Range& range,
+                              int n, ScanHandler* handler);
+
   // Compact the underlying storage for the key range [*begin,*end].
   // In particular, deleted and overwritten versions are discarded,
   // and the data is rearranged to reduce the cost of operations
@@ -142,6 +269,70 @@ class DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Write out the log records that Options::manual_wal_flush has kept
+  // buffered, and then, if "sync" is true, sync the log as a write with
+  // WriteOptions::sync would.  Waits for writes already in progress.
+  virtual Status FlushWAL(bool sync) = 0;
+
+  // For a secondary instance (see OpenAsSecondary()), read the tables
+  // and log records the primary has written since the last catch-up,
+  // so that later reads see them.  Snapshots and iterators keep the
+  // state they were made with.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status TryCatchUpWithPrimary();
+
+  // Flush the memtables of all column families and pass the files that
+  // make up the resulting state of the database to "handler" (see
+  // leveldb/checkpoint.h).  Writes wait until the memtables are flushed,
+  // so that no batch is split between families.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status GetCheckpointFiles(CheckpointHandler* handler);
+
+  // Store in *iter an iterator over the batches the database has written
+  // to its logs (see leveldb/transaction_log.h), starting with the batch
+  // that holds the update with sequence number "seq".  It reads the logs
+  // as they are when it is made, so once it is no longer valid with an
+  // OK status, call again with its last last_sequence() plus one for
+  // the batches written since.  With Options::manual_wal_flush, batches
+  // still buffered are not seen.  The logs recovery no longer needs are
+  // deleted unless Options::wal_ttl_seconds or wal_size_limit_mb keep
+  // them; the iterator's status is NotFound once "seq" is in none.
+  // The caller should delete *iter when it is no longer needed.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status GetUpdatesSince(uint64_t seq, TransactionLogIterator** iter);
+
+  // Add a column family named "name" with the settings of "options" (see
+  // ColumnFamilyDescriptor) and store a handle for it in *handle.
+  // Returns InvalidArgument if the database already has the family.
+  virtual Status CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle) = 0;
+
+  // Return the handle of the default column family, which the methods
+  // without a handle operate on.
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const = 0;
+
+  // Variants of the methods above for the given column family.
+  virtual Status Put(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key,
+                     const Slice& value);
+  virtual Status Delete(const WriteOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const Slice& key);
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key, std::string* value) = 0;
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family) = 0;
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value) = 0;
+  virtual void CompactRange(ColumnFamilyHandle* column_family,
+                            const Slice* begin, const Slice* end) = 0;
+
  private:
   // No copying allowed
   DB(const DB&);
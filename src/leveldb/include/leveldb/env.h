@@ -84,6 +84,35 @@ class Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile(), but reads bypass the operating system's
+  // page cache where the platform supports it, so that reading the
+  // file once does not evict more useful pages.  Intended for large
+  // sequential reads such as compaction inputs.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
+  // Like NewWritableFile(), but written data bypasses the operating
+  // system's page cache where the platform supports it.  Intended for
+  // large files that are written once, such as compaction outputs.
+  //
+  // The default implementation calls NewWritableFile().
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
+  // Rename the existing file "old_fname" to "fname" and open it for
+  // writing from the start, overwriting its contents but without first
+  // truncating it, so that the blocks it already has are reused.
+  // On success, stores a pointer to the file in *result and returns OK.
+  // On failure stores NULL in *result and returns non-OK.
+  //
+  // The default implementation renames the file and then calls
+  // NewWritableFile(), which truncates it.
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -109,6 +138,12 @@ class Env {
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) = 0;
 
+  // Make "target" a new name for the existing file "src", such as a hard
+  // link, so that both names refer to the same data without a copy.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status LinkFile(const std::string& src, const std::string& target);
+
   // Lock the specified file.  Used to prevent concurrent access to
   // the same db by multiple processes.  On failure, stores NULL in
   // *lock and returns non-OK.
@@ -157,6 +192,11 @@ class Env {
   // useful for computing deltas of time.
   virtual uint64_t NowMicros() = 0;
 
+  // Returns the number of nano-seconds since some fixed point in time. Only
+  // useful for computing deltas of time.  The default implementation
+  // returns NowMicros() * 1000.
+  virtual uint64_t NowNanos();
+
   // Sleep/delay the thread for the prescribed number of micro-seconds.
   virtual void SleepForMicroseconds(int micros) = 0;
 
@@ -218,6 +258,25 @@ class RandomAccessFile {
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
 
+  // Called by ReadAsync() when the read has finished.  "s" and
+  // "result" are as for Read().
+  typedef void (*ReadCallback)(void* arg, const Status& s,
+                               const Slice& result);
+
+  // Asynchronous version of Read().  Starts reading up to "n" bytes
+  // starting at "offset" and arranges for (*callback)(arg, ...) to be
+  // called once the data is available.  The callback may run on
+  // another thread, and it may run before ReadAsync() returns.
+  // "scratch[0..n-1]" and this file must remain live until the
+  // callback has run.  The callback should not block.
+  //
+  // The default implementation calls Read() and then the callback
+  // on the calling thread.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void ReadAsync(uint64_t offset, size_t n, char* scratch,
+                         ReadCallback callback, void* arg) const;
+
   // Get a name for the file, only for error reporting
   virtual std::string GetName() const = 0;
 
@@ -240,6 +299,12 @@ class WritableFile {
   virtual Status Flush() = 0;
   virtual Status Sync() = 0;
 
+  // Reserve space for the first "size" bytes of the file without changing
+  // its length, so that appending up to that size does not have to
+  // allocate blocks (and update file system metadata) as it goes.
+  // Only a hint: the default implementation does nothing.
+  virtual Status Preallocate(uint64_t size);
+
   // Get a name for the file, only for error reporting
   virtual std::string GetName() const = 0;
 
@@ -316,6 +381,17 @@ class EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) {
     return target_->NewAppendableFile(f, r);
   }
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) {
+    return target_->NewDirectRandomAccessFile(f, r);
+  }
+  Status NewDirectWritableFile(const std::string& f, WritableFile** r) {
+    return target_->NewDirectWritableFile(f, r);
+  }
+  Status ReuseWritableFile(const std::string& f, const std::string& old,
+                           WritableFile** r) {
+    return target_->ReuseWritableFile(f, old, r);
+  }
   bool FileExists(const std::string& f) { return target_->FileExists(f); }
   Status GetChildren(const std::string& dir, std::vector<std::string>* r) {
     return target_->GetChildren(dir, r);
@@ -329,6 +405,9 @@ class EnvWrapper : public Env {
   Status RenameFile(const std::string& s, const std::string& t) {
     return target_->RenameFile(s, t);
   }
+  Status LinkFile(const std::string& s, const std::string& t) {
+    return target_->LinkFile(s, t);
+  }
   Status LockFile(const std::string& f, FileLock** l) {
     return target_->LockFile(f, l);
   }
@@ -348,6 +427,9 @@ class EnvWrapper : public Env {
   uint64_t NowMicros() {
     return target_->NowMicros();
   }
+  uint64_t NowNanos() {
+    return target_->NowNanos();
+  }
   void SleepForMicroseconds(int micros) {
     target_->SleepForMicroseconds(micros);
   }
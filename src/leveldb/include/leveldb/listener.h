@@ -0,0 +1,109 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An EventListener supplied as Options::listener is told about memtable
+// flushes, compactions and write stalls as they happen, with the same
+// details the DB writes to its info log, in structured form.
+//
+// Callbacks are made without holding any DB lock, from the thread doing
+// the work: usually the background compaction thread, but a writer's
+// thread for write stalls and the opening thread for flushes done while
+// recovering logs in DB::Open.  They delay that work while they run, so
+// they should return quickly.  They may be called concurrently and must
+// not call back into the DB.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_LISTENER_H_
+#define STORAGE_LEVELDB_INCLUDE_LISTENER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+struct FlushJobInfo {
+  std::string db_name;
+  uint64_t file_number;      // Number of the table file being written
+
+  // Only set for OnFlushCompleted()
+  int level;                 // Level the table was added at
+  uint64_t file_size;        // Zero if no table was needed
+  uint64_t micros;           // Time taken by the flush
+  Status status;
+
+  FlushJobInfo() : file_number(0), level(0), file_size(0), micros(0) { }
+};
+
+struct CompactionJobInfo {
+  std::string db_name;
+  int level;                 // Inputs come from "level" and "level"+1,
+                             // outputs go to "level"+1
+  bool is_manual;            // Requested by DB::CompactRange()
+  bool is_trivial_move;      // A single file moved without rewriting it
+  std::vector<uint64_t> input_files;             // At "level"
+  std::vector<uint64_t> input_files_next_level;  // At "level"+1
+
+  // Only set for OnCompactionCompleted()
+  std::vector<uint64_t> output_files;
+  uint64_t bytes_read;       // Size of all input files
+  uint64_t bytes_written;    // Size of all output files
+  uint64_t micros;           // Time taken, excluding memtable flushes
+                             // done in the middle of the compaction
+  // bytes_written divided by the size of the input files at "level",
+  // i.e. the bytes rewritten per byte pushed down a level.
+  double write_amplification;
+  Status status;
+
+  CompactionJobInfo()
+      : level(0), is_manual(false), is_trivial_move(false), bytes_read(0),
+        bytes_written(0), micros(0), write_amplification(0) { }
+};
+
+enum WriteStallCause {
+  // Each write is delayed by a millisecond because level-0 is close to
+  // its limit on the number of files.
+  kStallLevel0Slowdown,
+  // Writes wait because level-0 has too many files.
+  kStallLevel0Stop,
+  // Writes wait because the memtable is full and the previous one is
+  // still being flushed.
+  kStallMemtableFull
+};
+
+struct WriteStallInfo {
+  std::string db_name;
+  WriteStallCause cause;
+  int level0_files;          // Number of level-0 files at the time
+  uint64_t micros;           // Only for OnWriteStallEnd(): stall duration
+
+  WriteStallInfo() : cause(kStallLevel0Slowdown), level0_files(0),
+                     micros(0) { }
+};
+
+class EventListener {
+ public:
+  virtual ~EventListener();
+
+  // The default implementations do nothing.
+
+  // A memtable is about to be written to a level-0 table, or has been.
+  virtual void OnFlushBegin(const FlushJobInfo& info);
+  virtual void OnFlushCompleted(const FlushJobInfo& info);
+
+  // A compaction is about to start, or has finished (successfully or
+  // not, see info.status).
+  virtual void OnCompactionBegin(const CompactionJobInfo& info);
+  virtual void OnCompactionCompleted(const CompactionJobInfo& info);
+
+  // Writes have started or stopped waiting for "info.cause".  Every
+  // OnWriteStallBegin() is followed by an OnWriteStallEnd() with the
+  // same cause before the next OnWriteStallBegin() from the same write.
+  virtual void OnWriteStallBegin(const WriteStallInfo& info);
+  virtual void OnWriteStallEnd(const WriteStallInfo& info);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_LISTENER_H_
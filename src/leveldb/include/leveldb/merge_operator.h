@@ -0,0 +1,52 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator lets an application update a value without reading it
+// first.  DB::Merge() stores only an operand; the operands of a key are
+// combined with its older value when the key is read, and combined with
+// each other in the background during compactions.  Counters, appends to
+// lists and similar read-modify-write updates then cost one write each.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator.  It is not stored in the database,
+  // but all processes that open the database must agree on how its
+  // operands are combined.
+  virtual const char* Name() const = 0;
+
+  // Combine operand "value" with *existing_value, the value it is
+  // applied to, and store the result in *new_value.  existing_value is
+  // NULL if "key" has no older value (or it was deleted).  Return false
+  // if the inputs are malformed; reads and compactions of the key then
+  // fail with a corruption error.
+  //
+  // The operation must be associative.  Compactions combine adjacent
+  // operands by passing the older one as *existing_value, and later
+  // apply the result to the value they both belong to.
+  virtual bool Merge(const Slice& key,
+                     const Slice* existing_value,
+                     const Slice& value,
+                     std::string* new_value) const = 0;
+};
+
+// Return a merge operator that treats values as 64-bit unsigned integers
+// encoded in little-endian order (8 bytes) and adds them, wrapping around
+// on overflow.  A key without a value counts as zero.  The caller should
+// delete the result after any database using it has been closed.
+extern const MergeOperator* NewUInt64AddOperator();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
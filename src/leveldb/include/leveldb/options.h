@@ -6,15 +6,24 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <string>
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
+class EventListener;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class PersistentCache;
+class RateLimiter;
+class Slice;
+class SliceTransform;
 class Snapshot;
+class TableFactory;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -82,6 +91,23 @@ struct Options {
   // Default: 4MB
   size_t write_buffer_size;
 
+  // Memtables allocate their memory in blocks of this size.  Larger
+  // blocks mean fewer allocations when filling a large write buffer.
+  //
+  // Default: 4K
+  size_t arena_block_size;
+
+  // If non-zero, memtable blocks are carved out of regions of this size
+  // backed by huge pages, which makes lookups in large memtables take
+  // fewer TLB misses.  It should be the system's huge page size, usually
+  // 2MB.  Pages reserved with hugetlbfs are used if any are free, else
+  // transparent huge pages are requested.  Memory is then taken from the
+  // system a region at a time, and "leveldb.approximate-memory-usage"
+  // counts whole regions.  Ignored where memory cannot be mapped.
+  //
+  // Default: 0
+  size_t memtable_huge_page_size;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -97,6 +123,21 @@ struct Options {
   // Default: NULL
   Cache* block_cache;
 
+  // If non-NULL, use the specified cache for blocks in the form in
+  // which they are stored in table files, i.e. still compressed.  A
+  // block that is not found in block_cache is looked up here before it
+  // is read from disk.  Since compressed blocks are smaller, this cache
+  // holds more of the working set in the same amount of memory, at the
+  // cost of decompressing a block on every hit.
+  // Default: NULL
+  Cache* block_cache_compressed;
+
+  // If non-NULL, blocks read from table files are also stored in this
+  // cache (see leveldb/persistent_cache.h), which is consulted after
+  // block_cache and block_cache_compressed and before the table file.
+  // Default: NULL
+  PersistentCache* persistent_cache;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -146,6 +187,36 @@ struct Options {
   // Default: currently false, but may become true later.
   bool reuse_logs;
 
+  // If non-zero, up to this many write-ahead log files that are no
+  // longer needed are kept and overwritten by later logs, instead of
+  // being deleted and new ones created.  Overwriting blocks a file
+  // already has makes syncing it cheaper on most file systems, since
+  // its extents and size do not change.  Logs are then written in a
+  // format that older versions of leveldb cannot read.
+  // Default: 0
+  size_t recycle_log_file_num;
+
+  // If true, DB::Write() does not write out log records itself: they
+  // stay in the log file's buffer until DB::FlushWAL() is called, the
+  // buffer fills up, a write with WriteOptions::sync set is made, or
+  // the log is switched or closed.  Records still in the buffer are
+  // lost if the process crashes.  Lets callers that group their own
+  // writes make one write (and sync) per group.
+  // Default: false
+  bool manual_wal_flush;
+
+  // Write-ahead log files that recovery no longer needs are kept for
+  // DB::GetUpdatesSince() until wal_ttl_seconds have passed since they
+  // stopped being needed (if wal_ttl_seconds is positive), and while
+  // the newer of them take up no more than wal_size_limit_mb megabytes
+  // in total (if wal_size_limit_mb is positive).  If both are zero,
+  // logs are deleted as soon as they are no longer needed.  Kept logs
+  // are deleted after the next flush or compaction once they expire.
+  // The age of the logs found at open is counted from the open.
+  // Default: 0
+  uint64_t wal_ttl_seconds;
+  uint64_t wal_size_limit_mb;
+
   // If non-NULL, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
@@ -153,6 +224,84 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If true, table files written by memtable flushes and compactions,
+  // and table files read as compaction inputs, bypass the operating
+  // system's page cache (O_DIRECT on POSIX).  Background I/O then no
+  // longer evicts the pages that foreground reads depend on.  Ignored
+  // if the Env or the file system does not support direct I/O.
+  // Default: false
+  bool use_direct_io_for_flush_and_compaction;
+
+  // If non-NULL, writes to table files made by memtable flushes and
+  // compactions are throttled by this limiter (see
+  // leveldb/rate_limiter.h).  Passing the same limiter to several
+  // databases caps their combined background write rate.
+  // Default: NULL
+  RateLimiter* rate_limiter;
+
+  // If positive, DB::Open opens the table files of the database on this
+  // many threads before returning, so that their index and filter blocks
+  // are already in the table cache when the first reads arrive.  Tables
+  // are opened level by level, up to the capacity of the table cache
+  // (see max_open_files).
+  // Default: 0 (tables are opened lazily on first access)
+  int table_preload_threads;
+
+  // If non-NULL, the filters of new table files also hold the prefix of
+  // every key (see leveldb/slice_transform.h), which lets iterators that
+  // set ReadOptions::prefix_same_as_start skip whole table files whose
+  // filter rules out the prefix being sought.  Has no effect unless
+  // filter_policy is set.  Tables written with a different (or without
+  // a) prefix extractor are simply not skipped.
+  // Default: NULL
+  const SliceTransform* prefix_extractor;
+
+  // If non-NULL, new table files are written in the format of this
+  // factory (see leveldb/table_factory.h), e.g. NewPlainTableFactory()
+  // for mmap-friendly plain tables.  Tables of either built-in format
+  // are read whatever this is set to.  Must outlive the DB.
+  // Default: NULL (block-based tables)
+  const TableFactory* table_factory;
+
+  // If non-NULL, combines the operands written with DB::Merge() and
+  // WriteBatch::Merge() (see leveldb/merge_operator.h).  A database that
+  // holds merge operands must always be opened with the same operator.
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
+  // If non-NULL, may drop or rewrite values as they are compacted (see
+  // leveldb/compaction_filter.h).  DB::CompactRange() then rewrites the
+  // last level too, so that the filter sees every value in the range.
+  // Must outlive the DB.
+  // Default: NULL
+  const CompactionFilter* compaction_filter;
+
+  // If positive, the text of the "leveldb.stats" and "leveldb.perf"
+  // properties (see DB::GetProperty) is reported about every
+  // stats_dump_period_sec seconds while the database is in use: to
+  // stats_dump_callback if it is non-NULL, else to info_log.
+  // Default: 0
+  int stats_dump_period_sec;
+
+  // If non-NULL, called as (*stats_dump_callback)(stats_dump_arg, stats)
+  // from a background thread for every stats dump.  It may call the DB
+  // but must not delete it.
+  // Default: NULL
+  void (*stats_dump_callback)(void* arg, const std::string& stats);
+  void* stats_dump_arg;
+
+  // If non-NULL, told about every memtable flush, compaction and write
+  // stall (see leveldb/listener.h).  Must outlive the DB.
+  // Default: NULL
+  EventListener* listener;
+
+  // For a DB opened with DB::OpenAsSecondary(): if positive, reads
+  // schedule a catch-up with the primary in the background once this
+  // many milliseconds have passed since the last one (see
+  // DB::TryCatchUpWithPrimary()).
+  // Default: 0 (only explicit calls catch up)
+  int secondary_catch_up_period_ms;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -176,10 +325,41 @@ struct ReadOptions {
   // Default: NULL
   const Snapshot* snapshot;
 
+  // Once an iterator has moved forward through a few table blocks in a
+  // row, it starts reading the following blocks in the background.  The
+  // readahead window starts at one block and doubles with each block
+  // read in sequence, up to this many blocks.  Zero disables readahead.
+  // Default: 8
+  int readahead_blocks;
+
+  // If non-NULL, iterators return only keys before "*iterate_upper_bound"
+  // (exclusive), and forward scans stop at the bound without reading the
+  // table blocks that lie entirely past it.  The pointed-to key must
+  // outlive the iterator.
+  //
+  // Iterators over a single Table (Table::NewIterator) compare the bound
+  // with the table's comparator and only use it to avoid reading blocks
+  // past the bound; they may still return keys at or after it.
+  // Default: NULL
+  const Slice* iterate_upper_bound;
+
+  // If true and the database has a prefix_extractor (see Options),
+  // Seek(target) restricts the iterator to keys that have the same
+  // prefix as "target": it becomes invalid at the first key with a
+  // different prefix, and table files whose filters rule out the prefix
+  // are not read at all.  If "target" is outside the extractor's domain
+  // the iterator is not restricted.  Only forward iteration is supported
+  // in this mode; Prev() and SeekToLast() fail with NotSupported.
+  // Default: false
+  bool prefix_same_as_start;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        readahead_blocks(8),
+        iterate_upper_bound(NULL),
+        prefix_same_as_start(false) {
   }
 };
 
@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext breaks down the work done by the calling thread inside
+// DB::Get(), DB::Write() and the Seek()/Next() methods of DB iterators
+// into stages, so that the cause of a slow operation can be found:
+//
+//   leveldb::SetPerfLevel(leveldb::kEnableTime);
+//   leveldb::GetPerfContext()->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   fprintf(stderr, "%s\n", leveldb::GetPerfContext()->ToString().c_str());
+//
+// Each thread has its own context and perf level, so no synchronization
+// is needed.  Counters accumulate until Reset() is called.  All times are
+// in nanoseconds.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace leveldb {
+
+enum PerfLevel {
+  kDisablePerf = 0,   // Collect nothing
+  kEnableCount = 1,   // Collect counters only
+  kEnableTime = 2     // Collect counters and times; reads the clock often
+};
+
+// Set or return the perf level of the calling thread.
+// The default is kEnableCount.
+extern void SetPerfLevel(PerfLevel level);
+extern PerfLevel GetPerfLevel();
+
+struct PerfContext {
+  // Set all counters and times to zero.
+  void Reset();
+
+  // Return a single line listing the non-zero counters and times.
+  std::string ToString() const;
+
+  // Get()
+  uint64_t get_from_memtable_count;     // Memtables searched
+  uint64_t get_from_memtable_time;      // Searching memtables
+  uint64_t get_from_output_files_time;  // Searching table files
+
+  // Write()
+  uint64_t write_wait_time;             // Waiting for other writers
+  uint64_t write_delay_time;            // Waiting for room in the memtable
+  uint64_t write_wal_time;              // Appending to (and syncing) the log
+  uint64_t write_memtable_time;         // Inserting into the memtable
+
+  // Iterators
+  uint64_t iter_seek_count;             // Seek(), SeekToFirst(), SeekToLast()
+  uint64_t iter_next_count;             // Next()
+  uint64_t seek_internal_time;          // Positioning the merged children
+  uint64_t find_next_user_entry_time;   // Skipping to the next visible key
+  uint64_t internal_key_skipped_count;  // Entries skipped as overwritten
+  uint64_t internal_delete_skipped_count;  // Deletion markers skipped
+
+  // Table files
+  uint64_t filter_probe_count;          // Filter blocks consulted
+  uint64_t filter_useful_count;         // ... that ruled out a block read
+  uint64_t block_cache_hit_count;
+  uint64_t block_cache_miss_count;
+  uint64_t block_read_count;            // Blocks read from files
+  uint64_t block_read_byte;
+  uint64_t block_read_time;             // Reading blocks from files
+  uint64_t block_checksum_time;         // Verifying block checksums
+  uint64_t block_decompress_time;       // Decompressing blocks
+};
+
+// Return the calling thread's PerfContext.
+extern PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
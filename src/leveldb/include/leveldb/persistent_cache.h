@@ -0,0 +1,69 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PersistentCache is a block cache tier that lives on local storage
+// (typically a fast SSD) rather than in memory.  It sits behind
+// Options::block_cache and Options::block_cache_compressed: blocks that
+// are read from a table file are also stored here, so that once they
+// have been evicted from the in-memory tiers they can be served without
+// going back to the (possibly slower, possibly remote) table file.
+//
+// A DB keys its entries by a unique id kept in its directory, the table
+// file number and the block offset, so entries left behind by a
+// destroyed DB are never mistaken for blocks of a new one.
+//
+// A PersistentCache is thread-safe.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+
+class PersistentCache {
+ public:
+  PersistentCache() { }
+
+  // Flushes buffered entries (if any) and releases all resources.
+  virtual ~PersistentCache();
+
+  // Store "data" under "key", replacing any previous entry for "key".
+  // An implementation is free to drop the entry, e.g. if it is larger
+  // than the cache.
+  virtual Status Insert(const Slice& key, const Slice& data) = 0;
+
+  // If the cache holds an entry for "key", store its contents in *data
+  // and return OK.  Returns a NotFound status if there is no such entry
+  // and some other non-OK status if the entry could not be read.
+  virtual Status Lookup(const Slice& key, std::string* data) = 0;
+
+  // Return an estimate of the number of bytes currently stored.
+  virtual uint64_t TotalSize() = 0;
+
+ private:
+  // No copying allowed
+  PersistentCache(const PersistentCache&);
+  void operator=(const PersistentCache&);
+};
+
+// Create a persistent cache that keeps up to "capacity" bytes in files
+// under the directory "dir", which is created if necessary.  Entries
+// written by a previous instance using the same directory are reused.
+// The directory should be dedicated to the cache.
+//
+// On success, stores a pointer to the new cache in *result and returns
+// OK.  The caller should delete *result when it is no longer needed.
+extern Status NewFilePersistentCache(Env* env, const std::string& dir,
+                                     uint64_t capacity,
+                                     PersistentCache** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
@@ -0,0 +1,57 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter caps the rate at which background work (memtable
+// flushes and compactions) writes table files.  Without a limit a large
+// compaction can saturate the device and inflate the latency of
+// foreground reads and log writes.
+//
+// A single RateLimiter may be shared by several databases (see
+// Options::rate_limiter), in which case the limit applies to their
+// combined writes.
+//
+// A RateLimiter is thread-safe.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+class Env;
+
+class RateLimiter {
+ public:
+  RateLimiter() { }
+  virtual ~RateLimiter();
+
+  // Block the calling thread until "bytes" more bytes may be written
+  // without exceeding the limit.  Requests larger than the per-refill
+  // allowance are granted in several steps.
+  virtual void Request(int64_t bytes) = 0;
+
+  // Return the configured limit in bytes per second.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Return the total number of bytes granted so far.
+  virtual int64_t GetTotalBytesThrough() const = 0;
+
+ private:
+  // No copying allowed
+  RateLimiter(const RateLimiter&);
+  void operator=(const RateLimiter&);
+};
+
+// Return a token-bucket limiter that allows "bytes_per_second" bytes per
+// second, measured with env->NowMicros() and enforced with
+// env->SleepForMicroseconds().  The caller should delete the result when
+// no database uses it any more.
+//
+// REQUIRES: bytes_per_second > 0
+extern RateLimiter* NewRateLimiter(Env* env, int64_t bytes_per_second);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -0,0 +1,49 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to a prefix of it.  When one is supplied as
+// Options::prefix_extractor, the database adds the prefixes of all keys
+// to its filters and can use them to skip table files during prefix
+// seeks (see ReadOptions::prefix_same_as_start).
+//
+// The keys that share a prefix must form a contiguous range under the
+// database's comparator, which holds for any prefix of a key under the
+// default bytewise comparator.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transformation.  The name is stored with
+  // every table whose filter holds prefixes, and the prefixes of a table
+  // are only used if the name still matches, so the name must change
+  // whenever Transform() changes in an incompatible way.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true if Transform() may be applied to "key".  Keys outside
+  // the domain are not added to filters as prefixes, and seeks to them
+  // are not restricted to a prefix.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a transform that maps a key to its first "prefix_len" bytes.
+// Keys shorter than that are outside its domain.  The caller should
+// delete the result when it is no longer needed.
+extern const SliceTransform* NewFixedPrefixTransform(size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
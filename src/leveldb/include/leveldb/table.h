@@ -6,12 +6,16 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <stdint.h>
+#include <string>
 #include "leveldb/iterator.h"
+#include "leveldb/table_factory.h"
+#include "leveldb/table_properties.h"
 
 namespace leveldb {
 
 class Block;
 class BlockHandle;
+struct BlockContents;
 class Footer;
 struct Options;
 class RandomAccessFile;
@@ -21,7 +25,9 @@ class TableCache;
 // A Table is a sorted map from strings to strings.  Tables are
 // immutable and persistent.  A Table may be safely accessed from
 // multiple threads without external synchronization.
-class Table {
+//
+// Table reads the block-based format written by TableBuilder.
+class Table : public TableReader {
  public:
   // Attempt to open the table that is stored in bytes [0..file_size)
   // of "file", and read the metadata entries necessary to allow
@@ -40,12 +46,12 @@ class Table {
                      uint64_t file_size,
                      Table** table);
 
-  ~Table();
+  virtual ~Table();
 
   // Returns a new iterator over the table contents.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
-  Iterator* NewIterator(const ReadOptions&) const;
+  virtual Iterator* NewIterator(const ReadOptions&) const;
 
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
@@ -53,7 +59,31 @@ class Table {
   // bytes, and so includes effects like compression of the underlying data.
   // E.g., the approximate offset of the last key in the table will
   // be close to the file length.
-  uint64_t ApproximateOffsetOf(const Slice& key) const;
+  virtual uint64_t ApproximateOffsetOf(const Slice& key) const;
+
+  // Return the properties recorded by the TableBuilder that wrote the
+  // table, or all-zero properties if it recorded none.
+  virtual const TableProperties& GetProperties() const;
+
+  // Implementations of the TableReader methods used by the DB.
+  virtual Status InternalGet(
+      const ReadOptions&, const Slice& key,
+      void* arg,
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v));
+
+  // Only tables whose filter holds the prefixes made by
+  // options.prefix_extractor ever rule out a prefix.
+  virtual bool PrefixMayMatch(const Slice& seek_key,
+                              const Slice& prefix_key) const;
+
+  // The keys of the range deletions are internal keys of type
+  // kTypeRangeDeletion.  Yields an error if they could not be read.
+  virtual Iterator* NewRangeTombstoneIterator() const;
+
+  // Tables opened by TableCache know the number of their file and the
+  // identity of their DB, which key their blocks in
+  // Options::persistent_cache.
+  virtual void SetCacheKey(const Slice& prefix, uint64_t file_number);
 
  private:
   struct Rep;
@@ -61,19 +91,19 @@ class Table {
 
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
-
-  // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
-  friend class TableCache;
-  Status InternalGet(
-      const ReadOptions&, const Slice& key,
-      void* arg,
-      void (*handle_result)(void* arg, const Slice& k, const Slice& v));
-
+  static void PrefetchBlock(void*, const ReadOptions&, const Slice&);
+  static void PrefetchDone(void*, const Status&, const Slice&);
+  Block* TakePrefetchedBlock(const BlockHandle& handle, bool* cachable) const;
+  Status ReadBlockFromTiers(const ReadOptions&, const BlockHandle& handle,
+                            BlockContents* contents) const;
+  std::string PersistentCacheKey(uint64_t offset) const;
+  void CacheRawBlock(const BlockHandle& handle, std::string* raw,
+                     bool persist) const;
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadRangeDeletions(const Slice& handle_value);
+  void ReadProperties(const Slice& handle_value);
 
   // No copying allowed
   Table(const Table&);
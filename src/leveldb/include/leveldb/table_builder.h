@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include "leveldb/options.h"
 #include "leveldb/status.h"
+#include "leveldb/table_factory.h"
 
 namespace leveldb {
 
@@ -23,7 +24,7 @@ class BlockBuilder;
 class BlockHandle;
 class WritableFile;
 
-class TableBuilder {
+class TableBuilder : public TableWriter {
  public:
   // Create a builder that will store the contents of the table it is
   // building in *file.  Does not close the file.  It is up to the
@@ -31,7 +32,7 @@ class TableBuilder {
   TableBuilder(const Options& options, WritableFile* file);
 
   // REQUIRES: Either Finish() or Abandon() has been called.
-  ~TableBuilder();
+  virtual ~TableBuilder();
 
   // Change the options used by this builder.  Note: only some of the
   // option fields can be changed after construction.  If a field is
@@ -44,7 +45,15 @@ class TableBuilder {
   // Add key,value to the table being constructed.
   // REQUIRES: key is after any previously added key according to comparator.
   // REQUIRES: Finish(), Abandon() have not been called
-  void Add(const Slice& key, const Slice& value);
+  virtual void Add(const Slice& key, const Slice& value);
+
+  // Add key,value to a separate block of range deletions, which the DB
+  // uses to store the tombstones written by WriteBatch::DeleteRange().
+  // The entries are not part of the table's data and are not counted
+  // by NumEntries().
+  // REQUIRES: key is after any previously added range deletion key.
+  // REQUIRES: Finish(), Abandon() have not been called
+  virtual void AddRangeTombstone(const Slice& key, const Slice& value);
 
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
@@ -53,26 +62,33 @@ class TableBuilder {
   void Flush();
 
   // Return non-ok iff some error has been detected.
-  Status status() const;
+  virtual Status status() const;
 
   // Finish building the table.  Stops using the file passed to the
   // constructor after this function returns.
   // REQUIRES: Finish(), Abandon() have not been called
-  Status Finish();
+  virtual Status Finish();
 
   // Indicate that the contents of this builder should be abandoned.  Stops
   // using the file passed to the constructor after this function returns.
   // If the caller is not going to call Finish(), it must call Abandon()
   // before destroying this builder.
   // REQUIRES: Finish(), Abandon() have not been called
-  void Abandon();
+  virtual void Abandon();
 
   // Number of calls to Add() so far.
-  uint64_t NumEntries() const;
+  virtual uint64_t NumEntries() const;
+
+  // Number of calls to AddRangeTombstone() so far.
+  virtual uint64_t NumRangeTombstones() const;
 
   // Size of the file generated so far.  If invoked after a successful
   // Finish() call, returns the size of the final generated file.
-  uint64_t FileSize() const;
+  virtual uint64_t FileSize() const;
+
+  // Properties of the table built so far (see leveldb/table_properties.h).
+  // The block sizes are only complete after a successful Finish() call.
+  virtual TableProperties GetProperties() const;
 
  private:
   bool ok() const { return status().ok(); }
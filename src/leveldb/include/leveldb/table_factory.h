@@ -0,0 +1,174 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A TableFactory creates the readers and writers of one table file
+// format.  Options::table_factory selects the format that a DB writes
+// its tables in.  Two formats are built in:
+//
+//  - Block-based tables (see leveldb/table.h), the default.  Entries are
+//    stored in compressed blocks that are read through the block cache.
+//
+//  - Plain tables (NewPlainTableFactory() below), meant for read-mostly
+//    data on files the Env maps into memory.  Entries are stored one
+//    after the other without compression, and lookups go through a hash
+//    index of key prefixes straight to the mapped file, bypassing the
+//    block cache.
+//
+// Both built-in factories read tables of either built-in format, so the
+// format of a DB can be changed between runs; existing tables keep
+// theirs until they are compacted.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TABLE_FACTORY_H_
+#define STORAGE_LEVELDB_INCLUDE_TABLE_FACTORY_H_
+
+#include <stdint.h>
+#include "leveldb/iterator.h"
+#include "leveldb/status.h"
+#include "leveldb/table_properties.h"
+
+namespace leveldb {
+
+struct Options;
+class RandomAccessFile;
+struct ReadOptions;
+class WritableFile;
+
+// An open table.  May be accessed from multiple threads without
+// external synchronization.
+class TableReader {
+ public:
+  TableReader() { }
+  virtual ~TableReader();
+
+  // Returns a new iterator over the table contents.
+  // The result of NewIterator() is initially invalid (caller must
+  // call one of the Seek methods on the iterator before using it).
+  virtual Iterator* NewIterator(const ReadOptions& options) const = 0;
+
+  // Calls (*handle_result)(arg, ...) with the entry found after a call
+  // to Seek(key), and then with each following entry for as long as it
+  // returns true.  May not make such a call if an index or filter
+  // shows that key is not present.
+  virtual Status InternalGet(
+      const ReadOptions& options, const Slice& key,
+      void* arg,
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v)) = 0;
+
+  // Return false if it is known that no key in the table at or after
+  // "seek_key" has the prefix of Options::prefix_extractor held in
+  // "prefix_key", which is a key whose user key is the prefix.  The
+  // default implementation returns true.
+  virtual bool PrefixMayMatch(const Slice& seek_key,
+                              const Slice& prefix_key) const;
+
+  // Returns an iterator over the range deletions the table holds in
+  // addition to its entries (see TableWriter::AddRangeTombstone()).
+  virtual Iterator* NewRangeTombstoneIterator() const = 0;
+
+  // Given a key, return an approximate byte offset in the file where
+  // the data for that key begins (or would begin if the key were
+  // present in the file).
+  virtual uint64_t ApproximateOffsetOf(const Slice& key) const = 0;
+
+  // Return the properties recorded by the writer of the table.
+  virtual const TableProperties& GetProperties() const = 0;
+
+  // Called by the DB with the number of the table's file and a prefix
+  // that is unique to the DB and the directory of the file, which
+  // together name the table in caches that outlive the DB.  The default
+  // implementation does nothing.
+  virtual void SetCacheKey(const Slice& prefix, uint64_t file_number);
+
+ private:
+  // No copying allowed
+  TableReader(const TableReader&);
+  void operator=(const TableReader&);
+};
+
+// Builds a table file.  See leveldb/table_builder.h for the meaning of
+// the methods, which TableBuilder implements for block-based tables.
+class TableWriter {
+ public:
+  TableWriter() { }
+
+  // REQUIRES: Either Finish() or Abandon() has been called.
+  virtual ~TableWriter();
+
+  virtual void Add(const Slice& key, const Slice& value) = 0;
+  virtual void AddRangeTombstone(const Slice& key, const Slice& value) = 0;
+  virtual Status status() const = 0;
+  virtual Status Finish() = 0;
+  virtual void Abandon() = 0;
+  virtual uint64_t NumEntries() const = 0;
+  virtual uint64_t NumRangeTombstones() const = 0;
+  virtual uint64_t FileSize() const = 0;
+  virtual TableProperties GetProperties() const = 0;
+
+ private:
+  // No copying allowed
+  TableWriter(const TableWriter&);
+  void operator=(const TableWriter&);
+};
+
+class TableFactory {
+ public:
+  TableFactory() { }
+  virtual ~TableFactory();
+
+  // Return the name of the table format.
+  virtual const char* Name() const = 0;
+
+  // Open the table stored in bytes [0..file_size) of "file", which must
+  // remain live while the table is in use.  On success stores a table
+  // that the caller should delete in *table and returns OK; otherwise
+  // stores NULL in *table and returns a non-ok status.
+  virtual Status NewTableReader(const Options& options,
+                                RandomAccessFile* file,
+                                uint64_t file_size,
+                                TableReader** table) const = 0;
+
+  // Return a writer that stores a table in *file, which it does not
+  // close.  The caller should delete the writer when done with it.
+  virtual TableWriter* NewTableWriter(const Options& options,
+                                      WritableFile* file) const = 0;
+
+ private:
+  // No copying allowed
+  TableFactory(const TableFactory&);
+  void operator=(const TableFactory&);
+};
+
+struct PlainTableOptions {
+  // Every this many entries, and wherever a new key prefix starts, the
+  // offset of an entry is added to the index that lookups search.  Lower
+  // values make lookups faster and the index larger.
+  //
+  // Default: 16
+  int index_interval;
+
+  PlainTableOptions() : index_interval(16) { }
+};
+
+// Return the factory of block-based tables, which are written when
+// Options::table_factory is NULL.  The result is owned by the library.
+extern const TableFactory* BlockBasedTableFactory();
+
+// Return a new factory of plain tables.
+//
+// Plain tables need no block cache: a table is read into memory when it
+// is opened, without a copy when the Env maps the file (for instance,
+// the default Env on 64-bit systems).  When Options::prefix_extractor
+// is set, each table has a hash index of the prefixes of its keys, which
+// takes point lookups straight to the entries of a prefix and rules out
+// absent prefixes; otherwise lookups binary search the index.  A table
+// file must be smaller than 4GB.
+//
+// The caller should delete the result when it is no longer needed,
+// after any DB that uses it has been closed.
+extern TableFactory* NewPlainTableFactory(
+    const PlainTableOptions& options = PlainTableOptions());
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TABLE_FACTORY_H_
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// TableProperties summarize the contents of a table.  TableBuilder
+// records them in a meta block of the table, from which Table and
+// DB::GetPropertiesOfAllTables() read them back without scanning the
+// data.  Tables written before the properties block existed report
+// all-zero properties.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+#define STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+
+#include <map>
+#include <string>
+#include <stdint.h>
+
+namespace leveldb {
+
+struct TableProperties {
+  // Bytes taken by the data, index and filter blocks, including their
+  // block trailers.
+  uint64_t data_size;
+  uint64_t index_size;
+  uint64_t filter_size;
+
+  uint64_t num_data_blocks;
+
+  // Number of calls to TableBuilder::Add(), and the total size of the
+  // keys and values passed to it, before compression.
+  uint64_t num_entries;
+  uint64_t raw_key_size;
+  uint64_t raw_value_size;
+
+  // The following are only known for the tables of a DB, whose keys
+  // carry a sequence number and a type, and are zero for other tables.
+
+  // Entries that delete their key, and range deletions, which are not
+  // counted by num_entries.
+  uint64_t num_deletions;
+  uint64_t num_range_deletions;
+
+  // Smallest and largest sequence number of any entry or range deletion.
+  uint64_t smallest_seqno;
+  uint64_t largest_seqno;
+
+  TableProperties();
+
+  // Return a human-readable summary, one "name: value" pair per line.
+  std::string ToString() const;
+};
+
+// Properties of the tables of a DB, keyed by file name.
+typedef std::map<std::string, TableProperties> TablePropertiesCollection;
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
@@ -0,0 +1,91 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An OptimisticTransactionDB groups reads and writes into transactions
+// without taking locks.  A transaction reads from the snapshot taken when
+// it began and buffers its writes.  Commit() applies the writes only if
+// none of the keys the transaction read or wrote has been written by
+// anyone else since then, and returns a Busy status otherwise, in which
+// case the caller typically retries with a new transaction.
+//
+// Example:
+//   Transaction* txn = txn_db->BeginTransaction(WriteOptions());
+//   std::string balance;
+//   Status s = txn->Get(ReadOptions(), "alice", &balance);
+//   if (s.ok()) txn->Put("alice", Debit(balance));
+//   if (s.ok()) s = txn->Commit();
+//   delete txn;
+//   if (s.IsBusy()) ... start over ...
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TRANSACTION_H_
+#define STORAGE_LEVELDB_INCLUDE_TRANSACTION_H_
+
+#include <string>
+#include "leveldb/db.h"
+
+namespace leveldb {
+
+class Transaction {
+ public:
+  Transaction() { }
+
+  // Rolls back the transaction if it has not been committed.
+  virtual ~Transaction();
+
+  // Look "key" up among the writes of the transaction, then in the
+  // database as of the start of the transaction (options.snapshot is
+  // ignored).  The key becomes part of the transaction's read set.
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     std::string* value) = 0;
+
+  // Buffer a write of "key", to be applied by Commit().
+  virtual void Put(const Slice& key, const Slice& value) = 0;
+  virtual void Delete(const Slice& key) = 0;
+
+  // Atomically apply the buffered writes, unless one of the keys read or
+  // written has been written to the database since the transaction
+  // began, in which case nothing is written and a Busy status is
+  // returned.  A transaction without writes always commits.  The
+  // transaction is over afterwards, whatever the outcome.
+  virtual Status Commit() = 0;
+
+  // Discard the buffered writes and end the transaction.
+  virtual void Rollback() = 0;
+
+ private:
+  // No copying allowed
+  Transaction(const Transaction&);
+  void operator=(const Transaction&);
+};
+
+class OptimisticTransactionDB {
+ public:
+  // Open the database with the specified "name" for transactional use.
+  // Stores a pointer to a heap-allocated database in *dbptr and returns
+  // OK on success.
+  static Status Open(const Options& options, const std::string& name,
+                     OptimisticTransactionDB** dbptr);
+
+  OptimisticTransactionDB() { }
+
+  // Closes the database.  Every transaction must be deleted first.
+  virtual ~OptimisticTransactionDB();
+
+  // Begin a transaction whose commit uses "options".  The caller must
+  // delete the result when done with it.
+  virtual Transaction* BeginTransaction(const WriteOptions& options) = 0;
+
+  // The underlying database, for reads and writes outside transactions.
+  // Such writes are seen by the conflict checks of transactions.
+  virtual DB* GetBaseDB() = 0;
+
+ private:
+  // No copying allowed
+  OptimisticTransactionDB(const OptimisticTransactionDB&);
+  void operator=(const OptimisticTransactionDB&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TRANSACTION_H_
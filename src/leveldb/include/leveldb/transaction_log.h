@@ -0,0 +1,57 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A TransactionLogIterator yields the write batches that a database has
+// committed, in order, as its write-ahead logs record them.  A follower
+// can keep a copy of the database up to date by applying them with
+// DB::Write() (see DB::GetUpdatesSince()).
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TRANSACTION_LOG_H_
+#define STORAGE_LEVELDB_INCLUDE_TRANSACTION_LOG_H_
+
+#include <stdint.h>
+#include "leveldb/status.h"
+#include "leveldb/write_batch.h"
+
+namespace leveldb {
+
+class TransactionLogIterator {
+ public:
+  TransactionLogIterator() { }
+  virtual ~TransactionLogIterator();
+
+  // An iterator is either positioned at a batch, or not valid.  It is
+  // no longer valid after the last batch in the logs it reads, or after
+  // an error, which status() returns.
+  virtual bool Valid() const = 0;
+
+  // Moves to the next batch.
+  // REQUIRES: Valid()
+  virtual void Next() = 0;
+
+  // Return the sequence numbers of the first and of the last update in
+  // the current batch.
+  // REQUIRES: Valid()
+  virtual uint64_t sequence() const = 0;
+  virtual uint64_t last_sequence() const = 0;
+
+  // Return the current batch.  It stays the same until the next call to
+  // Next() or the destruction of the iterator.
+  // REQUIRES: Valid()
+  virtual const WriteBatch& batch() const = 0;
+
+  // Returns NotFound if the update asked for is no longer in a log that
+  // the database keeps, and Corruption if a log is damaged or does not
+  // continue where the one before it ended.
+  virtual Status status() const = 0;
+
+ private:
+  // No copying allowed
+  TransactionLogIterator(const TransactionLogIterator&);
+  void operator=(const TransactionLogIterator&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TRANSACTION_LOG_H_
@@ -0,0 +1,35 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database opened with OpenDBWithTTL() stores the time each value was
+// written along with it, and compactions remove values that are older
+// than the time-to-live.  Expired data thus goes away without being read
+// back and deleted.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TTL_H_
+#define STORAGE_LEVELDB_INCLUDE_TTL_H_
+
+#include <string>
+#include "leveldb/db.h"
+
+namespace leveldb {
+
+// Open the database with the specified "name", whose values expire
+// "ttl_seconds" after they were written (never if ttl_seconds <= 0).
+// Options::env tells the time.  Stores a pointer to a heap-allocated
+// database in *dbptr and returns OK on success.
+//
+// Expired values are removed only when compacted, and read as usual
+// until then.  Options::compaction_filter, if set, sees the values
+// without their timestamps after the expired ones are removed.  A
+// database must always be opened with this function once it has been,
+// and merge operands and column families are not supported.
+extern Status OpenDBWithTTL(const Options& options,
+                            const std::string& name,
+                            int ttl_seconds,
+                            DB** dbptr);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TTL_H_
@@ -21,11 +21,13 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 #define STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 
+#include <stdint.h>
 #include <string>
 #include "leveldb/status.h"
 
 namespace leveldb {
 
+class ColumnFamilyHandle;
 class Slice;
 
 class WriteBatch {
@@ -39,6 +41,23 @@ class WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping whose key is in ["begin", "end").  Later writes
+  // to keys in the range are not affected.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
+  // Combine "value" with the current value of "key" using the database's
+  // Options::merge_operator.
+  void Merge(const Slice& key, const Slice& value);
+
+  // Variants of the methods above for the given column family.
+  void Put(ColumnFamilyHandle* column_family,
+           const Slice& key, const Slice& value);
+  void Delete(ColumnFamilyHandle* column_family, const Slice& key);
+  void DeleteRange(ColumnFamilyHandle* column_family,
+                   const Slice& begin, const Slice& end);
+  void Merge(ColumnFamilyHandle* column_family,
+             const Slice& key, const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -48,6 +67,20 @@ class WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementation ignores range deletions, for handlers
+    // written before DeleteRange() existed.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
+    // Likewise, merge operands are ignored by default.
+    virtual void Merge(const Slice& key, const Slice& value);
+    // Records of column families other than the default one are passed
+    // to these, which ignore them by default.
+    virtual void PutCF(uint32_t column_family_id,
+                       const Slice& key, const Slice& value);
+    virtual void DeleteCF(uint32_t column_family_id, const Slice& key);
+    virtual void DeleteRangeCF(uint32_t column_family_id,
+                               const Slice& begin, const Slice& end);
+    virtual void MergeCF(uint32_t column_family_id,
+                         const Slice& key, const Slice& value);
   };
   Status Iterate(Handler* handler) const;
 
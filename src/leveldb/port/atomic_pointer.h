@@ -233,6 +233,66 @@ class AtomicPointer {
 #endif
 #endif
 
+// AtomicUint64 holds a counter that many threads can update without a
+// lock.  None of its operations order other memory accesses.
+#if defined(LEVELDB_ATOMIC_PRESENT)
+class AtomicUint64 {
+ private:
+  std::atomic<uint64_t> rep_;
+ public:
+  AtomicUint64() { }
+  explicit AtomicUint64(uint64_t v) : rep_(v) { }
+  inline uint64_t NoBarrier_Load() const {
+    return rep_.load(std::memory_order_relaxed);
+  }
+  inline void NoBarrier_Store(uint64_t v) {
+    rep_.store(v, std::memory_order_relaxed);
+  }
+  inline uint64_t NoBarrier_FetchAdd(uint64_t n) {
+    return rep_.fetch_add(n, std::memory_order_relaxed);
+  }
+  inline bool NoBarrier_CompareAndSwap(uint64_t* expected, uint64_t v) {
+    return rep_.compare_exchange_strong(*expected, v,
+                                        std::memory_order_relaxed);
+  }
+};
+
+// AtomicUint64 based on the gcc __sync builtins
+#elif defined(__GNUC__)
+class AtomicUint64 {
+ private:
+  mutable uint64_t rep_;
+ public:
+  AtomicUint64() { }
+  explicit AtomicUint64(uint64_t v) : rep_(v) { }
+  inline uint64_t NoBarrier_Load() const {
+    // A plain load may tear on 32-bit platforms.
+    return __sync_val_compare_and_swap(&rep_, 0, 0);
+  }
+  inline void NoBarrier_Store(uint64_t v) {
+    uint64_t old = NoBarrier_Load();
+    uint64_t prev;
+    while ((prev = __sync_val_compare_and_swap(&rep_, old, v)) != old) {
+      old = prev;
+    }
+  }
+  inline uint64_t NoBarrier_FetchAdd(uint64_t n) {
+    return __sync_fetch_and_add(&rep_, n);
+  }
+  inline bool NoBarrier_CompareAndSwap(uint64_t* expected, uint64_t v) {
+    const uint64_t prev = __sync_val_compare_and_swap(&rep_, *expected, v);
+    if (prev == *expected) {
+      return true;
+    }
+    *expected = prev;
+    return false;
+  }
+};
+
+#else
+#error Please implement AtomicUint64 for this platform.
+#endif
+
 #undef LEVELDB_HAVE_MEMORY_BARRIER
 #undef ARCH_CPU_X86_FAMILY
 #undef ARCH_CPU_ARM_FAMILY
@@ -99,6 +99,32 @@ class AtomicPointer {
   void NoBarrier_Store(void* v);
 };
 
+// A 64-bit counter that can be read and updated atomically.  None of
+// the operations order other memory accesses.
+class AtomicUint64 {
+ public:
+  // Initialize to arbitrary value
+  AtomicUint64();
+
+  // Initialize to hold v
+  explicit AtomicUint64(uint64_t v);
+
+  uint64_t NoBarrier_Load() const;
+  void NoBarrier_Store(uint64_t v);
+
+  // Add n to the counter and return its previous value.
+  uint64_t NoBarrier_FetchAdd(uint64_t n);
+
+  // If the counter holds *expected, set it to v and return true.
+  // Else store its value in *expected and return false.
+  bool NoBarrier_CompareAndSwap(uint64_t* expected, uint64_t v);
+};
+
+// Storage class of variables that each thread has its own copy of,
+// e.g. "static LEVELDB_THREAD_LOCAL int counter;".  The type of the
+// variable must not need a constructor or destructor.
+#define LEVELDB_THREAD_LOCAL __thread
+
 // ------------------ Compression -------------------
 
 // Store the snappy compression of "input[0,input_length-1]" in *output.
@@ -46,6 +46,9 @@
 #include <string>
 #include "port/atomic_pointer.h"
 
+// Storage class of variables that each thread has its own copy of.
+#define LEVELDB_THREAD_LOCAL __thread
+
 #ifndef PLATFORM_IS_LITTLE_ENDIAN
 #define PLATFORM_IS_LITTLE_ENDIAN (__BYTE_ORDER == __LITTLE_ENDIAN)
 #endif
@@ -144,6 +144,28 @@ void AtomicPointer::NoBarrier_Store(void* v) {
   rep_ = v;
 }
 
+uint64_t AtomicUint64::NoBarrier_Load() const {
+  return InterlockedCompareExchange64(&rep_, 0, 0);
+}
+
+void AtomicUint64::NoBarrier_Store(uint64_t v) {
+  InterlockedExchange64(&rep_, static_cast<int64_t>(v));
+}
+
+uint64_t AtomicUint64::NoBarrier_FetchAdd(uint64_t n) {
+  return InterlockedExchangeAdd64(&rep_, static_cast<int64_t>(n));
+}
+
+bool AtomicUint64::NoBarrier_CompareAndSwap(uint64_t* expected, uint64_t v) {
+  const uint64_t prev = InterlockedCompareExchange64(
+      &rep_, static_cast<int64_t>(v), static_cast<int64_t>(*expected));
+  if (prev == *expected) {
+    return true;
+  }
+  *expected = prev;
+  return false;
+}
+
 bool HasAcceleratedCRC32C() {
 #if defined(__x86_64__) || defined(__i386__)
   int cpu_info[4];
@@ -133,6 +133,28 @@ class AtomicPointer {
   void NoBarrier_Store(void* v);
 };
 
+// Storage for a lock-free 64-bit counter
+class AtomicUint64 {
+ private:
+  mutable volatile int64_t rep_;
+ public:
+  AtomicUint64() : rep_(0) { }
+  explicit AtomicUint64(uint64_t v) : rep_(v) { }
+  uint64_t NoBarrier_Load() const;
+
+  void NoBarrier_Store(uint64_t v);
+
+  uint64_t NoBarrier_FetchAdd(uint64_t n);
+
+  bool NoBarrier_CompareAndSwap(uint64_t* expected, uint64_t v);
+};
+
+#if defined(_MSC_VER)
+#define LEVELDB_THREAD_LOCAL __declspec(thread)
+#else
+#define LEVELDB_THREAD_LOCAL __thread
+#endif
+
 inline bool Snappy_Compress(const char* input, size_t length,
                             ::std::string* output) {
 #ifdef SNAPPY
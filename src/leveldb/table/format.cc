@@ -4,11 +4,15 @@
 
 #include "table/format.h"
 
+#include <string.h>
+#include "leveldb/comparator.h"
 #include "leveldb/env.h"
+#include "leveldb/options.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -20,6 +24,11 @@ void BlockHandle::EncodeTo(std::string* dst) const {
   PutVarint64(dst, size_);
 }
 
+bool HasInternalKeys(const Options& options) {
+  return strcmp(options.comparator->Name(),
+                "leveldb.InternalKeyComparator") == 0;
+}
+
 Status BlockHandle::DecodeFrom(Slice* input) {
   if (GetVarint64(input, &offset_) &&
       GetVarint64(input, &size_)) {
@@ -62,42 +71,14 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file,
-                 const ReadOptions& options,
-                 const BlockHandle& handle,
-                 BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
-  size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    delete[] buf;
-    return s;
-  }
-  if (contents.size() != n + kBlockTrailerSize) {
-    delete[] buf;
-    return Status::Corruption("truncated block read", file->GetName());
-  }
-
-  // Check the crc of the type and the block contents
-  const char* data = contents.data();    // Pointer to where Read put the data
-  if (options.verify_checksums) {
-    const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
-    const uint32_t actual = crc32c::Value(data, n + 1);
-    if (actual != crc) {
-      delete[] buf;
-      s = Status::Corruption("block checksum mismatch", file->GetName());
-      return s;
-    }
-  }
-
-  switch (data[n]) {
+// Fill *result from the "n" bytes of block contents at "data" whose
+// compression type is "type".  "buf" is the heap buffer the contents
+// were read into; it is either handed to *result or deleted.  "fname"
+// is only used in error messages.
+static Status DecodeBlockContents(const char* data, size_t n, char type,
+                                  char* buf, const Slice& fname,
+                                  BlockContents* result) {
+  switch (type) {
     case kNoCompression:
       if (data != buf) {
         // File implementation gave us pointer to some other data.
@@ -119,13 +100,13 @@ Status ReadBlock(RandomAccessFile* file,
       size_t ulength = 0;
       if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
         delete[] buf;
-        return Status::Corruption("corrupted compressed block contents", file->GetName());
+        return Status::Corruption("corrupted compressed block contents", fname);
       }
       char* ubuf = new char[ulength];
       if (!port::Snappy_Uncompress(data, n, ubuf)) {
         delete[] buf;
         delete[] ubuf;
-        return Status::Corruption("corrupted compressed block contents", file->GetName());
+        return Status::Corruption("corrupted compressed block contents", fname);
       }
       delete[] buf;
       result->data = Slice(ubuf, ulength);
@@ -135,10 +116,99 @@ Status ReadBlock(RandomAccessFile* file,
     }
     default:
       delete[] buf;
-      return Status::Corruption("bad block type", file->GetName());
+      return Status::Corruption("bad block type", fname);
   }
 
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file,
+                 const ReadOptions& options,
+                 const BlockHandle& handle,
+                 BlockContents* result,
+                 std::string* raw) {
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size());
+  char* buf = new char[n + kBlockTrailerSize];
+  Slice contents;
+  PerfTimer read_timer(&PerfContext::block_read_time);
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  read_timer.Stop();
+  PerfCounterAdd(&PerfContext::block_read_count, 1);
+  PerfCounterAdd(&PerfContext::block_read_byte, n + kBlockTrailerSize);
+  if (!s.ok()) {
+    result->data = Slice();
+    result->cachable = false;
+    result->heap_allocated = false;
+    if (raw != NULL) {
+      raw->clear();
+    }
+    delete[] buf;
+    return s;
+  }
+  return FinishReadBlock(file, options, handle, contents, buf, result, raw);
+}
+
+Status FinishReadBlock(RandomAccessFile* file,
+                       const ReadOptions& options,
+                       const BlockHandle& handle,
+                       const Slice& contents,
+                       char* buf,
+                       BlockContents* result,
+                       std::string* raw) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+  if (raw != NULL) {
+    raw->clear();
+  }
+
+  size_t n = static_cast<size_t>(handle.size());
+  if (contents.size() != n + kBlockTrailerSize) {
+    delete[] buf;
+    return Status::Corruption("truncated block read", file->GetName());
+  }
+
+  // Check the crc of the type and the block contents
+  const char* data = contents.data();    // Pointer to where Read put the data
+  if (options.verify_checksums) {
+    PerfTimer checksum_timer(&PerfContext::block_checksum_time);
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
+    const uint32_t actual = crc32c::Value(data, n + 1);
+    if (actual != crc) {
+      delete[] buf;
+      return Status::Corruption("block checksum mismatch", file->GetName());
+    }
+  }
+
+  // Blocks served from a file mapping are never cached, so there is
+  // no point in keeping a raw copy of them either.
+  const bool keep_raw = (raw != NULL && data == buf);
+  if (keep_raw) {
+    raw->assign(data, n + 1);
+  }
+  PerfTimer decompress_timer(&PerfContext::block_decompress_time);
+  Status s = DecodeBlockContents(data, n, data[n], buf, file->GetName(),
+                                 result);
+  decompress_timer.Stop();
+  if (!s.ok() && keep_raw) {
+    raw->clear();
+  }
+  return s;
+}
+
+Status DecodeRawBlock(const Slice& raw, BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+  if (raw.empty()) {
+    return Status::Corruption("truncated raw block");
+  }
+  const size_t n = raw.size() - 1;
+  char* buf = new char[n];
+  memcpy(buf, raw.data(), n);
+  return DecodeBlockContents(buf, n, raw[n], buf, Slice(), result);
+}
+
 }  // namespace leveldb
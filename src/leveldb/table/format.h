@@ -14,8 +14,13 @@
 namespace leveldb {
 
 class Block;
+class BlockBuilder;
+class Iterator;
 class RandomAccessFile;
+struct Options;
 struct ReadOptions;
+class TableFactory;
+struct TableProperties;
 
 // BlockHandle is a pointer to the extent of a file that stores a data
 // block or a meta block.
@@ -80,6 +85,10 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// kPlainTableMagicNumber ends the tables of the plain format instead
+// (see table/plain_table.h).
+static const uint64_t kPlainTableMagicNumber = 0x5e1f9b6a3c7d0a21ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
@@ -91,10 +100,58 @@ struct BlockContents {
 
 // Read the block identified by "handle" from "file".  On failure
 // return non-OK.  On success fill *result and return OK.
+//
+// If "raw" is non-NULL and the result is cachable, *raw is set to the
+// block contents as stored on disk followed by the one byte block
+// type (i.e. everything but the crc), suitable for passing to
+// DecodeRawBlock() later.  Otherwise *raw is cleared.
 extern Status ReadBlock(RandomAccessFile* file,
                         const ReadOptions& options,
                         const BlockHandle& handle,
-                        BlockContents* result);
+                        BlockContents* result,
+                        std::string* raw = NULL);
+
+// Complete a read of the block identified by "handle" that was started
+// with RandomAccessFile::ReadAsync().  "buf" is the new[] allocated
+// buffer of handle.size() + kBlockTrailerSize bytes that was passed to
+// ReadAsync() and "contents" is the result it produced.  Takes
+// ownership of "buf".  Otherwise behaves like ReadBlock().
+extern Status FinishReadBlock(RandomAccessFile* file,
+                              const ReadOptions& options,
+                              const BlockHandle& handle,
+                              const Slice& contents,
+                              char* buf,
+                              BlockContents* result,
+                              std::string* raw = NULL);
+
+// Decode a block that was saved in the "raw" form produced by
+// ReadBlock().  On success fill *result with a heap allocated,
+// cachable copy of the block and return OK.
+extern Status DecodeRawBlock(const Slice& raw, BlockContents* result);
+
+// Return the factory of the table format that "options" selects.
+extern const TableFactory* GetTableFactory(const Options& options);
+
+// Return true if the tables built with "options" hold the internal keys
+// of a DB, which end with a sequence number and a type.
+extern bool HasInternalKeys(const Options& options);
+
+// Account in *props for an entry with the given key and value, or for a
+// range deletion if "range_deletion" is true.  "internal_keys" is the
+// result of HasInternalKeys() for the table.
+extern void RecordTableEntry(const Slice& key, const Slice& value,
+                             bool internal_keys, bool range_deletion,
+                             TableProperties* props);
+
+// Add "props" to "block" as the contents of a properties meta block: one
+// entry per property, named like "num.entries", with a varint64 value.
+extern void AddTableProperties(const TableProperties& props,
+                               BlockBuilder* block);
+
+// Read the properties stored in a properties meta block by iterating
+// over it with "iter".  Unknown properties are ignored, and properties
+// missing from the block are left unchanged.
+extern Status ReadTableProperties(Iterator* iter, TableProperties* props);
 
 // Implementation details follow.  Clients should ignore,
 
@@ -11,12 +11,19 @@
 namespace leveldb {
 
 namespace {
+// Merges the children with a binary heap of the valid ones, ordered by
+// the current direction: the root is the smallest child when moving
+// forward and the largest one in reverse.  Ties go to the child listed
+// first when moving forward and to the one listed last in reverse.
 class MergingIterator : public Iterator {
  public:
   MergingIterator(const Comparator* comparator, Iterator** children, int n)
       : comparator_(comparator),
         children_(new IteratorWrapper[n]),
         n_(n),
+        heap_(new int[n]),
+        heap_size_(0),
+        runner_up_(-1),
         current_(NULL),
         direction_(kForward) {
     for (int i = 0; i < n; i++) {
@@ -25,6 +32,7 @@ class MergingIterator : public Iterator {
   }
 
   virtual ~MergingIterator() {
+    delete[] heap_;
     delete[] children_;
   }
 
@@ -36,24 +44,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   virtual void SeekToLast() {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    BuildHeap();
   }
 
   virtual void Seek(const Slice& target) {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   virtual void Next() {
@@ -76,10 +84,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      BuildHeap();
+    } else {
+      current_->Next();
+      UpdateRoot();
     }
-
-    current_->Next();
-    FindSmallest();
   }
 
   virtual void Prev() {
@@ -105,10 +115,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      BuildHeap();
+    } else {
+      current_->Prev();
+      UpdateRoot();
     }
-
-    current_->Prev();
-    FindLargest();
   }
 
   virtual Slice key() const {
@@ -133,15 +145,33 @@ class MergingIterator : public Iterator {
   }
 
  private:
-  void FindSmallest();
-  void FindLargest();
+  // Does child "a" come out of the heap before child "b"?
+  bool Before(int a, int b) const {
+    const int r = comparator_->Compare(children_[a].key(), children_[b].key());
+    if (direction_ == kForward) {
+      return r < 0 || (r == 0 && a < b);
+    } else {
+      return r > 0 || (r == 0 && a > b);
+    }
+  }
+
+  void BuildHeap();
+  void SiftDown(int pos);
+  void UpdateRoot();
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
+
+  // Indexes of the valid children, in heap order
+  int* heap_;
+  int heap_size_;
+
+  // Position in heap_ of the child that comes out after the root, or -1
+  // if not known.  Lets a run of entries from one child cost a single
+  // comparison each.
+  int runner_up_;
+
   IteratorWrapper* current_;
 
   // Which direction is the iterator moving?
@@ -152,34 +182,61 @@ class MergingIterator : public Iterator {
   Direction direction_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = NULL;
+void MergingIterator::BuildHeap() {
+  heap_size_ = 0;
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == NULL) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+    if (children_[i].Valid()) {
+      heap_[heap_size_++] = i;
     }
   }
-  current_ = smallest;
+  for (int pos = heap_size_ / 2 - 1; pos >= 0; pos--) {
+    SiftDown(pos);
+  }
+  runner_up_ = -1;
+  current_ = (heap_size_ > 0) ? &children_[heap_[0]] : NULL;
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = NULL;
-  for (int i = n_-1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == NULL) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+void MergingIterator::SiftDown(int pos) {
+  const int child = heap_[pos];
+  while (true) {
+    int next = 2 * pos + 1;
+    if (next >= heap_size_) {
+      break;
+    }
+    if (next + 1 < heap_size_ && Before(heap_[next + 1], heap_[next])) {
+      next++;
+    }
+    if (!Before(heap_[next], child)) {
+      break;
+    }
+    heap_[pos] = heap_[next];
+    pos = next;
+  }
+  heap_[pos] = child;
+}
+
+// REQUIRES: the child at the root has moved in the current direction
+void MergingIterator::UpdateRoot() {
+  if (!children_[heap_[0]].Valid()) {
+    heap_[0] = heap_[--heap_size_];
+    if (heap_size_ > 0) {
+      SiftDown(0);
+    }
+    runner_up_ = -1;
+  } else if (heap_size_ > 1) {
+    if (runner_up_ < 0) {
+      runner_up_ = (heap_size_ > 2 && Before(heap_[2], heap_[1])) ? 2 : 1;
+    }
+    if (!Before(heap_[0], heap_[runner_up_])) {
+      // The root is no longer first: the runner-up takes its place
+      const int root = heap_[0];
+      heap_[0] = heap_[runner_up_];
+      heap_[runner_up_] = root;
+      SiftDown(runner_up_);
+      runner_up_ = -1;
     }
   }
-  current_ = largest;
+  current_ = (heap_size_ > 0) ? &children_[heap_[0]] : NULL;
 }
 }  // namespace
 
@@ -0,0 +1,194 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/merger.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+typedef std::pair<std::string, std::string> Entry;
+
+// Iterates over sorted entries
+class VectorIterator : public Iterator {
+ public:
+  explicit VectorIterator(const std::vector<Entry>& entries)
+      : entries_(entries), pos_(entries.size()) { }
+
+  virtual bool Valid() const { return pos_ < entries_.size(); }
+  virtual void SeekToFirst() { pos_ = 0; }
+  virtual void SeekToLast() {
+    pos_ = entries_.empty() ? 0 : entries_.size() - 1;
+  }
+  virtual void Seek(const Slice& target) {
+    pos_ = 0;
+    while (pos_ < entries_.size() &&
+           Slice(entries_[pos_].first).compare(target) < 0) {
+      pos_++;
+    }
+  }
+  virtual void Next() { pos_++; }
+  virtual void Prev() {
+    pos_ = (pos_ == 0) ? entries_.size() : pos_ - 1;
+  }
+  virtual Slice key() const { return entries_[pos_].first; }
+  virtual Slice value() const { return entries_[pos_].second; }
+  virtual Status status() const { return Status::OK(); }
+
+ private:
+  const std::vector<Entry> entries_;
+  size_t pos_;
+};
+}  // namespace
+
+class MergerTest {
+ public:
+  std::vector<std::vector<Entry> > children_;
+  std::vector<Entry> model_;  // Ordered as the merge must yield them
+
+  // Spread "num" keys, some of them repeated, over "n" children.
+  void Build(Random* rnd, int n, int num) {
+    children_.assign(n, std::vector<Entry>());
+    for (int i = 0; i < num; i++) {
+      char buf[20];
+      snprintf(buf, sizeof(buf), "%06d", static_cast<int>(rnd->Uniform(num)));
+      const int child = rnd->Uniform(n);
+      std::vector<Entry>& c = children_[child];
+      bool present = false;
+      for (size_t j = 0; j < c.size(); j++) {
+        present = present || (c[j].first == buf);
+      }
+      if (!present) {
+        char value[20];
+        snprintf(value, sizeof(value), "%d", child);
+        c.push_back(Entry(buf, value));
+      }
+    }
+    model_.clear();
+    for (int i = 0; i < n; i++) {
+      std::sort(children_[i].begin(), children_[i].end());
+      model_.insert(model_.end(), children_[i].begin(), children_[i].end());
+    }
+    // Equal keys come out in the order of the children
+    std::stable_sort(model_.begin(), model_.end(), KeyLess);
+  }
+
+  static bool KeyLess(const Entry& a, const Entry& b) {
+    return a.first < b.first;
+  }
+
+  Iterator* NewIterator() {
+    std::vector<Iterator*> list;
+    for (size_t i = 0; i < children_.size(); i++) {
+      list.push_back(new VectorIterator(children_[i]));
+    }
+    return NewMergingIterator(BytewiseComparator(), &list[0], list.size());
+  }
+};
+
+TEST(MergerTest, Forward) {
+  Random rnd(301);
+  for (int n = 2; n <= 64; n *= 2) {
+    Build(&rnd, n, 500);
+    Iterator* iter = NewIterator();
+    size_t i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      ASSERT_LT(i, model_.size());
+      ASSERT_EQ(model_[i].first, iter->key().ToString());
+      ASSERT_EQ(model_[i].second, iter->value().ToString());
+    }
+    ASSERT_EQ(model_.size(), i);
+    delete iter;
+  }
+}
+
+TEST(MergerTest, Reverse) {
+  Random rnd(302);
+  for (int n = 2; n <= 64; n *= 2) {
+    Build(&rnd, n, 500);
+    // Ties come out of the last child first in reverse
+    std::vector<Entry> reversed(model_.rbegin(), model_.rend());
+    Iterator* iter = NewIterator();
+    size_t i = 0;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev(), i++) {
+      ASSERT_LT(i, reversed.size());
+      ASSERT_EQ(reversed[i].first, iter->key().ToString());
+      ASSERT_EQ(reversed[i].second, iter->value().ToString());
+    }
+    ASSERT_EQ(reversed.size(), i);
+    delete iter;
+  }
+}
+
+TEST(MergerTest, RandomWalk) {
+  Random rnd(303);
+  for (int n = 2; n <= 64; n *= 2) {
+    // Distinct keys, so that changing direction never lands on a tie
+    Build(&rnd, n, 300);
+    std::vector<Entry> unique;
+    for (size_t i = 0; i < model_.size(); i++) {
+      if (unique.empty() || unique.back().first != model_[i].first) {
+        unique.push_back(model_[i]);
+      }
+    }
+    for (size_t c = 0; c < children_.size(); c++) {
+      children_[c].clear();
+    }
+    for (size_t i = 0; i < unique.size(); i++) {
+      children_[atoi(unique[i].second.c_str())].push_back(unique[i]);
+    }
+
+    Iterator* iter = NewIterator();
+    iter->Seek(unique[unique.size() / 2].first);
+    size_t pos = unique.size() / 2;
+    for (int step = 0; step < 2000; step++) {
+      if (pos < unique.size()) {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(unique[pos].first, iter->key().ToString());
+      } else {
+        ASSERT_TRUE(!iter->Valid());
+        pos = rnd.Uniform(unique.size());
+        iter->Seek(unique[pos].first);
+        continue;
+      }
+      if (rnd.OneIn(2)) {
+        iter->Next();
+        pos++;
+      } else {
+        iter->Prev();
+        pos = (pos == 0) ? unique.size() : pos - 1;
+      }
+    }
+    delete iter;
+  }
+}
+
+TEST(MergerTest, EmptyChildren) {
+  children_.assign(5, std::vector<Entry>());
+  children_[3].push_back(Entry("a", "3"));
+  Iterator* iter = NewIterator();
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("a", iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  iter->SeekToLast();
+  ASSERT_EQ("a", iter->key().ToString());
+  iter->Seek("b");
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
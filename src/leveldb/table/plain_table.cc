@@ -0,0 +1,638 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/plain_table.h"
+
+#include <assert.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+static const uint32_t kEmptyBucket = 0xffffffffu;
+
+// Five section offsets and the magic number
+static const size_t kFooterLength = 6 * 8;
+
+static uint32_t PrefixHash(const Slice& prefix) {
+  return Hash(prefix.data(), prefix.size(), 0x8d3e5a17);
+}
+
+// Returns the part of "key" that prefixes are taken from
+static Slice PrefixSource(const Slice& key, bool internal_keys) {
+  if (internal_keys && key.size() >= 8) {
+    return Slice(key.data(), key.size() - 8);
+  }
+  return key;
+}
+
+// Decode the entry that starts at "p" into *key and *value, and return
+// the start of the next entry, or NULL if the entry is corrupt.
+static const char* DecodeEntry(const char* p, const char* limit,
+                               Slice* key, Slice* value) {
+  uint32_t key_length, value_length;
+  p = GetVarint32Ptr(p, limit, &key_length);
+  if (p == NULL || key_length > static_cast<uint32_t>(limit - p)) {
+    return NULL;
+  }
+  *key = Slice(p, key_length);
+  p += key_length;
+  p = GetVarint32Ptr(p, limit, &value_length);
+  if (p == NULL || value_length > static_cast<uint32_t>(limit - p)) {
+    return NULL;
+  }
+  *value = Slice(p, value_length);
+  return p + value_length;
+}
+
+// Iterates over the entries in [base, limit).  Seeks binary search the
+// entries whose offsets from "base" are listed in "index", if any.
+class PlainTableIterator : public Iterator {
+ public:
+  PlainTableIterator(const Comparator* comparator,
+                     const char* base, const char* limit,
+                     const char* index, uint32_t num_index)
+      : comparator_(comparator),
+        base_(base),
+        limit_(limit),
+        index_(index),
+        num_index_(num_index),
+        current_(limit),
+        next_(limit) {
+  }
+
+  virtual bool Valid() const { return current_ < limit_; }
+  virtual Slice key() const { assert(Valid()); return key_; }
+  virtual Slice value() const { assert(Valid()); return value_; }
+  virtual Status status() const { return status_; }
+
+  virtual void SeekToFirst() {
+    ParseAt(base_);
+  }
+
+  virtual void SeekToLast() {
+    ParseAt(num_index_ > 0 ? IndexEntry(num_index_ - 1) : base_);
+    while (Valid() && next_ < limit_) {
+      ParseAt(next_);
+    }
+  }
+
+  virtual void Seek(const Slice& target) {
+    // Binary search for the last indexed entry with a key < target
+    uint32_t left = 0;
+    uint32_t right = num_index_;
+    while (left + 1 < right) {
+      const uint32_t mid = left + (right - left) / 2;
+      if (IndexKeyBefore(mid, target)) {
+        left = mid;
+      } else {
+        right = mid;
+      }
+    }
+    ScanFrom(num_index_ > 0 ? IndexEntry(left) : base_, target);
+  }
+
+  // Like Seek(), but "target" is known to come at or after the indexed
+  // entry "first".  Gallops forward from there, so that a target near
+  // "first" takes few comparisons.
+  void SeekFrom(uint32_t first, const Slice& target) {
+    assert(first < num_index_);
+    uint32_t left = first;
+    uint32_t step = 1;
+    uint32_t right = first + step;
+    while (right < num_index_ && IndexKeyBefore(right, target)) {
+      left = right;
+      step *= 2;
+      right = (num_index_ - left > step) ? left + step : num_index_;
+    }
+    if (right > num_index_) {
+      right = num_index_;
+    }
+    while (left + 1 < right) {
+      const uint32_t mid = left + (right - left) / 2;
+      if (IndexKeyBefore(mid, target)) {
+        left = mid;
+      } else {
+        right = mid;
+      }
+    }
+    ScanFrom(IndexEntry(left), target);
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    ParseAt(next_);
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    // Scan forward from the last indexed entry before the current one
+    const char* original = current_;
+    if (original == base_) {
+      current_ = next_ = limit_;
+      return;
+    }
+    uint32_t left = 0;
+    uint32_t right = num_index_;
+    while (left < right) {
+      const uint32_t mid = left + (right - left) / 2;
+      if (IndexEntry(mid) < original) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    ParseAt(left > 0 ? IndexEntry(left - 1) : base_);
+    while (Valid() && next_ < original) {
+      ParseAt(next_);
+    }
+  }
+
+ private:
+  const char* IndexEntry(uint32_t i) const {
+    return base_ + DecodeFixed32(index_ + 4 * i);
+  }
+
+  // Return true if the key of indexed entry "i" is before "target".
+  // Treats a corrupt entry as being after every key.
+  bool IndexKeyBefore(uint32_t i, const Slice& target) const {
+    Slice key, value;
+    if (DecodeEntry(IndexEntry(i), limit_, &key, &value) == NULL) {
+      return false;
+    }
+    return comparator_->Compare(key, target) < 0;
+  }
+
+  void ScanFrom(const char* start, const Slice& target) {
+    ParseAt(start);
+    while (Valid() && comparator_->Compare(key_, target) < 0) {
+      ParseAt(next_);
+    }
+  }
+
+  void ParseAt(const char* p) {
+    if (p < base_ || p >= limit_) {
+      current_ = next_ = limit_;
+      return;
+    }
+    const char* next = DecodeEntry(p, limit_, &key_, &value_);
+    if (next == NULL) {
+      status_ = Status::Corruption("bad entry in plain table");
+      current_ = next_ = limit_;
+      return;
+    }
+    current_ = p;
+    next_ = next;
+  }
+
+  const Comparator* const comparator_;
+  const char* const base_;
+  const char* const limit_;
+  const char* const index_;
+  const uint32_t num_index_;
+
+  const char* current_;    // Start of the current entry, limit_ if invalid
+  const char* next_;       // Start of the entry after it
+  Slice key_;
+  Slice value_;
+  Status status_;
+};
+
+class PlainTableWriter : public TableWriter {
+ public:
+  PlainTableWriter(const Options& options,
+                   const PlainTableOptions& table_options,
+                   WritableFile* file)
+      : options_(options),
+        index_interval_(table_options.index_interval > 0 ?
+                        table_options.index_interval : 1),
+        internal_keys_(HasInternalKeys(options)),
+        file_(file),
+        offset_(0),
+        closed_(false),
+        in_prefix_(false),
+        entries_since_index_(0),
+        num_range_tombstones_(0) {
+  }
+
+  virtual ~PlainTableWriter() {
+    assert(closed_);  // Catch errors where caller forgot to call Finish()
+  }
+
+  virtual void Add(const Slice& key, const Slice& value) {
+    assert(!closed_);
+    if (!ok()) return;
+    if (props_.num_entries > 0) {
+      assert(options_.comparator->Compare(key, Slice(last_key_)) > 0);
+    }
+
+    // Index the first entry, every index_interval_'th one and each one
+    // that starts a prefix, so that the hash buckets can point to it.
+    bool indexed = (props_.num_entries == 0 ||
+                    entries_since_index_ >= index_interval_);
+    const SliceTransform* extractor = options_.prefix_extractor;
+    if (extractor != NULL) {
+      const Slice source = PrefixSource(key, internal_keys_);
+      if (!extractor->InDomain(source)) {
+        in_prefix_ = false;
+      } else {
+        const Slice prefix = extractor->Transform(source);
+        if (!in_prefix_ || prefix != Slice(last_prefix_)) {
+          indexed = true;
+          prefixes_.push_back(std::make_pair(
+              PrefixHash(prefix), static_cast<uint32_t>(index_.size())));
+          last_prefix_.assign(prefix.data(), prefix.size());
+          in_prefix_ = true;
+        }
+      }
+    }
+    if (indexed) {
+      if (offset_ > 0xffffffffu) {
+        status_ = Status::InvalidArgument("plain table exceeds 4GB");
+        return;
+      }
+      index_.push_back(static_cast<uint32_t>(offset_));
+      entries_since_index_ = 0;
+    }
+    entries_since_index_++;
+
+    entry_.clear();
+    PutVarint32(&entry_, key.size());
+    entry_.append(key.data(), key.size());
+    PutVarint32(&entry_, value.size());
+    entry_.append(value.data(), value.size());
+    status_ = file_->Append(entry_);
+    if (ok()) {
+      offset_ += entry_.size();
+    }
+
+    last_key_.assign(key.data(), key.size());
+    RecordTableEntry(key, value, internal_keys_, false, &props_);
+  }
+
+  virtual void AddRangeTombstone(const Slice& key, const Slice& value) {
+    assert(!closed_);
+    if (!ok()) return;
+    PutVarint32(&tombstones_, key.size());
+    tombstones_.append(key.data(), key.size());
+    PutVarint32(&tombstones_, value.size());
+    tombstones_.append(value.data(), value.size());
+    num_range_tombstones_++;
+    RecordTableEntry(key, value, internal_keys_, true, &props_);
+  }
+
+  virtual Status status() const {
+    return status_;
+  }
+
+  virtual Status Finish() {
+    assert(!closed_);
+    closed_ = true;
+    if (!ok()) return status_;
+
+    std::string tail = tombstones_;
+    const uint64_t tombstones_offset = offset_;
+    const uint64_t index_offset = offset_ + tail.size();
+    for (size_t i = 0; i < index_.size(); i++) {
+      PutFixed32(&tail, index_[i]);
+    }
+
+    const uint64_t buckets_offset = offset_ + tail.size();
+    if (!prefixes_.empty()) {
+      // Keep the buckets at most half full
+      size_t num_buckets = 1;
+      while (num_buckets < 2 * prefixes_.size()) {
+        num_buckets *= 2;
+      }
+      std::vector<uint32_t> buckets(num_buckets, kEmptyBucket);
+      for (size_t i = 0; i < prefixes_.size(); i++) {
+        size_t b = prefixes_[i].first & (num_buckets - 1);
+        while (buckets[b] != kEmptyBucket) {
+          b = (b + 1) & (num_buckets - 1);
+        }
+        buckets[b] = prefixes_[i].second;
+      }
+      for (size_t i = 0; i < num_buckets; i++) {
+        PutFixed32(&tail, buckets[i]);
+      }
+    }
+
+    const uint64_t properties_offset = offset_ + tail.size();
+    props_.data_size = tombstones_offset;
+    props_.index_size = properties_offset - index_offset;
+    {
+      // Property names are ordered bytewise, whatever the table's keys
+      Options properties_options = options_;
+      properties_options.comparator = BytewiseComparator();
+      BlockBuilder properties_block(&properties_options);
+      AddTableProperties(props_, &properties_block);
+      const Slice contents = properties_block.Finish();
+      tail.append(contents.data(), contents.size());
+    }
+
+    const uint64_t name_offset = offset_ + tail.size();
+    if (!prefixes_.empty()) {
+      tail.append(options_.prefix_extractor->Name());
+    }
+
+    PutFixed64(&tail, tombstones_offset);
+    PutFixed64(&tail, index_offset);
+    PutFixed64(&tail, buckets_offset);
+    PutFixed64(&tail, properties_offset);
+    PutFixed64(&tail, name_offset);
+    PutFixed64(&tail, kPlainTableMagicNumber);
+    status_ = file_->Append(tail);
+    if (ok()) {
+      offset_ += tail.size();
+    }
+    return status_;
+  }
+
+  virtual void Abandon() {
+    assert(!closed_);
+    closed_ = true;
+  }
+
+  virtual uint64_t NumEntries() const {
+    return props_.num_entries;
+  }
+
+  virtual uint64_t NumRangeTombstones() const {
+    return num_range_tombstones_;
+  }
+
+  virtual uint64_t FileSize() const {
+    return offset_;
+  }
+
+  virtual TableProperties GetProperties() const {
+    return props_;
+  }
+
+ private:
+  bool ok() const { return status_.ok(); }
+
+  const Options options_;
+  const int index_interval_;
+  const bool internal_keys_;
+  WritableFile* const file_;
+  Status status_;
+  uint64_t offset_;
+  bool closed_;
+
+  std::string last_key_;
+  std::string last_prefix_;
+  bool in_prefix_;              // The last key had prefix last_prefix_
+  int entries_since_index_;
+  std::vector<uint32_t> index_;
+  // Hash of each prefix and the position in index_ of its first entry
+  std::vector<std::pair<uint32_t, uint32_t> > prefixes_;
+  std::string tombstones_;      // Encoded range deletions
+  uint64_t num_range_tombstones_;
+  std::string entry_;           // Scratch space for Add()
+  TableProperties props_;
+};
+
+class PlainTable : public TableReader {
+ public:
+  PlainTable(const Options& options, char* buf, const Slice& contents)
+      : options_(options),
+        internal_keys_(HasInternalKeys(options)),
+        buf_(buf),
+        contents_(contents),
+        data_end_(NULL),
+        tombstones_end_(NULL),
+        index_(NULL),
+        num_index_(0),
+        buckets_(NULL),
+        num_buckets_(0) {
+  }
+
+  virtual ~PlainTable() {
+    delete[] buf_;
+  }
+
+  // Locate the sections of the table from its footer
+  Status ReadFooter() {
+    const uint64_t size = contents_.size();
+    if (size < kFooterLength) {
+      return Status::Corruption("file is too short to be a plain table");
+    }
+    const char* footer = contents_.data() + size - kFooterLength;
+    if (DecodeFixed64(footer + 40) != kPlainTableMagicNumber) {
+      return Status::Corruption("not a plain table (bad magic number)");
+    }
+    const uint64_t tombstones_offset = DecodeFixed64(footer);
+    const uint64_t index_offset = DecodeFixed64(footer + 8);
+    const uint64_t buckets_offset = DecodeFixed64(footer + 16);
+    const uint64_t properties_offset = DecodeFixed64(footer + 24);
+    const uint64_t name_offset = DecodeFixed64(footer + 32);
+    const uint64_t footer_offset = size - kFooterLength;
+    if (tombstones_offset > index_offset ||
+        index_offset > buckets_offset ||
+        buckets_offset > properties_offset ||
+        properties_offset > name_offset ||
+        name_offset > footer_offset ||
+        (buckets_offset - index_offset) % 4 != 0 ||
+        (properties_offset - buckets_offset) % 4 != 0 ||
+        tombstones_offset > 0xffffffffu) {
+      return Status::Corruption("bad plain table footer");
+    }
+
+    const char* base = contents_.data();
+    data_end_ = base + tombstones_offset;
+    tombstones_end_ = base + index_offset;
+    index_ = base + index_offset;
+    num_index_ = (buckets_offset - index_offset) / 4;
+
+    // The hash buckets are only of use with the extractor that made them
+    const uint64_t num_buckets = (properties_offset - buckets_offset) / 4;
+    const Slice name(base + name_offset, footer_offset - name_offset);
+    if (num_buckets > 0 && (num_buckets & (num_buckets - 1)) == 0 &&
+        options_.prefix_extractor != NULL &&
+        name == Slice(options_.prefix_extractor->Name())) {
+      buckets_ = base + buckets_offset;
+      num_buckets_ = num_buckets;
+    }
+
+    // Like the filter of other tables, the properties are not needed for
+    // operation, so damaged ones are left at zero.
+    BlockContents properties_contents;
+    properties_contents.data = Slice(base + properties_offset,
+                                     name_offset - properties_offset);
+    properties_contents.cachable = false;
+    properties_contents.heap_allocated = false;
+    Block properties_block(properties_contents);
+    Iterator* iter = properties_block.NewIterator(BytewiseComparator());
+    TableProperties props;
+    if (ReadTableProperties(iter, &props).ok()) {
+      props_ = props;
+    }
+    delete iter;
+    return Status::OK();
+  }
+
+  virtual Iterator* NewIterator(const ReadOptions& options) const {
+    return NewDataIterator();
+  }
+
+  virtual Status InternalGet(
+      const ReadOptions& options, const Slice& key,
+      void* arg,
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v)) {
+    PlainTableIterator* iter = NewDataIterator();
+    uint32_t first;
+    const Slice source = PrefixSource(key, internal_keys_);
+    if (buckets_ == NULL || !options_.prefix_extractor->InDomain(source)) {
+      iter->Seek(key);
+    } else if (FindPrefix(options_.prefix_extractor->Transform(source),
+                          &first)) {
+      iter->SeekFrom(first, key);
+    } else {
+      // No entry has the prefix of the key
+      delete iter;
+      return Status::OK();
+    }
+    for (; iter->Valid(); iter->Next()) {
+      if (!(*handle_result)(arg, iter->key(), iter->value())) {
+        break;
+      }
+    }
+    Status s = iter->status();
+    delete iter;
+    return s;
+  }
+
+  virtual bool PrefixMayMatch(const Slice& seek_key,
+                              const Slice& prefix_key) const {
+    if (buckets_ == NULL) {
+      return true;
+    }
+    uint32_t first;
+    return FindPrefix(PrefixSource(prefix_key, internal_keys_), &first);
+  }
+
+  virtual Iterator* NewRangeTombstoneIterator() const {
+    return new PlainTableIterator(options_.comparator, data_end_,
+                                  tombstones_end_, NULL, 0);
+  }
+
+  virtual uint64_t ApproximateOffsetOf(const Slice& key) const {
+    PlainTableIterator iter(options_.comparator, contents_.data(), data_end_,
+                            index_, num_index_);
+    iter.Seek(key);
+    if (iter.Valid()) {
+      return iter.key().data() - contents_.data();
+    }
+    return data_end_ - contents_.data();
+  }
+
+  virtual const TableProperties& GetProperties() const {
+    return props_;
+  }
+
+ private:
+  PlainTableIterator* NewDataIterator() const {
+    return new PlainTableIterator(options_.comparator, contents_.data(),
+                                  data_end_, index_, num_index_);
+  }
+
+  // If some entry has "prefix", store the position in the index of the
+  // first such entry in *first and return true.
+  bool FindPrefix(const Slice& prefix, uint32_t* first) const {
+    const SliceTransform* extractor = options_.prefix_extractor;
+    const uint32_t mask = num_buckets_ - 1;
+    uint32_t b = PrefixHash(prefix) & mask;
+    for (uint32_t probes = 0; probes < num_buckets_; probes++) {
+      const uint32_t pos = DecodeFixed32(buckets_ + 4 * b);
+      if (pos == kEmptyBucket || pos >= num_index_) {
+        return false;
+      }
+      Slice key, value;
+      const char* entry =
+          contents_.data() + DecodeFixed32(index_ + 4 * pos);
+      if (entry < data_end_ &&
+          DecodeEntry(entry, data_end_, &key, &value) != NULL) {
+        const Slice source = PrefixSource(key, internal_keys_);
+        if (extractor->InDomain(source) &&
+            extractor->Transform(source) == prefix) {
+          *first = pos;
+          return true;
+        }
+      }
+      b = (b + 1) & mask;
+    }
+    return false;
+  }
+
+  const Options options_;
+  const bool internal_keys_;
+  char* const buf_;          // Holds the file, unless the Env mapped it
+  const Slice contents_;     // The whole file
+  const char* data_end_;
+  const char* tombstones_end_;
+  const char* index_;
+  uint32_t num_index_;
+  const char* buckets_;      // NULL if not usable
+  uint32_t num_buckets_;
+  TableProperties props_;
+};
+
+}  // namespace
+
+Status OpenPlainTable(const Options& options,
+                      RandomAccessFile* file,
+                      uint64_t file_size,
+                      TableReader** table) {
+  *table = NULL;
+  if (file_size < kFooterLength) {
+    return Status::Corruption("file is too short to be a plain table");
+  }
+
+  // Files the Env maps into memory return the mapping without touching
+  // the buffer, which is then released.
+  char* buf = new char[file_size];
+  Slice contents;
+  Status s = file->Read(0, file_size, &contents, buf);
+  if (s.ok() && contents.size() != file_size) {
+    s = Status::Corruption("truncated plain table");
+  }
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  if (contents.data() != buf) {
+    delete[] buf;
+    buf = NULL;
+  }
+
+  PlainTable* t = new PlainTable(options, buf, contents);
+  s = t->ReadFooter();
+  if (s.ok()) {
+    *table = t;
+  } else {
+    delete t;
+  }
+  return s;
+}
+
+TableWriter* NewPlainTableWriter(const Options& options,
+                                 const PlainTableOptions& table_options,
+                                 WritableFile* file) {
+  return new PlainTableWriter(options, table_options, file);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,56 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A plain table stores its entries uncompressed, one after the other,
+// followed by the index that lookups search:
+//
+//    entry*               varint32 key length, key,
+//                         varint32 value length, value
+//    range deletion*      encoded like entries
+//    index                fixed32 file offset of every index_interval'th
+//                         entry and of every entry that starts a prefix
+//    hash buckets         fixed32 position in the index of the first
+//                         entry of a prefix, or 0xffffffff; a power of
+//                         two of them, probed linearly from the hash of
+//                         the prefix
+//    properties           a block of properties (see table/format.h),
+//                         without a trailer
+//    extractor name       Options::prefix_extractor->Name(), if there
+//                         are hash buckets
+//    footer               fixed64 offsets of the range deletions, index,
+//                         hash buckets, properties and extractor name,
+//                         then fixed64 kPlainTableMagicNumber
+//
+// Nothing is compressed or checksummed, so that a table the Env maps
+// into memory is read in place.
+
+#ifndef STORAGE_LEVELDB_TABLE_PLAIN_TABLE_H_
+#define STORAGE_LEVELDB_TABLE_PLAIN_TABLE_H_
+
+#include <stdint.h>
+#include "leveldb/status.h"
+#include "leveldb/table_factory.h"
+
+namespace leveldb {
+
+struct Options;
+class RandomAccessFile;
+class WritableFile;
+
+// Open the plain table stored in bytes [0..file_size) of "file".  Has
+// the contract of TableFactory::NewTableReader().
+extern Status OpenPlainTable(const Options& options,
+                             RandomAccessFile* file,
+                             uint64_t file_size,
+                             TableReader** table);
+
+// Return a writer of a plain table to *file.  Has the contract of
+// TableFactory::NewTableWriter().
+extern TableWriter* NewPlainTableWriter(const Options& options,
+                                        const PlainTableOptions& table_options,
+                                        WritableFile* file);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_PLAIN_TABLE_H_
@@ -4,35 +4,99 @@
 
 #include "leveldb/table.h"
 
+#include <deque>
+#include <map>
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
+namespace {
+
+// A data block read ahead of time by Table::PrefetchBlock() that has
+// not yet been claimed by Table::BlockReader().
+struct PrefetchedBlock {
+  const Table* table;
+  port::Mutex* mu;
+  port::CondVar* cv;
+  RandomAccessFile* file;
+  BlockHandle handle;
+  bool verify_checksums;
+  bool fill_cache;
+  char* buf;
+
+  // Protected by *mu
+  bool done;
+  Block* block;     // NULL if the read failed
+  bool cachable;
+  std::string raw;  // For the caches, which the taker fills (may be empty)
+};
+
+// Upper bound on the number of blocks a table holds in its prefetch
+// buffer, e.g. on behalf of iterators that were abandoned.
+static const size_t kMaxPrefetchedBlocks = 64;
+
+}  // namespace
+
 struct Table::Rep {
+  Rep() : prefetch_cv(&prefetch_mu) { }
+
   ~Rep() {
+    // Reads may still be in flight; they refer to "file" and to us.
+    {
+      MutexLock l(&prefetch_mu);
+      for (std::map<uint64_t, PrefetchedBlock*>::iterator it =
+               prefetched.begin(); it != prefetched.end(); ++it) {
+        PrefetchedBlock* p = it->second;
+        while (!p->done) {
+          prefetch_cv.Wait();
+        }
+        delete p->block;
+        delete p;
+      }
+    }
     delete filter;
     delete [] filter_data;
     delete index_block;
+    delete range_del_block;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
+  uint64_t compressed_cache_id;
+  // DB identity and file number, or empty if unknown (see SetCacheKey())
+  std::string persistent_cache_prefix;
   FilterBlockReader* filter;
   const char* filter_data;
+  bool filter_has_prefixes;  // See Options::prefix_extractor
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  Block* range_del_block;    // NULL if the table has no range deletions
+  Status range_del_status;   // Error reading range_del_block, if any
+  TableProperties properties;  // All zero if the table has none
+
+  // Blocks read ahead for iterators, keyed by offset, plus the order in
+  // which they were requested.
+  port::Mutex prefetch_mu;
+  port::CondVar prefetch_cv;
+  std::map<uint64_t, PrefetchedBlock*> prefetched;
+  std::deque<uint64_t> prefetch_order;
 };
 
 Status Table::Open(const Options& options,
@@ -77,8 +141,12 @@ Status Table::Open(const Options& options,
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->compressed_cache_id = (options.block_cache_compressed ?
+                                options.block_cache_compressed->NewId() : 0);
     rep->filter_data = NULL;
     rep->filter = NULL;
+    rep->filter_has_prefixes = false;
+    rep->range_del_block = NULL;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   } else {
@@ -89,10 +157,8 @@ Status Table::Open(const Options& options,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == NULL) {
-    return;  // Do not need any metadata
-  }
-
+  // The metaindex block is always read since it locates the range
+  // deletions, which unlike the filter are needed for correct reads.
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -100,23 +166,99 @@ void Table::ReadMeta(const Footer& footer) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+  if (!s.ok()) {
+    // Only report the error to readers of the range deletions; the
+    // filter is not needed for operation.
+    rep_->range_del_status = s;
     return;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != NULL) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+  }
+  if (rep_->filter != NULL && rep_->options.prefix_extractor != NULL) {
+    iter->Seek("prefix_extractor");
+    rep_->filter_has_prefixes =
+        iter->Valid() && iter->key() == Slice("prefix_extractor") &&
+        iter->value() == Slice(rep_->options.prefix_extractor->Name());
+  }
+  iter->Seek("properties");
+  if (iter->Valid() && iter->key() == Slice("properties")) {
+    ReadProperties(iter->value());
+  }
+  iter->Seek("rangedel");
+  if (iter->Valid() && iter->key() == Slice("rangedel")) {
+    ReadRangeDeletions(iter->value());
   }
   delete iter;
   delete meta;
 }
 
+void Table::ReadProperties(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, opt, handle, &contents).ok()) {
+    return;
+  }
+  // Like the filter, the properties are not needed for operation, so a
+  // damaged block leaves them at zero.
+  Block block(contents);
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+  TableProperties props;
+  if (ReadTableProperties(iter, &props).ok()) {
+    rep_->properties = props;
+  }
+  delete iter;
+}
+
+const TableProperties& Table::GetProperties() const {
+  return rep_->properties;
+}
+
+void Table::ReadRangeDeletions(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  Status s = handle.DecodeFrom(&v);
+  BlockContents contents;
+  if (s.ok()) {
+    ReadOptions opt;
+    if (rep_->options.paranoid_checks) {
+      opt.verify_checksums = true;
+    }
+    s = ReadBlock(rep_->file, opt, handle, &contents);
+  }
+  if (s.ok()) {
+    rep_->range_del_block = new Block(contents);
+  } else {
+    rep_->range_del_status = s;
+  }
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (!rep_->range_del_status.ok()) {
+    return NewErrorIterator(rep_->range_del_status);
+  } else if (rep_->range_del_block == NULL) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
+}
+
 void Table::ReadFilter(const Slice& filter_handle_value) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
@@ -144,6 +286,18 @@ Table::~Table() {
   delete rep_;
 }
 
+void Table::SetCacheKey(const Slice& prefix, uint64_t file_number) {
+  rep_->persistent_cache_prefix.assign(prefix.data(), prefix.size());
+  PutFixed64(&rep_->persistent_cache_prefix, file_number);
+}
+
+// Return the key of the block at "offset" in Options::persistent_cache.
+std::string Table::PersistentCacheKey(uint64_t offset) const {
+  std::string key = rep_->persistent_cache_prefix;
+  PutFixed64(&key, offset);
+  return key;
+}
+
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
@@ -153,12 +307,245 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+static void DeleteCachedRawBlock(const Slice& key, void* value) {
+  std::string* raw = reinterpret_cast<std::string*>(value);
+  delete raw;
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
   cache->Release(handle);
 }
 
+// Fetch the block identified by "handle" from the first tier that has
+// it: the compressed block cache, the persistent cache and finally the
+// table file.  Tiers that missed are filled on the way back.
+Status Table::ReadBlockFromTiers(const ReadOptions& options,
+                                 const BlockHandle& handle,
+                                 BlockContents* contents) const {
+  Cache* compressed_cache = rep_->options.block_cache_compressed;
+  PersistentCache* persistent_cache =
+      (rep_->persistent_cache_prefix.empty() ? NULL
+                                             : rep_->options.persistent_cache);
+  if (compressed_cache == NULL && persistent_cache == NULL) {
+    return ReadBlock(rep_->file, options, handle, contents);
+  }
+
+  if (compressed_cache != NULL) {
+    char key_buffer[16];
+    EncodeFixed64(key_buffer, rep_->compressed_cache_id);
+    EncodeFixed64(key_buffer+8, handle.offset());
+    Cache::Handle* h =
+        compressed_cache->Lookup(Slice(key_buffer, sizeof(key_buffer)));
+    if (h != NULL) {
+      const std::string* raw =
+          reinterpret_cast<std::string*>(compressed_cache->Value(h));
+      Status s = DecodeRawBlock(*raw, contents);
+      compressed_cache->Release(h);
+      return s;
+    }
+  }
+
+  std::string raw;
+  bool found = false;
+  if (persistent_cache != NULL) {
+    if (persistent_cache->Lookup(PersistentCacheKey(handle.offset()),
+                                 &raw).ok()) {
+      // A bad entry is not fatal: fall back to the table file.
+      found = DecodeRawBlock(raw, contents).ok();
+    }
+  }
+  if (!found) {
+    Status s = ReadBlock(rep_->file, options, handle, contents, &raw);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (options.fill_cache) {
+    CacheRawBlock(handle, &raw, !found);
+  }
+  return Status::OK();
+}
+
+// Store "*raw", the raw form of the block identified by "handle", in
+// the compressed block cache and, if "persist" is true, in the
+// persistent cache.  May clobber *raw.
+void Table::CacheRawBlock(const BlockHandle& handle, std::string* raw,
+                          bool persist) const {
+  if (raw->empty()) {
+    return;  // Block is not cachable
+  }
+  PersistentCache* persistent_cache = rep_->options.persistent_cache;
+  if (persist && persistent_cache != NULL &&
+      !rep_->persistent_cache_prefix.empty()) {
+    persistent_cache->Insert(PersistentCacheKey(handle.offset()), *raw);
+  }
+  Cache* compressed_cache = rep_->options.block_cache_compressed;
+  if (compressed_cache != NULL) {
+    char key_buffer[16];
+    EncodeFixed64(key_buffer, rep_->compressed_cache_id);
+    EncodeFixed64(key_buffer+8, handle.offset());
+    std::string* value = new std::string;
+    value->swap(*raw);
+    compressed_cache->Release(compressed_cache->Insert(
+        Slice(key_buffer, sizeof(key_buffer)), value, value->size(),
+        &DeleteCachedRawBlock));
+  }
+}
+
+void Table::PrefetchDone(void* arg, const Status& s, const Slice& result) {
+  PrefetchedBlock* p = reinterpret_cast<PrefetchedBlock*>(arg);
+  Block* block = NULL;
+  bool cachable = false;
+  if (s.ok()) {
+    ReadOptions options;
+    options.verify_checksums = p->verify_checksums;
+    BlockContents contents;
+    if (FinishReadBlock(p->file, options, p->handle, result, p->buf,
+                        &contents, p->fill_cache ? &p->raw : NULL).ok()) {
+      block = new Block(contents);
+      cachable = contents.cachable;
+    }
+  } else {
+    delete[] p->buf;
+  }
+  p->buf = NULL;
+
+  MutexLock l(p->mu);
+  p->done = true;
+  p->block = block;
+  p->cachable = cachable;
+  p->cv->SignalAll();
+}
+
+// Start reading the block identified by "index_value" in the background
+// unless it is already cached or on its way.  Prefetched blocks go to
+// a small per-table buffer rather than straight into the block cache;
+// BlockReader() moves them to the cache when they are used, so a scan
+// with fill_cache == false does not disturb the cache.
+void Table::PrefetchBlock(void* arg,
+                          const ReadOptions& options,
+                          const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Rep* r = table->rep_;
+  BlockHandle handle;
+  Slice input = index_value;
+  if (!handle.DecodeFrom(&input).ok()) {
+    return;
+  }
+
+  Cache* block_cache = r->options.block_cache;
+  if (block_cache != NULL) {
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, r->cache_id);
+    EncodeFixed64(cache_key_buffer+8, handle.offset());
+    Cache::Handle* h =
+        block_cache->Lookup(Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+    if (h != NULL) {
+      block_cache->Release(h);
+      return;
+    }
+  }
+  Cache* compressed_cache = r->options.block_cache_compressed;
+  if (compressed_cache != NULL) {
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, r->compressed_cache_id);
+    EncodeFixed64(cache_key_buffer+8, handle.offset());
+    Cache::Handle* h = compressed_cache->Lookup(
+        Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+    if (h != NULL) {
+      compressed_cache->Release(h);
+      return;
+    }
+  }
+
+  PrefetchedBlock* p;
+  {
+    MutexLock l(&r->prefetch_mu);
+    if (r->prefetched.count(handle.offset()) > 0) {
+      return;
+    }
+    if (r->prefetched.size() >= kMaxPrefetchedBlocks) {
+      // Drop the oldest unclaimed block to make room, unless it is
+      // still being read.
+      PrefetchedBlock* oldest = r->prefetched[r->prefetch_order.front()];
+      if (!oldest->done) {
+        return;
+      }
+      r->prefetched.erase(r->prefetch_order.front());
+      r->prefetch_order.pop_front();
+      delete oldest->block;
+      delete oldest;
+    }
+    p = new PrefetchedBlock;
+    p->table = table;
+    p->mu = &r->prefetch_mu;
+    p->cv = &r->prefetch_cv;
+    p->file = r->file;
+    p->handle = handle;
+    p->verify_checksums = options.verify_checksums;
+    p->fill_cache = options.fill_cache;
+    p->buf = new char[handle.size() + kBlockTrailerSize];
+    p->done = false;
+    p->block = NULL;
+    p->cachable = false;
+    r->prefetched[handle.offset()] = p;
+    r->prefetch_order.push_back(handle.offset());
+  }
+
+  // Must not hold prefetch_mu: PrefetchDone() may run right away.
+  r->file->ReadAsync(handle.offset(), handle.size() + kBlockTrailerSize,
+                     p->buf, &PrefetchDone, p);
+}
+
+// If the block identified by "handle" was prefetched, wait for its read
+// to finish and return it (or NULL if the read failed), passing
+// ownership to the caller.  Returns NULL if it was not prefetched.
+// The compressed and persistent caches are filled here rather than in
+// PrefetchDone(), whose thread completes the reads of all tables.
+Block* Table::TakePrefetchedBlock(const BlockHandle& handle,
+                                  bool* cachable) const {
+  Rep* r = rep_;
+  Block* block;
+  std::string raw;
+  {
+    MutexLock l(&r->prefetch_mu);
+    if (r->prefetched.empty()) {
+      return NULL;
+    }
+    std::map<uint64_t, PrefetchedBlock*>::iterator it;
+    while (true) {
+      // Look again after every wait: another reader may have claimed it.
+      it = r->prefetched.find(handle.offset());
+      if (it == r->prefetched.end()) {
+        return NULL;
+      }
+      if (it->second->done) {
+        break;
+      }
+      r->prefetch_cv.Wait();
+    }
+    PrefetchedBlock* p = it->second;
+    r->prefetched.erase(it);
+    for (std::deque<uint64_t>::iterator o = r->prefetch_order.begin();
+         o != r->prefetch_order.end(); ++o) {
+      if (*o == handle.offset()) {
+        r->prefetch_order.erase(o);
+        break;
+      }
+    }
+    block = p->block;
+    *cachable = p->cachable;
+    raw.swap(p->raw);
+    delete p;
+  }
+  if (block != NULL) {
+    CacheRawBlock(handle, &raw, true);
+  }
+  return block;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg,
@@ -176,29 +563,34 @@ Iterator* Table::BlockReader(void* arg,
   // can add more features in the future.
 
   if (s.ok()) {
-    BlockContents contents;
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+    EncodeFixed64(cache_key_buffer+8, handle.offset());
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
     if (block_cache != NULL) {
-      char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer+8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+        PerfCounterAdd(&PerfContext::block_cache_hit_count, 1);
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        PerfCounterAdd(&PerfContext::block_cache_miss_count, 1);
+      }
+    }
+    if (block == NULL) {
+      bool cachable = false;
+      block = table->TakePrefetchedBlock(handle, &cachable);
+      if (block == NULL) {
+        BlockContents contents;
+        s = table->ReadBlockFromTiers(options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
-          }
+          cachable = contents.cachable;
         }
       }
-    } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
-      if (s.ok()) {
-        block = new Block(contents);
+      if (block != NULL && block_cache != NULL && cachable &&
+          options.fill_cache) {
+        cache_handle = block_cache->Insert(
+            key, block, block->size(), &DeleteCachedBlock);
       }
     }
   }
@@ -218,14 +610,21 @@ Iterator* Table::BlockReader(void* arg,
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
+  const Comparator* cmp = rep_->options.comparator;
+  if (options.readahead_blocks <= 0) {
+    return NewTwoLevelIterator(
+        rep_->index_block->NewIterator(cmp),
+        &Table::BlockReader, const_cast<Table*>(this), options, cmp);
+  }
   return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+      rep_->index_block->NewIterator(cmp),
+      &Table::BlockReader, const_cast<Table*>(this), options, cmp,
+      rep_->index_block->NewIterator(cmp), &Table::PrefetchBlock);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
-                          void (*saver)(void*, const Slice&, const Slice&)) {
+                          bool (*saver)(void*, const Slice&, const Slice&)) {
   Status s;
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
   iiter->Seek(k);
@@ -233,18 +632,36 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
     Slice handle_value = iiter->value();
     FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
+    if (filter != NULL) {
+      PerfCounterAdd(&PerfContext::filter_probe_count, 1);
+    }
     if (filter != NULL &&
         handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
+      PerfCounterAdd(&PerfContext::filter_useful_count, 1);
     } else {
+      // The saver may ask for the entries that follow, which can run
+      // on into the next blocks.
+      bool more = true;
       Iterator* block_iter = BlockReader(this, options, iiter->value());
       block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*saver)(arg, block_iter->key(), block_iter->value());
+      while (true) {
+        for (; more && block_iter->Valid(); block_iter->Next()) {
+          more = (*saver)(arg, block_iter->key(), block_iter->value());
+        }
+        s = block_iter->status();
+        delete block_iter;
+        if (!more || !s.ok()) {
+          break;
+        }
+        iiter->Next();
+        if (!iiter->Valid()) {
+          break;
+        }
+        block_iter = BlockReader(this, options, iiter->value());
+        block_iter->SeekToFirst();
       }
-      s = block_iter->status();
-      delete block_iter;
     }
   }
   if (s.ok()) {
@@ -255,6 +672,29 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
 }
 
 
+bool Table::PrefixMayMatch(const Slice& seek_key,
+                           const Slice& prefix_key) const {
+  if (!rep_->filter_has_prefixes) {
+    return true;
+  }
+  bool may_match = true;
+  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  iiter->Seek(seek_key);
+  if (iiter->Valid()) {
+    // If any key at or after seek_key has the prefix, the first of them
+    // is in this block.
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    if (handle.DecodeFrom(&handle_value).ok()) {
+      may_match = rep_->filter->KeyMayMatch(handle.offset(), prefix_key);
+    }
+  } else if (iiter->status().ok()) {
+    may_match = false;  // Every key in the table is before seek_key
+  }
+  delete iiter;
+  return may_match;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   Iterator* index_iter =
       rep_->index_block->NewIterator(rep_->options.comparator);
@@ -9,6 +9,8 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/table_properties.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -29,6 +31,13 @@ struct TableBuilder::Rep {
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  BlockBuilder* range_del_block;  // NULL until a range deletion is added
+  int64_t num_range_tombstones;
+
+  // Keys are the internal keys of a DB, so that the properties can
+  // include deletions and sequence numbers.
+  const bool internal_keys;
+  TableProperties props;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -55,6 +64,9 @@ struct TableBuilder::Rep {
         closed(false),
         filter_block(opt.filter_policy == NULL ? NULL
                      : new FilterBlockBuilder(opt.filter_policy)),
+        range_del_block(NULL),
+        num_range_tombstones(0),
+        internal_keys(HasInternalKeys(opt)),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -70,6 +82,7 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->range_del_block;
   delete rep_;
 }
 
@@ -113,6 +126,7 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
   r->data_block.Add(key, value);
+  RecordTableEntry(key, value, r->internal_keys, false, &r->props);
 
   const size_t estimated_block_size = r->data_block.CurrentSizeEstimate();
   if (estimated_block_size >= r->options.block_size) {
@@ -120,6 +134,18 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  if (r->range_del_block == NULL) {
+    r->range_del_block = new BlockBuilder(&r->options);
+  }
+  r->range_del_block->Add(key, value);
+  r->num_range_tombstones++;
+  RecordTableEntry(key, value, r->internal_keys, true, &r->props);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -128,6 +154,8 @@ void TableBuilder::Flush() {
   assert(!r->pending_index_entry);
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
+    r->props.num_data_blocks++;
+    r->props.data_size += r->pending_handle.size() + kBlockTrailerSize;
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
@@ -202,12 +230,43 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle,
+      range_del_block_handle, properties_block_handle;
 
   // Write filter block
   if (ok() && r->filter_block != NULL) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+    r->props.filter_size = filter_block_handle.size() + kBlockTrailerSize;
+  }
+
+  // Write range deletion block
+  if (ok() && r->range_del_block != NULL) {
+    WriteBlock(r->range_del_block, &range_del_block_handle);
+  }
+
+  // Write index block, ahead of the meta blocks so that the properties
+  // can include its size
+  if (ok()) {
+    if (r->pending_index_entry) {
+      r->options.comparator->FindShortSuccessor(&r->last_key);
+      std::string handle_encoding;
+      r->pending_handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->last_key, Slice(handle_encoding));
+      r->pending_index_entry = false;
+    }
+    WriteBlock(&r->index_block, &index_block_handle);
+    r->props.index_size = index_block_handle.size() + kBlockTrailerSize;
+  }
+
+  // Write properties block
+  if (ok()) {
+    // Property names are ordered bytewise, whatever the table's keys
+    Options properties_options = r->options;
+    properties_options.comparator = BytewiseComparator();
+    BlockBuilder properties_block(&properties_options);
+    AddTableProperties(r->props, &properties_block);
+    WriteBlock(&properties_block, &properties_block_handle);
   }
 
   // Write metaindex block
@@ -220,22 +279,30 @@ Status TableBuilder::Finish() {
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
+
+      if (r->options.prefix_extractor != NULL) {
+        // The filter policy was handed key prefixes too; record which
+        // extractor produced them.
+        meta_index_block.Add("prefix_extractor",
+                             r->options.prefix_extractor->Name());
+      }
     }
 
-    // TODO(postrelease): Add stats and other meta blocks
-    WriteBlock(&meta_index_block, &metaindex_block_handle);
-  }
+    {
+      // Add mapping from "properties" to location of the properties
+      std::string handle_encoding;
+      properties_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("properties", handle_encoding);
+    }
 
-  // Write index block
-  if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
+    if (r->range_del_block != NULL) {
+      // Add mapping from "rangedel" to location of the range deletions
       std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("rangedel", handle_encoding);
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+
+    WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
   // Write footer
@@ -263,8 +330,16 @@ uint64_t TableBuilder::NumEntries() const {
   return rep_->num_entries;
 }
 
+uint64_t TableBuilder::NumRangeTombstones() const {
+  return rep_->num_range_tombstones;
+}
+
 uint64_t TableBuilder::FileSize() const {
   return rep_->offset;
 }
 
+TableProperties TableBuilder::GetProperties() const {
+  return rep_->props;
+}
+
 }  // namespace leveldb
@@ -0,0 +1,119 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/table_factory.h"
+
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "leveldb/table.h"
+#include "leveldb/table_builder.h"
+#include "table/format.h"
+#include "table/plain_table.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+TableReader::~TableReader() { }
+
+bool TableReader::PrefixMayMatch(const Slice& seek_key,
+                                 const Slice& prefix_key) const {
+  return true;
+}
+
+void TableReader::SetCacheKey(const Slice& prefix, uint64_t file_number) { }
+
+TableWriter::~TableWriter() { }
+
+TableFactory::~TableFactory() { }
+
+namespace {
+
+// Open a table of either built-in format, telling them apart by the
+// magic number that ends both.
+static Status OpenAnyTable(const Options& options,
+                           RandomAccessFile* file,
+                           uint64_t file_size,
+                           TableReader** table) {
+  *table = NULL;
+  if (file_size < 8) {
+    return Status::Corruption("file is too short to be an sstable");
+  }
+  char buf[8];
+  Slice magic;
+  Status s = file->Read(file_size - 8, 8, &magic, buf);
+  if (!s.ok()) {
+    return s;
+  }
+  if (magic.size() == 8 && DecodeFixed64(magic.data()) ==
+      kPlainTableMagicNumber) {
+    return OpenPlainTable(options, file, file_size, table);
+  }
+  Table* t = NULL;
+  s = Table::Open(options, file, file_size, &t);
+  *table = t;
+  return s;
+}
+
+class BlockBasedFactory : public TableFactory {
+ public:
+  virtual const char* Name() const {
+    return "leveldb.BlockBasedTable";
+  }
+
+  virtual Status NewTableReader(const Options& options,
+                                RandomAccessFile* file,
+                                uint64_t file_size,
+                                TableReader** table) const {
+    return OpenAnyTable(options, file, file_size, table);
+  }
+
+  virtual TableWriter* NewTableWriter(const Options& options,
+                                      WritableFile* file) const {
+    return new TableBuilder(options, file);
+  }
+};
+
+class PlainTableFactory : public TableFactory {
+ public:
+  explicit PlainTableFactory(const PlainTableOptions& options)
+      : options_(options) {
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.PlainTable";
+  }
+
+  virtual Status NewTableReader(const Options& options,
+                                RandomAccessFile* file,
+                                uint64_t file_size,
+                                TableReader** table) const {
+    return OpenAnyTable(options, file, file_size, table);
+  }
+
+  virtual TableWriter* NewTableWriter(const Options& options,
+                                      WritableFile* file) const {
+    return NewPlainTableWriter(options, options_, file);
+  }
+
+ private:
+  const PlainTableOptions options_;
+};
+
+}  // namespace
+
+const TableFactory* BlockBasedTableFactory() {
+  static BlockBasedFactory singleton;
+  return &singleton;
+}
+
+TableFactory* NewPlainTableFactory(const PlainTableOptions& options) {
+  return new PlainTableFactory(options);
+}
+
+const TableFactory* GetTableFactory(const Options& options) {
+  return options.table_factory != NULL ?
+      options.table_factory : BlockBasedTableFactory();
+}
+
+}  // namespace leveldb
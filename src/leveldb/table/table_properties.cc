@@ -0,0 +1,123 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/table_properties.h"
+
+#include <stdio.h>
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+namespace {
+
+struct PropertyName {
+  const char* name;
+  uint64_t TableProperties::*field;
+};
+
+// Sorted by name, the order in which they are stored in the block
+static const PropertyName kProperties[] = {
+  { "data.blocks",          &TableProperties::num_data_blocks },
+  { "data.size",            &TableProperties::data_size },
+  { "filter.size",          &TableProperties::filter_size },
+  { "index.size",           &TableProperties::index_size },
+  { "num.deletions",        &TableProperties::num_deletions },
+  { "num.entries",          &TableProperties::num_entries },
+  { "num.range-deletions",  &TableProperties::num_range_deletions },
+  { "raw.key.size",         &TableProperties::raw_key_size },
+  { "raw.value.size",       &TableProperties::raw_value_size },
+  { "seqno.largest",        &TableProperties::largest_seqno },
+  { "seqno.smallest",       &TableProperties::smallest_seqno },
+};
+
+static const int kNumProperties = sizeof(kProperties) / sizeof(kProperties[0]);
+
+}  // namespace
+
+TableProperties::TableProperties()
+    : data_size(0),
+      index_size(0),
+      filter_size(0),
+      num_data_blocks(0),
+      num_entries(0),
+      raw_key_size(0),
+      raw_value_size(0),
+      num_deletions(0),
+      num_range_deletions(0),
+      smallest_seqno(0),
+      largest_seqno(0) {
+}
+
+std::string TableProperties::ToString() const {
+  std::string result;
+  char buf[100];
+  for (int i = 0; i < kNumProperties; i++) {
+    snprintf(buf, sizeof(buf), "%s: %llu\n", kProperties[i].name,
+             static_cast<unsigned long long>(this->*kProperties[i].field));
+    result.append(buf);
+  }
+  return result;
+}
+
+void AddTableProperties(const TableProperties& props, BlockBuilder* block) {
+  std::string value;
+  for (int i = 0; i < kNumProperties; i++) {
+    value.clear();
+    PutVarint64(&value, props.*kProperties[i].field);
+    block->Add(kProperties[i].name, value);
+  }
+}
+
+void RecordTableEntry(const Slice& key, const Slice& value,
+                      bool internal_keys, bool range_deletion,
+                      TableProperties* props) {
+  const bool first = (props->num_entries + props->num_range_deletions == 0);
+  if (range_deletion) {
+    props->num_range_deletions++;
+  } else {
+    props->num_entries++;
+    props->raw_key_size += key.size();
+    props->raw_value_size += value.size();
+  }
+  if (internal_keys && key.size() >= 8) {
+    const uint64_t tag = DecodeFixed64(key.data() + key.size() - 8);
+    if (!range_deletion &&
+        static_cast<ValueType>(tag & 0xff) == kTypeDeletion) {
+      props->num_deletions++;
+    }
+    const SequenceNumber seq = tag >> 8;
+    if (first || seq < props->smallest_seqno) {
+      props->smallest_seqno = seq;
+    }
+    if (first || seq > props->largest_seqno) {
+      props->largest_seqno = seq;
+    }
+  }
+}
+
+Status ReadTableProperties(Iterator* iter, TableProperties* props) {
+  // Both sequences are sorted by name, so merge them
+  int i = 0;
+  for (iter->SeekToFirst(); iter->Valid() && i < kNumProperties;
+       iter->Next()) {
+    const Slice name = iter->key();
+    while (i < kNumProperties && name.compare(kProperties[i].name) > 0) {
+      i++;
+    }
+    if (i < kNumProperties && name == Slice(kProperties[i].name)) {
+      Slice input = iter->value();
+      if (!GetVarint64(&input, &(props->*kProperties[i].field))) {
+        return Status::Corruption("bad table property", name);
+      }
+      i++;
+    }
+  }
+  return iter->status();
+}
+
+}  // namespace leveldb
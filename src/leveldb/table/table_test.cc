@@ -9,10 +9,14 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/table_factory.h"
+#include "leveldb/table_properties.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
@@ -96,6 +100,7 @@ class StringSink: public WritableFile {
   virtual Status Close() { return Status::OK(); }
   virtual Status Flush() { return Status::OK(); }
   virtual Status Sync() { return Status::OK(); }
+  virtual std::string GetName() const { return ""; }
 
   virtual Status Append(const Slice& data) {
     contents_.append(data.data(), data.size());
@@ -110,13 +115,21 @@ class StringSink: public WritableFile {
 class StringSource: public RandomAccessFile {
  public:
   StringSource(const Slice& contents)
-      : contents_(contents.data(), contents.size()) {
+      : contents_(contents.data(), contents.size()),
+        reads_(0),
+        async_reads_(0) {
   }
 
   virtual ~StringSource() { }
 
   uint64_t Size() const { return contents_.size(); }
 
+  // Number of calls to Read() and ReadAsync() so far
+  int reads() const { return reads_; }
+  int async_reads() const { return async_reads_; }
+
+  virtual std::string GetName() const { return ""; }
+
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                        char* scratch) const {
     if (offset > contents_.size()) {
@@ -127,11 +140,20 @@ class StringSource: public RandomAccessFile {
     }
     memcpy(scratch, &contents_[offset], n);
     *result = Slice(scratch, n);
+    reads_++;
     return Status::OK();
   }
 
+  virtual void ReadAsync(uint64_t offset, size_t n, char* scratch,
+                         ReadCallback callback, void* arg) const {
+    async_reads_++;
+    RandomAccessFile::ReadAsync(offset, n, scratch, callback, arg);
+  }
+
  private:
   std::string contents_;
+  mutable int reads_;
+  mutable int async_reads_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -272,6 +294,58 @@ class TableConstructor: public Constructor {
   TableConstructor();
 };
 
+class PlainTableConstructor: public Constructor {
+ public:
+  PlainTableConstructor(const Comparator* cmp, int index_interval)
+      : Constructor(cmp),
+        source_(NULL), table_(NULL) {
+    PlainTableOptions plain_options;
+    plain_options.index_interval = index_interval;
+    factory_ = NewPlainTableFactory(plain_options);
+  }
+  ~PlainTableConstructor() {
+    Reset();
+    delete factory_;
+  }
+  virtual Status FinishImpl(const Options& options, const KVMap& data) {
+    Reset();
+    StringSink sink;
+    TableWriter* writer = factory_->NewTableWriter(options, &sink);
+    for (KVMap::const_iterator it = data.begin();
+         it != data.end();
+         ++it) {
+      writer->Add(it->first, it->second);
+      ASSERT_TRUE(writer->status().ok());
+    }
+    Status s = writer->Finish();
+    ASSERT_TRUE(s.ok()) << s.ToString();
+    ASSERT_EQ(sink.contents().size(), writer->FileSize());
+    delete writer;
+
+    source_ = new StringSource(sink.contents());
+    return factory_->NewTableReader(options, source_, source_->Size(),
+                                    &table_);
+  }
+
+  virtual Iterator* NewIterator() const {
+    return table_->NewIterator(ReadOptions());
+  }
+
+ private:
+  void Reset() {
+    delete table_;
+    delete source_;
+    table_ = NULL;
+    source_ = NULL;
+  }
+
+  TableFactory* factory_;
+  StringSource* source_;
+  TableReader* table_;
+
+  PlainTableConstructor();
+};
+
 // A helper class that converts internal format keys into user keys
 class KeyConvertingIterator: public Iterator {
  public:
@@ -398,6 +472,7 @@ class DBConstructor: public Constructor {
 
 enum TestType {
   TABLE_TEST,
+  PLAIN_TABLE_TEST,
   BLOCK_TEST,
   MEMTABLE_TEST,
   DB_TEST
@@ -417,6 +492,12 @@ static const TestArgs kTestArgList[] = {
   { TABLE_TEST, true, 1 },
   { TABLE_TEST, true, 1024 },
 
+  // For plain tables the restart interval is the index interval
+  { PLAIN_TABLE_TEST, false, 16 },
+  { PLAIN_TABLE_TEST, false, 1 },
+  { PLAIN_TABLE_TEST, true, 16 },
+  { PLAIN_TABLE_TEST, true, 1024 },
+
   { BLOCK_TEST, false, 16 },
   { BLOCK_TEST, false, 1 },
   { BLOCK_TEST, false, 1024 },
@@ -454,6 +535,10 @@ class Harness {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PLAIN_TABLE_TEST:
+        constructor_ = new PlainTableConstructor(options_.comparator,
+                                                 args.restart_interval);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
@@ -827,6 +912,135 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
 
 }
 
+TEST(TableTest, Properties) {
+  Options options;
+  options.block_size = 256;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  char key[20];
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "k%04d", i);
+    builder.Add(key, std::string(100, 'x'));
+  }
+  ASSERT_OK(builder.Finish());
+  const TableProperties built = builder.GetProperties();
+  ASSERT_EQ(100u, built.num_entries);
+  ASSERT_EQ(500u, built.raw_key_size);
+  ASSERT_EQ(10000u, built.raw_value_size);
+  ASSERT_GT(built.num_data_blocks, 10u);
+  ASSERT_LT(built.data_size + built.index_size, builder.FileSize());
+
+  // Only the keys of a DB tell deletions and sequence numbers apart
+  ASSERT_EQ(0u, built.num_deletions);
+  ASSERT_EQ(0u, built.largest_seqno);
+
+  StringSource source(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, source.Size(), &table));
+  ASSERT_EQ(built.ToString(), table->GetProperties().ToString());
+  delete table;
+}
+
+static bool SaveFirstValue(void* arg, const Slice& k, const Slice& v) {
+  std::string* result = reinterpret_cast<std::string*>(arg);
+  result->assign(k.data(), k.size());
+  result->append("=");
+  result->append(v.data(), v.size());
+  return false;
+}
+
+static std::string PlainGet(TableReader* table, const Slice& key) {
+  std::string result = "NOT_FOUND";
+  Status s = table->InternalGet(ReadOptions(), key, &result, SaveFirstValue);
+  if (!s.ok()) {
+    result = s.ToString();
+  }
+  return result;
+}
+
+TEST(TableTest, PlainTablePrefixIndex) {
+  const SliceTransform* prefix = NewFixedPrefixTransform(2);
+  TableFactory* factory = NewPlainTableFactory();
+  Options options;
+  options.prefix_extractor = prefix;
+  StringSink sink;
+  TableWriter* writer = factory->NewTableWriter(options, &sink);
+  char key[20];
+  for (int p = 0; p < 10; p++) {
+    for (int i = 0; i < 50; i++) {
+      snprintf(key, sizeof(key), "%c%c%04d", 'a' + 2 * p, 'a' + 2 * p, i);
+      writer->Add(key, "v");
+    }
+  }
+  writer->Add("z", "short");  // Outside the domain of the extractor
+  ASSERT_OK(writer->Finish());
+  ASSERT_EQ(501u, writer->GetProperties().num_entries);
+  delete writer;
+
+  StringSource source(sink.contents());
+  TableReader* table;
+  ASSERT_OK(factory->NewTableReader(options, &source, source.Size(), &table));
+  ASSERT_EQ(501u, table->GetProperties().num_entries);
+  ASSERT_EQ("aa0000=v", PlainGet(table, "aa0000"));
+  ASSERT_EQ("cc0049=v", PlainGet(table, "cc0049"));
+  ASSERT_EQ("ss0025=v", PlainGet(table, "ss0025"));
+  ASSERT_EQ("ss0026=v", PlainGet(table, "ss00251"));
+  ASSERT_EQ("z=short", PlainGet(table, "z"));
+
+  // The hash index rules out absent prefixes without a search
+  ASSERT_EQ("NOT_FOUND", PlainGet(table, "bb0000"));
+  ASSERT_TRUE(table->PrefixMayMatch("cc", "cc"));
+  ASSERT_TRUE(!table->PrefixMayMatch("dd", "dd"));
+
+  // Iteration does not use the hash index
+  Iterator* iter = table->NewIterator(ReadOptions());
+  iter->Seek("bb0000");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("cc0000", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("aa0049", iter->key().ToString());
+  iter->SeekToLast();
+  ASSERT_EQ("z", iter->key().ToString());
+  ASSERT_OK(iter->status());
+  delete iter;
+  delete table;
+
+  // Without the extractor that built it, the hash index is ignored
+  options.prefix_extractor = NULL;
+  ASSERT_OK(factory->NewTableReader(options, &source, source.Size(), &table));
+  ASSERT_EQ("cc0000=v", PlainGet(table, "bb0000"));
+  ASSERT_TRUE(table->PrefixMayMatch("dd", "dd"));
+  delete table;
+
+  delete factory;
+  delete prefix;
+}
+
+TEST(TableTest, FactoriesReadBothFormats) {
+  TableFactory* plain = NewPlainTableFactory();
+  const TableFactory* factories[] = { BlockBasedTableFactory(), plain };
+  Options options;
+  for (int w = 0; w < 2; w++) {
+    StringSink sink;
+    TableWriter* writer = factories[w]->NewTableWriter(options, &sink);
+    writer->Add("k1", "v1");
+    writer->Add("k2", "v2");
+    ASSERT_OK(writer->Finish());
+    delete writer;
+
+    StringSource source(sink.contents());
+    for (int r = 0; r < 2; r++) {
+      TableReader* table;
+      ASSERT_OK(factories[r]->NewTableReader(options, &source, source.Size(),
+                                             &table));
+      ASSERT_EQ("k2=v2", PlainGet(table, "k2"));
+      ASSERT_EQ(2u, table->GetProperties().num_entries);
+      delete table;
+    }
+  }
+  delete plain;
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -869,6 +1083,104 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+static int CountEntries(Table* table) {
+  Iterator* iter = table->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+  return count;
+}
+
+TEST(TableTest, Readahead) {
+  Options options;
+  options.block_size = 256;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  char key[20];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "k%04d", i);
+    builder.Add(key, std::string(100, 'x'));
+  }
+  ASSERT_OK(builder.Finish());
+
+  StringSource source(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, source.Size(), &table));
+
+  // Point lookups never read ahead
+  ReadOptions read_options;
+  Iterator* iter = table->NewIterator(read_options);
+  iter->Seek("k0100");
+  ASSERT_TRUE(iter->Valid());
+  iter->Seek("k0500");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(0, source.async_reads());
+
+  // A scan reads ahead once it has entered a couple of blocks in a row,
+  // and the prefetched blocks are used.
+  const int reads_before_scan = source.reads();
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(1000, count);
+  ASSERT_GT(source.async_reads(), 0);
+  ASSERT_EQ(source.reads() - reads_before_scan, source.async_reads() + 3);
+  delete iter;
+
+  // Disabled
+  const int async_reads = source.async_reads();
+  read_options.readahead_blocks = 0;
+  iter = table->NewIterator(read_options);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(1000, count);
+  ASSERT_EQ(async_reads, source.async_reads());
+  delete iter;
+
+  delete table;
+}
+
+TEST(TableTest, CompressedBlockCache) {
+  Options options;
+  options.block_size = 256;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  char key[20];
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "k%04d", i);
+    builder.Add(key, std::string(100, 'x'));
+  }
+  ASSERT_OK(builder.Finish());
+
+  // A tiny uncompressed block cache forces every block to come from
+  // the compressed tier once it has been filled.
+  options.block_cache = NewLRUCache(1);
+  options.block_cache_compressed = NewLRUCache(1 << 20);
+  StringSource source(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, source.Size(), &table));
+
+  const int reads_after_open = source.reads();
+  ASSERT_EQ(100, CountEntries(table));
+  const int reads_after_first_scan = source.reads();
+  ASSERT_GT(reads_after_first_scan, reads_after_open);
+  ASSERT_GT(options.block_cache_compressed->TotalCharge(), 0);
+
+  ASSERT_EQ(100, CountEntries(table));
+  ASSERT_EQ(reads_after_first_scan, source.reads());
+
+  delete table;
+  delete options.block_cache_compressed;
+  delete options.block_cache;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,6 +4,8 @@
 
 #include "table/two_level_iterator.h"
 
+#include <algorithm>
+#include "leveldb/comparator.h"
 #include "leveldb/table.h"
 #include "table/block.h"
 #include "table/format.h"
@@ -14,6 +16,11 @@ namespace leveldb {
 namespace {
 
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
+typedef void (*PrefetchFunction)(void*, const ReadOptions&, const Slice&);
+
+// Number of blocks that must be entered in sequence before readahead
+// starts.
+static const int kReadaheadTrigger = 2;
 
 class TwoLevelIterator: public Iterator {
  public:
@@ -21,7 +28,10 @@ class TwoLevelIterator: public Iterator {
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    const Comparator* comparator,
+    Iterator* lookahead_iter,
+    PrefetchFunction prefetch_function);
 
   virtual ~TwoLevelIterator();
 
@@ -61,34 +71,63 @@ class TwoLevelIterator: public Iterator {
   void SkipEmptyDataBlocksBackward();
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
+  void ResetReadahead();
+  void ReadAhead();
+
+  // Return true if every block after the one with index key "index_key"
+  // lies at or past options_.iterate_upper_bound.
+  bool PastUpperBound(const Slice& index_key) const {
+    return comparator_ != NULL && options_.iterate_upper_bound != NULL &&
+        comparator_->Compare(index_key, *options_.iterate_upper_bound) >= 0;
+  }
 
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  const Comparator* const comparator_;  // May be NULL
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_; // May be NULL
   // If data_iter_ is non-NULL, then "data_block_handle_" holds the
   // "index_value" passed to block_function_ to create the data_iter_.
   std::string data_block_handle_;
+
+  // Readahead state.  lookahead_iter_ is NULL if readahead is disabled;
+  // otherwise, when blocks_ahead_ > 0, it is positioned at the last
+  // block handed to prefetch_function_.
+  PrefetchFunction prefetch_function_;
+  IteratorWrapper lookahead_iter_;
+  int sequential_blocks_;   // Blocks entered in sequence since last reset
+  int readahead_window_;    // Number of blocks to keep prefetched
+  int blocks_ahead_;        // Prefetched blocks past the current one
 };
 
 TwoLevelIterator::TwoLevelIterator(
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options)
+    const ReadOptions& options,
+    const Comparator* comparator,
+    Iterator* lookahead_iter,
+    PrefetchFunction prefetch_function)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
+      comparator_(comparator),
       index_iter_(index_iter),
-      data_iter_(NULL) {
+      data_iter_(NULL),
+      prefetch_function_(prefetch_function),
+      lookahead_iter_(lookahead_iter),
+      sequential_blocks_(0),
+      readahead_window_(0),
+      blocks_ahead_(0) {
 }
 
 TwoLevelIterator::~TwoLevelIterator() {
 }
 
 void TwoLevelIterator::Seek(const Slice& target) {
+  ResetReadahead();
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.Seek(target);
@@ -96,6 +135,7 @@ void TwoLevelIterator::Seek(const Slice& target) {
 }
 
 void TwoLevelIterator::SeekToFirst() {
+  ResetReadahead();
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.SeekToFirst();
@@ -103,6 +143,7 @@ void TwoLevelIterator::SeekToFirst() {
 }
 
 void TwoLevelIterator::SeekToLast() {
+  ResetReadahead();
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.SeekToLast();
@@ -125,12 +166,13 @@ void TwoLevelIterator::Prev() {
 void TwoLevelIterator::SkipEmptyDataBlocksForward() {
   while (data_iter_.iter() == NULL || !data_iter_.Valid()) {
     // Move to next block
-    if (!index_iter_.Valid()) {
+    if (!index_iter_.Valid() || PastUpperBound(index_iter_.key())) {
       SetDataIterator(NULL);
       return;
     }
     index_iter_.Next();
     InitDataBlock();
+    ReadAhead();
     if (data_iter_.iter() != NULL) data_iter_.SeekToFirst();
   }
 }
@@ -142,6 +184,7 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
       SetDataIterator(NULL);
       return;
     }
+    ResetReadahead();
     index_iter_.Prev();
     InitDataBlock();
     if (data_iter_.iter() != NULL) data_iter_.SeekToLast();
@@ -169,14 +212,62 @@ void TwoLevelIterator::InitDataBlock() {
   }
 }
 
+void TwoLevelIterator::ResetReadahead() {
+  sequential_blocks_ = 0;
+  readahead_window_ = 0;
+  blocks_ahead_ = 0;
+}
+
+// Called after moving forward to the next block.
+void TwoLevelIterator::ReadAhead() {
+  if (lookahead_iter_.iter() == NULL || !index_iter_.Valid() ||
+      options_.readahead_blocks <= 0) {
+    return;
+  }
+  sequential_blocks_++;
+  if (sequential_blocks_ < kReadaheadTrigger) {
+    return;
+  }
+  readahead_window_ = std::min(std::max(2 * readahead_window_, 1),
+                               options_.readahead_blocks);
+  if (blocks_ahead_ > 0) {
+    blocks_ahead_--;  // We just moved onto one of the prefetched blocks
+  } else {
+    lookahead_iter_.Seek(index_iter_.key());
+  }
+  while (blocks_ahead_ < readahead_window_ && lookahead_iter_.Valid() &&
+         !PastUpperBound(lookahead_iter_.key())) {
+    lookahead_iter_.Next();
+    if (!lookahead_iter_.Valid()) {
+      break;
+    }
+    (*prefetch_function_)(arg_, options_, lookahead_iter_.value());
+    blocks_ahead_++;
+  }
+}
+
 }  // namespace
 
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+    const ReadOptions& options,
+    const Comparator* comparator) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              comparator, NULL, NULL);
+}
+
+Iterator* NewTwoLevelIterator(
+    Iterator* index_iter,
+    BlockFunction block_function,
+    void* arg,
+    const ReadOptions& options,
+    const Comparator* comparator,
+    Iterator* lookahead_iter,
+    PrefetchFunction prefetch_function) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              comparator, lookahead_iter, prefetch_function);
 }
 
 }  // namespace leveldb
@@ -9,6 +9,7 @@
 
 namespace leveldb {
 
+class Comparator;
 struct ReadOptions;
 
 // Return a new two level iterator.  A two-level iterator contains an
@@ -20,6 +21,34 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If "comparator" is non-NULL and options.iterate_upper_bound is set,
+// moving forward stops, without reading the next block, once an index
+// key at or past the bound shows that no later block can hold a key
+// before it.  The bound must then be in the same key space as the index.
+extern Iterator* NewTwoLevelIterator(
+    Iterator* index_iter,
+    Iterator* (*block_function)(
+        void* arg,
+        const ReadOptions& options,
+        const Slice& index_value),
+    void* arg,
+    const ReadOptions& options,
+    const Comparator* comparator = NULL);
+
+// Like the above, but with readahead.  Once the returned iterator has
+// moved forward through a few blocks in a row it calls
+// (*prefetch_function)(arg, options, index_value) for the blocks that
+// follow, keeping a window of up to options.readahead_blocks blocks
+// ahead of the current one; blocks past the upper bound are skipped.
+// The window starts at one block and doubles with every further block
+// read in sequence; any seek or backward step resets it.  The prefetch
+// function should start loading the block in the background and
+// return immediately.
+//
+// "lookahead_iter" must be a second iterator over the same index as
+// "index_iter"; it is used to find the blocks to prefetch.  Takes
+// ownership of "lookahead_iter".
 extern Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(
@@ -27,7 +56,13 @@ extern Iterator* NewTwoLevelIterator(
         const ReadOptions& options,
         const Slice& index_value),
     void* arg,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    const Comparator* comparator,
+    Iterator* lookahead_iter,
+    void (*prefetch_function)(
+        void* arg,
+        const ReadOptions& options,
+        const Slice& index_value));
 
 }  // namespace leveldb
 
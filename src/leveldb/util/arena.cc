@@ -4,24 +4,84 @@
 
 #include "util/arena.h"
 #include <assert.h>
+#if defined(LEVELDB_PLATFORM_POSIX)
+#include <sys/mman.h>
+#endif
 
 namespace leveldb {
 
-static const int kBlockSize = 4096;
+const size_t Arena::kDefaultBlockSize;
 
-Arena::Arena() : memory_usage_(0) {
+static const int kAlign = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+
+// Map "size" bytes of anonymous memory backed by huge pages.  Reserved
+// huge pages (MAP_HUGETLB) are used if the system has enough of them
+// free; otherwise the region is aligned to "size" and marked for
+// transparent huge pages, which the kernel backs with huge pages as it
+// is touched if it can.  Returns NULL if memory cannot be mapped.
+static char* MapHugePageRegion(size_t size) {
+#if defined(LEVELDB_PLATFORM_POSIX)
+  void* p;
+#if defined(MAP_HUGETLB)
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) {
+    return reinterpret_cast<char*>(p);
+  }
+#endif
+  // Map twice the size and trim it, since a huge page can only be used
+  // for a range aligned to its size.
+  p = mmap(NULL, 2 * size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  char* base = reinterpret_cast<char*>(p);
+  const uintptr_t mod = reinterpret_cast<uintptr_t>(base) % size;
+  const size_t head = (mod == 0) ? 0 : size - mod;
+  if (head > 0) {
+    munmap(base, head);
+  }
+  munmap(base + head + size, size - head);
+  base += head;
+#if defined(MADV_HUGEPAGE)
+  madvise(base, size, MADV_HUGEPAGE);
+#endif
+  return base;
+#else
+  return NULL;
+#endif
+}
+
+static void UnmapHugePageRegion(char* region, size_t size) {
+#if defined(LEVELDB_PLATFORM_POSIX)
+  munmap(region, size);
+#endif
+}
+
+Arena::Arena(size_t block_size, size_t huge_page_size)
+    : block_size_(block_size),
+      huge_page_size_(huge_page_size),
+      memory_usage_(0),
+      memory_reserved_(0) {
+  assert(block_size_ > 0);
   alloc_ptr_ = NULL;  // First allocation will allocate a block
   alloc_bytes_remaining_ = 0;
+  region_ptr_ = NULL;
+  region_bytes_remaining_ = 0;
 }
 
 Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
+  for (size_t i = 0; i < regions_.size(); i++) {
+    UnmapHugePageRegion(regions_[i], huge_page_size_);
+  }
 }
 
 char* Arena::AllocateFallback(size_t bytes) {
-  if (bytes > kBlockSize / 4) {
+  if (bytes > block_size_ / 4) {
     // Object is more than a quarter of our block size.  Allocate it separately
     // to avoid wasting too much space in leftover bytes.
     char* result = AllocateNewBlock(bytes);
@@ -29,8 +89,8 @@ char* Arena::AllocateFallback(size_t bytes) {
   }
 
   // We waste the remaining space in the current block.
-  alloc_ptr_ = AllocateNewBlock(kBlockSize);
-  alloc_bytes_remaining_ = kBlockSize;
+  alloc_ptr_ = AllocateNewBlock(block_size_);
+  alloc_bytes_remaining_ = block_size_;
 
   char* result = alloc_ptr_;
   alloc_ptr_ += bytes;
@@ -39,7 +99,7 @@ char* Arena::AllocateFallback(size_t bytes) {
 }
 
 char* Arena::AllocateAligned(size_t bytes) {
-  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+  const int align = kAlign;
   assert((align & (align-1)) == 0);   // Pointer size should be a power of 2
   size_t current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align-1);
   size_t slop = (current_mod == 0 ? 0 : align - current_mod);
@@ -58,11 +118,47 @@ char* Arena::AllocateAligned(size_t bytes) {
 }
 
 char* Arena::AllocateNewBlock(size_t block_bytes) {
+  if (huge_page_size_ > 0 && block_bytes <= huge_page_size_) {
+    char* result = AllocateFromRegion(block_bytes);
+    if (result != NULL) {
+      return result;
+    }
+  }
   char* result = new char[block_bytes];
   blocks_.push_back(result);
-  memory_usage_.NoBarrier_Store(
-      reinterpret_cast<void*>(MemoryUsage() + block_bytes + sizeof(char*)));
+  AddUsage(block_bytes + sizeof(char*), block_bytes + sizeof(char*));
   return result;
 }
 
+char* Arena::AllocateFromRegion(size_t block_bytes) {
+  // Keep every block aligned, as AllocateAligned() relies on.
+  const size_t needed = (block_bytes + kAlign - 1) & ~(kAlign - 1);
+  if (needed > region_bytes_remaining_) {
+    // The rest of the current region is wasted.  It was already counted
+    // as reserved, and is never touched, so it takes no physical memory.
+    char* region = MapHugePageRegion(huge_page_size_);
+    if (region == NULL) {
+      return NULL;
+    }
+    regions_.push_back(region);
+    region_ptr_ = region;
+    region_bytes_remaining_ = huge_page_size_;
+    AddUsage(0, huge_page_size_);
+  }
+  char* result = region_ptr_;
+  region_ptr_ += needed;
+  region_bytes_remaining_ -= needed;
+  AddUsage(needed, 0);
+  return result;
+}
+
+void Arena::AddUsage(size_t used, size_t reserved) {
+  // Only the thread allocating from the arena updates these, so a plain
+  // load and store suffice; other threads may read them at any time.
+  memory_usage_.NoBarrier_Store(
+      reinterpret_cast<void*>(MemoryUsage() + used));
+  memory_reserved_.NoBarrier_Store(
+      reinterpret_cast<void*>(MemoryReserved() + reserved));
+}
+
 }  // namespace leveldb
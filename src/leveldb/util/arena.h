@@ -15,7 +15,14 @@ namespace leveldb {
 
 class Arena {
  public:
-  Arena();
+  static const size_t kDefaultBlockSize = 4096;
+
+  // Small allocations are carved out of blocks of "block_size" bytes.
+  // If "huge_page_size" is non-zero, blocks are in turn carved out of
+  // regions of that many bytes mapped with huge pages, where the system
+  // provides them, so that the arena's contents need few TLB entries.
+  explicit Arena(size_t block_size = kDefaultBlockSize,
+                 size_t huge_page_size = 0);
   ~Arena();
 
   // Return a pointer to a newly allocated memory block of "bytes" bytes.
@@ -25,14 +32,27 @@ class Arena {
   char* AllocateAligned(size_t bytes);
 
   // Returns an estimate of the total memory usage of data allocated
-  // by the arena.
+  // by the arena: the size of every block handed out so far, including
+  // the unused tail of the current one.
   size_t MemoryUsage() const {
     return reinterpret_cast<uintptr_t>(memory_usage_.NoBarrier_Load());
   }
 
+  // Returns the number of bytes the arena has taken from the system.
+  // This is MemoryUsage() plus the part of the current huge page region
+  // that no block has been carved from yet.
+  size_t MemoryReserved() const {
+    return reinterpret_cast<uintptr_t>(memory_reserved_.NoBarrier_Load());
+  }
+
  private:
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateFromRegion(size_t block_bytes);
+  void AddUsage(size_t used, size_t reserved);
+
+  const size_t block_size_;
+  const size_t huge_page_size_;
 
   // Allocation state
   char* alloc_ptr_;
@@ -41,8 +61,15 @@ class Arena {
   // Array of new[] allocated memory blocks
   std::vector<char*> blocks_;
 
+  // Huge page regions, each of huge_page_size_ bytes, and the part of the
+  // last one that blocks have not been carved from yet.
+  std::vector<char*> regions_;
+  char* region_ptr_;
+  size_t region_bytes_remaining_;
+
   // Total memory usage of the arena.
   port::AtomicPointer memory_usage_;
+  port::AtomicPointer memory_reserved_;
 
   // No copying allowed
   Arena(const Arena&);
@@ -4,6 +4,8 @@
 
 #include "util/arena.h"
 
+#include <string.h>
+
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -61,6 +63,55 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+static void FillAndCheck(Arena* arena, int n) {
+  std::vector<std::pair<size_t, char*> > allocated;
+  Random rnd(301);
+  size_t bytes = 0;
+  for (int i = 0; i < n; i++) {
+    size_t s = rnd.OneIn(100) ? 1 + rnd.Uniform(20000) : 1 + rnd.Uniform(100);
+    char* r = rnd.OneIn(2) ? arena->AllocateAligned(s) : arena->Allocate(s);
+    memset(r, i % 256, s);
+    bytes += s;
+    allocated.push_back(std::make_pair(s, r));
+    ASSERT_GE(arena->MemoryUsage(), bytes);
+    ASSERT_GE(arena->MemoryReserved(), arena->MemoryUsage());
+  }
+  for (size_t i = 0; i < allocated.size(); i++) {
+    for (size_t b = 0; b < allocated[i].first; b++) {
+      ASSERT_EQ(int(allocated[i].second[b]) & 0xff, i % 256);
+    }
+  }
+}
+
+TEST(ArenaTest, BlockSize) {
+  Arena arena(64 << 10);
+  char* p = arena.Allocate(1);
+  // The first block is a whole block of the requested size.
+  ASSERT_GE(arena.MemoryUsage(), 64 << 10);
+  ASSERT_LT(arena.MemoryUsage(), (64 << 10) + 64);
+  ASSERT_EQ(arena.MemoryUsage(), arena.MemoryReserved());
+  // Later small allocations come from the same block.
+  const size_t usage = arena.MemoryUsage();
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(arena.Allocate(10) != p);
+  }
+  ASSERT_EQ(usage, arena.MemoryUsage());
+  FillAndCheck(&arena, 20000);
+}
+
+TEST(ArenaTest, HugePages) {
+  const size_t kHugePage = 2 << 20;
+  Arena arena(64 << 10, kHugePage);
+  arena.Allocate(1);
+  // Usage counts only the block handed out, while the whole region it
+  // was carved from is reserved (unless mapping it failed).
+  ASSERT_LT(arena.MemoryUsage(), 128 << 10);
+  ASSERT_TRUE(arena.MemoryReserved() == kHugePage ||
+              arena.MemoryReserved() == arena.MemoryUsage());
+  FillAndCheck(&arena, 50000);
+  ASSERT_LT(arena.MemoryReserved(), arena.MemoryUsage() + 2 * kHugePage);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,6 +4,10 @@
 
 #include "util/coding.h"
 
+#if defined(__BMI2__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 namespace leveldb {
 
 void EncodeFixed32(char* buf, uint32_t value) {
@@ -109,9 +113,63 @@ int VarintLength(uint64_t v) {
   return len;
 }
 
+namespace {
+
+const uint64_t kStopBits = 0x8080808080808080ull;
+
+// Returns the index of the lowest set bit of "x".  REQUIRES: x != 0
+inline int LowestBit(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// Reads eight bytes as a little-endian word.  REQUIRES: port::kLittleEndian
+inline uint64_t LoadWord(const char* p) {
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+// Drops the continuation bit of every byte of "x" and packs the
+// remaining 7-bit groups together, giving the value of a varint of
+// at most eight bytes whose trailing bytes have been cleared.
+inline uint64_t PackGroups(uint64_t x) {
+#if defined(__BMI2__) && defined(__x86_64__)
+  return _pext_u64(x, 0x7f7f7f7f7f7f7f7full);
+#else
+  x = ((x & 0x7f007f007f007f00ull) >> 1) | (x & 0x007f007f007f007full);
+  x = ((x & 0x3fff00003fff0000ull) >> 2) | (x & 0x00003fff00003fffull);
+  x = ((x & 0x0fffffff00000000ull) >> 4) | (x & 0x000000000fffffffull);
+  return x;
+#endif
+}
+
+}  // namespace
+
 const char* GetVarint32PtrFallback(const char* p,
                                    const char* limit,
                                    uint32_t* value) {
+  if (port::kLittleEndian && limit - p >= 8) {
+    const uint64_t x = LoadWord(p);
+    const uint64_t stop = ~x & kStopBits;
+    if (stop != 0) {
+      const int len = LowestBit(stop) / 8 + 1;
+      if (len > 5) return NULL;
+      // stop ^ (stop - 1) covers the bytes up to the last one of the value
+      *value = static_cast<uint32_t>(PackGroups(x & (stop ^ (stop - 1))));
+      return p + len;
+    }
+    return NULL;
+  }
+
   uint32_t result = 0;
   for (uint32_t shift = 0; shift <= 28 && p < limit; shift += 7) {
     uint32_t byte = *(reinterpret_cast<const unsigned char*>(p));
@@ -141,6 +199,20 @@ bool GetVarint32(Slice* input, uint32_t* value) {
 }
 
 const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* value) {
+  if (p < limit && (*reinterpret_cast<const unsigned char*>(p) & 128) == 0) {
+    *value = *reinterpret_cast<const unsigned char*>(p);
+    return p + 1;
+  }
+  if (port::kLittleEndian && limit - p >= 8) {
+    const uint64_t x = LoadWord(p);
+    const uint64_t stop = ~x & kStopBits;
+    if (stop != 0) {
+      *value = PackGroups(x & (stop ^ (stop - 1)));
+      return p + LowestBit(stop) / 8 + 1;
+    }
+    // Nine and ten byte values take the loop below
+  }
+
   uint64_t result = 0;
   for (uint32_t shift = 0; shift <= 63 && p < limit; shift += 7) {
     uint64_t byte = *(reinterpret_cast<const unsigned char*>(p));
@@ -4,6 +4,8 @@
 
 #include "util/coding.h"
 
+#include "leveldb/env.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -169,6 +171,39 @@ TEST(Coding, Varint64Truncation) {
   ASSERT_EQ(large_value, result);
 }
 
+TEST(Coding, VarintWithTrailingBytes) {
+  // Values followed by enough bytes to be decoded a word at a time
+  const uint64_t values[] = { 0, 127, 128, 300, 1ull << 31, 1ull << 35,
+                              (1ull << 56) - 1, 1ull << 56, 1ull << 63,
+                              ~static_cast<uint64_t>(0) };
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    for (int pad = 0; pad < 10; pad++) {
+      std::string s;
+      PutVarint64(&s, values[i]);
+      const int len = s.size();
+      s.append(pad, static_cast<char>(0xff));
+      uint64_t v64;
+      const char* p = GetVarint64Ptr(s.data(), s.data() + s.size(), &v64);
+      ASSERT_EQ(s.data() + len, p);
+      ASSERT_EQ(values[i], v64);
+
+      uint32_t v32;
+      p = GetVarint32Ptr(s.data(), s.data() + s.size(), &v32);
+      if (len > 5) {
+        ASSERT_TRUE(p == NULL);
+      } else {
+        ASSERT_EQ(s.data() + len, p);
+        ASSERT_EQ(static_cast<uint32_t>(values[i]), v32);
+      }
+    }
+  }
+
+  std::string overflow("\x81\x82\x83\x84\x85\x11\x00\x00\x00");
+  uint32_t result;
+  ASSERT_TRUE(GetVarint32Ptr(overflow.data(), overflow.data() + overflow.size(),
+                             &result) == NULL);
+}
+
 TEST(Coding, Strings) {
   std::string s;
   PutLengthPrefixedSlice(&s, Slice(""));
@@ -189,8 +224,70 @@ TEST(Coding, Strings) {
   ASSERT_EQ("", input.ToString());
 }
 
+// Decodes one byte at a time, for comparison with GetVarint64Ptr
+static const char* ByteLoopVarint64(const char* p, const char* limit,
+                                    uint64_t* value) {
+  uint64_t result = 0;
+  for (uint32_t shift = 0; shift <= 63 && p < limit; shift += 7) {
+    uint64_t byte = *(reinterpret_cast<const unsigned char*>(p));
+    p++;
+    result |= ((byte & 127) << shift);
+    if ((byte & 128) == 0) {
+      *value = result;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+void BM_Varint64(int max_log) {
+  Random rnd(301);
+  std::string s;
+  const int kCount = 1 << 16;
+  for (int i = 0; i < kCount; i++) {
+    // Values of 1 to "max_log" bits
+    const int bits = rnd.Uniform(max_log) + 1;
+    PutVarint64(&s, (static_cast<uint64_t>(rnd.Next()) << 33 ^
+                     static_cast<uint64_t>(rnd.Next()) << 2 ^ rnd.Next()) &
+                    (~static_cast<uint64_t>(0) >> (64 - bits)));
+  }
+  const char* limit = s.data() + s.size();
+  const int kRounds = 200;
+  Env* env = Env::Default();
+  uint64_t sums[2] = { 0, 0 };
+  uint64_t micros[2];
+  for (int which = 0; which < 2; which++) {
+    const uint64_t start = env->NowMicros();
+    for (int r = 0; r < kRounds; r++) {
+      const char* p = s.data();
+      while (p < limit) {
+        uint64_t v;
+        p = (which == 0) ? ByteLoopVarint64(p, limit, &v)
+                         : GetVarint64Ptr(p, limit, &v);
+        sums[which] += v;
+      }
+    }
+    micros[which] = env->NowMicros() - start;
+  }
+  if (sums[0] != sums[1]) {
+    fprintf(stderr, "BM_Varint64: decoders disagree\n");
+    exit(1);
+  }
+  const double ops = static_cast<double>(kCount) * kRounds / 1e3;
+  fprintf(stderr, "BM_Varint64/%-2d byte loop: %6.2f ns/op  word: %6.2f ns/op\n",
+          max_log, micros[0] / ops, micros[1] / ops);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    leveldb::BM_Varint64(7);
+    leveldb::BM_Varint64(21);
+    leveldb::BM_Varint64(42);
+    leveldb::BM_Varint64(64);
+    return 0;
+  }
+
   return leveldb::test::RunAllTests();
 }
@@ -3,6 +3,8 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "util/crc32c.h"
+#include "leveldb/env.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -56,6 +58,44 @@ TEST(CRC, Extend) {
             Extend(Value("hello ", 6), "world", 5));
 }
 
+// Bit at a time, for checking the optimized implementations
+static uint32_t SlowCRC(uint32_t crc, const char* buf, size_t size) {
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= static_cast<unsigned char>(buf[i]);
+    for (int k = 0; k < 8; k++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x82f63b78u : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+TEST(CRC, LongBuffers) {
+  // Cover every path of the accelerated code: alignments, the short and
+  // long interleaved streams and the tails after them.
+  Random rnd(301);
+  std::string data;
+  for (int i = 0; i < 100000; i++) {
+    data.push_back(static_cast<char>(rnd.Uniform(256)));
+  }
+  const size_t sizes[] = { 17, 767, 768, 769, 1000, 24575, 24576, 24577,
+                           25344, 50000, 99990 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    for (size_t offset = 0; offset < 8; offset++) {
+      const char* p = data.data() + offset;
+      ASSERT_EQ(SlowCRC(0, p, sizes[i]), Value(p, sizes[i]));
+      ASSERT_EQ(SlowCRC(0x12345678, p, sizes[i]),
+                Extend(0x12345678, p, sizes[i]));
+    }
+  }
+  for (int i = 0; i < 200; i++) {
+    const size_t offset = rnd.Uniform(8);
+    const size_t size = rnd.Uniform(data.size() - offset);
+    ASSERT_EQ(SlowCRC(0, data.data() + offset, size),
+              Value(data.data() + offset, size));
+  }
+}
+
 TEST(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
@@ -64,9 +104,34 @@ TEST(CRC, Mask) {
   ASSERT_EQ(crc, Unmask(Unmask(Mask(Mask(crc)))));
 }
 
+void BM_CRC32C(size_t size) {
+  std::string data(size, 'x');
+  const int iters = static_cast<int>((1 << 30) / size);  // 1GB in total
+  Env* env = Env::Default();
+  uint32_t crc = 0;
+  uint64_t start_micros = env->NowMicros();
+  for (int i = 0; i < iters; i++) {
+    crc = Extend(crc, data.data(), data.size());
+  }
+  uint64_t micros = env->NowMicros() - start_micros;
+  if (micros == 0) micros = 1;
+  fprintf(stderr, "BM_CRC32C/%-8llu %8d iters : %7.2f GB/s (crc %08x)\n",
+          static_cast<unsigned long long>(size), iters,
+          (static_cast<double>(size) * iters / 1e3) / micros, crc);
+}
+
 }  // namespace crc32c
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    leveldb::crc32c::BM_CRC32C(64);
+    leveldb::crc32c::BM_CRC32C(1024);
+    leveldb::crc32c::BM_CRC32C(4096);
+    leveldb::crc32c::BM_CRC32C(65536);
+    leveldb::crc32c::BM_CRC32C(1 << 20);
+    return 0;
+  }
+
   return leveldb::test::RunAllTests();
 }
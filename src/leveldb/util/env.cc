@@ -13,15 +13,55 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
+Status Env::ReuseWritableFile(const std::string& fname,
+                              const std::string& old_fname,
+                              WritableFile** result) {
+  Status s = RenameFile(old_fname, fname);
+  if (!s.ok()) {
+    *result = NULL;
+    return s;
+  }
+  return NewWritableFile(fname, result);
+}
+
+Status Env::LinkFile(const std::string& src, const std::string& target) {
+  return Status::NotSupported("LinkFile", src);
+}
+
+uint64_t Env::NowNanos() {
+  return NowMicros() * 1000;
+}
+
 SequentialFile::~SequentialFile() {
 }
 
 RandomAccessFile::~RandomAccessFile() {
 }
 
+void RandomAccessFile::ReadAsync(uint64_t offset, size_t n, char* scratch,
+                                 ReadCallback callback, void* arg) const {
+  Slice result;
+  Status s = Read(offset, n, &result, scratch);
+  (*callback)(arg, s, result);
+}
+
 WritableFile::~WritableFile() {
 }
 
+Status WritableFile::Preallocate(uint64_t size) {
+  return Status::OK();
+}
+
 Logger::~Logger() {
 }
 
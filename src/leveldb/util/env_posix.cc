@@ -13,10 +13,15 @@
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
+#if defined(LEVELDB_IO_URING_PRESENT)
+#include <linux/io_uring.h>
+#endif
+#include <algorithm>
 #include <deque>
 #include <limits>
 #include <set>
@@ -90,6 +95,292 @@ class Limiter {
   void operator=(const Limiter&);
 };
 
+// A read started through RandomAccessFile::ReadAsync() on a pread()
+// based file.
+struct AsyncRead {
+  int fd;
+  uint64_t offset;
+  size_t n;
+  char* scratch;
+  const std::string* filename;  // Owned by the file, which outlives us
+  RandomAccessFile::ReadCallback callback;
+  void* arg;
+};
+
+static void CompleteAsyncRead(AsyncRead* r, ssize_t bytes, int err) {
+  Status s;
+  Slice result;
+  if (bytes < 0) {
+    s = IOError(*r->filename, err);
+  } else {
+    result = Slice(r->scratch, bytes);
+  }
+  (*r->callback)(r->arg, s, result);
+  delete r;
+}
+
+static void RunAsyncRead(AsyncRead* r) {
+  ssize_t bytes = pread(r->fd, r->scratch, r->n,
+                        static_cast<off_t>(r->offset));
+  CompleteAsyncRead(r, bytes, (bytes < 0) ? errno : 0);
+}
+
+#if defined(LEVELDB_IO_URING_PRESENT)
+// Minimal io_uring driver.  Reads are submitted by the caller and
+// reaped by a dedicated thread that runs the callbacks.  We talk to
+// the kernel directly rather than depend on liburing.
+class IoUring {
+ public:
+  // Returns NULL if the kernel does not let us set up a ring, e.g.
+  // because it is too old or io_uring is disabled.
+  static IoUring* Create(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) {
+      return NULL;
+    }
+    IoUring* ring = new IoUring(fd, p);
+    if (!ring->ok_) {
+      delete ring;
+      return NULL;
+    }
+    return ring;
+  }
+
+  ~IoUring() {
+    if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_len_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_len_);
+    }
+    if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_len_);
+    close(fd_);
+  }
+
+  // Queue "r".  Returns false, without taking ownership of "r", if the
+  // ring is full or the kernel refused the submission.
+  bool Submit(AsyncRead* r) {
+    MutexLock l(&mu_);
+    if (!started_) {
+      started_ = true;
+      pthread_t t;
+      if (pthread_create(&t, NULL, &IoUring::ReaperWrapper, this) != 0) {
+        abort();
+      }
+      pthread_detach(t);
+    }
+    if (in_flight_ >= cq_entries_) {
+      return false;
+    }
+    const unsigned tail = *sq_tail_;
+    const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (tail - head >= sq_entries_) {
+      return false;
+    }
+    const unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = r->fd;
+    sqe->off = r->offset;
+    sqe->addr = reinterpret_cast<uintptr_t>(r->scratch);
+    sqe->len = r->n;
+    sqe->user_data = reinterpret_cast<uintptr_t>(r);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    int submitted;
+    do {
+      submitted = syscall(__NR_io_uring_enter, fd_, 1, 0, 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted != 1) {
+      // Nothing was consumed, so it is safe to take the entry back.
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      return false;
+    }
+    in_flight_++;
+    return true;
+  }
+
+ private:
+  IoUring(int fd, const struct io_uring_params& p)
+      : ok_(false),
+        fd_(fd),
+        sq_entries_(p.sq_entries),
+        cq_entries_(p.cq_entries),
+        sq_ring_(MAP_FAILED),
+        cq_ring_(MAP_FAILED),
+        sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+        started_(false),
+        in_flight_(0) {
+    sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    sqes_len_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+    }
+    sq_ring_ = mmap(NULL, sq_len_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) return;
+    cq_ring_ = single_mmap ? sq_ring_ :
+        mmap(NULL, cq_len_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) return;
+    void* sqes = mmap(NULL, sqes_len_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return;
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+    ok_ = true;
+  }
+
+  static void* ReaperWrapper(void* arg) {
+    reinterpret_cast<IoUring*>(arg)->Reaper();
+    return NULL;
+  }
+
+  // Body of the thread that waits for completions and runs callbacks.
+  void Reaper() {
+    while (true) {
+      syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS,
+              NULL, 0);
+      unsigned head = *cq_head_;
+      const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      while (head != tail) {
+        struct io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+        AsyncRead* r = reinterpret_cast<AsyncRead*>(cqe->user_data);
+        const int res = cqe->res;
+        head++;
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        {
+          MutexLock l(&mu_);
+          in_flight_--;
+        }
+        if (res == -EINVAL || res == -EOPNOTSUPP) {
+          // Kernel knows io_uring but not IORING_OP_READ.
+          RunAsyncRead(r);
+        } else if (res < 0) {
+          CompleteAsyncRead(r, -1, -res);
+        } else {
+          CompleteAsyncRead(r, res, 0);
+        }
+      }
+    }
+  }
+
+  bool ok_;
+  const int fd_;
+  const unsigned sq_entries_;
+  const unsigned cq_entries_;
+  size_t sq_len_;
+  size_t cq_len_;
+  size_t sqes_len_;
+  void* sq_ring_;
+  void* cq_ring_;
+  struct io_uring_sqe* sqes_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  struct io_uring_cqe* cqes_;
+
+  port::Mutex mu_;   // Serializes submissions
+  bool started_;
+  unsigned in_flight_;
+
+  // No copying allowed
+  IoUring(const IoUring&);
+  void operator=(const IoUring&);
+};
+#endif  // defined(LEVELDB_IO_URING_PRESENT)
+
+// Services ReadAsync() for pread() based files: through io_uring when
+// the kernel supports it, otherwise on a small pool of threads.
+class AsyncReader {
+ public:
+  AsyncReader()
+      : initialized_(false),
+        ring_(NULL),
+        work_cv_(&mu_),
+        threads_started_(0) {
+  }
+
+  void Submit(AsyncRead* r) {
+    {
+      MutexLock l(&mu_);
+      if (!initialized_) {
+        initialized_ = true;
+#if defined(LEVELDB_IO_URING_PRESENT)
+        ring_ = IoUring::Create(kRingEntries);
+#endif
+      }
+    }
+#if defined(LEVELDB_IO_URING_PRESENT)
+    if (ring_ != NULL && ring_->Submit(r)) {
+      return;
+    }
+#endif
+    MutexLock l(&mu_);
+    if (threads_started_ < kNumThreads) {
+      threads_started_++;
+      pthread_t t;
+      if (pthread_create(&t, NULL, &AsyncReader::ThreadWrapper, this) != 0) {
+        abort();
+      }
+      pthread_detach(t);
+    }
+    queue_.push_back(r);
+    work_cv_.Signal();
+  }
+
+ private:
+  enum { kRingEntries = 128, kNumThreads = 4 };
+
+  static void* ThreadWrapper(void* arg) {
+    reinterpret_cast<AsyncReader*>(arg)->ThreadBody();
+    return NULL;
+  }
+
+  void ThreadBody() {
+    while (true) {
+      AsyncRead* r;
+      {
+        MutexLock l(&mu_);
+        while (queue_.empty()) {
+          work_cv_.Wait();
+        }
+        r = queue_.front();
+        queue_.pop_front();
+      }
+      RunAsyncRead(r);
+    }
+  }
+
+  port::Mutex mu_;
+  bool initialized_;
+#if defined(LEVELDB_IO_URING_PRESENT)
+  IoUring* ring_;
+#else
+  void* ring_;
+#endif
+  port::CondVar work_cv_;
+  int threads_started_;
+  std::deque<AsyncRead*> queue_;
+};
+
 class PosixSequentialFile: public SequentialFile {
  private:
   std::string filename_;
@@ -132,10 +423,13 @@ class PosixRandomAccessFile: public RandomAccessFile {
   bool temporary_fd_;  // If true, fd_ is -1 and we open on every read.
   int fd_;
   Limiter* limiter_;
+  AsyncReader* async_reader_;
 
  public:
-  PosixRandomAccessFile(const std::string& fname, int fd, Limiter* limiter)
-      : filename_(fname), fd_(fd), limiter_(limiter) {
+  PosixRandomAccessFile(const std::string& fname, int fd, Limiter* limiter,
+                        AsyncReader* async_reader)
+      : filename_(fname), fd_(fd), limiter_(limiter),
+        async_reader_(async_reader) {
     temporary_fd_ = !limiter->Acquire();
     if (temporary_fd_) {
       // Open file on every access.
@@ -175,6 +469,24 @@ class PosixRandomAccessFile: public RandomAccessFile {
     return s;
   }
 
+  virtual void ReadAsync(uint64_t offset, size_t n, char* scratch,
+                         ReadCallback callback, void* arg) const {
+    if (temporary_fd_) {
+      // No descriptor to hand to another thread.
+      RandomAccessFile::ReadAsync(offset, n, scratch, callback, arg);
+      return;
+    }
+    AsyncRead* r = new AsyncRead;
+    r->fd = fd_;
+    r->offset = offset;
+    r->n = n;
+    r->scratch = scratch;
+    r->filename = &filename_;
+    r->callback = callback;
+    r->arg = arg;
+    async_reader_->Submit(r);
+  }
+
   virtual std::string GetName() const { return filename_; }
 };
 
@@ -211,6 +523,21 @@ class PosixMmapReadableFile: public RandomAccessFile {
     return s;
   }
 
+  // The data is already addressable; all we can do asynchronously is
+  // ask the kernel to start paging it in.
+  virtual void ReadAsync(uint64_t offset, size_t n, char* scratch,
+                         ReadCallback callback, void* arg) const {
+    Slice result;
+    Status s = Read(offset, n, &result, scratch);
+    if (s.ok() && n > 0) {
+      const uint64_t page_size = getpagesize();
+      const uint64_t start = offset & ~(page_size - 1);
+      madvise(reinterpret_cast<char*>(mmapped_region_) + start,
+              offset + n - start, MADV_WILLNEED);
+    }
+    (*callback)(arg, s, result);
+  }
+
   virtual std::string GetName() const { return filename_; }
 };
 
@@ -294,9 +621,198 @@ class PosixWritableFile : public WritableFile {
     return s;
   }
 
+  virtual Status Preallocate(uint64_t size) {
+#if defined(OS_LINUX) && defined(FALLOC_FL_KEEP_SIZE)
+    if (fallocate(fileno(file_), FALLOC_FL_KEEP_SIZE, 0,
+                  static_cast<off_t>(size)) != 0 &&
+        errno != EOPNOTSUPP && errno != ENOSYS) {
+      return IOError(filename_, errno);
+    }
+#endif
+    return Status::OK();
+  }
+
+  virtual std::string GetName() const { return filename_; }
+};
+
+#if defined(O_DIRECT)
+// O_DIRECT requires file offsets, transfer sizes and memory buffers to be
+// aligned.  4K satisfies every file system and device we care about.
+static const size_t kDirectIOAlignment = 4096;
+
+// Size of the aligned buffers used by the direct I/O file classes below.
+static const size_t kDirectIOBufferSize = 1 << 20;
+
+static char* NewAlignedBuffer(size_t size) {
+  void* p = NULL;
+  if (posix_memalign(&p, kDirectIOAlignment, size) != 0) {
+    return NULL;
+  }
+  return reinterpret_cast<char*>(p);
+}
+
+// Reads a file opened with O_DIRECT.  Each read is served from an
+// aligned buffer holding the kDirectIOBufferSize bytes starting at the
+// last miss, so sequential readers (compactions) issue one large read
+// per megabyte instead of one per block.
+class PosixDirectRandomAccessFile: public RandomAccessFile {
+ private:
+  std::string filename_;
+  int fd_;
+  mutable port::Mutex mu_;
+  char* const buf_;
+  mutable uint64_t buf_offset_;   // Protected by mu_; offset of buf_[0]
+  mutable size_t buf_len_;        // Protected by mu_; valid bytes in buf_
+
+ public:
+  PosixDirectRandomAccessFile(const std::string& fname, int fd, char* buf)
+      : filename_(fname), fd_(fd), buf_(buf), buf_offset_(0), buf_len_(0) {
+  }
+
+  virtual ~PosixDirectRandomAccessFile() {
+    close(fd_);
+    free(buf_);
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    MutexLock l(&mu_);
+    Status s;
+    size_t copied = 0;
+    while (copied < n) {
+      const uint64_t pos = offset + copied;
+      if (pos >= buf_offset_ && pos < buf_offset_ + buf_len_) {
+        const size_t avail = buf_offset_ + buf_len_ - pos;
+        const size_t m = std::min(avail, n - copied);
+        memcpy(scratch + copied, buf_ + (pos - buf_offset_), m);
+        copied += m;
+        continue;
+      }
+      const uint64_t aligned = pos & ~(kDirectIOAlignment - 1);
+      ssize_t r = pread(fd_, buf_, kDirectIOBufferSize,
+                        static_cast<off_t>(aligned));
+      if (r < 0) {
+        buf_len_ = 0;
+        s = IOError(filename_, errno);
+        break;
+      }
+      buf_offset_ = aligned;
+      buf_len_ = r;
+      if (pos >= aligned + r) {
+        break;  // End of file
+      }
+    }
+    *result = Slice(scratch, copied);
+    return s;
+  }
+
   virtual std::string GetName() const { return filename_; }
 };
 
+// Writes a file opened with O_DIRECT.  Appended data is staged in an
+// aligned buffer that is written out whenever it fills up.  Sync() and
+// Close() also write the partial tail, padded to the alignment, and then
+// truncate the file back to its logical length; the tail stays in the
+// buffer so later appends rewrite that last partial block.
+class PosixDirectWritableFile : public WritableFile {
+ private:
+  std::string filename_;
+  int fd_;
+  char* buf_;
+  size_t pos_;            // Bytes of buf_ in use
+  uint64_t buf_offset_;   // File offset of buf_[0]; always aligned
+
+  Status WriteAt(const char* data, size_t n, uint64_t offset) {
+    while (n > 0) {
+      ssize_t r = pwrite(fd_, data, n, static_cast<off_t>(offset));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return IOError(filename_, errno);
+      }
+      data += r;
+      n -= r;
+      offset += r;
+    }
+    return Status::OK();
+  }
+
+  // Write out the partial tail of the buffer and trim the padding.
+  Status WriteTail() {
+    if (pos_ == 0) {
+      return Status::OK();
+    }
+    const size_t padded =
+        (pos_ + kDirectIOAlignment - 1) & ~(kDirectIOAlignment - 1);
+    memset(buf_ + pos_, 0, padded - pos_);
+    Status s = WriteAt(buf_, padded, buf_offset_);
+    if (s.ok() && ftruncate(fd_, static_cast<off_t>(buf_offset_ + pos_)) != 0) {
+      s = IOError(filename_, errno);
+    }
+    return s;
+  }
+
+ public:
+  PosixDirectWritableFile(const std::string& fname, int fd, char* buf)
+      : filename_(fname), fd_(fd), buf_(buf), pos_(0), buf_offset_(0) { }
+
+  virtual ~PosixDirectWritableFile() {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    free(buf_);
+  }
+
+  virtual Status Append(const Slice& data) {
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+      const size_t n = std::min(left, kDirectIOBufferSize - pos_);
+      memcpy(buf_ + pos_, p, n);
+      pos_ += n;
+      p += n;
+      left -= n;
+      if (pos_ == kDirectIOBufferSize) {
+        Status s = WriteAt(buf_, pos_, buf_offset_);
+        if (!s.ok()) {
+          return s;
+        }
+        buf_offset_ += pos_;
+        pos_ = 0;
+      }
+    }
+    return Status::OK();
+  }
+
+  virtual Status Close() {
+    Status result = WriteTail();
+    if (close(fd_) < 0 && result.ok()) {
+      result = IOError(filename_, errno);
+    }
+    fd_ = -1;
+    return result;
+  }
+
+  // Nothing is read back before Sync() or Close(), so keep buffering
+  // rather than issue small unaligned writes.
+  virtual Status Flush() {
+    return Status::OK();
+  }
+
+  virtual Status Sync() {
+    Status s = WriteTail();
+    if (s.ok() && fdatasync(fd_) != 0) {
+      s = IOError(filename_, errno);
+    }
+    return s;
+  }
+
+  virtual std::string GetName() const { return filename_; }
+};
+#endif  // defined(O_DIRECT)
+
 static int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct flock f;
@@ -376,7 +892,8 @@ class PosixEnv : public Env {
         mmap_limit_.Release();
       }
     } else {
-      *result = new PosixRandomAccessFile(fname, fd, &fd_limit_);
+      *result = new PosixRandomAccessFile(fname, fd, &fd_limit_,
+                                          &async_reader_);
     }
     return s;
   }
@@ -407,6 +924,64 @@ class PosixEnv : public Env {
     return s;
   }
 
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result) {
+    *result = NULL;
+    Status s = RenameFile(old_fname, fname);
+    if (!s.ok()) {
+      return s;
+    }
+    FILE* f = fopen(fname.c_str(), "r+");  // Does not truncate
+    if (f == NULL) {
+      s = IOError(fname, errno);
+    } else {
+      *result = new PosixWritableFile(fname, f);
+    }
+    return s;
+  }
+
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result) {
+#if defined(O_DIRECT)
+    int fd = open(fname.c_str(), O_RDONLY | O_DIRECT);
+    if (fd >= 0) {
+      char* buf = NewAlignedBuffer(kDirectIOBufferSize);
+      if (buf != NULL) {
+        *result = new PosixDirectRandomAccessFile(fname, fd, buf);
+        return Status::OK();
+      }
+      close(fd);
+    } else if (errno != EINVAL) {
+      *result = NULL;
+      return IOError(fname, errno);
+    }
+#endif
+    // The file system does not support O_DIRECT.
+    return NewRandomAccessFile(fname, result);
+  }
+
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result) {
+#if defined(O_DIRECT)
+    int fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT,
+                  0644);
+    if (fd >= 0) {
+      char* buf = NewAlignedBuffer(kDirectIOBufferSize);
+      if (buf != NULL) {
+        *result = new PosixDirectWritableFile(fname, fd, buf);
+        return Status::OK();
+      }
+      close(fd);
+    } else if (errno != EINVAL) {
+      *result = NULL;
+      return IOError(fname, errno);
+    }
+#endif
+    // The file system does not support O_DIRECT.
+    return NewWritableFile(fname, result);
+  }
+
   virtual bool FileExists(const std::string& fname) {
     return access(fname.c_str(), F_OK) == 0;
   }
@@ -470,6 +1045,14 @@ class PosixEnv : public Env {
     return result;
   }
 
+  virtual Status LinkFile(const std::string& src, const std::string& target) {
+    Status result;
+    if (link(src.c_str(), target.c_str()) != 0) {
+      result = IOError(src, errno);
+    }
+    return result;
+  }
+
   virtual Status LockFile(const std::string& fname, FileLock** lock) {
     *lock = NULL;
     Status result;
@@ -546,6 +1129,12 @@ class PosixEnv : public Env {
     return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
   }
 
+  virtual uint64_t NowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
   virtual void SleepForMicroseconds(int micros) {
     usleep(micros);
   }
@@ -578,6 +1167,7 @@ class PosixEnv : public Env {
   PosixLockTable locks_;
   Limiter mmap_limit_;
   Limiter fd_limit_;
+  AsyncReader async_reader_;
 };
 
 // Return the maximum number of concurrent mmaps.
@@ -5,6 +5,7 @@
 #include "leveldb/env.h"
 
 #include "port/port.h"
+#include "util/mutexlock.h"
 #include "util/testharness.h"
 #include "util/env_posix_test_helper.h"
 
@@ -56,6 +57,96 @@ TEST(EnvPosixTest, TestOpenOnRead) {
   ASSERT_OK(env_->DeleteFile(test_file));
 }
 
+struct AsyncReadState {
+  port::Mutex mu;
+  port::CondVar cv;
+  int pending;
+  std::string data;
+
+  AsyncReadState() : cv(&mu), pending(0) { }
+};
+
+static void AsyncReadDone(void* arg, const Status& s, const Slice& result) {
+  AsyncReadState* state = reinterpret_cast<AsyncReadState*>(arg);
+  ASSERT_OK(s);
+  MutexLock l(&state->mu);
+  state->data.append(result.data(), result.size());
+  state->pending--;
+  state->cv.SignalAll();
+}
+
+TEST(EnvPosixTest, TestReadAsync) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/read_async.txt";
+  const char kFileData[] = "abcdefghijklmnopqrstuvwxyz";
+  ASSERT_OK(WriteStringToFile(env_, kFileData, test_file));
+
+  // Open enough files that both mmap and pread based files are used.
+  const int kNumFiles = kMMapLimit + 2;
+  RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    AsyncReadState state;
+    char scratch[5];
+    state.pending = 1;
+    files[i]->ReadAsync(i, sizeof(scratch), scratch, &AsyncReadDone, &state);
+    MutexLock l(&state.mu);
+    while (state.pending > 0) {
+      state.cv.Wait();
+    }
+    ASSERT_EQ(std::string(kFileData + i, sizeof(scratch)), state.data);
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_OK(env_->DeleteFile(test_file));
+}
+
+TEST(EnvPosixTest, TestDirectIO) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_io.txt";
+
+  // Use sizes that are not multiples of the I/O alignment, and append
+  // again after a Sync() so that the padded tail has to be rewritten.
+  std::string data;
+  for (int i = 0; data.size() < 3000000; i++) {
+    data.append(1 + i % 5000, static_cast<char>('a' + i % 26));
+  }
+  const size_t kSplit = 1234567;
+  WritableFile* wfile;
+  ASSERT_OK(env_->NewDirectWritableFile(test_file, &wfile));
+  ASSERT_OK(wfile->Append(Slice(data.data(), kSplit)));
+  ASSERT_OK(wfile->Sync());
+  uint64_t size;
+  ASSERT_OK(env_->GetFileSize(test_file, &size));
+  ASSERT_EQ(kSplit, size);
+  ASSERT_OK(wfile->Append(Slice(data.data() + kSplit, data.size() - kSplit)));
+  ASSERT_OK(wfile->Close());
+  delete wfile;
+  ASSERT_OK(env_->GetFileSize(test_file, &size));
+  ASSERT_EQ(data.size(), size);
+
+  RandomAccessFile* rfile;
+  ASSERT_OK(env_->NewDirectRandomAccessFile(test_file, &rfile));
+  std::string scratch(20000, '\0');
+  const size_t kOffsets[] = { 0, 1, 4095, 4096, 1048575, 2000001, 1000 };
+  for (size_t i = 0; i < sizeof(kOffsets) / sizeof(kOffsets[0]); i++) {
+    Slice result;
+    ASSERT_OK(rfile->Read(kOffsets[i], scratch.size(), &result, &scratch[0]));
+    ASSERT_EQ(data.substr(kOffsets[i], scratch.size()), result.ToString());
+  }
+  // Reads past the end are truncated.
+  Slice result;
+  ASSERT_OK(rfile->Read(data.size() - 10, 100, &result, &scratch[0]));
+  ASSERT_EQ(data.substr(data.size() - 10), result.ToString());
+  delete rfile;
+  ASSERT_OK(env_->DeleteFile(test_file));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
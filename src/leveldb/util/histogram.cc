@@ -4,6 +4,8 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include "port/port.h"
 #include "util/histogram.h"
 
@@ -136,4 +138,59 @@ std::string Histogram::ToString() const {
   return r;
 }
 
+static uint64_t DoubleToBits(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+static double BitsToDouble(uint64_t bits) {
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+AtomicHistogram::AtomicHistogram()
+    : min_(~static_cast<uint64_t>(0)), max_(0), sum_(0),
+      sum_squares_(DoubleToBits(0)) {
+  for (int i = 0; i < Histogram::kNumBuckets; i++) {
+    buckets_[i].NoBarrier_Store(0);
+  }
+}
+
+void AtomicHistogram::Add(uint64_t value) {
+  const double v = static_cast<double>(value);
+  const double* limit = std::upper_bound(
+      Histogram::kBucketLimit,
+      Histogram::kBucketLimit + Histogram::kNumBuckets - 1, v);
+  buckets_[limit - Histogram::kBucketLimit].NoBarrier_FetchAdd(1);
+  sum_.NoBarrier_FetchAdd(value);
+
+  uint64_t old = min_.NoBarrier_Load();
+  while (value < old && !min_.NoBarrier_CompareAndSwap(&old, value)) {
+  }
+  old = max_.NoBarrier_Load();
+  while (value > old && !max_.NoBarrier_CompareAndSwap(&old, value)) {
+  }
+  old = sum_squares_.NoBarrier_Load();
+  while (!sum_squares_.NoBarrier_CompareAndSwap(
+             &old, DoubleToBits(BitsToDouble(old) + v * v))) {
+  }
+}
+
+void AtomicHistogram::Snapshot(Histogram* h) const {
+  h->Clear();
+  for (int i = 0; i < Histogram::kNumBuckets; i++) {
+    h->buckets_[i] = static_cast<double>(buckets_[i].NoBarrier_Load());
+    h->num_ += h->buckets_[i];
+  }
+  if (h->num_ == 0) {
+    return;
+  }
+  h->min_ = static_cast<double>(min_.NoBarrier_Load());
+  h->max_ = static_cast<double>(max_.NoBarrier_Load());
+  h->sum_ = static_cast<double>(sum_.NoBarrier_Load());
+  h->sum_squares_ = BitsToDouble(sum_squares_.NoBarrier_Load());
+}
+
 }  // namespace leveldb
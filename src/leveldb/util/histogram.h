@@ -5,7 +5,9 @@
 #ifndef STORAGE_LEVELDB_UTIL_HISTOGRAM_H_
 #define STORAGE_LEVELDB_UTIL_HISTOGRAM_H_
 
+#include <stdint.h>
 #include <string>
+#include "port/port.h"
 
 namespace leveldb {
 
@@ -20,6 +22,13 @@ class Histogram {
 
   std::string ToString() const;
 
+  double Median() const;
+  double Percentile(double p) const;
+  double Average() const;
+  double StandardDeviation() const;
+  double Count() const { return num_; }
+  double Max() const { return max_; }
+
  private:
   double min_;
   double max_;
@@ -31,10 +40,32 @@ class Histogram {
   static const double kBucketLimit[kNumBuckets];
   double buckets_[kNumBuckets];
 
-  double Median() const;
-  double Percentile(double p) const;
-  double Average() const;
-  double StandardDeviation() const;
+  friend class AtomicHistogram;
+};
+
+// A histogram of unsigned integer values, using the same buckets as
+// Histogram, that many threads can add to concurrently.  Add() never
+// blocks; it costs a few atomic operations.
+class AtomicHistogram {
+ public:
+  AtomicHistogram();
+
+  void Add(uint64_t value);
+
+  // Store a copy of the current contents in "*h".  Values added
+  // concurrently may be partially reflected.
+  void Snapshot(Histogram* h) const;
+
+ private:
+  port::AtomicUint64 min_;
+  port::AtomicUint64 max_;
+  port::AtomicUint64 sum_;
+  port::AtomicUint64 sum_squares_;  // Bits of a double
+  port::AtomicUint64 buckets_[Histogram::kNumBuckets];
+
+  // No copying allowed
+  AtomicHistogram(const AtomicHistogram&);
+  void operator=(const AtomicHistogram&);
 };
 
 }  // namespace leveldb
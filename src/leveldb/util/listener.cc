@@ -0,0 +1,30 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/listener.h"
+
+namespace leveldb {
+
+EventListener::~EventListener() {
+}
+
+void EventListener::OnFlushBegin(const FlushJobInfo& info) {
+}
+
+void EventListener::OnFlushCompleted(const FlushJobInfo& info) {
+}
+
+void EventListener::OnCompactionBegin(const CompactionJobInfo& info) {
+}
+
+void EventListener::OnCompactionCompleted(const CompactionJobInfo& info) {
+}
+
+void EventListener::OnWriteStallBegin(const WriteStallInfo& info) {
+}
+
+void EventListener::OnWriteStallEnd(const WriteStallInfo& info) {
+}
+
+}  // namespace leveldb
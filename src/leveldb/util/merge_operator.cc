@@ -0,0 +1,49 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/merge_operator.h"
+
+#include "leveldb/slice.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+MergeOperator::~MergeOperator() { }
+
+namespace {
+
+class UInt64AddOperator : public MergeOperator {
+ public:
+  virtual const char* Name() const {
+    return "leveldb.UInt64Add";
+  }
+
+  virtual bool Merge(const Slice& key,
+                     const Slice* existing_value,
+                     const Slice& value,
+                     std::string* new_value) const {
+    uint64_t sum = 0;
+    if (existing_value != NULL) {
+      if (existing_value->size() != sizeof(uint64_t)) {
+        return false;
+      }
+      sum = DecodeFixed64(existing_value->data());
+    }
+    if (value.size() != sizeof(uint64_t)) {
+      return false;
+    }
+    sum += DecodeFixed64(value.data());
+    new_value->clear();
+    PutFixed64(new_value, sum);
+    return true;
+  }
+};
+
+}  // namespace
+
+const MergeOperator* NewUInt64AddOperator() {
+  return new UInt64AddOperator;
+}
+
+}  // namespace leveldb
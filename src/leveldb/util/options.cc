@@ -17,14 +17,34 @@ Options::Options()
       env(Env::Default()),
       info_log(NULL),
       write_buffer_size(4<<20),
+      arena_block_size(4096),
+      memtable_huge_page_size(0),
       max_open_files(1000),
       block_cache(NULL),
+      block_cache_compressed(NULL),
+      persistent_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
       max_file_size(2<<20),
       compression(kSnappyCompression),
       reuse_logs(false),
-      filter_policy(NULL) {
+      recycle_log_file_num(0),
+      manual_wal_flush(false),
+      wal_ttl_seconds(0),
+      wal_size_limit_mb(0),
+      filter_policy(NULL),
+      use_direct_io_for_flush_and_compaction(false),
+      rate_limiter(NULL),
+      table_preload_threads(0),
+      prefix_extractor(NULL),
+      table_factory(NULL),
+      merge_operator(NULL),
+      compaction_filter(NULL),
+      stats_dump_period_sec(0),
+      stats_dump_callback(NULL),
+      stats_dump_arg(NULL),
+      listener(NULL),
+      secondary_catch_up_period_ms(0) {
 }
 
 }  // namespace leveldb
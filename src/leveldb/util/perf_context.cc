@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <stdio.h>
+#include "util/perf_context_imp.h"
+
+namespace leveldb {
+
+LEVELDB_THREAD_LOCAL PerfContext perf_context;
+LEVELDB_THREAD_LOCAL PerfLevel perf_level = kEnableCount;
+
+void SetPerfLevel(PerfLevel level) {
+  perf_level = level;
+}
+
+PerfLevel GetPerfLevel() {
+  return perf_level;
+}
+
+PerfContext* GetPerfContext() {
+  return &perf_context;
+}
+
+void PerfContext::Reset() {
+  *this = PerfContext();
+}
+
+static void AppendField(std::string* result, const char* name,
+                        uint64_t value) {
+  if (value == 0) {
+    return;
+  }
+  char buf[100];
+  snprintf(buf, sizeof(buf), "%s%s = %llu", result->empty() ? "" : ", ",
+           name, static_cast<unsigned long long>(value));
+  result->append(buf);
+}
+
+std::string PerfContext::ToString() const {
+  std::string r;
+  AppendField(&r, "get_from_memtable_count", get_from_memtable_count);
+  AppendField(&r, "get_from_memtable_time", get_from_memtable_time);
+  AppendField(&r, "get_from_output_files_time", get_from_output_files_time);
+  AppendField(&r, "write_wait_time", write_wait_time);
+  AppendField(&r, "write_delay_time", write_delay_time);
+  AppendField(&r, "write_wal_time", write_wal_time);
+  AppendField(&r, "write_memtable_time", write_memtable_time);
+  AppendField(&r, "iter_seek_count", iter_seek_count);
+  AppendField(&r, "iter_next_count", iter_next_count);
+  AppendField(&r, "seek_internal_time", seek_internal_time);
+  AppendField(&r, "find_next_user_entry_time", find_next_user_entry_time);
+  AppendField(&r, "internal_key_skipped_count", internal_key_skipped_count);
+  AppendField(&r, "internal_delete_skipped_count",
+              internal_delete_skipped_count);
+  AppendField(&r, "filter_probe_count", filter_probe_count);
+  AppendField(&r, "filter_useful_count", filter_useful_count);
+  AppendField(&r, "block_cache_hit_count", block_cache_hit_count);
+  AppendField(&r, "block_cache_miss_count", block_cache_miss_count);
+  AppendField(&r, "block_read_count", block_read_count);
+  AppendField(&r, "block_read_byte", block_read_byte);
+  AppendField(&r, "block_read_time", block_read_time);
+  AppendField(&r, "block_checksum_time", block_checksum_time);
+  AppendField(&r, "block_decompress_time", block_decompress_time);
+  return r;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,67 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Helpers for updating the calling thread's PerfContext from inside the
+// library.  See leveldb/perf_context.h.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+#define STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+
+#include "leveldb/env.h"
+#include "leveldb/perf_context.h"
+#include "port/port.h"
+
+namespace leveldb {
+
+extern LEVELDB_THREAD_LOCAL PerfContext perf_context;
+extern LEVELDB_THREAD_LOCAL PerfLevel perf_level;
+
+// Add "n" to the counter "*field" of the calling thread's context.
+inline void PerfCounterAdd(uint64_t PerfContext::*field, uint64_t n) {
+  if (perf_level >= kEnableCount) {
+    perf_context.*field += n;
+  }
+}
+
+// Adds the time between its construction (or Start()) and its
+// destruction (or Stop()) to a field of the calling thread's context.
+// Reads the clock only when the perf level is kEnableTime.
+class PerfTimer {
+ public:
+  explicit PerfTimer(uint64_t PerfContext::*field, bool start = true)
+      : field_(field), start_(0) {
+    if (start) {
+      Start();
+    }
+  }
+
+  ~PerfTimer() {
+    Stop();
+  }
+
+  void Start() {
+    if (perf_level >= kEnableTime) {
+      start_ = Env::Default()->NowNanos();
+    }
+  }
+
+  void Stop() {
+    if (start_ != 0) {
+      perf_context.*field_ += Env::Default()->NowNanos() - start_;
+      start_ = 0;
+    }
+  }
+
+ private:
+  uint64_t PerfContext::* const field_;
+  uint64_t start_;  // Zero if not running
+
+  // No copying allowed
+  PerfTimer(const PerfTimer&);
+  void operator=(const PerfTimer&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
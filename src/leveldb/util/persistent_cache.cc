@@ -0,0 +1,493 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// File based PersistentCache.
+//
+// The cache is a sequence of append-only segment files named
+// "<dir>/<number>.pcache".  New entries are collected in an in-memory
+// buffer; once the buffer reaches the segment size it is written out as
+// the next segment.  When the total size exceeds the capacity, the
+// oldest segment is deleted together with its entries, so eviction is
+// FIFO at segment granularity.  An in-memory index maps each key to the
+// location of its most recent record.
+//
+// Record format:
+//    checksum: uint32     // masked crc32c of key_len, value_len, key, value
+//    key_len: uint32
+//    value_len: uint32
+//    key: uint8[key_len]
+//    value: uint8[value_len]
+
+#include "leveldb/persistent_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+PersistentCache::~PersistentCache() {
+}
+
+namespace {
+
+static const size_t kHeaderSize = 12;
+static const int kNumSegments = 8;
+static const uint64_t kMinSegmentSize = 64 << 10;
+
+static std::string SegmentFileName(const std::string& dir, uint64_t number) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/%06llu.pcache",
+           static_cast<unsigned long long>(number));
+  return dir + buf;
+}
+
+static bool ParseSegmentFileName(const std::string& fname, uint64_t* number) {
+  static const std::string kSuffix = ".pcache";
+  if (fname.size() <= kSuffix.size() ||
+      fname.compare(fname.size() - kSuffix.size(), kSuffix.size(),
+                    kSuffix) != 0) {
+    return false;
+  }
+  uint64_t v = 0;
+  for (size_t i = 0; i < fname.size() - kSuffix.size(); i++) {
+    const char c = fname[i];
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    v = v * 10 + (c - '0');
+  }
+  *number = v;
+  return true;
+}
+
+static void EncodeRecord(const Slice& key, const Slice& value,
+                         std::string* dst) {
+  const size_t start = dst->size();
+  PutFixed32(dst, 0);  // Checksum placeholder
+  PutFixed32(dst, key.size());
+  PutFixed32(dst, value.size());
+  dst->append(key.data(), key.size());
+  dst->append(value.data(), value.size());
+  const uint32_t crc = crc32c::Value(dst->data() + start + 4,
+                                     dst->size() - start - 4);
+  EncodeFixed32(&(*dst)[start], crc32c::Mask(crc));
+}
+
+// Parse "input", which must hold exactly one record, into *key and
+// *value.  The results point into "input".
+static Status DecodeRecord(const Slice& input, Slice* key, Slice* value) {
+  if (input.size() < kHeaderSize) {
+    return Status::Corruption("truncated persistent cache record");
+  }
+  const char* p = input.data();
+  const uint32_t key_len = DecodeFixed32(p + 4);
+  const uint32_t value_len = DecodeFixed32(p + 8);
+  if (static_cast<uint64_t>(key_len) + value_len !=
+      input.size() - kHeaderSize) {
+    return Status::Corruption("bad persistent cache record length");
+  }
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(p));
+  if (crc32c::Value(p + 4, input.size() - 4) != crc) {
+    return Status::Corruption("persistent cache record checksum mismatch");
+  }
+  *key = Slice(p + kHeaderSize, key_len);
+  *value = Slice(p + kHeaderSize + key_len, value_len);
+  return Status::OK();
+}
+
+class FilePersistentCache : public PersistentCache {
+ public:
+  FilePersistentCache(Env* env, const std::string& dir, uint64_t capacity);
+  virtual ~FilePersistentCache();
+
+  // Pick up segments left behind by a previous instance.
+  Status Recover();
+
+  virtual Status Insert(const Slice& key, const Slice& data);
+  virtual Status Lookup(const Slice& key, std::string* data);
+  virtual uint64_t TotalSize();
+
+ private:
+  struct Segment {
+    uint64_t number;
+    uint64_t size;
+    RandomAccessFile* file;         // NULL while the segment is written
+    std::string contents;           // Records, while file is NULL
+    std::vector<std::string> keys;  // Keys written to this segment
+    bool evicted;                   // Evicted while being written
+    int refs;
+  };
+
+  struct Location {
+    uint64_t segment;
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  typedef std::map<std::string, Location> Index;
+
+  Status LoadSegment(uint64_t number);
+  Segment* SealActiveSegment();
+  Status WriteSegment(Segment* seg);
+  void RemoveSegment(std::deque<Segment*>::iterator pos,
+                     std::vector<uint64_t>* obsolete);
+  void EvictOldestSegment(std::vector<uint64_t>* obsolete) {
+    RemoveSegment(segments_.begin(), obsolete);
+  }
+  void DeleteSegmentFiles(const std::vector<uint64_t>& obsolete);
+  void Unref(Segment* s);
+
+  Env* const env_;
+  const std::string dir_;
+  const uint64_t capacity_;
+  const uint64_t segment_size_;
+
+  port::Mutex mu_;
+  Index index_;
+  std::deque<Segment*> segments_;    // Sealed segments, oldest first
+  uint64_t segments_size_;           // Sum of segments_[i]->size
+  uint64_t active_number_;           // Number of the buffered segment
+  std::string active_;               // Records not yet written out
+  std::vector<std::string> active_keys_;
+};
+
+FilePersistentCache::FilePersistentCache(Env* env, const std::string& dir,
+                                         uint64_t capacity)
+    : env_(env),
+      dir_(dir),
+      capacity_(capacity),
+      segment_size_(std::max(capacity / kNumSegments, kMinSegmentSize)),
+      segments_size_(0),
+      active_number_(1) {
+}
+
+FilePersistentCache::~FilePersistentCache() {
+  MutexLock l(&mu_);
+  Segment* seg = SealActiveSegment();
+  if (seg != NULL) {
+    mu_.Unlock();
+    WriteSegment(seg);
+    mu_.Lock();
+  }
+  for (size_t i = 0; i < segments_.size(); i++) {
+    Unref(segments_[i]);
+  }
+}
+
+void FilePersistentCache::Unref(Segment* s) {
+  mu_.AssertHeld();
+  assert(s->refs > 0);
+  s->refs--;
+  if (s->refs == 0) {
+    delete s->file;
+    delete s;
+  }
+}
+
+Status FilePersistentCache::Recover() {
+  env_->CreateDir(dir_);  // Ignore error: may already exist
+  std::vector<std::string> children;
+  Status s = env_->GetChildren(dir_, &children);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<uint64_t> numbers;
+  for (size_t i = 0; i < children.size(); i++) {
+    uint64_t number;
+    if (ParseSegmentFileName(children[i], &number)) {
+      numbers.push_back(number);
+    }
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  MutexLock l(&mu_);
+  for (size_t i = 0; i < numbers.size(); i++) {
+    if (!LoadSegment(numbers[i]).ok()) {
+      env_->DeleteFile(SegmentFileName(dir_, numbers[i]));
+    }
+    active_number_ = numbers[i] + 1;
+  }
+  std::vector<uint64_t> obsolete;
+  while (!segments_.empty() && segments_size_ > capacity_) {
+    EvictOldestSegment(&obsolete);
+  }
+  DeleteSegmentFiles(obsolete);
+  return Status::OK();
+}
+
+// Index the records of segment "number".  A corrupted or truncated
+// tail (e.g. from a crash during the write) ends the segment.
+Status FilePersistentCache::LoadSegment(uint64_t number) {
+  mu_.AssertHeld();
+  const std::string fname = SegmentFileName(dir_, number);
+  uint64_t file_size;
+  Status s = env_->GetFileSize(fname, &file_size);
+  RandomAccessFile* file = NULL;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  Segment* seg = new Segment;
+  seg->number = number;
+  seg->size = 0;
+  seg->file = file;
+  seg->evicted = false;
+  seg->refs = 1;
+  std::string scratch;
+  uint64_t offset = 0;
+  while (offset + kHeaderSize <= file_size) {
+    char header[kHeaderSize];
+    Slice input;
+    if (!file->Read(offset, kHeaderSize, &input, header).ok() ||
+        input.size() != kHeaderSize) {
+      break;
+    }
+    const uint64_t record_size = kHeaderSize +
+        static_cast<uint64_t>(DecodeFixed32(input.data() + 4)) +
+        DecodeFixed32(input.data() + 8);
+    if (offset + record_size > file_size) {
+      break;
+    }
+    scratch.resize(record_size);
+    if (!file->Read(offset, record_size, &input, &scratch[0]).ok() ||
+        input.size() != record_size) {
+      break;
+    }
+    Slice key, value;
+    if (!DecodeRecord(input, &key, &value).ok()) {
+      break;
+    }
+    Location loc;
+    loc.segment = number;
+    loc.offset = offset;
+    loc.size = record_size;
+    index_[key.ToString()] = loc;
+    seg->keys.push_back(key.ToString());
+    offset += record_size;
+  }
+  seg->size = offset;
+  segments_.push_back(seg);
+  segments_size_ += seg->size;
+  return Status::OK();
+}
+
+// Move the buffered records to a new segment at the end of segments_,
+// or return NULL if there are none.  The caller must write the segment
+// out with WriteSegment(), without holding mu_.
+FilePersistentCache::Segment* FilePersistentCache::SealActiveSegment() {
+  mu_.AssertHeld();
+  if (active_.empty()) {
+    return NULL;
+  }
+  Segment* seg = new Segment;
+  seg->number = active_number_++;
+  seg->size = active_.size();
+  seg->file = NULL;
+  seg->contents.swap(active_);
+  seg->keys.swap(active_keys_);
+  seg->evicted = false;
+  seg->refs = 2;  // One for segments_ and one for WriteSegment()
+  segments_.push_back(seg);
+  segments_size_ += seg->size;
+  return seg;
+}
+
+// Write "seg" to its file and switch its readers over to the file.
+// Lookups are served from seg->contents until then.
+Status FilePersistentCache::WriteSegment(Segment* seg) {
+  const std::string fname = SegmentFileName(dir_, seg->number);
+  WritableFile* file;
+  Status s = env_->NewWritableFile(fname, &file);
+  if (s.ok()) {
+    s = file->Append(seg->contents);
+    if (s.ok()) {
+      s = file->Close();
+    }
+    delete file;
+  }
+  RandomAccessFile* reader = NULL;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &reader);
+  }
+
+  bool remove = !s.ok();
+  {
+    MutexLock l(&mu_);
+    if (s.ok() && !seg->evicted) {
+      seg->file = reader;
+      reader = NULL;
+      std::string().swap(seg->contents);
+    } else if (!seg->evicted) {
+      // Drop the entries; they are only a cache.
+      std::vector<uint64_t> ignored;
+      RemoveSegment(std::find(segments_.begin(), segments_.end(), seg),
+                    &ignored);
+    }
+    remove = remove || seg->evicted;
+    Unref(seg);
+  }
+  delete reader;
+  if (remove) {
+    env_->DeleteFile(fname);
+  }
+  return s;
+}
+
+// Drop the segment at "pos" and its entries, and add its number to
+// *obsolete if its file is to be deleted.  The file of a segment that is
+// still being written is deleted by WriteSegment() instead.
+void FilePersistentCache::RemoveSegment(std::deque<Segment*>::iterator pos,
+                                        std::vector<uint64_t>* obsolete) {
+  mu_.AssertHeld();
+  Segment* seg = *pos;
+  segments_.erase(pos);
+  segments_size_ -= seg->size;
+  for (size_t i = 0; i < seg->keys.size(); i++) {
+    Index::iterator it = index_.find(seg->keys[i]);
+    if (it != index_.end() && it->second.segment == seg->number) {
+      index_.erase(it);
+    }
+  }
+  seg->evicted = true;
+  if (seg->file != NULL) {
+    obsolete->push_back(seg->number);
+  }
+  Unref(seg);
+}
+
+void FilePersistentCache::DeleteSegmentFiles(
+    const std::vector<uint64_t>& obsolete) {
+  for (size_t i = 0; i < obsolete.size(); i++) {
+    env_->DeleteFile(SegmentFileName(dir_, obsolete[i]));
+  }
+}
+
+Status FilePersistentCache::Insert(const Slice& key, const Slice& data) {
+  const uint64_t record_size = kHeaderSize + key.size() + data.size();
+  if (record_size > segment_size_) {
+    return Status::OK();  // Too big to ever fit
+  }
+
+  // A full buffer is written out and old segments are deleted without
+  // holding mu_, so that lookups and other inserts go on meanwhile.
+  Segment* sealed = NULL;
+  std::vector<uint64_t> obsolete;
+  {
+    MutexLock l(&mu_);
+    if (active_.size() + record_size > segment_size_) {
+      sealed = SealActiveSegment();
+      while (!segments_.empty() &&
+             segments_size_ + segment_size_ > capacity_) {
+        EvictOldestSegment(&obsolete);
+      }
+    }
+    Location loc;
+    loc.segment = active_number_;
+    loc.offset = active_.size();
+    loc.size = record_size;
+    EncodeRecord(key, data, &active_);
+    std::string k = key.ToString();
+    index_[k] = loc;
+    active_keys_.push_back(k);
+  }
+  DeleteSegmentFiles(obsolete);
+  if (sealed != NULL) {
+    return WriteSegment(sealed);
+  }
+  return Status::OK();
+}
+
+Status FilePersistentCache::Lookup(const Slice& key, std::string* data) {
+  Location loc;
+  Segment* seg = NULL;
+  {
+    MutexLock l(&mu_);
+    Index::const_iterator it = index_.find(key.ToString());
+    if (it == index_.end()) {
+      return Status::NotFound(Slice());
+    }
+    loc = it->second;
+    const std::string* buffer = NULL;
+    if (loc.segment == active_number_) {
+      buffer = &active_;
+    } else {
+      for (size_t i = 0; i < segments_.size(); i++) {
+        if (segments_[i]->number == loc.segment) {
+          seg = segments_[i];
+          break;
+        }
+      }
+      if (seg == NULL) {
+        return Status::NotFound(Slice());
+      }
+      if (seg->file == NULL) {
+        buffer = &seg->contents;  // Still being written
+      }
+    }
+    if (buffer != NULL) {
+      Slice k, v;
+      Status s = DecodeRecord(Slice(buffer->data() + loc.offset, loc.size),
+                              &k, &v);
+      if (s.ok()) {
+        data->assign(v.data(), v.size());
+      }
+      return s;
+    }
+    seg->refs++;
+  }
+
+  // Read outside the lock so that lookups can proceed in parallel.
+  std::string scratch;
+  scratch.resize(loc.size);
+  Slice input;
+  Status s = seg->file->Read(loc.offset, loc.size, &input, &scratch[0]);
+  Slice k, v;
+  if (s.ok()) {
+    s = DecodeRecord(input, &k, &v);
+  }
+  if (s.ok() && k != key) {
+    s = Status::Corruption("persistent cache key mismatch");
+  }
+  if (s.ok()) {
+    data->assign(v.data(), v.size());
+  }
+
+  MutexLock l(&mu_);
+  Unref(seg);
+  return s;
+}
+
+uint64_t FilePersistentCache::TotalSize() {
+  MutexLock l(&mu_);
+  return segments_size_ + active_.size();
+}
+
+}  // end anonymous namespace
+
+Status NewFilePersistentCache(Env* env, const std::string& dir,
+                              uint64_t capacity, PersistentCache** result) {
+  *result = NULL;
+  FilePersistentCache* cache = new FilePersistentCache(env, dir, capacity);
+  Status s = cache->Recover();
+  if (s.ok()) {
+    *result = cache;
+  } else {
+    delete cache;
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,211 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  std::string result;
+  PutFixed64(&result, i);
+  return result;
+}
+
+static std::string Value(int i, size_t len) {
+  return std::string(len, static_cast<char>('a' + i % 26));
+}
+
+class PersistentCacheTest {
+ public:
+  Env* env_;
+  std::string dir_;
+  PersistentCache* cache_;
+
+  PersistentCacheTest() : env_(Env::Default()), cache_(NULL) {
+    dir_ = test::TmpDir() + "/persistent_cache_test";
+    DestroyDir();
+  }
+
+  ~PersistentCacheTest() {
+    delete cache_;
+    DestroyDir();
+  }
+
+  void DestroyDir() {
+    std::vector<std::string> children;
+    env_->GetChildren(dir_, &children);
+    for (size_t i = 0; i < children.size(); i++) {
+      env_->DeleteFile(dir_ + "/" + children[i]);
+    }
+    env_->DeleteDir(dir_);
+  }
+
+  void Open(uint64_t capacity) {
+    delete cache_;
+    cache_ = NULL;
+    ASSERT_OK(NewFilePersistentCache(env_, dir_, capacity, &cache_));
+  }
+
+  std::string Lookup(int i) {
+    std::string result;
+    Status s = cache_->Lookup(Key(i), &result);
+    if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    }
+    ASSERT_OK(s);
+    return result;
+  }
+};
+
+TEST(PersistentCacheTest, InsertAndLookup) {
+  Open(1 << 20);
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  ASSERT_OK(cache_->Insert(Key(1), "one"));
+  ASSERT_OK(cache_->Insert(Key(2), "two"));
+  ASSERT_EQ("one", Lookup(1));
+  ASSERT_EQ("two", Lookup(2));
+  ASSERT_OK(cache_->Insert(Key(1), "uno"));
+  ASSERT_EQ("uno", Lookup(1));
+  ASSERT_EQ("NOT_FOUND", Lookup(3));
+}
+
+TEST(PersistentCacheTest, SurvivesReopen) {
+  Open(1 << 20);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(cache_->Insert(Key(i), Value(i, 500)));
+  }
+  Open(1 << 20);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(Value(i, 500), Lookup(i));
+  }
+}
+
+TEST(PersistentCacheTest, EvictsOldestEntries) {
+  const uint64_t kCapacity = 1 << 20;
+  Open(kCapacity);
+  const int kNum = 10000;
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_OK(cache_->Insert(Key(i), Value(i, 1000)));
+  }
+  ASSERT_LE(cache_->TotalSize(), kCapacity);
+  ASSERT_EQ("NOT_FOUND", Lookup(0));
+  ASSERT_EQ(Value(kNum - 1, 1000), Lookup(kNum - 1));
+}
+
+// Holds up every file write until Release() is called.
+class BlockingEnv : public EnvWrapper {
+ public:
+  explicit BlockingEnv(Env* base)
+      : EnvWrapper(base), cv_(&mu_), blocked_(true), waiting_(0) { }
+
+  Status NewWritableFile(const std::string& f, WritableFile** r) {
+    class BlockingFile : public WritableFile {
+     public:
+      BlockingFile(BlockingEnv* env, WritableFile* target)
+          : env_(env), target_(target) { }
+      virtual ~BlockingFile() { delete target_; }
+      virtual Status Append(const Slice& data) {
+        env_->Wait();
+        return target_->Append(data);
+      }
+      virtual Status Close() { return target_->Close(); }
+      virtual Status Flush() { return target_->Flush(); }
+      virtual Status Sync() { return target_->Sync(); }
+      virtual std::string GetName() const { return ""; }
+     private:
+      BlockingEnv* env_;
+      WritableFile* target_;
+    };
+    Status s = target()->NewWritableFile(f, r);
+    if (s.ok()) {
+      *r = new BlockingFile(this, *r);
+    }
+    return s;
+  }
+
+  void Wait() {
+    MutexLock l(&mu_);
+    waiting_++;
+    cv_.SignalAll();
+    while (blocked_) {
+      cv_.Wait();
+    }
+  }
+
+  void WaitForWriter() {
+    MutexLock l(&mu_);
+    while (waiting_ == 0) {
+      cv_.Wait();
+    }
+  }
+
+  void Release() {
+    MutexLock l(&mu_);
+    blocked_ = false;
+    cv_.SignalAll();
+  }
+
+ private:
+  port::Mutex mu_;
+  port::CondVar cv_;
+  bool blocked_;
+  int waiting_;
+};
+
+struct InsertState {
+  PersistentCache* cache;
+  int num;
+  port::AtomicPointer done;
+};
+
+static void InsertBody(void* arg) {
+  InsertState* state = reinterpret_cast<InsertState*>(arg);
+  for (int i = 0; i < state->num; i++) {
+    state->cache->Insert(Key(i), Value(i, 1000));
+  }
+  state->done.Release_Store(state);
+}
+
+TEST(PersistentCacheTest, LookupsWhileSegmentIsWritten) {
+  BlockingEnv env(env_);
+  PersistentCache* cache;
+  ASSERT_OK(NewFilePersistentCache(&env, dir_, 1 << 20, &cache));
+
+  // The first segment holds about 128 records; the insert after them
+  // writes it out and blocks.
+  InsertState state;
+  state.cache = cache;
+  state.num = 200;
+  state.done.Release_Store(NULL);
+  env_->StartThread(&InsertBody, &state);
+  env.WaitForWriter();
+
+  std::string value;
+  ASSERT_OK(cache->Lookup(Key(0), &value));
+  ASSERT_EQ(Value(0, 1000), value);
+  ASSERT_OK(cache->Insert(Key(1000), "x"));
+  ASSERT_OK(cache->Lookup(Key(1000), &value));
+  ASSERT_EQ("x", value);
+
+  env.Release();
+  while (state.done.Acquire_Load() == NULL) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_OK(cache->Lookup(Key(0), &value));
+  ASSERT_EQ(Value(0, 1000), value);
+  delete cache;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <assert.h>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() {
+}
+
+namespace {
+
+// Tokens accumulate continuously at the configured rate, but no more
+// than one refill period's worth is kept, so an idle limiter does not
+// allow an unbounded burst afterwards.
+static const int64_t kRefillPeriodMicros = 100000;
+
+class TokenBucketRateLimiter : public RateLimiter {
+ public:
+  TokenBucketRateLimiter(Env* env, int64_t bytes_per_second)
+      : env_(env),
+        bytes_per_second_(bytes_per_second),
+        burst_bytes_(bytes_per_second * kRefillPeriodMicros / 1000000),
+        available_(0),
+        total_bytes_(0),
+        last_refill_micros_(env->NowMicros()) {
+    assert(bytes_per_second > 0);
+    if (burst_bytes_ < 1) {
+      burst_bytes_ = 1;
+    }
+  }
+
+  virtual ~TokenBucketRateLimiter() { }
+
+  virtual void Request(int64_t bytes) {
+    while (bytes > 0) {
+      const int64_t chunk = (bytes < burst_bytes_) ? bytes : burst_bytes_;
+      mu_.Lock();
+      Refill();
+      while (available_ < chunk) {
+        // Sleep (without holding mu_) until enough tokens should exist.
+        uint64_t wait = (chunk - available_) * 1000000 / bytes_per_second_;
+        if (wait < 1) {
+          wait = 1;
+        }
+        mu_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(wait));
+        mu_.Lock();
+        Refill();
+      }
+      available_ -= chunk;
+      total_bytes_ += chunk;
+      mu_.Unlock();
+      bytes -= chunk;
+    }
+  }
+
+  virtual int64_t GetBytesPerSecond() const {
+    return bytes_per_second_;
+  }
+
+  virtual int64_t GetTotalBytesThrough() const {
+    MutexLock l(&mu_);
+    return total_bytes_;
+  }
+
+ private:
+  // REQUIRES: mu_ is held
+  void Refill() {
+    const uint64_t now = env_->NowMicros();
+    if (now <= last_refill_micros_) {
+      return;
+    }
+    uint64_t elapsed = now - last_refill_micros_;
+    if (elapsed > 1000000) {
+      elapsed = 1000000;  // Avoid overflow; the bucket is full anyway
+    }
+    const int64_t tokens =
+        static_cast<int64_t>(elapsed) * bytes_per_second_ / 1000000;
+    if (tokens == 0) {
+      return;  // Let the fraction accumulate rather than drop it
+    }
+    last_refill_micros_ = now;
+    available_ += tokens;
+    if (available_ > burst_bytes_) {
+      available_ = burst_bytes_;
+    }
+  }
+
+  Env* const env_;
+  const int64_t bytes_per_second_;
+  int64_t burst_bytes_;
+
+  mutable port::Mutex mu_;
+  int64_t available_;           // Protected by mu_
+  int64_t total_bytes_;         // Protected by mu_
+  uint64_t last_refill_micros_; // Protected by mu_
+};
+
+}  // namespace
+
+RateLimiter* NewRateLimiter(Env* env, int64_t bytes_per_second) {
+  return new TokenBucketRateLimiter(env, bytes_per_second);
+}
+
+}  // namespace leveldb